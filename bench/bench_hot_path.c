@@ -0,0 +1,345 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Micro-benchmarks of the measurement hot path:
+ *   read_msr                             one register of a fake MSR device (a regular file)
+ *   get_total_energy_consumed_for_nodes  one sample of 1 to 16 simulated nodes
+ *   init_rapl                            topology discovery (build_topology()) and sampling plan
+ *   format_csv_record                    one trace record in the CSV format (format_trace_record())
+ *
+ * Usage: bench_hot_path [ITERATIONS]
+ *
+ * Prints one CSV line per benchmark with the columns of BENCH_HEADER, which stay the same such that
+ * results can be compared automatically. Allocations and system calls are counted by wrapping the
+ * functions of the C library that are listed in BENCH_HOT_PATH_WRAPPED in the Makefile, so only
+ * calls from the code of this repository are counted, and clock_gettime() is not (it does not enter
+ * the kernel thanks to the vDSO).
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for sched_setaffinity()
+#endif
+
+#include "msr.h"
+#include "rapl-impl.h"
+#include "rapl.h"
+#include "simulator.h"
+#include "textformat.h"
+
+#include <err.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_HEADER "name,nodes,iterations,ns_per_op,allocations_per_op,syscalls_per_op"
+#define BENCH_MAX_NODES 16
+
+static uint64_t allocations = 0;
+static uint64_t syscalls = 0;
+
+// Stand-in files of the MSR devices of the first CPUs, or NULL
+static const char *fake_msr_devices[BENCH_MAX_NODES];
+
+static void count(uint64_t *counter) {
+  __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Wrappers of the C library, cf. the --wrap option of ld.
+ */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+ssize_t __real_read(int fd, void *buffer, size_t size);
+ssize_t __real_pread(int fd, void *buffer, size_t size, off_t offset);
+ssize_t __real_write(int fd, const void *buffer, size_t size);
+int __real_ioctl(int fd, unsigned long request, ...);
+void *__real_mmap(void *address, size_t length, int protection, int flags, int fd, off_t offset);
+int __real_munmap(void *address, size_t length);
+int __real_ftruncate(int fd, off_t length);
+int __real_nanosleep(const struct timespec *duration, struct timespec *remaining);
+long __real_syscall(long number, ...);
+int __real_sched_getaffinity(pid_t pid, size_t size, cpu_set_t *set);
+int __real_sched_setaffinity(pid_t pid, size_t size, const cpu_set_t *set);
+
+void *__wrap_malloc(size_t size) {
+  count(&allocations);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count_, size_t size) {
+  count(&allocations);
+  return __real_calloc(count_, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+  count(&allocations);
+  return __real_realloc(pointer, size);
+}
+
+int __wrap_open(const char *path, int flags, ...) {
+  count(&syscalls);
+  mode_t mode = 0;
+  if (flags & O_CREAT) {
+    va_list arguments;
+    va_start(arguments, flags);
+    mode = va_arg(arguments, mode_t);
+    va_end(arguments);
+  }
+  unsigned int cpu;
+  char suffix;
+  if (sscanf(path, "/dev/cpu/%u/msr%c", &cpu, &suffix) == 1 && cpu < BENCH_MAX_NODES
+      && fake_msr_devices[cpu] != NULL) {
+    path = fake_msr_devices[cpu];
+  }
+  return __real_open(path, flags, mode);
+}
+
+int __wrap_close(int fd) {
+  count(&syscalls);
+  return __real_close(fd);
+}
+
+ssize_t __wrap_read(int fd, void *buffer, size_t size) {
+  count(&syscalls);
+  return __real_read(fd, buffer, size);
+}
+
+ssize_t __wrap_pread(int fd, void *buffer, size_t size, off_t offset) {
+  count(&syscalls);
+  return __real_pread(fd, buffer, size, offset);
+}
+
+ssize_t __wrap_write(int fd, const void *buffer, size_t size) {
+  count(&syscalls);
+  return __real_write(fd, buffer, size);
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...) {
+  count(&syscalls);
+  va_list arguments;
+  va_start(arguments, request);
+  void *const argument = va_arg(arguments, void *);
+  va_end(arguments);
+  return __real_ioctl(fd, request, argument);
+}
+
+void *__wrap_mmap(void *address, size_t length, int protection, int flags, int fd, off_t offset) {
+  count(&syscalls);
+  return __real_mmap(address, length, protection, flags, fd, offset);
+}
+
+int __wrap_munmap(void *address, size_t length) {
+  count(&syscalls);
+  return __real_munmap(address, length);
+}
+
+int __wrap_ftruncate(int fd, off_t length) {
+  count(&syscalls);
+  return __real_ftruncate(fd, length);
+}
+
+int __wrap_nanosleep(const struct timespec *duration, struct timespec *remaining) {
+  count(&syscalls);
+  return __real_nanosleep(duration, remaining);
+}
+
+long __wrap_syscall(long number, ...) {
+  count(&syscalls);
+  // system calls have at most six arguments, passing more than needed is harmless
+  long a[6];
+  va_list arguments;
+  va_start(arguments, number);
+  for (int i = 0; i < 6; i++) {
+    a[i] = va_arg(arguments, long);
+  }
+  va_end(arguments);
+  return __real_syscall(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+int __wrap_sched_getaffinity(pid_t pid, size_t size, cpu_set_t *set) {
+  count(&syscalls);
+  return __real_sched_getaffinity(pid, size, set);
+}
+
+int __wrap_sched_setaffinity(pid_t pid, size_t size, const cpu_set_t *set) {
+  count(&syscalls);
+  return __real_sched_setaffinity(pid, size, set);
+}
+
+/*
+ * Measurement
+ */
+
+typedef struct {
+  struct timespec start;
+  uint64_t allocations;
+  uint64_t syscalls;
+} bench_state_t;
+
+static void start_bench(bench_state_t *state) {
+  state->allocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+  state->syscalls = __atomic_load_n(&syscalls, __ATOMIC_RELAXED);
+  clock_gettime(CLOCK_MONOTONIC, &state->start);
+}
+
+static void print_bench(const bench_state_t *state, const char *name, int nodes, int iterations) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  const double ns = (end.tv_sec - state->start.tv_sec) * 1e9 + (end.tv_nsec - state->start.tv_nsec);
+  const uint64_t allocated = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - state->allocations;
+  const uint64_t called = __atomic_load_n(&syscalls, __ATOMIC_RELAXED) - state->syscalls;
+  printf(
+      "%s,%d,%d,%.1f,%.2f,%.2f\n",
+      name,
+      nodes,
+      iterations,
+      ns / iterations,
+      (double)allocated / iterations,
+      (double)called / iterations);
+}
+
+/*
+ * Create a stand-in file for the MSR device of the given CPU with a value at the offset of the
+ * package energy-status register.
+ */
+static void create_fake_msr_device(int cpu) {
+  char path[] = "/tmp/bench_hot_path.XXXXXX";
+  const int fd = mkstemp(path);
+  const uint64_t value = cpu;
+  if (fd == -1
+      || pwrite(fd, &value, sizeof(value), MSR_RAPL_PKG_ENERGY_STATUS) != sizeof(value)) {
+    err(1, "Could not create fake MSR device");
+  }
+  close(fd);
+  fake_msr_devices[cpu] = strdup(path);
+}
+
+static int identity(int cpu) {
+  return cpu;
+}
+
+static void bench_read_msr(int iterations) {
+  create_fake_msr_device(0);
+  if (open_msr_fd(1, &identity) != 0) {
+    errx(1, "Could not open fake MSR device.");
+  }
+  uint64_t value;
+  bench_state_t state;
+  start_bench(&state);
+  for (int i = 0; i < iterations; i++) {
+    if (read_msr(0, MSR_RAPL_PKG_ENERGY_STATUS, &value) != 0) {
+      errx(1, "Reading fake MSR device failed.");
+    }
+  }
+  print_bench(&state, "read_msr", 1, iterations);
+  close_msr_fd();
+  unlink(fake_msr_devices[0]);
+  free((char *)fake_msr_devices[0]);
+  fake_msr_devices[0] = NULL;
+}
+
+/*
+ * Initialize the simulated device with the given number of nodes, or the nodes of the machine if 0.
+ */
+static void init_simulated_rapl(int nodes) {
+  char config[sizeof(SIMULATOR_DEFAULT_CONFIG) + 32];
+  if (nodes > 0) {
+    snprintf(config, sizeof(config), SIMULATOR_DEFAULT_CONFIG ",sockets=%d", nodes);
+  } else {
+    snprintf(config, sizeof(config), "%s", SIMULATOR_DEFAULT_CONFIG);
+  }
+  if (configure_simulator(config) != 0 || init_rapl() != 0) {
+    errx(1, "Could not initialize the simulated device.");
+  }
+}
+
+static void bench_sample(int nodes, int iterations) {
+  init_simulated_rapl(nodes);
+  uint64_t prev_sample[nodes][RAPL_NR_DOMAIN];
+  uint64_t cum_ticks[nodes][RAPL_NR_DOMAIN];
+  memset(cum_ticks, 0, sizeof(cum_ticks));
+  get_total_energy_consumed_for_nodes(nodes, prev_sample, NULL);
+
+  bench_state_t state;
+  start_bench(&state);
+  for (int i = 0; i < iterations; i++) {
+    if (get_total_energy_consumed_for_nodes(nodes, prev_sample, cum_ticks) != 0) {
+      errx(1, "Sampling the simulated device failed.");
+    }
+  }
+  print_bench(&state, "get_total_energy_consumed_for_nodes", nodes, iterations);
+  terminate_rapl();
+}
+
+static void bench_init_rapl(int iterations) {
+  init_simulated_rapl(0);
+  const int nodes = get_num_rapl_nodes();
+  terminate_rapl();
+
+  bench_state_t state;
+  start_bench(&state);
+  for (int i = 0; i < iterations; i++) {
+    init_simulated_rapl(0);
+    terminate_rapl();
+  }
+  print_bench(&state, "init_rapl", nodes, iterations);
+}
+
+/*
+ * Format a record of a trace in the CSV format with 3 domains per node.
+ */
+static void bench_format_csv_record(int nodes, int iterations) {
+  const unsigned int domain_mask = (1u << RAPL_PKG) | (1u << RAPL_PP0) | (1u << RAPL_DRAM);
+  double energy_J[nodes * RAPL_NR_DOMAIN];
+  for (int value = 0; value < nodes * RAPL_NR_DOMAIN; value++) {
+    energy_J[value] = 0.0123 * (value + 1);
+  }
+  char record[TEXTFORMAT_TRACE_RECORD_LENGTH(nodes * RAPL_NR_DOMAIN)];
+  volatile size_t length = 0; // keeps the formatting from being optimized away
+  bench_state_t state;
+  start_bench(&state);
+  for (int i = 0; i < iterations; i++) {
+    const char *end = format_trace_record(
+        record, 0, 1234.5 + i * 1e-3, 0.001, 0, nodes, RAPL_NR_DOMAIN, domain_mask, energy_J);
+    length = end - record;
+  }
+  print_bench(&state, "format_csv_record", nodes, iterations);
+  (void)length;
+}
+
+int main(int argc, char **argv) {
+  const int iterations = (argc > 1) ? atoi(argv[1]) : 100000;
+  if (iterations <= 0) {
+    errx(1, "Usage: %s [ITERATIONS]", argv[0]);
+  }
+
+  set_rapl_backend(RAPL_BACKEND_SIM);
+  printf("%s\n", BENCH_HEADER);
+  bench_read_msr(iterations);
+  for (int nodes = 1; nodes <= BENCH_MAX_NODES; nodes *= 2) {
+    bench_sample(nodes, iterations);
+  }
+  // each iteration pins this thread to every CPU
+  bench_init_rapl((iterations / 1000 > 0) ? iterations / 1000 : 1);
+  for (int nodes = 1; nodes <= BENCH_MAX_NODES; nodes *= 2) {
+    bench_format_csv_record(nodes, iterations);
+  }
+  return 0;
+}
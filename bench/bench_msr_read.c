@@ -0,0 +1,124 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Compares the latency of reading one energy-status MSR per CPU synchronously with pread()
+ * (as done by read_msr_fd()) and concurrently with io_uring (as done by read_uring()).
+ *
+ * Usage: bench_msr_read [NUM_CPUS [ITERATIONS]]
+ *
+ * If /dev/cpu/N/msr cannot be read, regular files are used as a stand-in, which only measures
+ * the overhead of the system calls, but not the cost of the cross-CPU calls.
+ */
+
+#include "msr.h"
+#include "rapl-impl.h"
+#include "uring.h"
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static int identity(int cpu) {
+  return cpu;
+}
+
+static double get_monotonic_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * Create a temporary file per CPU that contains a value at the offset of the MSR.
+ */
+static int open_stand_in_files(int num_cpus, int fds[]) {
+  for (int i = 0; i < num_cpus; i++) {
+    char path[] = "/tmp/bench_msr_read.XXXXXX";
+    fds[i] = mkstemp(path);
+    if (fds[i] == -1) {
+      return -1;
+    }
+    unlink(path);
+    const uint64_t value = i;
+    if (pwrite(fds[i], &value, sizeof(value), MSR_RAPL_PKG_ENERGY_STATUS) != sizeof(value)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  const int num_cpus = (argc > 1) ? atoi(argv[1]) : (int)online_cpus;
+  const int iterations = (argc > 2) ? atoi(argv[2]) : 10000;
+  if (num_cpus <= 0 || iterations <= 0) {
+    errx(1, "Usage: %s [NUM_CPUS [ITERATIONS]]", argv[0]);
+  }
+
+  int fds[num_cpus];
+  off_t addresses[num_cpus];
+  uint64_t values[num_cpus];
+  unsigned char failed[num_cpus];
+  const char *device = "/dev/cpu/N/msr";
+
+  if (num_cpus <= online_cpus && open_msr_fd(num_cpus, &identity) == 0
+      && read_msr_fd(get_msr_fd(0), MSR_RAPL_PKG_ENERGY_STATUS, &values[0]) == 0) {
+    for (int i = 0; i < num_cpus; i++) {
+      fds[i] = get_msr_fd(i);
+    }
+  } else {
+    device = "stand-in files";
+    if (open_stand_in_files(num_cpus, fds) != 0) {
+      err(1, "Could not create stand-in files");
+    }
+  }
+  for (int i = 0; i < num_cpus; i++) {
+    addresses[i] = MSR_RAPL_PKG_ENERGY_STATUS;
+  }
+
+  printf("Reading MSR 0x%x of %d CPUs from %s, %d iterations\n",
+         MSR_RAPL_PKG_ENERGY_STATUS,
+         num_cpus,
+         device,
+         iterations);
+
+  double start = get_monotonic_time();
+  for (int n = 0; n < iterations; n++) {
+    for (int i = 0; i < num_cpus; i++) {
+      if (read_msr_fd(fds[i], addresses[i], &values[i]) != 0) {
+        errx(1, "Synchronous read of CPU %d failed.", i);
+      }
+    }
+  }
+  const double sync_us = (get_monotonic_time() - start) / iterations * 1e6;
+  printf("%-10s %10.3f us/sample\n", "pread", sync_us);
+
+  if (open_uring(num_cpus, fds, addresses) != 0) {
+    printf("%-10s %10s\n", "io_uring", "not available");
+    return 0;
+  }
+  start = get_monotonic_time();
+  for (int n = 0; n < iterations; n++) {
+    if (read_uring(values, failed) != 0) {
+      errx(1, "Reading with io_uring failed.");
+    }
+    for (int i = 0; i < num_cpus; i++) {
+      if (failed[i]) {
+        errx(1, "Read of CPU %d with io_uring failed.", i);
+      }
+    }
+  }
+  const double uring_us = (get_monotonic_time() - start) / iterations * 1e6;
+  printf("%-10s %10.3f us/sample (%.2fx)\n", "io_uring", uring_us, sync_us / uring_us);
+  close_uring();
+  return 0;
+}
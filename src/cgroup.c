@@ -0,0 +1,189 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cgroup.h"
+#include "util.h"
+
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CPU_STAT_SIZE 4096
+
+static int num_cgroups = 0;
+static int num_cpus = 0;
+static int is_open = 0;
+
+// cpu.stat of each cgroup, and of the root cgroup at index num_cgroups (-1 if not available)
+static int stat_fds[MAX_CGROUPS + 1];
+static uint64_t previous_usage_usec[MAX_CGROUPS + 1];
+static int read_failed[MAX_CGROUPS + 1]; // to warn only once
+
+// the cgroups, followed by "other" and "idle"
+static cgroup_energy_t entries[MAX_CGROUPS + 2];
+static char *names[MAX_CGROUPS];
+
+static double previous_time = 0;
+static double previous_energy_J[CGROUP_NR_DOMAIN];
+
+static int read_usage_usec(int fd, uint64_t *usage_usec) {
+  char buffer[CPU_STAT_SIZE];
+  const ssize_t length = pread(fd, buffer, sizeof(buffer) - 1, 0);
+  if (length <= 0) {
+    return -1;
+  }
+  buffer[length] = '\0';
+  // the first line, but do not rely on it
+  const char *line = buffer;
+  while (strncmp(line, "usage_usec ", strlen("usage_usec ")) != 0) {
+    line = strchr(line, '\n');
+    if (line == NULL) {
+      return -1;
+    }
+    line++;
+  }
+  return sscanf(line, "usage_usec %" SCNu64, usage_usec) == 1 ? 0 : -1;
+}
+
+static int open_cpu_stat(const char *root, const char *cgroup) {
+  char path[4096];
+  if (snprintf(path, sizeof(path), "%s/%s/cpu.stat", root, cgroup) >= (int)sizeof(path)) {
+    return -1;
+  }
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+int open_cgroup_attribution(const char *root, int count, char *const cgroups[], int cpus) {
+  close_cgroup_attribution();
+  if (count > MAX_CGROUPS) {
+    warnx("At most %d cgroups can be measured.", MAX_CGROUPS);
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    stat_fds[i] = open_cpu_stat(root, cgroups[i]);
+    uint64_t usage_usec;
+    if (stat_fds[i] < 0 || read_usage_usec(stat_fds[i], &usage_usec) != 0) {
+      warnx("Could not read CPU time of cgroup %s from %s/%s/cpu.stat.", cgroups[i], root, cgroups[i]);
+      if (stat_fds[i] >= 0) {
+        close(stat_fds[i]);
+      }
+      close_cgroup_attribution();
+      return -1;
+    }
+    names[i] = cgroups[i];
+    num_cgroups++;
+  }
+  // The root cgroup only has a cpu.stat on newer kernels.
+  stat_fds[count] = open_cpu_stat(root, ".");
+  if (stat_fds[count] < 0) {
+    DEBUG("No cpu.stat in %s, CPU time of other processes counts as idle.", root);
+  }
+  num_cpus = cpus;
+  is_open = 1;
+  update_cgroup_attribution(0, NULL);
+  return 0;
+}
+
+int is_cgroup_attribution_open() {
+  return is_open;
+}
+
+/*
+ * Read the CPU time of the given cgroup (or the root cgroup) in the interval since the previous
+ * read, which is 0 if it cannot be read.
+ */
+static double read_cpu_seconds(int index) {
+  uint64_t usage_usec;
+  if (stat_fds[index] < 0) {
+    return 0;
+  }
+  if (read_usage_usec(stat_fds[index], &usage_usec) != 0) {
+    if (!read_failed[index]) {
+      warnx("Reading CPU time of cgroup %s failed.", (index < num_cgroups) ? names[index] : "/");
+      read_failed[index] = 1;
+    }
+    return 0;
+  }
+  const uint64_t delta = usage_usec - previous_usage_usec[index];
+  previous_usage_usec[index] = usage_usec;
+  return delta / 1e6;
+}
+
+void update_cgroup_attribution(double time, const double energy_J[CGROUP_NR_DOMAIN]) {
+  double cpu_seconds[MAX_CGROUPS + 2];
+  double cgroups_seconds = 0;
+  for (int i = 0; i < num_cgroups; i++) {
+    cpu_seconds[i] = read_cpu_seconds(i);
+    cgroups_seconds += cpu_seconds[i];
+  }
+  const double root_seconds = read_cpu_seconds(num_cgroups);
+
+  if (energy_J == NULL) {
+    for (int i = 0; i < num_cgroups + 2; i++) {
+      entries[i].cpu_seconds = 0;
+      memset(entries[i].energy_J, 0, sizeof(entries[i].energy_J));
+    }
+    entries[num_cgroups].name = "other";
+    entries[num_cgroups + 1].name = "idle";
+    for (int i = 0; i < num_cgroups; i++) {
+      entries[i].name = names[i];
+    }
+    previous_time = time;
+    memset(previous_energy_J, 0, sizeof(previous_energy_J));
+    return;
+  }
+
+  // The counters are not read at exactly the same time, so the CPU time may exceed the capacity.
+  cpu_seconds[num_cgroups] = fmax(root_seconds - cgroups_seconds, 0);
+  const double busy_seconds = cgroups_seconds + cpu_seconds[num_cgroups];
+  const double capacity = fmax(num_cpus * (time - previous_time), busy_seconds);
+  cpu_seconds[num_cgroups + 1] = capacity - busy_seconds;
+
+  for (int domain = 0; domain < CGROUP_NR_DOMAIN; domain++) {
+    const double delta_J = energy_J[domain] - previous_energy_J[domain];
+    previous_energy_J[domain] = energy_J[domain];
+    if (capacity <= 0) {
+      entries[num_cgroups + 1].energy_J[domain] += delta_J; // nothing ran in an empty interval
+      continue;
+    }
+    for (int i = 0; i < num_cgroups + 2; i++) {
+      entries[i].energy_J[domain] += delta_J * cpu_seconds[i] / capacity;
+    }
+  }
+  for (int i = 0; i < num_cgroups + 2; i++) {
+    entries[i].cpu_seconds += cpu_seconds[i];
+  }
+  previous_time = time;
+}
+
+int get_num_cgroup_entries() {
+  return is_open ? num_cgroups + 2 : 0;
+}
+
+const cgroup_energy_t *get_cgroup_energy(int index) {
+  return &entries[index];
+}
+
+void close_cgroup_attribution() {
+  for (int i = 0; i < num_cgroups; i++) {
+    close(stat_fds[i]);
+  }
+  if (is_open && stat_fds[num_cgroups] >= 0) {
+    close(stat_fds[num_cgroups]);
+  }
+  memset(read_failed, 0, sizeof(read_failed));
+  memset(previous_usage_usec, 0, sizeof(previous_usage_usec));
+  num_cgroups = 0;
+  is_open = 0;
+}
@@ -0,0 +1,75 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_cgroup
+#define _h_cgroup
+
+/*
+ * Attribution of the energy of the CPUs to cgroups (v2) by their CPU time.
+ *
+ * The CPU time of each cgroup is read from "usage_usec" in its cpu.stat file at every sample.
+ * The energy consumed in the interval since the previous sample is split in proportion to the
+ * CPU time of each cgroup in the interval, relative to the capacity of all CPUs (number of CPUs
+ * times the length of the interval). The CPU time of all other processes (the root cgroup minus
+ * the given cgroups) is attributed to "other", and the remaining capacity to "idle", such that
+ * the energy of all entries sums up to the total energy.
+ *
+ * The cgroups should not be nested, otherwise the CPU time of the inner ones is counted twice.
+ * The energy of all packages is attributed together, because cgroups do not tell on which package
+ * their CPU time was spent. If the root cgroup has no cpu.stat (older kernels), the CPU time of
+ * other processes counts as idle.
+ */
+
+#define CGROUP_FS_ROOT "/sys/fs/cgroup"
+#define MAX_CGROUPS 64
+
+// Domains that are attributed
+enum CGROUP_DOMAIN { CGROUP_DOMAIN_PACKAGE, CGROUP_DOMAIN_CORE, CGROUP_NR_DOMAIN };
+
+typedef struct {
+  const char *name; // path of the cgroup relative to the root, or "other" or "idle"
+  double cpu_seconds;
+  double energy_J[CGROUP_NR_DOMAIN];
+} cgroup_energy_t;
+
+/**
+ * Open the cpu.stat files of the given cgroups (paths relative to root) and of the root cgroup.
+ * num_cpus is the number of CPUs whose capacity is shared by the cgroups.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_cgroup_attribution(const char *root, int num_cgroups, char *const cgroups[], int num_cpus);
+
+/**
+ * Check whether the attribution is open.
+ */
+int is_cgroup_attribution_open();
+
+/**
+ * Read the CPU time of all cgroups, and attribute the energy that was consumed since the previous
+ * update, where energy_J is the total energy consumed so far in each domain. If energy_J is NULL,
+ * the attribution restarts at the given time (in seconds) with zero energy.
+ */
+void update_cgroup_attribution(double time, const double energy_J[CGROUP_NR_DOMAIN]);
+
+/**
+ * Get the number of entries, i.e., the number of cgroups plus one for "other" and one for "idle".
+ */
+int get_num_cgroup_entries();
+
+/**
+ * Get the CPU time and energy of the entry with the given index since the last restart.
+ */
+const cgroup_energy_t *get_cgroup_energy(int index);
+
+/**
+ * Close all cpu.stat files.
+ */
+void close_cgroup_attribution();
+
+#endif
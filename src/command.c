@@ -0,0 +1,287 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for pipe2(), setresuid() and setresgid()
+#endif
+
+#include "command.h"
+#include "util.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef struct {
+  pid_t pid;
+  int start_fd; // closing or writing it lets the child continue, -1 once started
+  int exec_error_fd; // the child writes errno to it if execve() fails, -1 once started
+} prepared_command_t;
+
+// The prepared processes in the order in which they are started. The current one is the first
+// one that has not exited.
+static prepared_command_t commands[MAX_PREPARED_COMMANDS];
+static int current_command = 0;
+static int num_commands = 0;
+
+// The pipe for markers is shared by all commands, and this process keeps the write end for the
+// commands that are prepared later.
+static int marker_fd = -1; // read end
+static int marker_write_fd = -1;
+
+#define MARKER_BUFFER_SIZE 256
+static char marker_buffer[MARKER_BUFFER_SIZE]; // received bytes that are not yet taken
+static size_t marker_length = 0;
+
+/*
+ * Runs in the child: wait for start_command() and execute the command.
+ */
+static void run_child(char *const argv[], int start_pipe, int exec_error_pipe, int marker_pipe) {
+  int error = 0;
+  char start;
+  char marker_fd_string[16];
+  sigset_t no_signals;
+  sigemptyset(&no_signals);
+  // unlike the pipe itself, the duplicate is inherited by the command
+  const int inherited_marker_fd = dup(marker_pipe);
+  snprintf(marker_fd_string, sizeof(marker_fd_string), "%d", inherited_marker_fd);
+  if (inherited_marker_fd < 0 || setenv(COMMAND_MARKER_ENV, marker_fd_string, 1) != 0) {
+    error = errno;
+  }
+  // Give up the privileges of a set-user-ID or set-group-ID binary. File capabilities of the binary
+  // are not passed on because execve() by a user other than root clears them.
+  if (setresgid(getgid(), getgid(), getgid()) != 0 || setresuid(getuid(), getuid(), getuid()) != 0
+      || sigprocmask(SIG_SETMASK, &no_signals, NULL) != 0) {
+    error = error ? error : errno;
+  }
+  // Report errors only after being started, such that the parent can always write to the pipe.
+  if (read(start_pipe, &start, 1) != 1) {
+    _exit(127); // the measurement was cancelled
+  }
+  if (error == 0) {
+    execvp(argv[0], argv);
+    error = errno;
+  }
+  if (write(exec_error_pipe, &error, sizeof(error)) != sizeof(error)) {
+    // nothing that could be done, the parent sees the exit code
+  }
+  _exit(error == ENOENT ? 127 : 126);
+}
+
+static void close_pipe(int pipe[2]) {
+  close(pipe[0]);
+  close(pipe[1]);
+}
+
+/*
+ * Create the pipe for markers, unless it exists already.
+ */
+static int open_marker_pipe() {
+  int marker_pipe[2];
+  if (marker_fd != -1) {
+    return 0;
+  }
+  if (pipe2(marker_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+    return -1;
+  }
+  if (fcntl(marker_pipe[0], F_SETOWN, getpid()) != 0
+      || fcntl(marker_pipe[0], F_SETFL, O_NONBLOCK | O_ASYNC) != 0) {
+    close_pipe(marker_pipe);
+    return -1;
+  }
+  marker_fd = marker_pipe[0];
+  marker_write_fd = marker_pipe[1];
+  marker_length = 0;
+  return 0;
+}
+
+int prepare_command(char *const argv[]) {
+  int start_pipe[2];
+  int exec_error_pipe[2];
+  if (current_command == num_commands) {
+    current_command = num_commands = 0;
+  }
+  if (num_commands == MAX_PREPARED_COMMANDS) {
+    warnx("At most %d commands can be prepared.", MAX_PREPARED_COMMANDS);
+    return -1;
+  }
+  if (open_marker_pipe() != 0) {
+    warn("Could not create pipe for markers");
+    return -1;
+  }
+  if (pipe2(start_pipe, O_CLOEXEC) != 0) {
+    warn("Could not create pipe");
+    return -1;
+  }
+  if (pipe2(exec_error_pipe, O_CLOEXEC) != 0) {
+    warn("Could not create pipe");
+    close_pipe(start_pipe);
+    return -1;
+  }
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(start_pipe[1]);
+    close(exec_error_pipe[0]);
+    close(marker_fd);
+    // Otherwise the previously prepared children would not notice that they are cancelled.
+    for (int i = current_command; i < num_commands; i++) {
+      if (commands[i].start_fd != -1) {
+        close(commands[i].start_fd);
+        close(commands[i].exec_error_fd);
+      }
+    }
+    run_child(argv, start_pipe[0], exec_error_pipe[1], marker_write_fd);
+  }
+  close(start_pipe[0]);
+  close(exec_error_pipe[1]);
+  if (pid < 0) {
+    warn("Could not create process for %s", argv[0]);
+    close(start_pipe[1]);
+    close(exec_error_pipe[0]);
+    return -1;
+  }
+  commands[num_commands++] = (prepared_command_t){
+      .pid = pid,
+      .start_fd = start_pipe[1],
+      .exec_error_fd = exec_error_pipe[0],
+  };
+  DEBUG("Prepared process %d for %s.", (int)pid, argv[0]);
+  return 0;
+}
+
+int start_command() {
+  const char start = 1;
+  int error = 0;
+  if (current_command == num_commands || commands[current_command].start_fd == -1) {
+    warnx("No prepared command to start.");
+    return -1;
+  }
+  prepared_command_t *const command = &commands[current_command];
+  // If the child died already, writing fails, which should not terminate this process.
+  void (*const previous_handler)(int) = signal(SIGPIPE, SIG_IGN);
+  const int started = write(command->start_fd, &start, 1) == 1;
+  signal(SIGPIPE, previous_handler);
+  close(command->start_fd);
+  command->start_fd = -1;
+  // The pipe is closed by a successful execve(), so this returns as soon as the command runs.
+  ssize_t received;
+  do {
+    received = read(command->exec_error_fd, &error, sizeof(error));
+  } while (received < 0 && errno == EINTR);
+  close(command->exec_error_fd);
+  command->exec_error_fd = -1;
+  if (!started || received != 0) {
+    warnx("Could not execute command: %s", started ? strerror(error) : "child process failed");
+    return -1;
+  }
+  return 0;
+}
+
+int wait_for_command(int wait, command_result_t *result) {
+  if (current_command == num_commands) {
+    return -1;
+  }
+  pid_t pid;
+  do {
+    pid = wait4(commands[current_command].pid, &result->status, wait ? 0 : WNOHANG, &result->usage);
+  } while (pid < 0 && errno == EINTR);
+  if (pid < 0) {
+    warn("Waiting for command failed");
+    return -1;
+  }
+  if (pid == 0) {
+    return 0;
+  }
+  current_command++;
+  return 1;
+}
+
+int get_command_marker_fd() {
+  return marker_fd;
+}
+
+int read_command_marker(char *label, size_t size) {
+  char *newline = memchr(marker_buffer, '\n', marker_length);
+  if (newline == NULL && marker_fd != -1 && marker_length < sizeof(marker_buffer)) {
+    const ssize_t received =
+        read(marker_fd, marker_buffer + marker_length, sizeof(marker_buffer) - marker_length);
+    if (received > 0) {
+      marker_length += received;
+      newline = memchr(marker_buffer, '\n', marker_length);
+    }
+  }
+  if (newline == NULL && marker_length == sizeof(marker_buffer)) {
+    newline = &marker_buffer[marker_length - 1]; // a line that is too long is split
+  }
+  if (newline == NULL) {
+    return 0;
+  }
+
+  size_t length = newline - marker_buffer;
+  const size_t consumed = length + 1;
+  if (length > 0 && marker_buffer[length - 1] == '\r') {
+    length--;
+  }
+  if (size > 0) {
+    length = (length < size - 1) ? length : size - 1;
+    memcpy(label, marker_buffer, length);
+    label[length] = '\0';
+  }
+  marker_length -= consumed;
+  memmove(marker_buffer, marker_buffer + consumed, marker_length);
+  return 1;
+}
+
+void signal_command(int signal) {
+  // This fails if this process dropped its root privileges but the command runs as root.
+  if (current_command < num_commands && kill(commands[current_command].pid, signal) != 0) {
+    warn("Could not send signal %d to command", signal);
+  }
+}
+
+void cancel_command() {
+  for (int i = current_command; i < num_commands; i++) {
+    if (commands[i].start_fd != -1) {
+      close(commands[i].start_fd); // the child exits instead of executing the command
+      close(commands[i].exec_error_fd);
+      commands[i].start_fd = -1;
+      commands[i].exec_error_fd = -1;
+    }
+  }
+  if (marker_fd != -1) {
+    close(marker_fd);
+    close(marker_write_fd);
+    marker_fd = -1;
+    marker_write_fd = -1;
+    // Discard a pending notification of the pipe, which would terminate us once it is unblocked.
+    sigset_t sigio;
+    sigemptyset(&sigio);
+    sigaddset(&sigio, SIGIO);
+    const struct timespec no_wait = {0, 0};
+    while (sigtimedwait(&sigio, NULL, &no_wait) > 0) {
+    }
+  }
+  for (; current_command < num_commands; current_command++) {
+    while (waitpid(commands[current_command].pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+  }
+}
+
+int get_command_exit_code(const command_result_t *result) {
+  if (WIFSIGNALED(result->status)) {
+    return 128 + WTERMSIG(result->status);
+  }
+  return WEXITSTATUS(result->status);
+}
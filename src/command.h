@@ -0,0 +1,94 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_command
+#define _h_command
+
+#include <stddef.h>
+#include <sys/resource.h>
+
+/*
+ * A command that is measured from its start to its exit. The child process is created in advance
+ * and blocks until start_command() is called, such that the initial sample can be taken directly
+ * before execve() and forking is not part of the measurement.
+ *
+ * The command can mark the start of a new phase of its execution by writing a line with the label
+ * of the phase to the file descriptor in the environment variable CEM_MARK_FD, e.g.,
+ * "echo compute >&$CEM_MARK_FD" in a shell. The file descriptor is a pipe, so writes of up to
+ * PIPE_BUF bytes are atomic even if several processes write to it.
+ *
+ * Several processes can be prepared in advance (e.g., for repeated runs of a benchmark). They are
+ * started one after another, and the current command is the first one that has not exited.
+ */
+
+#define COMMAND_MARKER_ENV "CEM_MARK_FD"
+#define MAX_PREPARED_COMMANDS 128
+
+typedef struct {
+  int status; // as returned by waitpid()
+  struct rusage usage; // of the command and its waited-for children
+} command_result_t;
+
+/**
+ * Create a child process for the command (argv[0] is searched in PATH). The child runs with the
+ * real user and group ID of this process and with no blocked signals, and does not inherit any
+ * file descriptors that are opened after this call. SIGIO needs to be blocked or handled before,
+ * because it is sent for markers.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int prepare_command(char *const argv[]);
+
+/**
+ * Let the child process of the current command execute it, and wait until it did so.
+ *
+ * @return 0 on success and -1 if the command could not be executed (the child then exits with 127
+ * if it was not found and 126 otherwise, like in a shell)
+ */
+int start_command();
+
+/**
+ * Check whether the current command has exited (then the next one becomes current), without
+ * blocking unless wait is true.
+ *
+ * @return 1 if it has exited (result is then filled), 0 if it is still running, and -1 on failure
+ */
+int wait_for_command(int wait, command_result_t *result);
+
+/**
+ * Get the file descriptor from which the markers of the command are read. It is non-blocking and
+ * sends SIGIO to this process whenever the command writes to it.
+ */
+int get_command_marker_fd();
+
+/**
+ * Take the label of the next complete marker line that the command wrote, without blocking.
+ * Labels that do not fit into size bytes are truncated.
+ *
+ * @return 1 if a label was taken, 0 otherwise
+ */
+int read_command_marker(char *label, size_t size);
+
+/**
+ * Send a signal to the command if it is running, and warn if this is not permitted.
+ */
+void signal_command(int signal);
+
+/**
+ * Close the pipes to the commands, terminate those that were prepared but not yet started, and
+ * wait for all of them.
+ */
+void cancel_command();
+
+/**
+ * Get the exit code of a shell for the command, i.e., its exit code or 128 plus the number of the
+ * signal that killed it.
+ */
+int get_command_exit_code(const command_result_t *result);
+
+#endif
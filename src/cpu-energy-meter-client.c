@@ -0,0 +1,89 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Client for a daemon started with "cpu-energy-meter -D SOCKET", see daemon.h for the requests.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define REQUEST_SIZE 256
+#define REPLY_SIZE 8192
+
+static void usage(FILE *target, const char *progname) {
+  fprintf(target, "\n");
+  fprintf(target, "Usage: %s SOCKET REQUEST...\n", progname);
+  fprintf(target, "Measure through a running \"cpu-energy-meter -D SOCKET\".\n");
+  fprintf(target, "\n");
+  fprintf(target, "  %-20s %s\n", "open", "start a session and print its ID");
+  fprintf(target, "  %-20s %s\n", "snapshot ID [LABEL]", "print the energy consumed since the start");
+  fprintf(target, "  %-20s %s\n", "close ID [LABEL]", "the same as snapshot, and end the session");
+  fprintf(target, "\n");
+  fprintf(target, "Example: id=$(%s /run/cpu-energy-meter.sock open | cut -d= -f2)\n", progname);
+  fprintf(target, "\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && strcmp(argv[1], "-h") == 0) {
+    usage(stdout, argv[0]);
+    return 0;
+  }
+  if (argc < 3) {
+    usage(stderr, argv[0]);
+    return 1;
+  }
+
+  char request[REQUEST_SIZE];
+  size_t length = 0;
+  for (int i = 2; i < argc; i++) {
+    const int written =
+        snprintf(request + length, sizeof(request) - length, "%s%s", argv[i], (i + 1 < argc) ? " " : "\n");
+    if (written < 0 || (size_t)written >= sizeof(request) - length || strchr(argv[i], '\n') != NULL) {
+      errx(1, "Invalid request.");
+    }
+    length += written;
+  }
+
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+    errx(1, "Socket path %s is too long.", argv[1]);
+  }
+  strcpy(address.sun_path, argv[1]);
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (const struct sockaddr *)&address, sizeof(address)) != 0) {
+    err(1, "Could not connect to %s", argv[1]);
+  }
+  if (write(fd, request, length) != (ssize_t)length) {
+    err(1, "Could not send request");
+  }
+
+  // The reply ends with an empty line.
+  char reply[REPLY_SIZE];
+  size_t received = 0;
+  while (received < 2 || strncmp(reply + received - 2, "\n\n", 2) != 0) {
+    const ssize_t n = read(fd, reply + received, sizeof(reply) - 1 - received);
+    if (n <= 0) {
+      errx(1, "Incomplete reply from %s.", argv[1]);
+    }
+    received += n;
+  }
+  reply[received - 1] = '\0';
+  close(fd);
+
+  if (strncmp(reply, "ok\n", 3) != 0) {
+    reply[strcspn(reply, "\n")] = '\0';
+    errx(1, "%s", reply);
+  }
+  fputs(reply + 3, stdout);
+  return 0;
+}
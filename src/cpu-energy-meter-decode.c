@@ -0,0 +1,149 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Decoder for the binary trace files written by "cpu-energy-meter -t MILLISEC:FILE",
+ * see tracefile.h for the format.
+ */
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "rapl.h"
+#include "tracefile.h"
+
+// Same order as enum RAPL_DOMAIN
+static const char *const DOMAIN_NAMES[RAPL_NR_DOMAIN] = {"package", "core", "uncore", "dram", "psys"};
+
+static const char *progname = "cpu-energy-meter-decode";
+
+static int print_rawtext = 0;
+
+// Names of the columns of the trace, i.e., "cpu0_package_joules"
+static char (*column_names)[32];
+
+static int create_column_names(const trace_file_header_t *header) {
+  column_names = calloc(header->num_columns, sizeof(*column_names));
+  if (column_names == NULL) {
+    return -1;
+  }
+  int column = 0;
+  for (int node = 0; node < header->num_nodes; node++) {
+    for (int domain = 0; domain < RAPL_NR_DOMAIN; domain++) {
+      if (header->domain_mask & (1u << domain)) {
+        snprintf(
+            column_names[column++], sizeof(*column_names), "cpu%d_%s_joules", node, DOMAIN_NAMES[domain]);
+      }
+    }
+  }
+  return 0;
+}
+
+static void print_csv_header(const trace_file_header_t *header) {
+  fprintf(stdout, "time_seconds");
+  for (int i = 0; i < header->num_columns; i++) {
+    fprintf(stdout, ",%s", column_names[i]);
+  }
+  fprintf(stdout, "\n");
+}
+
+static void print_record(
+    const trace_file_header_t *header, double time, uint64_t dropped_before, const uint64_t values[]) {
+  if (print_rawtext) {
+    fprintf(stdout, "\ntime_seconds=%f\n", time);
+    if (dropped_before > 0) {
+      fprintf(stdout, "dropped_samples=%" PRIu64 "\n", dropped_before);
+    }
+    for (int i = 0; i < header->num_columns; i++) {
+      fprintf(stdout, "%s=%f\n", column_names[i], values[i] * header->units[i]);
+    }
+  } else {
+    if (dropped_before > 0) {
+      fprintf(stdout, "# dropped %" PRIu64 " samples\n", dropped_before);
+    }
+    fprintf(stdout, "%f", time);
+    for (int i = 0; i < header->num_columns; i++) {
+      fprintf(stdout, ",%f", values[i] * header->units[i]);
+    }
+    fprintf(stdout, "\n");
+  }
+}
+
+static void usage(FILE *target) {
+  fprintf(target, "\n");
+  fprintf(target, "Usage: %s [OPTION]... FILE\n", progname);
+  fprintf(target, "Convert a binary trace of CPU Energy Meter to CSV.\n");
+  fprintf(target, "\n");
+  fprintf(target, "  %-20s %s\n", "-h", "show this help text");
+  fprintf(target, "  %-20s %s\n", "-r", "print the output as raw-text");
+  fprintf(target, "\n");
+}
+
+int main(int argc, char **argv) {
+  progname = argv[0];
+  int opt;
+  while ((opt = getopt(argc, argv, "hr")) != -1) {
+    switch (opt) {
+    case 'h':
+      usage(stdout);
+      return 0;
+    case 'r':
+      print_rawtext = 1;
+      break;
+    default:
+      usage(stderr);
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(stderr);
+    return 1;
+  }
+
+  trace_file_header_t header;
+  if (open_trace_file_reader(argv[optind], &header) != 0) {
+    return 1;
+  }
+  if (create_column_names(&header) != 0) {
+    close_trace_file_reader();
+    return 1;
+  }
+
+  if (!print_rawtext) {
+    print_csv_header(&header);
+  }
+  uint64_t values[header.num_columns];
+  double time;
+  uint64_t dropped_before;
+  uint64_t count = 0;
+  int result;
+  while ((result = read_trace_file_record(&time, &dropped_before, values)) == 0) {
+    print_record(&header, time, dropped_before, values);
+    count++;
+  }
+  uint64_t skipped_chunks, skipped_records;
+  get_skipped_trace_file_chunks(&skipped_chunks, &skipped_records);
+  if (result != 1) {
+    warnx("%s is truncated or corrupted after %" PRIu64 " records.", argv[optind], count);
+  }
+  if (skipped_chunks > 0) {
+    warnx(
+        "Skipped %" PRIu64 " truncated or corrupted chunks of %s "
+        "with at least %" PRIu64 " records.",
+        skipped_chunks,
+        argv[optind],
+        skipped_records);
+  }
+
+  free(column_names);
+  close_trace_file_reader();
+  return (result == 1 && skipped_chunks == 0) ? 0 : 1;
+}
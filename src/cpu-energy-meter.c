@@ -9,16 +9,34 @@
 
 #include <err.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "cgroup.h"
+#include "command.h"
+#include "daemon.h"
+#include "metrics.h"
+#include "phases.h"
+#include "powerstats.h"
 #include "rapl.h"
+#include "runstats.h"
+#include "simulator.h"
+#include "textformat.h"
+#include "trace.h"
+#include "tracefile.h"
 #include "util.h"
 
 const char *progname = "CPU Energy Meter"; // will be overwritten when parsing the command line
@@ -28,11 +46,66 @@ const char *const version = "1.3-dev";
 static uint64_t delay = 0;
 static const uint64_t delay_unit = 1000000000; // unit in nanoseconds
 static int print_rawtext = 0;
+static int adaptive_interval = 0;
+static int align_samples = 0;
+static uint64_t trace_interval = 0; // in nanoseconds, 0 if not tracing
+static const char *trace_path = NULL; // binary trace file, or NULL for printing the trace
+// Format of a printed trace: the energy since the start of the measurement and of each interval,
+// or records with the time, the interval, and the energy and power of each interval
+enum TRACE_FORMAT { TRACE_FORMAT_DEFAULT, TRACE_FORMAT_CSV, TRACE_FORMAT_JSONL };
+static enum TRACE_FORMAT trace_format = TRACE_FORMAT_DEFAULT;
+static const char *daemon_socket = NULL; // serve clients on this socket, or NULL
+static mode_t daemon_socket_mode = 0660; // owner and group of the caller may connect by default
+static const char *metrics_address = NULL; // serve metrics over HTTP on this address, or NULL
+static const char *shm_name = NULL; // publish the cumulative energy in /dev/shm/NAME, or NULL
+static char **command = NULL; // measure this command from its start to its exit, or NULL
+static int bench_runs = 0; // run the command this many times as a benchmark, or 0
+static int bench_warmup_runs = 1; // unmeasured runs before the benchmark
+static double bench_precision = 0; // stop once the CI of the package energy is within this fraction
+static const int BENCH_DEFAULT_RUNS = 10;
+static const char *cgroup_root = CGROUP_FS_ROOT;
+static char *cgroups[MAX_CGROUPS]; // attribute the energy to these cgroups
+static int num_cgroups = 0;
+static int power_stats = 0; // collect statistics of the power between samples
+static double power_thresholds_W[MAX_POWER_THRESHOLDS]; // measure the time above these
+static int num_power_thresholds = 0;
+// Sampling delay for power statistics if neither -e nor -t is given
+static const uint64_t POWER_STATS_DEFAULT_DELAY = 100000000; // 100 ms in ns
+// Sampling delay of the metrics exporter if -e is not given
+static const uint64_t METRICS_DEFAULT_DELAY = 1000000000; // 1 s in ns
 
-static double convert_time_to_sec(struct timeval tv) {
-  double elapsed_time = (double)(tv.tv_sec) + ((double)(tv.tv_usec) / 1000000);
-  return elapsed_time;
-}
+// Number of trace records that can wait for being written (about 16s at 1ms)
+static const int TRACE_BUFFER_RECORDS = 16384;
+static int trace_num_node = 0;
+static int trace_file_failed = 0;
+static double trace_start_time = 0; // of CLOCK_MONOTONIC, timestamps of records are relative to it
+static double trace_previous_timestamp = 0; // of the previous written record
+
+// Shared accumulator of the daemon
+static int daemon_num_node = 0;
+static uint64_t (*daemon_prev_sample)[RAPL_NR_DOMAIN] = NULL;
+static uint64_t (*daemon_cum_ticks)[RAPL_NR_DOMAIN] = NULL;
+
+// Health of the sampling loop of the metrics exporter
+static const double LATE_WAKEUP_FRACTION = 0.1; // of the delay after which a sample counts as late
+static uint64_t metrics_samples = 0;
+static uint64_t metrics_read_errors = 0; // samples in which reading a counter failed
+static uint64_t metrics_late_wakeups = 0;
+
+// Fraction of automatically computed intervals that the kernel may use to coalesce our wake-up
+// with others (see PR_SET_TIMERSLACK in prctl(2))
+static const double TIMER_SLACK_FRACTION = 0.125;
+static unsigned long timer_slack_ns = 0;
+
+// Cross-socket skew of the samples (time between reading the first and the last socket)
+static double max_sample_skew = 0;
+static double last_sample_skew = 0;
+
+// Maximum error of the times of the first and the last sample if they are aligned with counter
+// updates (NAN if no update was observed)
+static const double ALIGNMENT_TIMEOUT = 0.01; // seconds, about 10 counter updates
+static double start_alignment_error = 0;
+static double end_alignment_error = 0;
 
 /**
  * Create set with signals that we care about.
@@ -42,6 +115,10 @@ static sigset_t get_sigset() {
   sigemptyset(&set);
   sigaddset(&set, SIGINT);
   sigaddset(&set, SIGUSR1);
+  if (command != NULL) {
+    sigaddset(&set, SIGCHLD);
+    sigaddset(&set, SIGIO); // for markers
+  }
   return set;
 }
 
@@ -52,18 +129,36 @@ static void print_global_header(int num_node, double duration) {
   if (print_rawtext) {
     fprintf(stdout, "\ncpu_count=%d\n", num_node);
     fprintf(stdout, "duration_seconds=%f\n", duration);
+    if (num_node > 1) {
+      fprintf(stdout, "sample_skew_seconds=%.9f\n", last_sample_skew);
+      fprintf(stdout, "max_sample_skew_seconds=%.9f\n", max_sample_skew);
+    }
+    if (align_samples && !isnan(start_alignment_error + end_alignment_error)) {
+      fprintf(stdout, "alignment_error_seconds=%.9f\n", start_alignment_error + end_alignment_error);
+    }
   }
 }
 
 /**
  * Print socket-specific header of measurements.
  */
-static void print_header(int socket, double duration) {
+static void print_header(int socket, int num_node, double duration) {
   if (!print_rawtext) {
     fprintf(stdout, "\b\b+--------------------------------------+\n");
     fprintf(stdout, "| CPU Energy Meter            Socket %u |\n", socket);
     fprintf(stdout, "+--------------------------------------+\n");
     fprintf(stdout, "%-19s %14.6lf s\n", "Duration", duration);
+    if (num_node > 1) {
+      fprintf(stdout, "%-19s %14.3lf us\n", "Sample skew", last_sample_skew * 1e6);
+      fprintf(stdout, "%-19s %14.3lf us\n", "Max. sample skew", max_sample_skew * 1e6);
+    }
+    if (align_samples && !isnan(start_alignment_error + end_alignment_error)) {
+      fprintf(
+          stdout,
+          "%-19s %14.3lf us\n",
+          "Alignment error",
+          (start_alignment_error + end_alignment_error) * 1e6);
+    }
   }
 }
 
@@ -84,36 +179,291 @@ static void print_value(int socket, int domain, double value_J) {
   }
 }
 
+/**
+ * Print the CPU time and the energy attributed to each cgroup.
+ */
+static void print_cgroup_results() {
+  const int num_entries = get_num_cgroup_entries();
+  if (!print_rawtext) {
+    fprintf(stdout, "+--------------------------------------+\n");
+    fprintf(stdout, "| CPU Energy Meter             Cgroups |\n");
+    fprintf(stdout, "+--------------------------------------+\n");
+  }
+  for (int i = 0; i < num_entries; i++) {
+    const cgroup_energy_t *entry = get_cgroup_energy(i);
+    // other and idle are the last two entries
+    char prefix[32];
+    if (i < num_entries - 2) {
+      snprintf(prefix, sizeof(prefix), "cgroup%d_", i);
+    } else {
+      snprintf(prefix, sizeof(prefix), "%s_", entry->name);
+    }
+    if (print_rawtext) {
+      if (i < num_entries - 2) {
+        fprintf(stdout, "%spath=%s\n", prefix, entry->name);
+      }
+      fprintf(stdout, "%scpu_seconds=%f\n", prefix, entry->cpu_seconds);
+    } else {
+      fprintf(stdout, "%-19.19s %14.6lf s\n", entry->name, entry->cpu_seconds);
+    }
+    for (int domain = 0; domain < CGROUP_NR_DOMAIN; domain++) {
+      const enum RAPL_DOMAIN rapl_domain = (domain == CGROUP_DOMAIN_PACKAGE) ? RAPL_PKG : RAPL_PP0;
+      if (!is_supported_domain(rapl_domain)) {
+        continue;
+      }
+      if (print_rawtext) {
+        fprintf(
+            stdout, "%s%s_joules=%f\n", prefix, RAPL_DOMAIN_STRINGS[rapl_domain], entry->energy_J[domain]);
+      } else {
+        fprintf(
+            stdout,
+            "  %-17s %14.6f Joule\n",
+            RAPL_DOMAIN_FORMATTED_STRINGS[rapl_domain],
+            entry->energy_J[domain]);
+      }
+    }
+  }
+}
+
+/**
+ * Print the statistics of the power of the given domain between the samples.
+ */
+static void print_power_stats(int socket, int domain) {
+  power_stats_t stats;
+  if (get_power_stats(socket * RAPL_NR_DOMAIN + domain, &stats) != 0) {
+    return;
+  }
+  const struct {
+    const char *name;
+    const char *label;
+    double value_W;
+  } values[] = {
+      {"mean", "mean power", stats.mean_W},
+      {"stddev", "std. dev.", stats.stddev_W},
+      {"min", "min.", stats.min_W},
+      {"p50", "p50", stats.p50_W},
+      {"p95", "p95", stats.p95_W},
+      {"p99", "p99", stats.p99_W},
+      {"max", "max.", stats.max_W},
+  };
+  const char *const domain_string = RAPL_DOMAIN_STRINGS[domain];
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    if (print_rawtext) {
+      fprintf(
+          stdout,
+          "cpu%d_%s_power_%s_watts=%f\n",
+          socket,
+          domain_string,
+          values[i].name,
+          values[i].value_W);
+    } else {
+      fprintf(stdout, "  %-17s %14.3f W\n", values[i].label, values[i].value_W);
+    }
+  }
+  for (int i = 0; i < num_power_thresholds; i++) {
+    if (print_rawtext) {
+      fprintf(
+          stdout,
+          "cpu%d_%s_seconds_above_%g_watts=%f\n",
+          socket,
+          domain_string,
+          power_thresholds_W[i],
+          stats.seconds_above_threshold[i]);
+    } else {
+      char label[32];
+      snprintf(label, sizeof(label), "above %g W", power_thresholds_W[i]);
+      fprintf(stdout, "  %-17s %14.6f s\n", label, stats.seconds_above_threshold[i]);
+    }
+  }
+}
+
 static void print_results(
     int num_node,
-    double cum_energy_J[num_node][RAPL_NR_DOMAIN],
-    struct timeval measurement_start_time,
-    struct timeval measurement_end_time) {
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double measurement_start_time,
+    double measurement_end_time) {
 
-  const double duration =
-      convert_time_to_sec(measurement_end_time) - convert_time_to_sec(measurement_start_time);
+  // The conversion to joules is only done here to avoid rounding errors during accumulation.
+  double cum_energy_J[num_node][RAPL_NR_DOMAIN];
+  convert_ticks_to_joules(num_node, cum_ticks, cum_energy_J);
+
+  const double duration = measurement_end_time - measurement_start_time;
   print_global_header(num_node, duration);
 
   for (int i = 0; i < num_node; i++) {
-    print_header(i, duration);
+    print_header(i, num_node, duration);
 
     for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
       if (is_supported_domain(domain)) {
         print_value(i, domain, cum_energy_J[i][domain]);
+        if (is_power_stats_open() && cum_energy_J[i][domain] != 0.0) {
+          print_power_stats(i, domain);
+        }
+      }
+    }
+  }
+  if (is_cgroup_attribution_open()) {
+    print_cgroup_results();
+  }
+}
+
+static void print_command_results(const command_result_t *result) {
+  const double user_seconds = result->usage.ru_utime.tv_sec + result->usage.ru_utime.tv_usec / 1e6;
+  const double system_seconds = result->usage.ru_stime.tv_sec + result->usage.ru_stime.tv_usec / 1e6;
+  const int signaled = WIFSIGNALED(result->status);
+  const int code = signaled ? WTERMSIG(result->status) : WEXITSTATUS(result->status);
+  if (print_rawtext) {
+    fprintf(stdout, "command_%s=%d\n", signaled ? "signal" : "exit_code", code);
+    fprintf(stdout, "command_user_seconds=%f\n", user_seconds);
+    fprintf(stdout, "command_system_seconds=%f\n", system_seconds);
+    fprintf(stdout, "command_max_rss_kilobytes=%ld\n", result->usage.ru_maxrss);
+  } else {
+    fprintf(stdout, "+--------------------------------------+\n");
+    fprintf(stdout, "| CPU Energy Meter             Command |\n");
+    fprintf(stdout, "+--------------------------------------+\n");
+    fprintf(stdout, "%-19s %14d\n", signaled ? "Killed by signal" : "Exit code", code);
+    fprintf(stdout, "%-19s %14.6lf s\n", "User CPU time", user_seconds);
+    fprintf(stdout, "%-19s %14.6lf s\n", "System CPU time", system_seconds);
+    fprintf(stdout, "%-19s %14ld KiB\n", "Max. resident set", result->usage.ru_maxrss);
+  }
+}
+
+static void print_run_stats(
+    const char *raw_name, const char *name, const char *unit, const run_stats_t *stats) {
+  if (print_rawtext) {
+    fprintf(stdout, "%s_mean=%f\n", raw_name, stats->mean);
+    fprintf(stdout, "%s_stddev=%f\n", raw_name, get_run_stddev(stats));
+    fprintf(stdout, "%s_ci95=%f\n", raw_name, get_run_ci95(stats));
+  } else {
+    fprintf(stdout, "%-19.19s %14.6lf %s\n", name, stats->mean, unit);
+    fprintf(stdout, "  %-17s %14.6lf %s\n", "std. dev.", get_run_stddev(stats), unit);
+    fprintf(stdout, "  %-17s %14.6lf %s\n", "95% conf. +/-", get_run_ci95(stats), unit);
+  }
+}
+
+/**
+ * Print the statistics of the runs of a benchmark, where the energy is above the idle baseline.
+ */
+static void print_bench_results(
+    int num_node,
+    const run_stats_t *duration_stats,
+    run_stats_t energy_stats[num_node][RAPL_NR_DOMAIN],
+    run_stats_t idle_power_stats[num_node][RAPL_NR_DOMAIN]) {
+  if (print_rawtext) {
+    fprintf(stdout, "bench_runs=%d\n", duration_stats->count);
+    fprintf(stdout, "bench_warmup_runs=%d\n", bench_warmup_runs);
+  } else {
+    fprintf(stdout, "+--------------------------------------+\n");
+    fprintf(stdout, "| CPU Energy Meter           Benchmark |\n");
+    fprintf(stdout, "+--------------------------------------+\n");
+    fprintf(stdout, "%-19s %14d\n", "Runs", duration_stats->count);
+    fprintf(stdout, "%-19s %14d\n", "Warm-up runs", bench_warmup_runs);
+  }
+  print_run_stats("duration_seconds", "Duration", "s", duration_stats);
+  for (int node = 0; node < num_node; node++) {
+    for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+      if (!is_supported_domain(domain)) {
+        continue;
+      }
+      char raw_name[64];
+      char name[32];
+      snprintf(raw_name, sizeof(raw_name), "cpu%d_%s_joules", node, RAPL_DOMAIN_STRINGS[domain]);
+      if (num_node > 1) {
+        snprintf(name, sizeof(name), "Socket %d %s", node, RAPL_DOMAIN_FORMATTED_STRINGS[domain]);
+      } else {
+        snprintf(name, sizeof(name), "%s", RAPL_DOMAIN_FORMATTED_STRINGS[domain]);
+      }
+      print_run_stats(raw_name, name, "Joule", &energy_stats[node][domain]);
+      if (print_rawtext) {
+        fprintf(
+            stdout,
+            "cpu%d_%s_idle_watts=%f\n",
+            node,
+            RAPL_DOMAIN_STRINGS[domain],
+            idle_power_stats[node][domain].mean);
+      } else {
+        fprintf(stdout, "  %-17s %14.6lf W\n", "idle power", idle_power_stats[node][domain].mean);
+      }
+    }
+  }
+}
+
+/**
+ * Print the energy consumed in each phase that was marked by the command.
+ */
+static void print_phase_results(int num_node) {
+  if (!print_rawtext) {
+    fprintf(stdout, "+--------------------------------------+\n");
+    fprintf(stdout, "| CPU Energy Meter              Phases |\n");
+    fprintf(stdout, "+--------------------------------------+\n");
+  }
+  for (int i = 0; i < get_num_phases(); i++) {
+    const phase_t *phase = get_phase(i);
+    double energy_J[num_node][RAPL_NR_DOMAIN];
+    convert_ticks_to_joules(num_node, (uint64_t(*)[RAPL_NR_DOMAIN])phase->values, energy_J);
+    if (print_rawtext) {
+      fprintf(stdout, "phase%d_label=%s\n", i, phase->label);
+      fprintf(stdout, "phase%d_count=%d\n", i, phase->count);
+      fprintf(stdout, "phase%d_duration_seconds=%f\n", i, phase->duration);
+    } else {
+      fprintf(stdout, "%-19.19s %14.6lf s\n", phase->label, phase->duration);
+      if (phase->count > 1) {
+        fprintf(stdout, "  %-17s %14d\n", "Occurrences", phase->count);
       }
     }
+    for (int node = 0; node < num_node; node++) {
+      for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+        if (!is_supported_domain(domain)) {
+          continue;
+        }
+        if (print_rawtext) {
+          fprintf(
+              stdout,
+              "phase%d_cpu%d_%s_joules=%f\n",
+              i,
+              node,
+              RAPL_DOMAIN_STRINGS[domain],
+              energy_J[node][domain]);
+        } else {
+          char name[32];
+          if (num_node > 1) {
+            snprintf(name, sizeof(name), "Socket %d %s", node, RAPL_DOMAIN_FORMATTED_STRINGS[domain]);
+          } else {
+            snprintf(name, sizeof(name), "%s", RAPL_DOMAIN_FORMATTED_STRINGS[domain]);
+          }
+          fprintf(stdout, "  %-17s %14.6f Joule\n", name, energy_J[node][domain]);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Set the timer slack of this process to the given fraction of an automatically computed interval.
+ * The slack is subtracted from the interval, such that the wake-up is still in time.
+ */
+static double apply_timer_slack(double interval) {
+  const unsigned long slack_ns = (unsigned long)fmin(interval * TIMER_SLACK_FRACTION * 1e9, ULONG_MAX);
+  if (slack_ns != timer_slack_ns) {
+    if (prctl(PR_SET_TIMERSLACK, slack_ns, 0, 0, 0) != 0) {
+      DEBUG("Could not set timer slack to %luns.", slack_ns);
+      return interval;
+    }
+    timer_slack_ns = slack_ns;
   }
+  return interval - slack_ns / 1e9;
 }
 
-static struct timespec compute_msr_probe_interval_time() {
+static struct timespec compute_msr_probe_interval_time(double interval) {
   struct timespec signal_timelimit;
   if (delay) {
     // delay set by user; i.e. use the according values and return
     signal_timelimit.tv_sec = delay / delay_unit;
     signal_timelimit.tv_nsec = delay % delay_unit;
   } else {
-    signal_timelimit.tv_sec = get_maximum_read_interval();
-    signal_timelimit.tv_nsec = 0;
+    const double seconds = apply_timer_slack(interval);
+    signal_timelimit.tv_sec = (time_t)seconds;
+    signal_timelimit.tv_nsec = (long)((seconds - signal_timelimit.tv_sec) * delay_unit);
   }
   DEBUG(
       "Interval time of msr probes set to %lds, %ldns.",
@@ -122,25 +472,871 @@ static struct timespec compute_msr_probe_interval_time() {
   return signal_timelimit;
 }
 
+static void record_sample_skew() {
+  last_sample_skew = get_last_sample_skew();
+  if (last_sample_skew > max_sample_skew) {
+    max_sample_skew = last_sample_skew;
+  }
+  DEBUG("Cross-socket skew of sample: %.3fus.", last_sample_skew * 1e6);
+}
+
+/**
+ * If requested, wait for the next counter update such that the following sample is taken directly
+ * after it, and store the maximum error of the time of the sample.
+ */
+static void align_sample(double *alignment_error) {
+  if (!align_samples || get_remaining_samples() >= 0) {
+    return; // not requested or replaying
+  }
+  *alignment_error = align_to_counter_update(ALIGNMENT_TIMEOUT);
+  if (*alignment_error < 0) {
+    warnx("Counters did not change within %.0f ms, cannot align sample.", ALIGNMENT_TIMEOUT * 1e3);
+    *alignment_error = NAN;
+  }
+}
+
+/**
+ * Print the names of the columns of the trace, i.e., the time and all supported domains.
+ */
+static void print_trace_header(int num_node) {
+  fprintf(stdout, "time_seconds");
+  for (int i = 0; i < num_node; i++) {
+    for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+      if (is_supported_domain(domain)) {
+        fprintf(stdout, ",cpu%d_%s_joules", i, RAPL_DOMAIN_STRINGS[domain]);
+      }
+    }
+  }
+  fprintf(stdout, "\n");
+}
+
+/**
+ * Print the schema of the records of the trace in the CSV or JSON Lines format.
+ */
+static void print_trace_schema(int num_node) {
+  if (trace_format == TRACE_FORMAT_CSV) {
+    fprintf(stdout, "time_monotonic_seconds,interval_seconds,dropped_samples");
+    for (int i = 0; i < num_node; i++) {
+      for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+        if (is_supported_domain(domain)) {
+          const char *const domain_string = RAPL_DOMAIN_STRINGS[domain];
+          fprintf(stdout, ",cpu%d_%s_joules,cpu%d_%s_watts", i, domain_string, i, domain_string);
+        }
+      }
+    }
+    fprintf(stdout, "\n");
+    return;
+  }
+  fprintf(
+      stdout,
+      "{\"schema\":\"cpu-energy-meter-trace\",\"version\":1,\"nodes\":%d,\"domains\":[",
+      num_node);
+  const char *separator = "";
+  for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+    if (is_supported_domain(domain)) {
+      fprintf(stdout, "%s\"%s\"", separator, RAPL_DOMAIN_STRINGS[domain]);
+      separator = ",";
+    }
+  }
+  fprintf(
+      stdout,
+      "],\"fields\":{\"time\":\"seconds of CLOCK_MONOTONIC at the end of the interval\","
+      "\"interval\":\"seconds since the previous record\","
+      "\"dropped\":\"samples dropped before this record, contained in its interval\","
+      "\"joules\":\"energy in the interval, per node and domain\","
+      "\"watts\":\"average power in the interval, per node and domain\"}}\n");
+}
+
+/**
+ * Print one record of the trace in the CSV or JSON Lines format. Numbers are not formatted with
+ * printf(), because this runs for every sample. This is called by the consumer thread.
+ */
+static void write_formatted_trace_record(
+    double timestamp, uint64_t dropped_before, const uint64_t values[]) {
+  const int num_node = trace_num_node;
+  uint64_t ticks[num_node][RAPL_NR_DOMAIN];
+  double energy_J[num_node][RAPL_NR_DOMAIN];
+  memcpy(ticks, values, sizeof(ticks));
+  convert_ticks_to_joules(num_node, ticks, energy_J);
+  // The interval also contains the dropped samples, because their energy is part of this record.
+  const double interval = timestamp - trace_previous_timestamp;
+  trace_previous_timestamp = timestamp;
+  unsigned int domain_mask = 0;
+  for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+    if (is_supported_domain(domain)) {
+      domain_mask |= 1u << domain;
+    }
+  }
+
+  char line[TEXTFORMAT_TRACE_RECORD_LENGTH(num_node * RAPL_NR_DOMAIN)];
+  char *const end = format_trace_record(
+      line,
+      trace_format == TRACE_FORMAT_JSONL,
+      trace_start_time + timestamp,
+      interval,
+      dropped_before,
+      num_node,
+      RAPL_NR_DOMAIN,
+      domain_mask,
+      &energy_J[0][0]);
+  fwrite(line, 1, end - line, stdout); // a single write, such that lines are never interleaved
+}
+
+/**
+ * Print one line of the trace with the energy consumed since the previous line.
+ * This is called by the consumer thread of the trace buffer.
+ */
+static void write_trace_record(double timestamp, uint64_t dropped_before, const uint64_t values[]) {
+  const int num_node = trace_num_node;
+  uint64_t ticks[num_node][RAPL_NR_DOMAIN];
+  double energy_J[num_node][RAPL_NR_DOMAIN];
+  memcpy(ticks, values, sizeof(ticks));
+  convert_ticks_to_joules(num_node, ticks, energy_J);
+
+  char line[32 + num_node * RAPL_NR_DOMAIN * 32];
+  int length = 0;
+  if (dropped_before > 0) {
+    // the energy of the dropped samples is contained in this line
+    length += snprintf(line, sizeof(line), "# dropped %" PRIu64 " samples\n", dropped_before);
+  }
+  length += snprintf(line + length, sizeof(line) - length, "%.6f", timestamp);
+  for (int i = 0; i < num_node; i++) {
+    for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+      if (is_supported_domain(domain)) {
+        length += snprintf(line + length, sizeof(line) - length, ",%f", energy_J[i][domain]);
+      }
+    }
+  }
+  length += snprintf(line + length, sizeof(line) - length, "\n");
+  fwrite(line, 1, length, stdout); // a single write, such that lines are never interleaved
+}
+
+/**
+ * Append one record with the supported domains to the binary trace file.
+ * This is called by the consumer thread of the trace buffer.
+ */
+static void write_trace_file_of_nodes(
+    double timestamp, uint64_t dropped_before, const uint64_t values[]) {
+  uint64_t columns[trace_num_node * RAPL_NR_DOMAIN];
+  int num_columns = 0;
+  for (int slot = 0; slot < trace_num_node * RAPL_NR_DOMAIN; slot++) {
+    if (is_supported_domain(slot % RAPL_NR_DOMAIN)) {
+      columns[num_columns++] = values[slot];
+    }
+  }
+  if (!trace_file_failed && write_trace_file_record(timestamp, dropped_before, columns) != 0) {
+    trace_file_failed = 1; // do not try again for every sample
+  }
+}
+
+/**
+ * Sample in the given interval until SIGINT is received and pass the energy consumed in each
+ * interval to the trace buffer, whose consumer thread writes them. The sampling loop never waits
+ * for the output: if it is too slow, samples are dropped from the trace (and reported there),
+ * but the energy of dropped samples is still contained in the next line and in the results.
+ */
+static int trace_and_print_results(
+    int num_node,
+    uint64_t prev_sample[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double measurement_start_time) {
+  if (open_trace_buffer(TRACE_BUFFER_RECORDS, num_node * RAPL_NR_DOMAIN) != 0) {
+    warnx("Could not allocate trace buffer.");
+    return 1;
+  }
+  trace_num_node = num_node;
+  trace_writer_fn_t write_record = &write_trace_record;
+  if (trace_path != NULL) {
+    if (open_trace_file_for_nodes(trace_path) != 0) {
+      close_trace_buffer();
+      return 1;
+    }
+    write_record = &write_trace_file_of_nodes;
+  } else if (trace_format != TRACE_FORMAT_DEFAULT) {
+    trace_start_time = measurement_start_time;
+    trace_previous_timestamp = 0;
+    print_trace_schema(num_node);
+    write_record = &write_formatted_trace_record;
+  } else {
+    print_trace_header(num_node);
+  }
+  if (start_trace_consumer(write_record) != 0) {
+    warnx("Could not start trace consumer.");
+    close_trace_buffer();
+    close_trace_file();
+    return 1;
+  }
+
+  // accumulated values at the time of the last record that was passed to the trace buffer
+  uint64_t traced_ticks[num_node][RAPL_NR_DOMAIN];
+  uint64_t delta_ticks[num_node][RAPL_NR_DOMAIN];
+  memset(traced_ticks, 0, sizeof(traced_ticks));
+
+  const sigset_t signal_set = get_sigset();
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  int result = 0;
+  while (true) {
+    // Wait for signal or the next multiple of the interval (skipping those that were missed)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t remaining;
+    do {
+      deadline.tv_nsec += trace_interval;
+      deadline.tv_sec += deadline.tv_nsec / delay_unit;
+      deadline.tv_nsec %= delay_unit;
+      remaining = (int64_t)(deadline.tv_sec - now.tv_sec) * delay_unit + deadline.tv_nsec - now.tv_nsec;
+    } while (remaining < 0);
+    const struct timespec signal_timelimit = {
+        .tv_sec = remaining / delay_unit, .tv_nsec = remaining % delay_unit};
+    const int rcvd_signal = sigtimedwait(&signal_set, NULL, &signal_timelimit);
+    if (rcvd_signal == -1 && errno != EAGAIN && errno != EINTR) {
+      warn("Waiting for signal failed.");
+      result = 1;
+      break;
+    }
+
+    if (rcvd_signal == SIGINT) {
+      align_sample(&end_alignment_error);
+    }
+    if (get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_ticks) != 0) {
+      result = 1;
+      break;
+    }
+    record_sample_skew();
+    for (int i = 0; i < num_node; i++) {
+      for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+        delta_ticks[i][domain] = cum_ticks[i][domain] - traced_ticks[i][domain];
+      }
+    }
+    if (push_trace_record(get_last_sample_time() - measurement_start_time, &delta_ticks[0][0])
+        == 0) {
+      memcpy(traced_ticks, cum_ticks, sizeof(traced_ticks));
+    }
+
+    if (rcvd_signal == SIGINT) {
+      break;
+    } else if (rcvd_signal != -1) {
+      DEBUG("Ignoring signal %d while tracing.", rcvd_signal);
+    }
+  }
+
+  stop_trace_consumer();
+  const uint64_t dropped = get_dropped_trace_records();
+  if (dropped > 0) {
+    warnx("%" PRIu64 " samples were dropped from the trace because the output was too slow.", dropped);
+  }
+  close_trace_buffer();
+  if (trace_path != NULL && (close_trace_file() != 0 || trace_file_failed)) {
+    result = 1;
+  }
+
+  if (result == 0) {
+    print_results(num_node, cum_ticks, measurement_start_time, get_last_sample_time());
+  }
+  return result;
+}
+
+/**
+ * Sample the shared accumulator of the daemon for a request of a client.
+ */
+static int sample_for_daemon(uint64_t values[], double *time) {
+  if (get_total_energy_consumed_for_nodes(daemon_num_node, daemon_prev_sample, daemon_cum_ticks) != 0) {
+    return -1;
+  }
+  record_sample_skew();
+  memcpy(values, daemon_cum_ticks, daemon_num_node * sizeof(*daemon_cum_ticks));
+  *time = get_last_sample_time();
+  return 0;
+}
+
+/**
+ * Write the energy of a session in the same format as print_value() with raw-text output.
+ */
+static int format_for_daemon(const uint64_t values[], char *buffer, size_t size) {
+  const int num_node = daemon_num_node;
+  uint64_t ticks[num_node][RAPL_NR_DOMAIN];
+  double energy_J[num_node][RAPL_NR_DOMAIN];
+  memcpy(ticks, values, sizeof(ticks));
+  convert_ticks_to_joules(num_node, ticks, energy_J);
+
+  int length = 0;
+  for (int i = 0; i < num_node; i++) {
+    for (int domain = 0; domain < RAPL_NR_DOMAIN && length < (int)size; ++domain) {
+      if (is_supported_domain(domain)) {
+        length += snprintf(
+            buffer + length,
+            size - length,
+            "cpu%d_%s_joules=%f\n",
+            i,
+            RAPL_DOMAIN_STRINGS[domain],
+            energy_J[i][domain]);
+      }
+    }
+  }
+  return length;
+}
+
+static double get_seconds_until_next_read(double read_interval) {
+  const struct timespec interval = compute_msr_probe_interval_time(read_interval);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  const double remaining = get_last_sample_time() + interval.tv_sec + interval.tv_nsec * 1e-9
+                           - (now.tv_sec + now.tv_nsec * 1e-9);
+  return fmax(remaining, 0);
+}
+
+/**
+ * Serve the clients of the daemon socket until SIGINT is received. All clients share the
+ * accumulator, which is also sampled periodically such that no overflow is missed.
+ */
+static int serve_and_print_results(
+    int num_node,
+    uint64_t prev_sample[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double measurement_start_time) {
+  const sigset_t signal_set = get_sigset();
+  const int signal_fd = signalfd(-1, &signal_set, SFD_CLOEXEC);
+  if (signal_fd < 0) {
+    warn("Could not create signalfd");
+    return 1;
+  }
+  daemon_num_node = num_node;
+  daemon_prev_sample = prev_sample;
+  daemon_cum_ticks = cum_ticks;
+
+  double read_interval = get_maximum_read_interval();
+  double timeout = get_seconds_until_next_read(read_interval);
+  int result = 0;
+  while (true) {
+    const int woken = serve_daemon_requests(signal_fd, timeout);
+    if (woken < 0) {
+      result = 1;
+      break;
+    }
+    if (woken == 0) {
+      // Requests take samples as well, so only read if none was taken within the interval.
+      timeout = get_seconds_until_next_read(read_interval);
+      if (timeout > 0) {
+        continue;
+      }
+      DEBUG("Time limit elapsed, reading values to ensure overflows are detected.%s", "");
+      if (get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_ticks) != 0) {
+        result = 1;
+        break;
+      }
+      record_sample_skew();
+      if (adaptive_interval && !delay) {
+        read_interval = get_adaptive_read_interval(read_interval);
+      }
+      timeout = get_seconds_until_next_read(read_interval);
+      continue;
+    }
+
+    struct signalfd_siginfo info;
+    if (read(signal_fd, &info, sizeof(info)) != sizeof(info)) {
+      continue;
+    }
+    DEBUG("Received signal %u.", info.ssi_signo);
+    align_sample(&end_alignment_error);
+    if (get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_ticks) != 0) {
+      result = 1;
+      break;
+    }
+    record_sample_skew();
+    print_results(num_node, cum_ticks, measurement_start_time, get_last_sample_time());
+    if (info.ssi_signo == SIGINT) {
+      break;
+    }
+  }
+
+  if (get_open_daemon_sessions() > 0) {
+    warnx("Stopping with %d open sessions.", get_open_daemon_sessions());
+  }
+  close(signal_fd);
+  return result;
+}
+
+/**
+ * Start the command and sample until it exits, then take the final sample and print the results.
+ * SIGINT sent by another process (and not by the terminal, which sends it to the command as well)
+ * is forwarded to the command. Returns the exit code of the command.
+ */
+static int run_command_and_print_results(
+    int num_node,
+    uint64_t prev_sample[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double measurement_start_time) {
+  command_result_t command_result;
+  if (start_command() != 0) {
+    return (wait_for_command(1, &command_result) == 1) ? get_command_exit_code(&command_result) : 127;
+  }
+
+  int markers_received = 0;
+  int phases_open = 1;
+  if (open_phases(num_node * RAPL_NR_DOMAIN, "start", measurement_start_time, &cum_ticks[0][0]) != 0) {
+    warnx("Could not allocate phases, ignoring markers.");
+    phases_open = 0;
+  }
+
+  double read_interval = get_maximum_read_interval();
+  const sigset_t signal_set = get_sigset();
+  while (true) {
+    const struct timespec signal_timelimit = compute_msr_probe_interval_time(read_interval);
+    siginfo_t info;
+    const int rcvd_signal = sigtimedwait(&signal_set, &info, &signal_timelimit);
+    if (rcvd_signal == -1 && errno != EAGAIN && errno != EINTR) {
+      warn("Waiting for signal failed.");
+    }
+
+    // Each marker ends a phase with a sample of its own, even if SIGIO was merged for several ones.
+    char label[PHASE_LABEL_SIZE];
+    while (read_command_marker(label, sizeof(label))) {
+      if (!phases_open) {
+        continue;
+      }
+      get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_ticks);
+      record_sample_skew();
+      DEBUG("Command started phase %s.", label);
+      if (mark_phase(label, get_last_sample_time(), &cum_ticks[0][0]) != 0) {
+        DEBUG("Too many different phases, continuing the current one instead of %s.", label);
+      }
+      markers_received = 1;
+    }
+
+    // SIGCHLD may have been merged with an earlier one, so check for the exit in every iteration.
+    const int exited = wait_for_command(0, &command_result);
+    if (exited < 0) {
+      close_phases();
+      return 1;
+    }
+    if (exited) {
+      align_sample(&end_alignment_error);
+    }
+    // A failed sample is reported, but the command needs to be waited for anyway.
+    get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_ticks);
+    record_sample_skew();
+    if (adaptive_interval && !delay) {
+      read_interval = get_adaptive_read_interval(read_interval);
+    }
+
+    if (exited) {
+      break;
+    }
+    if (rcvd_signal == SIGUSR1) {
+      print_results(num_node, cum_ticks, measurement_start_time, get_last_sample_time());
+    } else if (rcvd_signal == SIGINT && info.si_code <= 0) {
+      DEBUG("Forwarding signal %d to command.", rcvd_signal);
+      signal_command(rcvd_signal);
+    }
+  }
+
+  end_phases(get_last_sample_time(), &cum_ticks[0][0]);
+  print_results(num_node, cum_ticks, measurement_start_time, get_last_sample_time());
+  if (markers_received) {
+    print_phase_results(num_node);
+  }
+  print_command_results(&command_result);
+  close_phases();
+  return get_command_exit_code(&command_result);
+}
+
+/**
+ * Measure the energy of all domains from now until the current command exits (if result is not
+ * NULL), or for the given idle duration otherwise. SIGINT is forwarded to the command or ends the
+ * idle duration early, and sets *interrupted.
+ *
+ * Returns 0 on success (result is then filled), -1 otherwise
+ */
+static int measure_bench_interval(
+    int num_node,
+    command_result_t *result,
+    double idle_duration,
+    double energy_J[num_node][RAPL_NR_DOMAIN],
+    double *duration,
+    int *interrupted) {
+  uint64_t prev_sample[num_node][RAPL_NR_DOMAIN];
+  uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN];
+  memset(cum_ticks, 0, sizeof(cum_ticks));
+  *duration = 0;
+
+  align_sample(&start_alignment_error);
+  if (get_total_energy_consumed_for_nodes(num_node, prev_sample, NULL) != 0) {
+    return -1;
+  }
+  const double start_time = get_last_sample_time();
+  if (result != NULL && start_command() != 0) {
+    return (wait_for_command(1, result) == 1) ? 0 : -1;
+  }
+
+  double read_interval = get_maximum_read_interval();
+  const sigset_t signal_set = get_sigset();
+  int done = 0;
+  while (!done) {
+    // The idle interval needs to end in time, also despite the timer slack.
+    const double remaining = fmax(start_time + idle_duration - get_monotonic_time(), 0);
+    struct timespec signal_timelimit = compute_msr_probe_interval_time(
+        (result == NULL) ? fmin(read_interval, remaining) : read_interval);
+    if (result == NULL && remaining < signal_timelimit.tv_sec + signal_timelimit.tv_nsec * 1e-9) {
+      signal_timelimit.tv_sec = (time_t)remaining;
+      signal_timelimit.tv_nsec = (long)((remaining - signal_timelimit.tv_sec) * delay_unit);
+    }
+    siginfo_t info;
+    const int rcvd_signal = sigtimedwait(&signal_set, &info, &signal_timelimit);
+    if (rcvd_signal == -1 && errno != EAGAIN && errno != EINTR) {
+      warn("Waiting for signal failed.");
+    }
+
+    char label[PHASE_LABEL_SIZE];
+    while (read_command_marker(label, sizeof(label))) {
+      // phases are not distinguished in benchmarks
+    }
+    if (result != NULL) {
+      // SIGCHLD may have been merged with an earlier one, so check for the exit in every iteration.
+      done = wait_for_command(0, result);
+      if (done < 0) {
+        return -1;
+      }
+    } else {
+      done = get_monotonic_time() >= start_time + idle_duration;
+    }
+    if (rcvd_signal == SIGINT && info.si_code <= 0) {
+      *interrupted = 1;
+      if (result != NULL) {
+        DEBUG("Forwarding signal %d to command.", rcvd_signal);
+        signal_command(rcvd_signal);
+      } else {
+        done = 1;
+      }
+    }
+
+    if (done) {
+      align_sample(&end_alignment_error);
+    }
+    get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_ticks);
+    record_sample_skew();
+    if (adaptive_interval && !delay) {
+      read_interval = get_adaptive_read_interval(read_interval);
+    }
+  }
+  convert_ticks_to_joules(num_node, cum_ticks, energy_J);
+  *duration = get_last_sample_time() - start_time;
+  return 0;
+}
+
+/**
+ * Run the prepared commands as a benchmark: after the warm-up runs, each run is followed by an
+ * idle interval of the same duration, whose energy is subtracted per domain. The runs stop early
+ * if the requested precision of the total package energy is reached, if a run fails, or on SIGINT.
+ */
+static int bench_and_print_results(int num_node) {
+  run_stats_t duration_stats = {0};
+  run_stats_t package_stats = {0}; // of all nodes together, for stopping early
+  run_stats_t energy_stats[num_node][RAPL_NR_DOMAIN];
+  run_stats_t idle_power_stats[num_node][RAPL_NR_DOMAIN];
+  memset(energy_stats, 0, sizeof(energy_stats));
+  memset(idle_power_stats, 0, sizeof(idle_power_stats));
+
+  int interrupted = 0;
+  int exit_code = 0;
+  for (int run = 0; run < bench_warmup_runs + bench_runs && !interrupted; run++) {
+    double run_energy_J[num_node][RAPL_NR_DOMAIN];
+    double idle_energy_J[num_node][RAPL_NR_DOMAIN];
+    double run_duration, idle_duration;
+    command_result_t command_result;
+    if (measure_bench_interval(
+            num_node, &command_result, 0, run_energy_J, &run_duration, &interrupted)
+        != 0) {
+      exit_code = 1;
+      break;
+    }
+    exit_code = get_command_exit_code(&command_result);
+    if (exit_code != 0) {
+      if (!interrupted) {
+        warnx("Run %d of the command failed with exit code %d.", run + 1, exit_code);
+      }
+      break;
+    }
+    if (interrupted || run < bench_warmup_runs) {
+      continue; // an interrupted run is not representative
+    }
+
+    if (measure_bench_interval(
+            num_node, NULL, run_duration, idle_energy_J, &idle_duration, &interrupted)
+            != 0
+        || idle_duration <= 0) {
+      exit_code = 1;
+      break;
+    }
+    if (interrupted) {
+      break;
+    }
+
+    add_run_value(&duration_stats, run_duration);
+    double package_J = 0;
+    for (int node = 0; node < num_node; node++) {
+      for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+        // scaled to the duration of the run, because the idle interval ends only at a sample
+        const double idle_W = idle_energy_J[node][domain] / idle_duration;
+        const double energy_J = run_energy_J[node][domain] - idle_W * run_duration;
+        add_run_value(&energy_stats[node][domain], energy_J);
+        add_run_value(&idle_power_stats[node][domain], idle_W);
+        if (domain == RAPL_PKG) {
+          package_J += energy_J;
+        }
+      }
+    }
+    add_run_value(&package_stats, package_J);
+    DEBUG(
+        "Run %d took %fs and %fJ in all packages above idle.",
+        duration_stats.count,
+        run_duration,
+        package_J);
+    if (bench_precision > 0 && is_run_precision_reached(&package_stats, bench_precision)) {
+      DEBUG("Precision reached after %d runs.", duration_stats.count);
+      break;
+    }
+  }
+
+  if (duration_stats.count > 0) {
+    print_bench_results(num_node, &duration_stats, energy_stats, idle_power_stats);
+  }
+  return exit_code;
+}
+
+/**
+ * Take all samples of a recording without waiting and print the results.
+ */
+static int replay_and_print_results(
+    int num_node,
+    uint64_t prev_sample[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double measurement_start_time) {
+  int result = 0;
+  while (get_remaining_samples() > 0) {
+    // failed reads are recorded as well, so continue with the remaining samples
+    result |= get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_ticks);
+    record_sample_skew();
+  }
+  print_results(num_node, cum_ticks, measurement_start_time, get_last_sample_time());
+  return result;
+}
+
+static char *append_domain_metric(
+    char *buffer, const char *name, int node, int domain, double value) {
+  buffer = append_string(buffer, name);
+  buffer = append_string(buffer, "{socket=\"");
+  buffer = append_uint(buffer, node);
+  buffer = append_string(buffer, "\",domain=\"");
+  buffer = append_string(buffer, RAPL_DOMAIN_STRINGS[domain]);
+  buffer = append_string(buffer, "\"} ");
+  buffer = append_fixed(buffer, value, 6);
+  return append_string(buffer, "\n");
+}
+
+static char *append_health_metric(
+    char *buffer, const char *name, const char *help, const char *type, uint64_t value) {
+  buffer = append_string(buffer, "# HELP ");
+  buffer = append_string(buffer, name);
+  buffer = append_string(buffer, " ");
+  buffer = append_string(buffer, help);
+  buffer = append_string(buffer, "\n# TYPE ");
+  buffer = append_string(buffer, name);
+  buffer = append_string(buffer, " ");
+  buffer = append_string(buffer, type);
+  buffer = append_string(buffer, "\n");
+  buffer = append_string(buffer, name);
+  buffer = append_string(buffer, " ");
+  buffer = append_uint(buffer, value);
+  return append_string(buffer, "\n");
+}
+
+/**
+ * Render the metrics that scrapes return until the next sample: the energy since the start of the
+ * measurement, the power since the previous sample (if any), and the health of the sampling loop.
+ */
+static void render_metrics(
+    int num_node,
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double previous_energy_J[num_node][RAPL_NR_DOMAIN],
+    double *previous_time) {
+  double energy_J[num_node][RAPL_NR_DOMAIN];
+  convert_ticks_to_joules(num_node, cum_ticks, energy_J);
+  const double time = get_last_sample_time();
+  const double interval = time - *previous_time;
+
+  // two lines per domain (of at most 128 characters) and the comments
+  char text[1024 + num_node * RAPL_NR_DOMAIN * 2 * 128];
+  char *end = text;
+  end = append_string(
+      end,
+      "# HELP cpu_energy_joules_total Energy consumed since the start of the measurement.\n"
+      "# TYPE cpu_energy_joules_total counter\n");
+  for (int i = 0; i < num_node; i++) {
+    for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+      if (is_supported_domain(domain)) {
+        end = append_domain_metric(end, "cpu_energy_joules_total", i, domain, energy_J[i][domain]);
+      }
+    }
+  }
+  if (interval > 0) {
+    end = append_string(
+        end,
+        "# HELP cpu_power_watts Average power between the last two samples.\n"
+        "# TYPE cpu_power_watts gauge\n");
+    for (int i = 0; i < num_node; i++) {
+      for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
+        if (is_supported_domain(domain)) {
+          const double power_W = (energy_J[i][domain] - previous_energy_J[i][domain]) / interval;
+          end = append_domain_metric(end, "cpu_power_watts", i, domain, power_W);
+        }
+      }
+    }
+  }
+  end = append_health_metric(
+      end,
+      "cpu_energy_meter_samples_total",
+      "Samples taken since the start of the measurement.",
+      "counter",
+      metrics_samples);
+  end = append_health_metric(
+      end,
+      "cpu_energy_meter_read_errors_total",
+      "Samples in which reading a counter failed.",
+      "counter",
+      metrics_read_errors);
+  end = append_health_metric(
+      end,
+      "cpu_energy_meter_late_wakeups_total",
+      "Samples that were taken more than 10% of the sampling delay after they were due.",
+      "counter",
+      metrics_late_wakeups);
+
+  memcpy(previous_energy_J, energy_J, sizeof(energy_J));
+  *previous_time = time;
+  if (publish_metrics(text, end - text, time) != 0) {
+    warnx("Could not publish metrics.");
+  }
+}
+
+/**
+ * Take a sample for the metrics exporter and render the metrics. Unlike in the other modes, a
+ * failed read is only counted, such that the exporter keeps running.
+ */
+static void sample_for_metrics(
+    int num_node,
+    uint64_t prev_sample[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double previous_energy_J[num_node][RAPL_NR_DOMAIN],
+    double *previous_time) {
+  if (get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_ticks) != 0) {
+    metrics_read_errors++;
+  }
+  metrics_samples++;
+  record_sample_skew();
+  render_metrics(num_node, cum_ticks, previous_energy_J, previous_time);
+}
+
+/**
+ * Serve the metrics until SIGINT is received. Scrapes only copy the metrics that were rendered for
+ * the most recent sample, and samples are taken with the sampling delay independently of them.
+ */
+static int export_and_print_results(
+    int num_node,
+    uint64_t prev_sample[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double measurement_start_time) {
+  const sigset_t signal_set = get_sigset();
+  const int signal_fd = signalfd(-1, &signal_set, SFD_CLOEXEC);
+  if (signal_fd < 0) {
+    warn("Could not create signalfd");
+    return 1;
+  }
+  double previous_energy_J[num_node][RAPL_NR_DOMAIN];
+  memset(previous_energy_J, 0, sizeof(previous_energy_J));
+  double previous_time = measurement_start_time;
+  const double delay_seconds = (double)delay / delay_unit;
+
+  // the counters were sampled at the start of the measurement already
+  metrics_samples = 1;
+  render_metrics(num_node, cum_ticks, previous_energy_J, &previous_time);
+  int result = 0;
+  while (true) {
+    const double due = get_last_sample_time() + delay_seconds;
+    const int woken = serve_metrics_requests(signal_fd, fmax(due - get_monotonic_time(), 0));
+    if (woken < 0) {
+      result = 1;
+      break;
+    }
+    if (woken == 0) {
+      const double lateness = get_monotonic_time() - due;
+      if (lateness < 0) {
+        continue; // a scrape was answered
+      }
+      if (lateness > LATE_WAKEUP_FRACTION * delay_seconds) {
+        DEBUG("Woke up %.3f ms late for sample.", lateness * 1e3);
+        metrics_late_wakeups++;
+      }
+      sample_for_metrics(num_node, prev_sample, cum_ticks, previous_energy_J, &previous_time);
+      continue;
+    }
+
+    struct signalfd_siginfo info;
+    if (read(signal_fd, &info, sizeof(info)) != sizeof(info)) {
+      continue;
+    }
+    DEBUG("Received signal %u.", info.ssi_signo);
+    align_sample(&end_alignment_error);
+    sample_for_metrics(num_node, prev_sample, cum_ticks, previous_energy_J, &previous_time);
+    print_results(num_node, cum_ticks, measurement_start_time, get_last_sample_time());
+    if (info.ssi_signo == SIGINT) {
+      break;
+    }
+  }
+
+  close(signal_fd);
+  return result;
+}
+
 static int measure_and_print_results() {
   const int num_node = get_num_rapl_nodes();
-  struct timeval measurement_start_time, measurement_end_time;
-  double prev_sample[num_node][RAPL_NR_DOMAIN];
+  double measurement_start_time, measurement_end_time;
+  uint64_t prev_sample[num_node][RAPL_NR_DOMAIN];
 
   // Read initial values
+  align_sample(&start_alignment_error);
   if (get_total_energy_consumed_for_nodes(num_node, prev_sample, NULL) != 0) {
     return 1;
   }
-  gettimeofday(&measurement_start_time, NULL);
+  measurement_start_time = get_last_sample_time();
 
-  double cum_energy_J[num_node][RAPL_NR_DOMAIN];
-  memset(cum_energy_J, 0, sizeof(cum_energy_J));
-  const struct timespec signal_timelimit = compute_msr_probe_interval_time();
+  uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN];
+  memset(cum_ticks, 0, sizeof(cum_ticks));
+  if (get_remaining_samples() >= 0) {
+    return replay_and_print_results(num_node, prev_sample, cum_ticks, measurement_start_time);
+  }
+  if (bench_runs) {
+    return bench_and_print_results(num_node);
+  }
+  if (command != NULL) {
+    return run_command_and_print_results(num_node, prev_sample, cum_ticks, measurement_start_time);
+  }
+  if (trace_interval) {
+    return trace_and_print_results(num_node, prev_sample, cum_ticks, measurement_start_time);
+  }
+  if (daemon_socket != NULL) {
+    return serve_and_print_results(num_node, prev_sample, cum_ticks, measurement_start_time);
+  }
+  if (metrics_address != NULL) {
+    return export_and_print_results(num_node, prev_sample, cum_ticks, measurement_start_time);
+  }
+  double read_interval = get_maximum_read_interval();
   const sigset_t signal_set = get_sigset();
 
   // Actual measurement loop
   while (true) {
     // Wait for signal or timeout
+    const struct timespec signal_timelimit = compute_msr_probe_interval_time(read_interval);
     const int rcvd_signal = sigtimedwait(&signal_set, NULL, &signal_timelimit);
 
     // handle errors
@@ -156,20 +1352,27 @@ static int measure_and_print_results() {
     }
 
     // make sure to read in each iteration, otherwise we might miss overflows
-    if (get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_energy_J) != 0) {
+    if (rcvd_signal != -1) {
+      align_sample(&end_alignment_error);
+    }
+    if (get_total_energy_consumed_for_nodes(num_node, prev_sample, cum_ticks) != 0) {
       return 1;
     }
+    record_sample_skew();
+    if (adaptive_interval && !delay) {
+      read_interval = get_adaptive_read_interval(read_interval);
+    }
 
     // handle signals
     if (rcvd_signal != -1) {
-      gettimeofday(&measurement_end_time, NULL);
+      measurement_end_time = get_last_sample_time();
       DEBUG("Received signal %d.", rcvd_signal);
       if (rcvd_signal == SIGINT) {
-        print_results(num_node, cum_energy_J, measurement_start_time, measurement_end_time);
+        print_results(num_node, cum_ticks, measurement_start_time, measurement_end_time);
         break;
 
       } else if (rcvd_signal == SIGUSR1) {
-        print_results(num_node, cum_energy_J, measurement_start_time, measurement_end_time);
+        print_results(num_node, cum_ticks, measurement_start_time, measurement_end_time);
 
       } else {
         warnx("Received unexpected signal %d", rcvd_signal);
@@ -185,13 +1388,95 @@ static void usage(FILE *target) {
   fprintf(target, "\n");
   fprintf(target, "CPU Energy Meter v%s\n", version);
   fprintf(target, "\n");
-  fprintf(target, "Usage: %s [OPTION]...\n", progname);
+  fprintf(target, "Usage: %s [OPTION]... [--] [COMMAND [ARG]...]\n", progname);
+  fprintf(target, "       %s bench [OPTION]... [--] COMMAND [ARG]...\n", progname);
+  fprintf(target, "Measure until SIGINT is received, or from the start to the exit of COMMAND.\n");
+  fprintf(target, "With bench, measure repeated runs of COMMAND above the idle baseline.\n");
+  fprintf(
+      target, "  %-20s %s\n", "-a", "adapt the sampling delay to the observed power consumption");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-b BACKEND",
+      "read counters through 'msr' (default), 'perf', 'powercap', 'sim[:CONFIG]' "
+      "or 'replay:FILE'");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-c PERCENT",
+      "bench: stop once the 95% confidence interval of the package energy is within PERCENT");
   fprintf(target, "  %-20s %s\n", "-d", "print additional debug information to the output");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-D SOCKET",
+      "serve measurements to clients (cf. cpu-energy-meter-client) on the Unix socket SOCKET");
   fprintf(target, "  %-20s %s\n", "-e MILLISEC", "set the sampling delay in ms");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-g CGROUP",
+      "attribute the energy to the cgroup CGROUP by its CPU time (can be given repeatedly)");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-G DIR",
+      "find cgroups in DIR instead of " CGROUP_FS_ROOT);
   fprintf(target, "  %-20s %s\n", "-h", "show this help text");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-m NAME",
+      "publish the cumulative energy in the shared memory /dev/shm/NAME (cf. rapl-shm.h)");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-M [HOST:]PORT",
+      "serve metrics for Prometheus on http://HOST:PORT/metrics (HOST defaults to 127.0.0.1)");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-o FORMAT",
+      "print the trace of -t as records of each interval in the format 'csv' or 'jsonl'");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-p",
+      "print statistics of the power between samples (every 100 ms unless -e or -t is given)");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-P WATTS",
+      "print the time with a power above WATTS (implies -p, can be given repeatedly)");
+  fprintf(
+      target, "  %-20s %s\n", "-n RUNS", "bench: run the command up to RUNS times (default 10)");
   fprintf(target, "  %-20s %s\n", "-r", "print the output as raw-text");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-s",
+      "start and stop the measurement exactly at updates of the counters (spins up to 10 ms)");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-S MODE",
+      "set the access mode of the socket of -D (octal, default 0660, clients need write access)");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-t MILLISEC[:FILE]",
+      "trace the energy consumption every MILLISEC ms (in binary format to FILE)");
+  fprintf(target, "  %-20s %s\n", "-u", "read the MSRs of all sockets concurrently with io_uring");
+  fprintf(target, "  %-20s %s\n", "-w FILE", "record all raw counter values to FILE");
+  fprintf(
+      target,
+      "  %-20s %s\n",
+      "-W RUNS",
+      "bench: run the command RUNS times before measuring (default 1)");
   fprintf(target, "\n");
   fprintf(target, "Example: %s -r\n", progname);
+  fprintf(target, "         %s -r -- make -j8\n", progname);
+  fprintf(target, "         %s bench -n 30 -c 1 -- ./workload\n", progname);
   fprintf(target, "\n");
 }
 
@@ -199,11 +1484,68 @@ static int read_cmdline(int argc, char **argv) {
   progname = argv[0];
 
   int opt;
-  while ((opt = getopt(argc, argv, "de:hr")) != -1) {
+  int replaying = 0;
+  int bench_option = 0;
+  // "bench" before the options runs the command as a benchmark
+  const int bench = argc > 1 && strcmp(argv[1], "bench") == 0;
+  if (bench) {
+    bench_runs = BENCH_DEFAULT_RUNS;
+    argv[1] = argv[0];
+    argc--;
+    argv++;
+  }
+  // stop at the first non-option, which starts the command
+  while ((opt = getopt(argc, argv, "+ab:c:dD:e:g:G:hm:M:n:o:pP:rsS:t:uw:W:")) != -1) {
     switch (opt) {
+    case 'a':
+      adaptive_interval = 1;
+      break;
+    case 'b': {
+      // the simulated device takes its configuration and replay its recording after a colon
+      char *config = strchr(optarg, ':');
+      if (config != NULL) {
+        *config++ = '\0';
+      }
+      int backend = 0;
+      while (backend < RAPL_NR_BACKEND && strcmp(optarg, RAPL_BACKEND_STRINGS[backend]) != 0) {
+        backend++;
+      }
+      if (backend == RAPL_NR_BACKEND
+          || (config != NULL && backend != RAPL_BACKEND_SIM && backend != RAPL_BACKEND_REPLAY)) {
+        fprintf(stderr, "Unknown backend '%s'.\n", optarg);
+        return -1;
+      }
+      if (backend == RAPL_BACKEND_REPLAY) {
+        if (config == NULL) {
+          fprintf(stderr, "Backend 'replay' needs a recording, e.g., 'replay:FILE'.\n");
+          return -1;
+        }
+        set_replay_file(config);
+      } else if (config != NULL && configure_simulator(config) != 0) {
+        fprintf(stderr, "Invalid configuration of the simulated device.\n");
+        return -1;
+      }
+      set_rapl_backend(backend);
+      replaying = backend == RAPL_BACKEND_REPLAY;
+      break;
+    }
+    case 'c': {
+      char *end;
+      const double percent = strtod(optarg, &end);
+      if (end == optarg || *end != '\0' || !(percent > 0)) {
+        fprintf(stderr, "Invalid precision '%s'.\n", optarg);
+        return -1;
+      }
+      bench_precision = percent / 100;
+      bench_option = 1;
+      break;
+    }
     case 'd':
       enable_debug();
       break;
+    case 'D':
+      daemon_socket = optarg;
+      break;
     case 'e': {
       if (*optarg == '=') {
         // support "-e=100" syntax
@@ -218,21 +1560,158 @@ static int read_cmdline(int argc, char **argv) {
       }
       break;
     }
+    case 'g':
+      if (num_cgroups == MAX_CGROUPS) {
+        fprintf(stderr, "At most %d cgroups can be given.\n", MAX_CGROUPS);
+        return -1;
+      }
+      cgroups[num_cgroups++] = optarg;
+      break;
+    case 'G':
+      cgroup_root = optarg;
+      break;
     case 'h':
       usage(stdout);
       exit(0);
       break;
+    case 'm':
+      shm_name = optarg;
+      break;
+    case 'M':
+      metrics_address = optarg;
+      break;
+    case 'n':
+      bench_runs = atoi(optarg);
+      if (bench_runs < 1) {
+        fprintf(stderr, "The number of runs must be at least 1.\n");
+        return -1;
+      }
+      bench_option = 1;
+      break;
+    case 'o':
+      if (strcmp(optarg, "csv") == 0) {
+        trace_format = TRACE_FORMAT_CSV;
+      } else if (strcmp(optarg, "jsonl") == 0) {
+        trace_format = TRACE_FORMAT_JSONL;
+      } else {
+        fprintf(stderr, "Unknown trace format '%s'.\n", optarg);
+        return -1;
+      }
+      break;
+    case 'p':
+      power_stats = 1;
+      break;
+    case 'P': {
+      char *end;
+      const double threshold_W = strtod(optarg, &end);
+      if (end == optarg || *end != '\0' || !(threshold_W >= 0)) {
+        fprintf(stderr, "Invalid power threshold '%s'.\n", optarg);
+        return -1;
+      }
+      if (num_power_thresholds == MAX_POWER_THRESHOLDS) {
+        fprintf(stderr, "At most %d power thresholds can be given.\n", MAX_POWER_THRESHOLDS);
+        return -1;
+      }
+      power_thresholds_W[num_power_thresholds++] = threshold_W;
+      power_stats = 1;
+      break;
+    }
     case 'r':
       print_rawtext = 1;
       break;
+    case 's':
+      align_samples = 1;
+      break;
+    case 'S': {
+      char *end;
+      const long mode = strtol(optarg, &end, 8);
+      if (end == optarg || *end != '\0' || mode < 0 || mode > 0777) {
+        fprintf(stderr, "Invalid socket mode '%s'.\n", optarg);
+        return -1;
+      }
+      daemon_socket_mode = mode;
+      break;
+    }
+    case 't': {
+      // the binary trace file is given after a colon
+      char *path = strchr(optarg, ':');
+      if (path != NULL) {
+        *path++ = '\0';
+        trace_path = path;
+      }
+      const int trace_ms = atoi(optarg);
+      if (trace_ms >= 1) {
+        trace_interval = (uint64_t)trace_ms * 1000000; // interval in ns
+      } else {
+        fprintf(stderr, "Tracing interval must be at least 1 ms.\n");
+        return -1;
+      }
+      break;
+    }
+    case 'u':
+      enable_io_uring();
+      break;
+    case 'w':
+      set_recording_file(optarg);
+      break;
+    case 'W':
+      bench_warmup_runs = atoi(optarg);
+      if (bench_warmup_runs < 0) {
+        fprintf(stderr, "The number of warm-up runs must not be negative.\n");
+        return -1;
+      }
+      bench_option = 1;
+      break;
     default:
       usage(stderr);
       return -1;
     }
   }
   if (optind < argc) {
-    warnx("no positional argument expected");
-    usage(stderr);
+    command = &argv[optind];
+  }
+  if (bench_option && !bench) {
+    fprintf(stderr, "Parameters -c, -n, and -W are only possible with bench.\n");
+    return -1;
+  }
+  if (bench && command == NULL) {
+    fprintf(stderr, "bench needs a command.\n");
+    return -1;
+  }
+  if (bench && bench_warmup_runs + bench_runs > MAX_PREPARED_COMMANDS) {
+    fprintf(
+        stderr, "At most %d runs including warm-up runs are possible.\n", MAX_PREPARED_COMMANDS);
+    return -1;
+  }
+  if (bench && (num_cgroups > 0 || power_stats)) {
+    fprintf(stderr, "Cgroups and power statistics cannot be measured with bench.\n");
+    return -1;
+  }
+  if (trace_format != TRACE_FORMAT_DEFAULT && (!trace_interval || trace_path != NULL)) {
+    fprintf(stderr, "A trace format needs -t without a file.\n");
+    return -1;
+  }
+  if (daemon_socket != NULL && trace_interval) {
+    fprintf(stderr, "Tracing is not possible in daemon mode.\n");
+    return -1;
+  }
+  if (power_stats && !delay && !trace_interval) {
+    delay = POWER_STATS_DEFAULT_DELAY;
+  }
+  if (metrics_address != NULL && (daemon_socket != NULL || trace_interval || bench)) {
+    fprintf(stderr, "Metrics cannot be served with -D, -t, or bench.\n");
+    return -1;
+  }
+  if (metrics_address != NULL && !delay) {
+    delay = METRICS_DEFAULT_DELAY;
+  }
+  if (num_cgroups > 0 && replaying) {
+    fprintf(stderr, "Cgroups cannot be measured when replaying.\n");
+    return -1;
+  }
+  if (command != NULL
+      && (daemon_socket != NULL || metrics_address != NULL || trace_interval || replaying)) {
+    fprintf(stderr, "Measuring a command is not possible with -D, -M, -t, or when replaying.\n");
     return -1;
   }
   return 0;
@@ -251,6 +1730,17 @@ int main(int argc, char **argv) {
     err(1, "Failed to block signals");
   }
 
+  // Create the processes of the command before opening any registers, such that they cannot inherit
+  // them, and before dropping privileges, such that they run as the caller
+  const int num_runs = bench_runs ? bench_warmup_runs + bench_runs : 1;
+  for (int run = 0; command != NULL && run < num_runs; run++) {
+    if (prepare_command(command) != 0) {
+      cancel_command();
+      sigprocmask(SIG_UNBLOCK, &signal_set, NULL);
+      return 1;
+    }
+  }
+
   // Initialize RAPL
   if (0 != init_rapl()) {
     fprintf(stderr, "Cannot access RAPL!\n");
@@ -258,15 +1748,70 @@ int main(int argc, char **argv) {
     goto out;
   }
 
+  // Create the socket with the privileges of the caller, such that it can be in /run.
+  // The group of the caller may connect, and the daemon keeps owning the socket after dropping
+  // the privileges, such that it can remove it again.
+  if (daemon_socket != NULL) {
+    const uid_t owner = (geteuid() == 0) ? UID_NOBODY : (uid_t)-1;
+    const daemon_source_t source = {
+        .num_values = get_num_rapl_nodes() * RAPL_NR_DOMAIN,
+        .sample = &sample_for_daemon,
+        .format = &format_for_daemon,
+    };
+    if (get_remaining_samples() >= 0) {
+      warnx("Daemon mode is not possible when replaying, ignoring -D.");
+      daemon_socket = NULL;
+    } else if (
+        open_daemon_socket(daemon_socket, daemon_socket_mode, owner, getgid(), &source) != 0) {
+      result = 1;
+      goto out;
+    }
+  }
+  // Likewise, a port below 1024 needs the privileges of the caller
+  if (metrics_address != NULL) {
+    if (get_remaining_samples() >= 0) {
+      warnx("Serving metrics is not possible when replaying, ignoring -M.");
+      metrics_address = NULL;
+    } else if (open_metrics_listener(metrics_address) != 0) {
+      result = 1;
+      goto out;
+    }
+  }
+
   drop_root_privileges_by_id(UID_NOBODY, GID_NOGROUP);
   drop_capabilities();
 
+  // Create the shared memory without privileges, such that it can be removed at the end
+  if (shm_name != NULL && open_shm_export_for_nodes(shm_name) != 0) {
+    result = 1;
+    goto out;
+  }
+  if (num_cgroups > 0
+      && open_cgroup_attribution(cgroup_root, num_cgroups, cgroups, (int)sysconf(_SC_NPROCESSORS_ONLN)) != 0) {
+    result = 1;
+    goto out;
+  }
+
+  if (power_stats
+      && open_power_stats(get_num_rapl_nodes() * RAPL_NR_DOMAIN, num_power_thresholds, power_thresholds_W) != 0) {
+    result = 1;
+    goto out;
+  }
+
+  // Only now start the sampling threads, such that they do not inherit any privileges
+  if (0 != start_parallel_sampling()) {
+    warnx("Could not start sampling threads, reading sockets one after another.");
+  }
+
   // Turn off buffering to ensure intermediate results are not delayed
   setbuf(stdout, NULL);
 
   result = measure_and_print_results();
 
 out:
+  cancel_command(); // if the measurement could not be started
+  close_daemon_socket();
+  close_metrics_listener();
   terminate_rapl();
   sigprocmask(SIG_UNBLOCK, &signal_set, NULL);
   return result;
@@ -0,0 +1,165 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpuenergymeter.h"
+#include "rapl.h"
+#include "simulator.h"
+
+// The public header must not include rapl.h, so check that both agree on the number of domains.
+typedef char cem_domains_match_rapl_domains[(CEM_NR_DOMAINS == RAPL_NR_DOMAIN) ? 1 : -1];
+
+struct cem_context {
+  int num_nodes;
+  double maximum_sample_interval;
+  // The contexts accumulate on their own, such that they do not need to synchronize.
+  uint64_t current_ticks[CEM_MAX_NODES][CEM_NR_DOMAINS];
+  uint64_t cum_ticks[CEM_MAX_NODES][CEM_NR_DOMAINS];
+};
+
+/*
+ * The registers are opened once per process and shared by all contexts. The lock protects opening
+ * and closing them, sampling only reads the sampling plan, which does not change in between.
+ */
+static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
+static int session_contexts = 0;
+static enum RAPL_BACKEND session_backend;
+
+static int parse_backend(const char *name, enum RAPL_BACKEND *backend, const char **config) {
+  if (name == NULL) {
+    name = "msr";
+  }
+  const char *colon = strchr(name, ':');
+  const size_t length = (colon != NULL) ? (size_t)(colon - name) : strlen(name);
+  *config = (colon != NULL) ? colon + 1 : NULL;
+  for (int i = 0; i < RAPL_NR_BACKEND; i++) {
+    if (strlen(RAPL_BACKEND_STRINGS[i]) == length && strncmp(name, RAPL_BACKEND_STRINGS[i], length) == 0) {
+      *backend = i;
+      // replaying is not reentrant, and only the simulated device takes a configuration
+      return (i == RAPL_BACKEND_REPLAY || (*config != NULL && i != RAPL_BACKEND_SIM)) ? -1 : 0;
+    }
+  }
+  return -1;
+}
+
+static int open_session(enum RAPL_BACKEND backend, const char *config) {
+  if (session_contexts > 0) {
+    if (backend != session_backend || config != NULL) {
+      errno = EBUSY;
+      return -1;
+    }
+    return 0;
+  }
+  if (config != NULL && configure_simulator(config) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  set_rapl_backend(backend);
+  if (init_rapl() != 0) {
+    if (errno == 0) {
+      errno = ENODEV;
+    }
+    return -1;
+  }
+  if (get_num_rapl_nodes() > CEM_MAX_NODES) {
+    terminate_rapl();
+    errno = ERANGE;
+    return -1;
+  }
+  session_backend = backend;
+  return 0;
+}
+
+cem_context_t *cem_open(const char *backend_name) {
+  enum RAPL_BACKEND backend;
+  const char *config;
+  if (parse_backend(backend_name, &backend, &config) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  cem_context_t *context = calloc(1, sizeof(*context));
+  if (context == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&session_lock);
+  errno = 0;
+  if (open_session(backend, config) != 0) {
+    pthread_mutex_unlock(&session_lock);
+    free(context);
+    return NULL;
+  }
+  session_contexts++;
+  context->num_nodes = get_num_rapl_nodes();
+  context->maximum_sample_interval = get_maximum_read_interval();
+  pthread_mutex_unlock(&session_lock);
+
+  // The first read only initializes the current values.
+  double time;
+  sample_energy_of_nodes(context->num_nodes, context->current_ticks, NULL, &time);
+  return context;
+}
+
+int cem_get_num_nodes(const cem_context_t *context) {
+  return context->num_nodes;
+}
+
+int cem_is_supported_domain(const cem_context_t *context, enum cem_domain domain) {
+  (void)context;
+  return domain >= 0 && domain < CEM_NR_DOMAINS && is_supported_domain((enum RAPL_DOMAIN)domain);
+}
+
+double cem_get_maximum_sample_interval(const cem_context_t *context) {
+  return context->maximum_sample_interval;
+}
+
+int cem_sample(cem_context_t *context, cem_sample_t *sample) {
+  const int result = sample_energy_of_nodes(
+      context->num_nodes, context->current_ticks, context->cum_ticks, &sample->time);
+  sample->num_nodes = context->num_nodes;
+  memcpy(sample->ticks, context->cum_ticks, sizeof(sample->ticks));
+  return (result == 0) ? 0 : -1;
+}
+
+int cem_delta(
+    const cem_context_t *context,
+    const cem_sample_t *begin,
+    const cem_sample_t *end,
+    cem_energy_t *energy) {
+  if (begin->num_nodes != context->num_nodes || end->num_nodes != context->num_nodes) {
+    return -1;
+  }
+  uint64_t ticks[CEM_MAX_NODES][CEM_NR_DOMAINS];
+  for (int node = 0; node < context->num_nodes; node++) {
+    for (int domain = 0; domain < CEM_NR_DOMAINS; domain++) {
+      ticks[node][domain] = end->ticks[node][domain] - begin->ticks[node][domain];
+    }
+  }
+  memset(energy, 0, sizeof(*energy));
+  energy->seconds = end->time - begin->time;
+  energy->num_nodes = context->num_nodes;
+  convert_ticks_to_joules(context->num_nodes, ticks, energy->joules);
+  return 0;
+}
+
+void cem_close(cem_context_t *context) {
+  if (context == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&session_lock);
+  if (--session_contexts == 0) {
+    terminate_rapl();
+  }
+  pthread_mutex_unlock(&session_lock);
+  free(context);
+}
@@ -0,0 +1,179 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_cpuenergymeter
+#define _h_cpuenergymeter
+
+/*
+ * libcpuenergymeter: measuring the energy consumption of the CPUs from within a program.
+ *
+ *   cem_context_t *context = cem_open(NULL);
+ *   cem_sample_t begin, end;
+ *   cem_sample(context, &begin);
+ *   ... workload ...
+ *   cem_sample(context, &end);
+ *   cem_energy_t energy;
+ *   cem_delta(context, &begin, &end, &energy);
+ *   printf("%f J in %f s\n", energy.joules[0][CEM_DOMAIN_PACKAGE], energy.seconds);
+ *   cem_close(context);
+ *
+ * All contexts of a process share the registers that are opened by the first cem_open(), so the
+ * process needs the same permissions as cpu-energy-meter. Each context keeps its own accumulated
+ * values, and reading them does not take any locks: different threads may use different contexts
+ * in parallel, but a single context must not be used by several threads at the same time.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CEM_MAX_NODES 16 // maximum number of CPU packages
+#define CEM_NR_DOMAINS 5
+
+enum cem_domain {
+  CEM_DOMAIN_PACKAGE = 0,
+  CEM_DOMAIN_CORE = 1,
+  CEM_DOMAIN_UNCORE = 2,
+  CEM_DOMAIN_DRAM = 3,
+  CEM_DOMAIN_PSYS = 4,
+};
+
+// Only the functions of this header are exported from the shared library.
+#pragma GCC visibility push(default)
+
+typedef struct cem_context cem_context_t;
+
+typedef struct {
+  double time; // seconds of CLOCK_MONOTONIC
+  int num_nodes;
+  uint64_t ticks[CEM_MAX_NODES][CEM_NR_DOMAINS]; // counter increments since cem_open()
+} cem_sample_t;
+
+typedef struct {
+  double seconds;
+  int num_nodes;
+  double joules[CEM_MAX_NODES][CEM_NR_DOMAINS]; // 0 for unsupported domains
+} cem_energy_t;
+
+/**
+ * Create a context for measuring with the given backend ("msr", "perf", "powercap", or "sim",
+ * NULL for "msr"). All contexts of a process need to use the same backend.
+ *
+ * @return the new context, or NULL on failure (with errno set)
+ */
+cem_context_t *cem_open(const char *backend);
+
+/**
+ * Get the number of CPU packages that are measured.
+ */
+int cem_get_num_nodes(const cem_context_t *context);
+
+/**
+ * Check whether the given domain is measured.
+ */
+int cem_is_supported_domain(const cem_context_t *context, enum cem_domain domain);
+
+/**
+ * Get the number of seconds after which the counters may wrap around more than once.
+ * cem_sample() needs to be called at least this often to get correct results.
+ */
+double cem_get_maximum_sample_interval(const cem_context_t *context);
+
+/**
+ * Read all counters and store their accumulated values in sample.
+ *
+ * @return 0 on success and -1 if reading one of the counters failed
+ */
+int cem_sample(cem_context_t *context, cem_sample_t *sample);
+
+/**
+ * Compute the energy consumed and the time elapsed between two samples of the same context.
+ *
+ * @return 0 on success and -1 if the samples do not belong to the context
+ */
+int cem_delta(
+    const cem_context_t *context,
+    const cem_sample_t *begin,
+    const cem_sample_t *end,
+    cem_energy_t *energy);
+
+/**
+ * Free the context. The registers are closed together with the last context.
+ */
+void cem_close(cem_context_t *context);
+
+/*
+ * Energy regions: instrumentation of application code that stays compiled into production binaries.
+ *
+ *   void handle_request(...) {
+ *     CEM_REGION_BEGIN("handle_request");
+ *     ...
+ *     CEM_REGION_END();
+ *   }
+ *
+ * Regions can be nested and each thread has its own stack of regions. Entering and leaving a region
+ * only appends a timestamp to a log of the thread, which takes a few nanoseconds. About once per
+ * millisecond, the thread additionally samples the energy counters, and the energy consumed
+ * between two samples is distributed over the events in between by their timestamps. Each thread
+ * aggregates its log into per-region statistics when the log is full and when the thread exits.
+ * At exit of the process, the following statistics are written for each region:
+ * number of calls, inclusive and exclusive time, and inclusive and exclusive joules of each
+ * supported domain (summed over all CPU packages). The energy of a region is the energy that the
+ * CPUs consumed while it was active, including the energy consumed by other threads and processes.
+ *
+ * The following environment variables are read when the first region is entered:
+ *   CEM_BACKEND             backend as for cem_open() (default msr)
+ *   CEM_REGION_INTERVAL_MS  milliseconds between two energy samples of a thread (default 1)
+ *   CEM_REGION_REPORT       file to write the statistics to (default stderr, empty for none)
+ *
+ * If the counters cannot be opened, only the calls and times are measured.
+ * Defining CEM_DISABLE_REGIONS removes the instrumentation at compile time.
+ */
+
+typedef struct {
+  const char *name; // needs to stay valid until the end of the process, e.g., a string literal
+  int id;           // assigned when the region is entered for the first time
+} cem_region_site_t;
+
+#ifdef CEM_DISABLE_REGIONS
+#define CEM_REGION_BEGIN(name) ((void)0)
+#define CEM_REGION_END() ((void)0)
+#else
+#define CEM_REGION_BEGIN(name)                                  \
+  do {                                                          \
+    static cem_region_site_t cem_region_site_ = {(name), 0};    \
+    cem_region_begin(&cem_region_site_);                        \
+  } while (0)
+#define CEM_REGION_END() cem_region_end()
+#endif
+
+/**
+ * Enter the region of the given site, use CEM_REGION_BEGIN() instead.
+ * Sites with the same name belong to the same region.
+ */
+void cem_region_begin(cem_region_site_t *site);
+
+/**
+ * Leave the innermost region of the calling thread that was entered most recently.
+ */
+void cem_region_end(void);
+
+/**
+ * Aggregate the log of the calling thread, such that it is included in the statistics immediately.
+ */
+void cem_region_flush(void);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,345 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for accept4() and ppoll()
+#endif
+
+#include "daemon.h"
+#include "util.h"
+
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_MAX_SESSIONS 256
+#define DAEMON_REQUEST_SIZE 256
+#define DAEMON_REPLY_SIZE 8192
+
+typedef struct {
+  int fd; // -1 if unused
+  size_t length;
+  char request[DAEMON_REQUEST_SIZE];
+} daemon_client_t;
+
+typedef struct {
+  int id; // 0 if unused
+  double start_time;
+  uint64_t *start_values;
+} daemon_session_t;
+
+static int listen_fd = -1;
+static char *socket_path = NULL;
+static daemon_source_t source;
+static daemon_client_t clients[DAEMON_MAX_CLIENTS];
+static daemon_session_t sessions[DAEMON_MAX_SESSIONS];
+static uint64_t *session_values = NULL; // start values of all sessions
+static uint64_t *current_values = NULL;
+static int next_session_id = 1;
+static int open_sessions = 0;
+static int clients_initialized = 0;
+
+/*
+ * Check whether another process is listening on the socket.
+ */
+static int is_socket_in_use(const struct sockaddr_un *address) {
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return 0;
+  }
+  const int in_use = connect(fd, (const struct sockaddr *)address, sizeof(*address)) == 0;
+  close(fd);
+  return in_use;
+}
+
+int open_daemon_socket(
+    const char *path,
+    mode_t mode,
+    uid_t owner,
+    gid_t group,
+    const daemon_source_t *daemon_source) {
+  if (!clients_initialized) {
+    for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+      clients[i].fd = -1;
+    }
+    clients_initialized = 1;
+  }
+
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    warnx("Socket path %s is too long.", path);
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  struct stat status;
+  if (stat(path, &status) == 0) {
+    if (!S_ISSOCK(status.st_mode) || is_socket_in_use(&address)) {
+      warnx("%s is already in use.", path);
+      return -1;
+    }
+    unlink(path); // stale socket of a daemon that did not exit cleanly
+  }
+
+  source = *daemon_source;
+  session_values = calloc((size_t)DAEMON_MAX_SESSIONS * source.num_values, sizeof(uint64_t));
+  current_values = calloc(source.num_values, sizeof(uint64_t));
+  socket_path = strdup(path);
+  if (session_values == NULL || current_values == NULL || socket_path == NULL) {
+    warnx("Could not allocate sessions.");
+    close_daemon_socket();
+    return -1;
+  }
+  for (int i = 0; i < DAEMON_MAX_SESSIONS; i++) {
+    sessions[i].id = 0;
+    sessions[i].start_values = &session_values[(size_t)i * source.num_values];
+  }
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (listen_fd < 0) {
+    warn("Could not create socket");
+    close_daemon_socket();
+    return -1;
+  }
+  // Set the mode already while creating the socket, such that no other client can connect before.
+  const mode_t old_umask = umask(~mode & 0777);
+  const int bound = bind(listen_fd, (const struct sockaddr *)&address, sizeof(address));
+  umask(old_umask);
+  if (bound != 0) {
+    warn("Could not bind socket to %s", path);
+    close(listen_fd);
+    listen_fd = -1; // do not remove a socket that we did not create
+    close_daemon_socket();
+    return -1;
+  }
+  if ((owner != (uid_t)-1 || group != (gid_t)-1) && chown(path, owner, group) != 0) {
+    warn("Could not change owner of %s", path);
+    close_daemon_socket();
+    return -1;
+  }
+  if (listen(listen_fd, SOMAXCONN) != 0) {
+    warn("Could not listen on %s", path);
+    close_daemon_socket();
+    return -1;
+  }
+  DEBUG("Listening on %s.", path);
+  return 0;
+}
+
+static void disconnect_client(daemon_client_t *client) {
+  close(client->fd);
+  client->fd = -1;
+  client->length = 0;
+}
+
+static void accept_client() {
+  const int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+  if (fd < 0) {
+    return; // the client may have given up already
+  }
+  for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+    if (clients[i].fd == -1) {
+      clients[i].fd = fd;
+      clients[i].length = 0;
+      return;
+    }
+  }
+  DEBUG("Rejecting client, already %d clients are connected.", DAEMON_MAX_CLIENTS);
+  close(fd);
+}
+
+static daemon_session_t *find_session(const char *id) {
+  char *end;
+  const long value = (id != NULL) ? strtol(id, &end, 10) : 0;
+  if (id == NULL || *end != '\0' || value <= 0) {
+    return NULL;
+  }
+  for (int i = 0; i < DAEMON_MAX_SESSIONS; i++) {
+    if (sessions[i].id == value) {
+      return &sessions[i];
+    }
+  }
+  return NULL;
+}
+
+static int open_session(char *reply, size_t size) {
+  for (int i = 0; i < DAEMON_MAX_SESSIONS; i++) {
+    daemon_session_t *const session = &sessions[i];
+    if (session->id == 0) {
+      if (source.sample(session->start_values, &session->start_time) != 0) {
+        return snprintf(reply, size, "error sampling failed\n\n");
+      }
+      session->id = next_session_id++;
+      open_sessions++;
+      return snprintf(reply, size, "ok\nsession=%d\n\n", session->id);
+    }
+  }
+  return snprintf(reply, size, "error too many open sessions\n\n");
+}
+
+static int report_session(
+    daemon_session_t *session, const char *label, int close_session, char *reply, size_t size) {
+  double time;
+  if (source.sample(current_values, &time) != 0) {
+    return snprintf(reply, size, "error sampling failed\n\n");
+  }
+  for (int i = 0; i < source.num_values; i++) {
+    current_values[i] -= session->start_values[i];
+  }
+
+  int length = snprintf(reply, size, "ok\nsession=%d\n", session->id);
+  if (label != NULL) {
+    length += snprintf(reply + length, size - length, "label=%s\n", label);
+  }
+  length += snprintf(reply + length, size - length, "duration_seconds=%f\n", time - session->start_time);
+  // the label is shorter than a request, so the reply can only become too long here
+  length += source.format(current_values, reply + length, size - length);
+  if (length < (int)size) {
+    length += snprintf(reply + length, size - length, "\n");
+  }
+
+  if (close_session) {
+    session->id = 0;
+    open_sessions--;
+  }
+  return length;
+}
+
+/*
+ * Answer a single request line and return the length of the reply.
+ */
+static int handle_request(char *request, char *reply, size_t size) {
+  char *rest;
+  const char *command = strtok_r(request, " \t\r", &rest);
+  if (command == NULL) {
+    return snprintf(reply, size, "error empty request\n\n");
+  }
+  if (strcmp(command, "open") == 0) {
+    return open_session(reply, size);
+  }
+  if (strcmp(command, "snapshot") == 0 || strcmp(command, "close") == 0) {
+    daemon_session_t *const session = find_session(strtok_r(NULL, " \t\r", &rest));
+    if (session == NULL) {
+      return snprintf(reply, size, "error unknown session\n\n");
+    }
+    // the label is the rest of the line and may contain spaces
+    const char *label = rest + strspn(rest, " \t");
+    rest[strcspn(rest, "\r")] = '\0';
+    return report_session(session, (*label != '\0') ? label : NULL, command[0] == 'c', reply, size);
+  }
+  return snprintf(reply, size, "error unknown request %s\n\n", command);
+}
+
+static void read_requests(daemon_client_t *client) {
+  const ssize_t received = recv(
+      client->fd, client->request + client->length, sizeof(client->request) - client->length, 0);
+  if (received <= 0) {
+    if (received == 0 || (errno != EAGAIN && errno != EINTR)) {
+      disconnect_client(client);
+    }
+    return;
+  }
+  client->length += received;
+
+  char *line = client->request;
+  char *newline;
+  while ((newline = memchr(line, '\n', client->request + client->length - line)) != NULL) {
+    *newline = '\0';
+    char reply[DAEMON_REPLY_SIZE];
+    int length = handle_request(line, reply, sizeof(reply));
+    if (length >= (int)sizeof(reply)) {
+      length = snprintf(reply, sizeof(reply), "error reply too long\n\n");
+    }
+    // Replies are small, so if the client does not read them, it is not worth waiting for it.
+    if (send(client->fd, reply, length, MSG_NOSIGNAL | MSG_DONTWAIT) != length) {
+      disconnect_client(client);
+      return;
+    }
+    line = newline + 1;
+  }
+
+  client->length -= line - client->request;
+  memmove(client->request, line, client->length);
+  if (client->length == sizeof(client->request)) {
+    disconnect_client(client); // line too long
+  }
+}
+
+int serve_daemon_requests(int wake_fd, double timeout) {
+  struct pollfd fds[2 + DAEMON_MAX_CLIENTS];
+  daemon_client_t *polled_clients[DAEMON_MAX_CLIENTS];
+  int num_fds = 0;
+  fds[num_fds++] = (struct pollfd){.fd = wake_fd, .events = POLLIN};
+  fds[num_fds++] = (struct pollfd){.fd = listen_fd, .events = POLLIN};
+  for (int i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+    if (clients[i].fd != -1) {
+      polled_clients[num_fds - 2] = &clients[i];
+      fds[num_fds++] = (struct pollfd){.fd = clients[i].fd, .events = POLLIN};
+    }
+  }
+
+  const struct timespec limit = {
+      .tv_sec = (time_t)timeout, .tv_nsec = (long)((timeout - (time_t)timeout) * 1e9)};
+  const int ready = ppoll(fds, num_fds, (timeout >= 0) ? &limit : NULL, NULL);
+  if (ready < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    warn("Waiting for clients failed");
+    return -1;
+  }
+
+  for (int i = 2; i < num_fds; i++) {
+    if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+      read_requests(polled_clients[i - 2]);
+    }
+  }
+  if (fds[1].revents & POLLIN) {
+    accept_client();
+  }
+  return (fds[0].revents & POLLIN) ? 1 : 0;
+}
+
+int get_open_daemon_sessions() {
+  return open_sessions;
+}
+
+void close_daemon_socket() {
+  for (int i = 0; clients_initialized && i < DAEMON_MAX_CLIENTS; i++) {
+    if (clients[i].fd != -1) {
+      disconnect_client(&clients[i]);
+    }
+  }
+  if (listen_fd != -1) {
+    close(listen_fd);
+    listen_fd = -1;
+    if (socket_path != NULL && unlink(socket_path) != 0) {
+      DEBUG("Could not remove %s.", socket_path);
+    }
+  }
+  free(socket_path);
+  socket_path = NULL;
+  free(session_values);
+  session_values = NULL;
+  free(current_values);
+  current_values = NULL;
+  for (int i = 0; i < DAEMON_MAX_SESSIONS; i++) {
+    sessions[i].id = 0;
+  }
+  open_sessions = 0;
+  next_session_id = 1;
+}
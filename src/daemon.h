@@ -0,0 +1,71 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_daemon
+#define _h_daemon
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Server for clients that measure through a running cpu-energy-meter over a Unix domain socket.
+ * The daemon owns a single accumulator of all counters, and each measurement of a client is a
+ * session that remembers the values of the accumulator at its start.
+ *
+ * Requests and replies are text lines. Each reply starts with "ok" or "error MESSAGE"
+ * and ends with an empty line. The requests are
+ *
+ *   open                  start a session, the reply contains "session=ID"
+ *   snapshot ID [LABEL]   reply with the energy consumed since the start of the session
+ *   close ID [LABEL]      the same as snapshot, but end the session afterwards
+ *
+ * The reply of snapshot and close consists of "session=ID", "label=LABEL" (if given),
+ * "duration_seconds=SECONDS", and the lines written by daemon_source_t.format().
+ * Sessions are independent of connections, such that a client may open a session in one
+ * connection and close it in another one.
+ */
+
+typedef struct {
+  int num_values; // number of counters in the accumulator
+  // Take a sample (updating the accumulator) and store the values and the time of the sample.
+  int (*sample)(uint64_t values[], double *time);
+  // Write the values of a measurement as "key=value" lines, return the length (cf. snprintf()).
+  int (*format)(const uint64_t values[], char *buffer, size_t size);
+} daemon_source_t;
+
+/**
+ * Create the socket at the given path (replacing a stale one) and listen for clients.
+ * Clients need write access to connect, so mode and the owner (as for chown(), -1 keeps the
+ * owner or group of the caller) determine who may connect. The daemon needs to own the socket
+ * to remove it from a directory with the sticky bit (like /tmp) after dropping its privileges.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_daemon_socket(
+    const char *path, mode_t mode, uid_t owner, gid_t group, const daemon_source_t *source);
+
+/**
+ * Wait up to timeout seconds for requests, accept new clients and answer all complete requests.
+ * Returns early if wake_fd (e.g., a signalfd) becomes readable.
+ *
+ * @return 1 if wake_fd is readable, 0 otherwise, and -1 on failure
+ */
+int serve_daemon_requests(int wake_fd, double timeout);
+
+/**
+ * Get the number of sessions that are currently open.
+ */
+int get_open_daemon_sessions();
+
+/**
+ * Disconnect all clients, close and remove the socket, and end all sessions.
+ */
+void close_daemon_socket();
+
+#endif
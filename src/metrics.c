@@ -0,0 +1,360 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for accept4() and ppoll()
+#endif
+
+#include "metrics.h"
+#include "util.h"
+
+#include <err.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define METRICS_MAX_CLIENTS 16
+#define METRICS_REQUEST_SIZE 1024
+#define METRICS_HEADER_SIZE 256
+#define METRICS_AGE_SIZE 256
+#define METRICS_DEFAULT_HOST "127.0.0.1"
+#define METRICS_DEFAULT_CLIENT_TIMEOUT 10.0 // seconds for sending the request and receiving the reply
+
+typedef struct {
+  int fd; // -1 if unused
+  size_t length; // of the received request, or of the reply once it is sent
+  size_t sent;
+  char *reply; // NULL while receiving the request
+  double deadline; // in seconds of CLOCK_MONOTONIC, the client is dropped afterwards
+  char request[METRICS_REQUEST_SIZE];
+} metrics_client_t;
+
+static int listen_fd = -1;
+static metrics_client_t clients[METRICS_MAX_CLIENTS];
+static int clients_initialized = 0;
+static char *metrics = NULL; // published text, or NULL before the first sample
+static size_t metrics_length = 0;
+static size_t metrics_capacity = 0;
+static double metrics_sample_time = 0;
+static double client_timeout = METRICS_DEFAULT_CLIENT_TIMEOUT;
+
+/*
+ * Split "[HOST:]PORT" into host and port, where an IPv6 host is enclosed in brackets.
+ */
+static int parse_address(const char *address, char *host, size_t size, const char **port) {
+  const char *colon = strrchr(address, ':');
+  if (colon == NULL) {
+    snprintf(host, size, "%s", METRICS_DEFAULT_HOST);
+    *port = address;
+    return 0;
+  }
+  const char *begin = address;
+  const char *end = colon;
+  if (*begin == '[') {
+    if (end == begin || end[-1] != ']') {
+      return -1;
+    }
+    begin++;
+    end--;
+  }
+  if (end == begin) {
+    snprintf(host, size, "%s", METRICS_DEFAULT_HOST);
+  } else if ((size_t)(end - begin) < size) {
+    memcpy(host, begin, end - begin);
+    host[end - begin] = '\0';
+  } else {
+    return -1;
+  }
+  *port = colon + 1;
+  return 0;
+}
+
+int open_metrics_listener(const char *address) {
+  if (!clients_initialized) {
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+      clients[i].fd = -1;
+      clients[i].reply = NULL;
+    }
+    clients_initialized = 1;
+  }
+
+  char host[NI_MAXHOST];
+  const char *port;
+  if (parse_address(address, host, sizeof(host), &port) != 0 || *port == '\0') {
+    warnx("Invalid address %s, expected [HOST:]PORT.", address);
+    return -1;
+  }
+  const struct addrinfo hints = {
+      .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_NUMERICSERV};
+  struct addrinfo *addresses;
+  const int error = getaddrinfo(host, port, &hints, &addresses);
+  if (error != 0) {
+    warnx("Could not resolve %s: %s", address, gai_strerror(error));
+    return -1;
+  }
+
+  int saved_errno = 0;
+  for (const struct addrinfo *info = addresses; info != NULL; info = info->ai_next) {
+    const int fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+      saved_errno = errno;
+      continue;
+    }
+    const int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, info->ai_addr, info->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) {
+      listen_fd = fd;
+      break;
+    }
+    saved_errno = errno;
+    close(fd);
+  }
+  freeaddrinfo(addresses);
+  if (listen_fd < 0) {
+    errno = saved_errno;
+    warn("Could not listen on %s", address);
+    return -1;
+  }
+  DEBUG("Serving metrics on port %d.", get_metrics_port());
+  return 0;
+}
+
+int get_metrics_port() {
+  struct sockaddr_storage address;
+  socklen_t length = sizeof(address);
+  if (listen_fd < 0 || getsockname(listen_fd, (struct sockaddr *)&address, &length) != 0) {
+    return -1;
+  }
+  if (address.ss_family == AF_INET6) {
+    return ntohs(((const struct sockaddr_in6 *)&address)->sin6_port);
+  }
+  return ntohs(((const struct sockaddr_in *)&address)->sin_port);
+}
+
+void set_metrics_client_timeout(double seconds) {
+  client_timeout = seconds;
+}
+
+int publish_metrics(const char *text, size_t length, double sample_time) {
+  if (length > metrics_capacity) {
+    char *const buffer = realloc(metrics, length);
+    if (buffer == NULL) {
+      return -1;
+    }
+    metrics = buffer;
+    metrics_capacity = length;
+  }
+  memcpy(metrics, text, length);
+  metrics_length = length;
+  metrics_sample_time = sample_time;
+  return 0;
+}
+
+static void disconnect_client(metrics_client_t *client) {
+  close(client->fd);
+  free(client->reply);
+  client->fd = -1;
+  client->reply = NULL;
+  client->length = 0;
+}
+
+static void accept_client() {
+  const int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+  if (fd < 0) {
+    return; // the client may have given up already
+  }
+  for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+    if (clients[i].fd == -1) {
+      clients[i].fd = fd;
+      clients[i].length = 0;
+      clients[i].deadline = get_monotonic_time() + client_timeout;
+      return;
+    }
+  }
+  DEBUG("Rejecting client, already %d clients are connected.", METRICS_MAX_CLIENTS);
+  close(fd);
+}
+
+/*
+ * Build the reply of a client from its request line. Only the published metrics are copied.
+ */
+static int prepare_reply(metrics_client_t *client) {
+  const char *status = "200 OK";
+  const char *body = NULL;
+  char message[METRICS_AGE_SIZE];
+  size_t body_length = 0;
+  int age_length = 0;
+
+  char *rest;
+  const char *method = strtok_r(client->request, " ", &rest);
+  const char *target = strtok_r(NULL, " \r\n", &rest);
+  const int head = method != NULL && strcmp(method, "HEAD") == 0;
+  if (method == NULL || target == NULL) {
+    status = "400 Bad Request";
+  } else if (strcmp(method, "GET") != 0 && !head) {
+    status = "405 Method Not Allowed";
+  } else if (strcmp(target, "/metrics") != 0 && strncmp(target, "/metrics?", 9) != 0) {
+    status = "404 Not Found";
+  } else if (metrics == NULL) {
+    status = "503 Service Unavailable";
+  } else {
+    body = metrics;
+    body_length = metrics_length;
+    age_length = snprintf(
+        message,
+        sizeof(message),
+        "# HELP cpu_energy_meter_last_sample_age_seconds Time since the last sample was taken.\n"
+        "# TYPE cpu_energy_meter_last_sample_age_seconds gauge\n"
+        "cpu_energy_meter_last_sample_age_seconds %.6f\n",
+        get_monotonic_time() - metrics_sample_time);
+  }
+  if (body == NULL) {
+    age_length = snprintf(message, sizeof(message), "%s\n", status);
+  }
+
+  char header[METRICS_HEADER_SIZE];
+  const int header_length = snprintf(
+      header,
+      sizeof(header),
+      "HTTP/1.0 %s\r\n"
+      "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+      "Content-Length: %zu\r\n"
+      "Connection: close\r\n"
+      "\r\n",
+      status,
+      body_length + age_length);
+  const size_t length = header_length + (head ? 0 : body_length + age_length);
+  client->reply = malloc(length);
+  if (client->reply == NULL) {
+    return -1;
+  }
+  memcpy(client->reply, header, header_length);
+  if (!head) {
+    if (body != NULL) {
+      memcpy(client->reply + header_length, body, body_length);
+    }
+    memcpy(client->reply + header_length + body_length, message, age_length);
+  }
+  client->length = length;
+  client->sent = 0;
+  return 0;
+}
+
+static void read_request(metrics_client_t *client) {
+  // leave room for terminating the request
+  const ssize_t received = recv(
+      client->fd,
+      client->request + client->length,
+      sizeof(client->request) - 1 - client->length,
+      0);
+  if (received <= 0) {
+    if (received == 0 || (errno != EAGAIN && errno != EINTR)) {
+      disconnect_client(client);
+    }
+    return;
+  }
+  client->length += received;
+  client->request[client->length] = '\0';
+
+  // the headers are irrelevant, but the reply must not be sent before the client finished them
+  if (strstr(client->request, "\r\n\r\n") == NULL && strstr(client->request, "\n\n") == NULL) {
+    if (client->length == sizeof(client->request) - 1) {
+      disconnect_client(client); // request too long
+    }
+    return;
+  }
+  if (prepare_reply(client) != 0) {
+    disconnect_client(client);
+  }
+}
+
+static void write_reply(metrics_client_t *client) {
+  const ssize_t sent = send(
+      client->fd, client->reply + client->sent, client->length - client->sent, MSG_NOSIGNAL);
+  if (sent < 0) {
+    if (errno != EAGAIN && errno != EINTR) {
+      disconnect_client(client);
+    }
+    return;
+  }
+  client->sent += sent;
+  if (client->sent == client->length) {
+    disconnect_client(client);
+  }
+}
+
+int serve_metrics_requests(int wake_fd, double timeout) {
+  struct pollfd fds[2 + METRICS_MAX_CLIENTS];
+  metrics_client_t *polled_clients[METRICS_MAX_CLIENTS];
+  int num_fds = 0;
+  fds[num_fds++] = (struct pollfd){.fd = wake_fd, .events = POLLIN};
+  fds[num_fds++] = (struct pollfd){.fd = listen_fd, .events = POLLIN};
+  // Clients that do not finish in time are dropped, such that they cannot occupy all slots.
+  const double now = get_monotonic_time();
+  for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+    if (clients[i].fd != -1 && now >= clients[i].deadline) {
+      DEBUG("Dropping client after %g seconds.", client_timeout);
+      disconnect_client(&clients[i]);
+    }
+    if (clients[i].fd != -1) {
+      if (timeout < 0 || clients[i].deadline - now < timeout) {
+        timeout = clients[i].deadline - now;
+      }
+      polled_clients[num_fds - 2] = &clients[i];
+      const short events = (clients[i].reply != NULL) ? POLLOUT : POLLIN;
+      fds[num_fds++] = (struct pollfd){.fd = clients[i].fd, .events = events};
+    }
+  }
+
+  const struct timespec limit = {
+      .tv_sec = (time_t)timeout, .tv_nsec = (long)((timeout - (time_t)timeout) * 1e9)};
+  const int ready = ppoll(fds, num_fds, (timeout >= 0) ? &limit : NULL, NULL);
+  if (ready < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    warn("Waiting for clients failed");
+    return -1;
+  }
+
+  for (int i = 2; i < num_fds; i++) {
+    metrics_client_t *const client = polled_clients[i - 2];
+    if (client->reply != NULL && (fds[i].revents & (POLLOUT | POLLHUP | POLLERR))) {
+      write_reply(client);
+    } else if (client->reply == NULL && (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+      read_request(client);
+    }
+  }
+  if (fds[1].revents & POLLIN) {
+    accept_client();
+  }
+  return (fds[0].revents & POLLIN) ? 1 : 0;
+}
+
+void close_metrics_listener() {
+  for (int i = 0; clients_initialized && i < METRICS_MAX_CLIENTS; i++) {
+    if (clients[i].fd != -1) {
+      disconnect_client(&clients[i]);
+    }
+  }
+  if (listen_fd != -1) {
+    close(listen_fd);
+    listen_fd = -1;
+  }
+  free(metrics);
+  metrics = NULL;
+  metrics_length = 0;
+  metrics_capacity = 0;
+}
@@ -0,0 +1,60 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_metrics
+#define _h_metrics
+
+#include <stddef.h>
+
+/*
+ * A minimal HTTP listener that serves metrics in the text format of Prometheus on /metrics.
+ * The metrics are rendered by the sampling loop and published with publish_metrics(), so
+ * answering a scrape only copies the published text and never reads any counters.
+ */
+
+/**
+ * Listen on the TCP address "[HOST:]PORT", where HOST defaults to 127.0.0.1 and an IPv6 address
+ * has to be enclosed in brackets. Until metrics are published, scrapes are answered with 503.
+ *
+ * Returns 0 on success, -1 otherwise
+ */
+int open_metrics_listener(const char *address);
+
+/**
+ * Get the port on which the listener accepts connections, or -1 if it is not open.
+ */
+int get_metrics_port();
+
+/**
+ * Set the time after which a client is disconnected, even if it did not finish its request or
+ * has not received the whole reply yet (default 10 seconds).
+ */
+void set_metrics_client_timeout(double seconds);
+
+/**
+ * Replace the published metrics by the given text, which was rendered for the sample taken at
+ * sample_time (in seconds of CLOCK_MONOTONIC). Scrapes append the age of this sample to the text.
+ *
+ * Returns 0 on success, -1 otherwise (the previous metrics are kept)
+ */
+int publish_metrics(const char *text, size_t length, double sample_time);
+
+/**
+ * Accept connections and answer scrapes until wake_fd becomes readable or timeout seconds
+ * have elapsed (a negative timeout waits indefinitely). Other signals interrupt waiting as well.
+ *
+ * Returns 1 if wake_fd is readable, 0 if not, or -1 if waiting failed.
+ */
+int serve_metrics_requests(int wake_fd, double timeout);
+
+/**
+ * Disconnect all clients, close the listener and free the published metrics.
+ */
+void close_metrics_listener();
+
+#endif
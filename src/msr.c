@@ -15,6 +15,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 static int *fds;
@@ -31,12 +32,20 @@ int open_msr_fd(int num_nodes, int (*pkg_map)(int)) {
   for (int node = 0; node < fds_size; node++) {
     char msr_path[32];
     sprintf(msr_path, "/dev/cpu/%u/msr", pkg_map(node));
-    DEBUG("Using %s for accessing MSR of socket %d.", msr_path, node);
     int fd = open(msr_path, O_RDONLY);
     if (fd == -1) {
-      warn("Could not open %s", msr_path);
-      result = -1;
+      // the msr-safe driver provides the same interface for allowlisted MSRs
+      char msr_safe_path[32];
+      sprintf(msr_safe_path, "/dev/cpu/%u/msr_safe", pkg_map(node));
+      fd = open(msr_safe_path, O_RDONLY);
+      if (fd == -1) {
+        warn("Could not open %s", msr_path);
+        result = -1;
+      } else {
+        strcpy(msr_path, msr_safe_path);
+      }
     }
+    DEBUG("Using %s for accessing MSR of socket %d.", msr_path, node);
 
     fds[node] = fd;
   }
@@ -44,28 +53,30 @@ int open_msr_fd(int num_nodes, int (*pkg_map)(int)) {
   return result;
 }
 
-int read_msr(int node, off_t address, uint64_t *value) {
+int get_msr_fd(int node) {
   assert(node < fds_size);
+  return fds[node];
+}
 
-  int fd = fds[node];
+int read_msr_fd(int fd, off_t address, uint64_t *value) {
   if (fd == -1) {
     return -1; // had failed to open
   }
 
-  if (lseek(fd, address, SEEK_SET) < 0) {
-    warn("Could not seek to address 0x%lX for reading from MSR for CPU %u", address, node);
-    return -1;
-  }
-
-  if (read(fd, value, sizeof(uint64_t)) != sizeof(uint64_t)) {
+  // pread() saves the extra lseek() syscall per register
+  if (pread(fd, value, sizeof(uint64_t), address) != sizeof(uint64_t)) {
     // expected if hardware does not support this domain
-    // warn("Could not read from address 0x%lX of MSR for CPU %u", address, node);
+    // warn("Could not read from address 0x%lX of MSR with fd %d", address, fd);
     return -1;
   }
 
   return 0;
 }
 
+int read_msr(int node, off_t address, uint64_t *value) {
+  return read_msr_fd(get_msr_fd(node), address, value);
+}
+
 void close_msr_fd() {
   if (fds == NULL) {
     return;
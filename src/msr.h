@@ -35,6 +35,20 @@ int open_msr_fd(int num_nodes, int (*node_to_core)(int));
  */
 int read_msr(int node, off_t address, uint64_t *val);
 
+/**
+ * Get the file descriptor that is used for accessing the MSRs of the given node.
+ *
+ * @return the file descriptor, or -1 if it could not be opened
+ */
+int get_msr_fd(int node);
+
+/**
+ * Read the given MSR from an already opened MSR device file with a single pread().
+ *
+ * @return 0 on success and -1 on failure
+ */
+int read_msr_fd(int fd, off_t address, uint64_t *val);
+
 /**
  * Close each file descriptor and free the allocated array memory.
  */
@@ -0,0 +1,128 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "msrsafe.h"
+#include "util.h"
+
+#include <assert.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int batch_fd = -1;
+static int batch_is_file = 0; // whether batch_fd is a regular file that stands in for the device
+static struct msr_batch_array batch = {0, NULL};
+
+int open_msr_batch(const char *path) {
+  assert(batch_fd == -1);
+
+  int fd = open(path, O_RDWR);
+  if (fd == -1) {
+    DEBUG("Could not open %s, not using batch reads.", path);
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    warn("Could not stat %s", path);
+    close(fd);
+    return -1;
+  }
+
+  batch_fd = fd;
+  batch_is_file = S_ISREG(st.st_mode);
+  DEBUG("Using %s%s for batch reads of MSRs.", path, batch_is_file ? " (regular file)" : "");
+  return 0;
+}
+
+int is_msr_batch_open() {
+  return batch_fd != -1;
+}
+
+int prepare_msr_batch(int numops, const int cpus[], const off_t msrs[]) {
+  assert(batch.ops == NULL);
+
+  batch.ops = calloc(numops > 0 ? numops : 1, sizeof(struct msr_batch_op));
+  if (batch.ops == NULL) {
+    warn("Could not allocate batch of MSR reads");
+    return -1;
+  }
+  batch.numops = numops;
+
+  for (int i = 0; i < numops; i++) {
+    batch.ops[i].cpu = cpus[i];
+    batch.ops[i].isrdmsr = 1;
+    batch.ops[i].msr = msrs[i];
+  }
+  return 0;
+}
+
+/*
+ * Emulate the batch ioctl on a regular file.
+ */
+static int read_msr_batch_from_file() {
+  for (uint32_t i = 0; i < batch.numops; i++) {
+    struct msr_batch_op *op = &batch.ops[i];
+    const off_t offset = MSR_BATCH_FILE_OFFSET(op->cpu, op->msr);
+    op->err = (pread(batch_fd, &op->msrdata, sizeof(uint64_t), offset) != sizeof(uint64_t));
+  }
+  return 0;
+}
+
+int read_msr_batch(uint64_t values[], unsigned char failed[]) {
+  assert(batch_fd != -1);
+
+  // Mark all operations as failed, in case the driver rejects the batch without executing it
+  for (uint32_t i = 0; i < batch.numops; i++) {
+    batch.ops[i].err = -1;
+  }
+
+  const int result = batch_is_file ? read_msr_batch_from_file()
+                                   : ioctl(batch_fd, X86_IOC_MSR_BATCH, &batch);
+  if (result != 0) {
+    // The driver reports a failure of single operations also for the whole batch,
+    // so we still look at the individual results below.
+    DEBUG("Batch read of %u MSRs reported an error.", batch.numops);
+  }
+
+  int all_failed = 1;
+  for (uint32_t i = 0; i < batch.numops; i++) {
+    failed[i] = batch.ops[i].err != 0;
+    values[i] = batch.ops[i].msrdata;
+    all_failed &= failed[i];
+  }
+  return (batch.numops > 0 && all_failed) ? -1 : 0;
+}
+
+int check_msr_batch() {
+  const int numops = (int)batch.numops;
+  uint64_t values[numops > 0 ? numops : 1];
+  unsigned char failed[numops > 0 ? numops : 1];
+  if (read_msr_batch(values, failed) != 0) {
+    return -1;
+  }
+  for (int i = 0; i < numops; i++) {
+    if (failed[i]) {
+      DEBUG("Batch read of MSR 0x%x on CPU %u failed.", batch.ops[i].msr, batch.ops[i].cpu);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void close_msr_batch() {
+  if (batch_fd != -1) {
+    close(batch_fd);
+    batch_fd = -1;
+  }
+  free(batch.ops);
+  batch.ops = NULL;
+  batch.numops = 0;
+}
@@ -0,0 +1,89 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_msrsafe
+#define _h_msrsafe
+
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+
+/*
+ * Access to MSRs through the batch interface of the msr-safe driver
+ * (https://github.com/LLNL/msr-safe), which executes an arbitrary number of MSR reads on
+ * arbitrary CPUs with a single ioctl. The MSRs need to be listed in the allowlist of msr-safe
+ * (cf. debian/additional_files/msr-safe-allowlist).
+ *
+ * Instead of the device, a regular file can be used (e.g., for testing). In this case, the value
+ * of an MSR is read from the offset given by MSR_BATCH_FILE_OFFSET.
+ */
+
+#define MSR_BATCH_DEVICE "/dev/cpu/msr_batch"
+
+/* Byte offset of the value of an MSR in a regular file that stands in for the batch device */
+#define MSR_BATCH_FILE_OFFSET(cpu, msr) (((((off_t)(cpu)) << 16) | (msr)) * (off_t)sizeof(uint64_t))
+
+/* Data structures of the msr-safe batch interface (cf. msr_batch.h of msr-safe) */
+struct msr_batch_op {
+  uint16_t cpu;     // in: CPU to execute the operation on
+  uint16_t isrdmsr; // in: non-zero for reading
+  int32_t err;      // out: set if an error occurred for this operation
+  uint32_t msr;     // in: MSR address
+  uint64_t msrdata; // out: value of the MSR
+  uint64_t wmask;   // out: write mask (unused for reads)
+};
+
+struct msr_batch_array {
+  uint32_t numops;
+  struct msr_batch_op *ops;
+};
+
+#define X86_IOC_MSR_BATCH _IOWR('c', 0xA2, struct msr_batch_array)
+
+/**
+ * Open the batch device (or a file that stands in for it).
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_msr_batch(const char *path);
+
+/**
+ * Check whether the batch device is open.
+ */
+int is_msr_batch_open();
+
+/**
+ * Prepare the batch that is executed by read_msr_batch(),
+ * which consists of one read of msrs[i] on cpus[i] for each i < numops.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int prepare_msr_batch(int numops, const int cpus[], const off_t msrs[]);
+
+/**
+ * Execute all reads of the prepared batch with a single ioctl.
+ * Stores the result of read i in values[i] and whether it failed in failed[i].
+ *
+ * @return 0 on success and -1 if the whole batch failed
+ */
+int read_msr_batch(uint64_t values[], unsigned char failed[]);
+
+/**
+ * Execute the prepared batch once and check that every read succeeds. The driver rejects reads of
+ * MSRs that are missing from its allowlist, in which case the batch should not be used.
+ *
+ * @return 0 if all reads succeeded and -1 otherwise
+ */
+int check_msr_batch();
+
+/**
+ * Close the batch device and free the prepared batch.
+ */
+void close_msr_batch();
+
+#endif
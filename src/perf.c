@@ -0,0 +1,226 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "perf.h"
+#include "util.h"
+
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define POWER_PMU_PATH "bus/event_source/devices/power"
+
+const char *const PERF_EVENT_NAMES[RAPL_NR_DOMAIN] = {
+    "energy-pkg", "energy-cores", "energy-gpu", "energy-ram", "energy-psys"};
+
+static int *fds; // fds[node * RAPL_NR_DOMAIN + domain], -1 if not opened
+static int fds_nodes = 0;
+
+int parse_perf_event_config(const char *event, uint64_t *config) {
+  // The power PMU only defines the term "event" (format "config:0-7").
+  const char *prefix = "event=";
+  if (strncmp(event, prefix, strlen(prefix)) != 0) {
+    return -1;
+  }
+  const char *value = event + strlen(prefix);
+  char *end;
+  errno = 0;
+  const unsigned long long parsed = strtoull(value, &end, 0);
+  if (errno != 0 || end == value || *end != '\0') {
+    return -1;
+  }
+  *config = parsed;
+  return 0;
+}
+
+int parse_perf_event_scale(const char *scale, const char *unit, double *joules_per_count) {
+  if (strcmp(unit, "Joules") != 0) {
+    return -1;
+  }
+  char *end;
+  errno = 0;
+  const double parsed = strtod(scale, &end);
+  if (errno != 0 || end == scale || *end != '\0' || parsed <= 0) {
+    return -1;
+  }
+  *joules_per_count = parsed;
+  return 0;
+}
+
+static int read_perf_event(
+    const char *sysfs_root, const char *name, uint64_t *config, double *joules_per_count) {
+  char path[PATH_MAX];
+  char event[64];
+  char scale[64];
+  char unit[64];
+
+  snprintf(path, sizeof(path), "%s/" POWER_PMU_PATH "/events/%s", sysfs_root, name);
+  if (read_sysfs_file(path, event, sizeof(event)) != 0) {
+    return -1; // event does not exist, i.e., domain is not supported
+  }
+  snprintf(path, sizeof(path), "%s/" POWER_PMU_PATH "/events/%s.scale", sysfs_root, name);
+  if (read_sysfs_file(path, scale, sizeof(scale)) != 0) {
+    return -1;
+  }
+  snprintf(path, sizeof(path), "%s/" POWER_PMU_PATH "/events/%s.unit", sysfs_root, name);
+  if (read_sysfs_file(path, unit, sizeof(unit)) != 0) {
+    return -1;
+  }
+
+  if (parse_perf_event_config(event, config) != 0) {
+    warnx("Unexpected content '%s' of event %s.", event, name);
+    return -1;
+  }
+  if (parse_perf_event_scale(scale, unit, joules_per_count) != 0) {
+    warnx("Unexpected scale '%s' or unit '%s' of event %s.", scale, unit, name);
+    return -1;
+  }
+  return 0;
+}
+
+int read_perf_power_pmu(const char *sysfs_root, perf_power_pmu_t *pmu) {
+  char path[PATH_MAX];
+  char type[32];
+
+  memset(pmu, 0, sizeof(*pmu));
+  snprintf(path, sizeof(path), "%s/" POWER_PMU_PATH "/type", sysfs_root);
+  if (read_sysfs_file(path, type, sizeof(type)) != 0) {
+    warnx("The power PMU is not available (%s is missing).", path);
+    return -1;
+  }
+  pmu->type = strtoul(type, NULL, 10);
+
+  int num_supported = 0;
+  for (int domain = 0; domain < RAPL_NR_DOMAIN; domain++) {
+    const char *name = PERF_EVENT_NAMES[domain];
+    pmu->supported[domain] =
+        read_perf_event(sysfs_root, name, &pmu->config[domain], &pmu->scale[domain]) == 0;
+    if (pmu->supported[domain]) {
+      num_supported++;
+      DEBUG(
+          "Event %s has config 0x%" PRIx64 " and scale %eJ.",
+          PERF_EVENT_NAMES[domain],
+          pmu->config[domain],
+          pmu->scale[domain]);
+    }
+  }
+
+  return num_supported > 0 ? 0 : -1;
+}
+
+static int perf_event_open(struct perf_event_attr *attr, int cpu, int group_fd) {
+  return syscall(__NR_perf_event_open, attr, -1, cpu, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+int open_perf_fds(int num_nodes, int (*node_to_cpu)(int), const perf_power_pmu_t *pmu) {
+  assert(fds == NULL);
+  int result = 0;
+
+  fds = malloc(num_nodes * RAPL_NR_DOMAIN * sizeof(int));
+  if (fds == NULL) {
+    warnx("Could not allocate perf events.");
+    return -1;
+  }
+  fds_nodes = num_nodes;
+  for (int i = 0; i < num_nodes * RAPL_NR_DOMAIN; i++) {
+    fds[i] = -1;
+  }
+
+  for (int node = 0; node < num_nodes; node++) {
+    const int cpu = node_to_cpu(node);
+    int group_fd = -1;
+    for (int domain = 0; domain < RAPL_NR_DOMAIN; domain++) {
+      if (!pmu->supported[domain]) {
+        continue;
+      }
+
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = pmu->type;
+      attr.config = pmu->config[domain];
+      attr.read_format = PERF_FORMAT_GROUP;
+
+      const int fd = perf_event_open(&attr, cpu, group_fd);
+      if (fd == -1) {
+        warn("Could not open perf event %s on CPU %d", PERF_EVENT_NAMES[domain], cpu);
+        result = -1;
+        continue;
+      }
+      if (group_fd == -1) {
+        group_fd = fd;
+      }
+      fds[node * RAPL_NR_DOMAIN + domain] = fd;
+    }
+    DEBUG("Using perf events on CPU %d for socket %d.", cpu, node);
+  }
+
+  return result;
+}
+
+int get_perf_group_fd(int node) {
+  assert(node < fds_nodes);
+  for (int domain = 0; domain < RAPL_NR_DOMAIN; domain++) {
+    if (fds[node * RAPL_NR_DOMAIN + domain] != -1) {
+      return fds[node * RAPL_NR_DOMAIN + domain];
+    }
+  }
+  return -1;
+}
+
+int decode_perf_group(const uint64_t *buf, size_t len, int num_events, uint64_t values[]) {
+  // struct read_format { u64 nr; u64 values[nr]; }
+  if (len < sizeof(uint64_t) || buf[0] != (uint64_t)num_events
+      || len != (1 + (size_t)num_events) * sizeof(uint64_t)) {
+    return -1;
+  }
+  memcpy(values, &buf[1], num_events * sizeof(uint64_t));
+  return 0;
+}
+
+int read_perf_group(int group_fd, int num_events, uint64_t values[]) {
+  if (group_fd == -1) {
+    return -1;
+  }
+  uint64_t buf[1 + RAPL_NR_DOMAIN];
+  assert(num_events <= RAPL_NR_DOMAIN);
+  const ssize_t len = read(group_fd, buf, (1 + num_events) * sizeof(uint64_t));
+  if (len < 0) {
+    return -1;
+  }
+  return decode_perf_group(buf, len, num_events, values);
+}
+
+void close_perf_fds() {
+  if (fds == NULL) {
+    return;
+  }
+
+  // close group members before their leaders
+  for (int i = fds_nodes * RAPL_NR_DOMAIN - 1; i >= 0; i--) {
+    if (fds[i] != -1) {
+      close(fds[i]);
+    }
+  }
+  free(fds);
+  fds = NULL;
+  fds_nodes = 0;
+}
@@ -0,0 +1,97 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_perf
+#define _h_perf
+
+#include "rapl.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Access to the RAPL counters through the "power" PMU of the Linux perf_event subsystem.
+ * The kernel reads the MSRs itself and accumulates them in 64-bit counters, so neither
+ * CAP_SYS_RAWIO nor handling of wraparounds is needed. The events of each package are opened as
+ * one group, such that a single read() returns the counters of all domains.
+ *
+ * For documentation of the sysfs files see
+ * https://www.kernel.org/doc/Documentation/ABI/testing/sysfs-bus-event_source-devices-events
+ */
+
+#define PERF_SYSFS_ROOT "/sys"
+
+/* Name of the event in the power PMU for each domain */
+extern const char *const PERF_EVENT_NAMES[RAPL_NR_DOMAIN];
+
+/* Description of the events of the power PMU as read from sysfs */
+typedef struct {
+  uint32_t type;                   // PMU type for perf_event_attr.type
+  int supported[RAPL_NR_DOMAIN];   // whether an event exists for the domain
+  uint64_t config[RAPL_NR_DOMAIN]; // value for perf_event_attr.config
+  double scale[RAPL_NR_DOMAIN];    // joules per count
+} perf_power_pmu_t;
+
+/**
+ * Read the description of the power PMU from sysfs below the given root directory
+ * (i.e., from sysfs_root/bus/event_source/devices/power/).
+ *
+ * @return 0 on success and -1 if the PMU or none of its energy events is available
+ */
+int read_perf_power_pmu(const char *sysfs_root, perf_power_pmu_t *pmu);
+
+/**
+ * Parse the content of an event file like "event=0x02" into the value for perf_event_attr.config.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int parse_perf_event_config(const char *event, uint64_t *config);
+
+/**
+ * Compute the number of joules per count from the content of the .scale and .unit file of an
+ * event.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int parse_perf_event_scale(const char *scale, const char *unit, double *joules_per_count);
+
+/**
+ * Open one event group per node on the CPU given by node_to_cpu with one event for each supported
+ * domain, in the order of enum RAPL_DOMAIN.
+ *
+ * @return 0 on success and -1 if at least one event could not be opened
+ */
+int open_perf_fds(int num_nodes, int (*node_to_cpu)(int), const perf_power_pmu_t *pmu);
+
+/**
+ * Get the file descriptor of the group leader of the given node.
+ */
+int get_perf_group_fd(int node);
+
+/**
+ * Read all counters of an event group with a single read().
+ * The counters are stored in values in the order in which the events were added to the group.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int read_perf_group(int group_fd, int num_events, uint64_t values[]);
+
+/**
+ * Decode the result of reading an event group with PERF_FORMAT_GROUP,
+ * which consists of the number of events followed by the value of each event.
+ *
+ * @return 0 on success and -1 if the buffer does not contain exactly num_events values
+ */
+int decode_perf_group(const uint64_t *buf, size_t len, int num_events, uint64_t values[]);
+
+/**
+ * Close all event file descriptors.
+ */
+void close_perf_fds();
+
+#endif
@@ -0,0 +1,113 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "phases.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static phase_t phases[MAX_PHASES];
+static int num_phases = 0;
+static int num_values = 0;
+static uint64_t *phase_values = NULL; // values of all phases
+
+static phase_t *current_phase = NULL;
+static double current_start_time = 0;
+static uint64_t *current_start_values = NULL;
+
+/*
+ * Find the phase with the given label, or add it if there is room for it.
+ * Returns NULL if there is no room or the phases are not open.
+ */
+static phase_t *get_phase_for_label(const char *label) {
+  if (phase_values == NULL) {
+    return NULL;
+  }
+  char cleaned[PHASE_LABEL_SIZE];
+  size_t length = 0;
+  for (; label[length] != '\0' && length < sizeof(cleaned) - 1; length++) {
+    const unsigned char c = label[length];
+    cleaned[length] = (c < ' ' || c == 0x7f) ? '_' : c;
+  }
+  cleaned[length] = '\0';
+
+  for (int i = 0; i < num_phases; i++) {
+    if (strcmp(phases[i].label, cleaned) == 0) {
+      return &phases[i];
+    }
+  }
+  if (num_phases == MAX_PHASES) {
+    return NULL;
+  }
+  phase_t *const phase = &phases[num_phases++];
+  memcpy(phase->label, cleaned, length + 1);
+  phase->count = 0;
+  phase->duration = 0;
+  phase->values = &phase_values[(size_t)(phase - phases) * num_values];
+  memset(phase->values, 0, num_values * sizeof(uint64_t));
+  return phase;
+}
+
+static void start_phase(phase_t *phase, double time, const uint64_t values[]) {
+  phase->count++;
+  current_phase = phase;
+  current_start_time = time;
+  memcpy(current_start_values, values, num_values * sizeof(uint64_t));
+}
+
+int open_phases(int count, const char *label, double time, const uint64_t values[]) {
+  close_phases();
+  num_values = count;
+  phase_values = calloc((size_t)MAX_PHASES * num_values, sizeof(uint64_t));
+  current_start_values = calloc(num_values, sizeof(uint64_t));
+  if (phase_values == NULL || current_start_values == NULL) {
+    close_phases();
+    return -1;
+  }
+  start_phase(get_phase_for_label(label), time, values);
+  return 0;
+}
+
+void end_phases(double time, const uint64_t values[]) {
+  if (current_phase == NULL) {
+    return;
+  }
+  current_phase->duration += time - current_start_time;
+  for (int i = 0; i < num_values; i++) {
+    current_phase->values[i] += values[i] - current_start_values[i];
+  }
+  current_phase = NULL;
+}
+
+int mark_phase(const char *label, double time, const uint64_t values[]) {
+  phase_t *const next = get_phase_for_label(label);
+  if (next == NULL) {
+    return -1;
+  }
+  end_phases(time, values);
+  start_phase(next, time, values);
+  return 0;
+}
+
+int get_num_phases() {
+  return num_phases;
+}
+
+const phase_t *get_phase(int index) {
+  return &phases[index];
+}
+
+void close_phases() {
+  free(phase_values);
+  phase_values = NULL;
+  free(current_start_values);
+  current_start_values = NULL;
+  current_phase = NULL;
+  num_phases = 0;
+  num_values = 0;
+}
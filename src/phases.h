@@ -0,0 +1,70 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_phases
+#define _h_phases
+
+#include <stdint.h>
+
+/*
+ * Breakdown of a measurement into labelled phases, which are started by markers of the measured
+ * command. Each marker ends the current phase and starts a new one. Phases with the same label
+ * (e.g., the iterations of a loop) are summed up, and the phases are kept in the order in which
+ * their labels first occurred.
+ *
+ * The values are cumulative counters (e.g., accumulated ticks of all domains), of which each phase
+ * gets the increase between its start and its end.
+ */
+
+#define PHASE_LABEL_SIZE 64
+#define MAX_PHASES 64
+
+typedef struct {
+  char label[PHASE_LABEL_SIZE];
+  int count; // number of times the phase was started
+  double duration; // in seconds, summed up over all occurrences
+  uint64_t *values; // increase of the values, summed up over all occurrences
+} phase_t;
+
+/**
+ * Start the first phase with the given label at the given time and count values.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_phases(int count, const char *label, double time, const uint64_t values[]);
+
+/**
+ * End the current phase at the given time and values, and start a phase with the given label.
+ * Labels are truncated to PHASE_LABEL_SIZE - 1 characters, and control characters are replaced.
+ * If there are already MAX_PHASES different labels, the current phase continues.
+ *
+ * @return 0 on success and -1 if there are too many phases or the phases are not open
+ */
+int mark_phase(const char *label, double time, const uint64_t values[]);
+
+/**
+ * End the current phase at the given time and values, such that no phase is running anymore.
+ */
+void end_phases(double time, const uint64_t values[]);
+
+/**
+ * Get the number of different phases.
+ */
+int get_num_phases();
+
+/**
+ * Get the phase with the given index (0 <= index < get_num_phases()).
+ */
+const phase_t *get_phase(int index);
+
+/**
+ * Free all phases.
+ */
+void close_phases();
+
+#endif
@@ -0,0 +1,215 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "powercap.h"
+#include "util.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int *fds;             // fds[node * RAPL_NR_DOMAIN + domain], -1 if not available
+static uint64_t *max_ranges; // max_ranges[node * RAPL_NR_DOMAIN + domain]
+static int zones_nodes = 0;
+
+static int parse_uint64(const char *s, uint64_t *value) {
+  char *end;
+  errno = 0;
+  const unsigned long long parsed = strtoull(s, &end, 10);
+  if (errno != 0 || end == s || (*end != '\0' && *end != '\n')) {
+    return -1;
+  }
+  *value = parsed;
+  return 0;
+}
+
+/*
+ * Map the name of a zone to a domain. For packages, the number of the package is stored in node.
+ */
+static int parse_zone_name(const char *name, int *node, enum RAPL_DOMAIN *domain) {
+  int package;
+  char rest;
+  if (sscanf(name, "package-%d%c", &package, &rest) == 1) {
+    *node = package;
+    *domain = RAPL_PKG;
+  } else if (strcmp(name, "core") == 0) {
+    *domain = RAPL_PP0;
+  } else if (strcmp(name, "uncore") == 0) {
+    *domain = RAPL_PP1;
+  } else if (strcmp(name, "dram") == 0) {
+    *domain = RAPL_DRAM;
+  } else if (strcmp(name, "psys") == 0) {
+    *node = 0; // the platform domain is not specific to a package
+    *domain = RAPL_PSYS;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+static int read_zone_name(const char *root, const char *zone, char *name, size_t size) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s/name", root, zone);
+  return read_sysfs_file(path, name, size);
+}
+
+/*
+ * Find out node and domain of a zone with the given directory name.
+ */
+static int identify_zone(const char *root, const char *zone, int *node, enum RAPL_DOMAIN *domain) {
+  int parent_id;
+  int id;
+  char name[64];
+  char parent[32];
+
+  const int ids = sscanf(zone, "intel-rapl:%d:%d", &parent_id, &id);
+  if (ids < 1 || read_zone_name(root, zone, name, sizeof(name)) != 0
+      || parse_zone_name(name, node, domain) != 0) {
+    return -1;
+  }
+
+  if (ids == 2) {
+    // subzone, belongs to the package of its parent zone
+    snprintf(parent, sizeof(parent), "intel-rapl:%d", parent_id);
+    enum RAPL_DOMAIN parent_domain;
+    if (read_zone_name(root, parent, name, sizeof(name)) != 0
+        || parse_zone_name(name, node, &parent_domain) != 0 || parent_domain != RAPL_PKG
+        || *domain == RAPL_PKG) {
+      return -1;
+    }
+  } else if (*domain != RAPL_PKG && *domain != RAPL_PSYS) {
+    return -1;
+  }
+  return 0;
+}
+
+static int open_zone(const char *root, const char *zone, int node, enum RAPL_DOMAIN domain) {
+  char path[PATH_MAX];
+  char range[32];
+  const int index = node * RAPL_NR_DOMAIN + domain;
+
+  if (fds[index] != -1) {
+    DEBUG("Ignoring zone %s because socket %d already has a zone of the same domain.", zone, node);
+    return -1;
+  }
+
+  snprintf(path, sizeof(path), "%s/%s/max_energy_range_uj", root, zone);
+  if (read_sysfs_file(path, range, sizeof(range)) != 0
+      || parse_uint64(range, &max_ranges[index]) != 0 || max_ranges[index] == 0) {
+    warnx("Could not read %s.", path);
+    return -1;
+  }
+
+  snprintf(path, sizeof(path), "%s/%s/energy_uj", root, zone);
+  const int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    warn("Could not open %s", path);
+    return -1;
+  }
+
+  fds[index] = fd;
+  DEBUG("Using %s for socket %d.", path, node);
+  return 0;
+}
+
+int open_powercap_zones(const char *root, int num_nodes) {
+  assert(fds == NULL);
+
+  zones_nodes = num_nodes;
+  fds = malloc(num_nodes * RAPL_NR_DOMAIN * sizeof(int));
+  max_ranges = calloc(num_nodes * RAPL_NR_DOMAIN, sizeof(uint64_t));
+  if (fds == NULL || max_ranges == NULL) {
+    warnx("Could not allocate powercap zones.");
+    close_powercap_zones();
+    return -1;
+  }
+  for (int i = 0; i < num_nodes * RAPL_NR_DOMAIN; i++) {
+    fds[i] = -1;
+  }
+
+  DIR *dir = opendir(root);
+  if (dir == NULL) {
+    warn("Could not open %s", root);
+    return -1;
+  }
+
+  int num_zones = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    int node = -1;
+    enum RAPL_DOMAIN domain;
+    if (identify_zone(root, entry->d_name, &node, &domain) != 0) {
+      continue; // not a RAPL zone
+    }
+    if (node < 0 || node >= num_nodes) {
+      warnx("Ignoring zone %s of unknown socket %d.", entry->d_name, node);
+      continue;
+    }
+    if (open_zone(root, entry->d_name, node, domain) == 0) {
+      num_zones++;
+    }
+  }
+  closedir(dir);
+
+  if (num_zones == 0) {
+    warnx("No RAPL zones found in %s.", root);
+    return -1;
+  }
+  return 0;
+}
+
+int get_powercap_fd(int node, enum RAPL_DOMAIN domain) {
+  assert(node < zones_nodes);
+  return fds[node * RAPL_NR_DOMAIN + domain];
+}
+
+uint64_t get_powercap_max_energy_range(int node, enum RAPL_DOMAIN domain) {
+  assert(node < zones_nodes);
+  return max_ranges[node * RAPL_NR_DOMAIN + domain];
+}
+
+int is_supported_powercap_domain(enum RAPL_DOMAIN domain) {
+  for (int node = 0; node < zones_nodes; node++) {
+    if (fds[node * RAPL_NR_DOMAIN + domain] != -1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int read_powercap_energy(int fd, uint64_t *energy_uj) {
+  char buf[32];
+  const ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0) {
+    return -1;
+  }
+  buf[len] = '\0';
+  return parse_uint64(buf, energy_uj);
+}
+
+void close_powercap_zones() {
+  if (fds != NULL) {
+    for (int i = 0; i < zones_nodes * RAPL_NR_DOMAIN; i++) {
+      if (fds[i] != -1) {
+        close(fds[i]);
+      }
+    }
+  }
+  free(fds);
+  fds = NULL;
+  free(max_ranges);
+  max_ranges = NULL;
+  zones_nodes = 0;
+}
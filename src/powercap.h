@@ -0,0 +1,67 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_powercap
+#define _h_powercap
+
+#include "rapl.h"
+
+#include <stdint.h>
+
+/*
+ * Access to the RAPL counters through the powercap framework of the Linux kernel.
+ * Each package is a zone "intel-rapl:N" with the name "package-K", and its domains are subzones
+ * "intel-rapl:N:M" with the names "core", "uncore" and "dram". The platform domain is a separate
+ * zone with the name "psys". The counters are provided in microjoules in the file energy_uj and
+ * wrap around at the value in max_energy_range_uj.
+ *
+ * For documentation see https://www.kernel.org/doc/html/latest/power/powercap/powercap.html
+ */
+
+#define POWERCAP_SYSFS_ROOT "/sys/class/powercap"
+
+/* Joules per unit of energy_uj */
+#define POWERCAP_ENERGY_UNIT 1e-6
+
+/**
+ * Find all RAPL zones below the given root directory and keep their energy_uj files open.
+ * Zones of packages with a number of at least num_nodes are ignored.
+ *
+ * @return 0 on success and -1 if no zone could be opened
+ */
+int open_powercap_zones(const char *root, int num_nodes);
+
+/**
+ * Get the file descriptor of the energy_uj file of the given domain of the given node,
+ * or -1 if there is no such zone.
+ */
+int get_powercap_fd(int node, enum RAPL_DOMAIN domain);
+
+/**
+ * Get the value at which the counter of the given domain of the given node wraps around.
+ */
+uint64_t get_powercap_max_energy_range(int node, enum RAPL_DOMAIN domain);
+
+/**
+ * Check whether a zone for the given domain was found for at least one node.
+ */
+int is_supported_powercap_domain(enum RAPL_DOMAIN domain);
+
+/**
+ * Read the current value of an open energy_uj file.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int read_powercap_energy(int fd, uint64_t *energy_uj);
+
+/**
+ * Close all files and forget about the zones.
+ */
+void close_powercap_zones();
+
+#endif
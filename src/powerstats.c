@@ -0,0 +1,172 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "powerstats.h"
+
+#include <err.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The histogram has SUB_BUCKETS linear buckets for each power of two between 2^(MIN_EXPONENT-1)
+ * and 2^MAX_EXPONENT watts (about 1 mW to 32 kW), plus one bucket for everything below. Values
+ * above are counted in the highest bucket, but min and max are always exact.
+ */
+#define MIN_EXPONENT (-9)
+#define MAX_EXPONENT 15
+#define SUB_BUCKETS 32
+#define NUM_BUCKETS (1 + (MAX_EXPONENT - MIN_EXPONENT + 1) * SUB_BUCKETS)
+
+typedef struct {
+  double previous_time;
+  double previous_energy_J;
+  uint64_t num_intervals;
+  double seconds; // sum of the weights
+  double mean_W;
+  double m2; // weighted sum of squared differences from the mean
+  double min_W;
+  double max_W;
+  double seconds_above_threshold[MAX_POWER_THRESHOLDS];
+  double histogram[NUM_BUCKETS]; // seconds per bucket
+} slot_stats_t;
+
+static slot_stats_t *slots = NULL;
+static int num_slots = 0;
+static int num_thresholds = 0;
+static double thresholds_W[MAX_POWER_THRESHOLDS];
+
+static int get_bucket(double power_W) {
+  int exponent;
+  const double mantissa = frexp(power_W, &exponent); // power_W = mantissa * 2^exponent
+  if (power_W <= 0 || exponent < MIN_EXPONENT) {
+    return 0;
+  }
+  if (exponent > MAX_EXPONENT) {
+    return NUM_BUCKETS - 1;
+  }
+  const int sub_bucket = (int)((mantissa - 0.5) * 2 * SUB_BUCKETS);
+  return 1 + (exponent - MIN_EXPONENT) * SUB_BUCKETS + sub_bucket;
+}
+
+/*
+ * Get the middle of the range of values of the given bucket.
+ */
+static double get_bucket_value(int bucket) {
+  if (bucket == 0) {
+    return 0;
+  }
+  const int exponent = (bucket - 1) / SUB_BUCKETS + MIN_EXPONENT;
+  const int sub_bucket = (bucket - 1) % SUB_BUCKETS;
+  return ldexp(0.5 + (sub_bucket + 0.5) / (2 * SUB_BUCKETS), exponent);
+}
+
+int open_power_stats(int count, int thresholds_count, const double thresholds[]) {
+  close_power_stats();
+  if (thresholds_count > MAX_POWER_THRESHOLDS) {
+    warnx("At most %d power thresholds can be given.", MAX_POWER_THRESHOLDS);
+    return -1;
+  }
+  slots = calloc(count, sizeof(slot_stats_t));
+  if (slots == NULL) {
+    return -1;
+  }
+  num_slots = count;
+  num_thresholds = thresholds_count;
+  for (int i = 0; i < thresholds_count; i++) {
+    thresholds_W[i] = thresholds[i];
+  }
+  add_power_sample(0, NULL, NULL);
+  return 0;
+}
+
+int is_power_stats_open() {
+  return slots != NULL;
+}
+
+static void add_interval(slot_stats_t *stats, double power_W, double seconds) {
+  // Welford's algorithm, generalized to weights by West (1979)
+  stats->num_intervals++;
+  stats->seconds += seconds;
+  const double delta = power_W - stats->mean_W;
+  stats->mean_W += delta * seconds / stats->seconds;
+  stats->m2 += seconds * delta * (power_W - stats->mean_W);
+
+  if (stats->num_intervals == 1 || power_W < stats->min_W) {
+    stats->min_W = power_W;
+  }
+  if (stats->num_intervals == 1 || power_W > stats->max_W) {
+    stats->max_W = power_W;
+  }
+  for (int i = 0; i < num_thresholds; i++) {
+    if (power_W > thresholds_W[i]) {
+      stats->seconds_above_threshold[i] += seconds;
+    }
+  }
+  stats->histogram[get_bucket(power_W)] += seconds;
+}
+
+void add_power_sample(double time, const unsigned char updated[], const double energy_J[]) {
+  for (int slot = 0; slot < num_slots; slot++) {
+    slot_stats_t *const stats = &slots[slot];
+    if (energy_J == NULL) {
+      memset(stats, 0, sizeof(*stats));
+      stats->previous_time = time;
+      continue;
+    }
+    const double seconds = time - stats->previous_time;
+    if (!updated[slot] || seconds <= 0) {
+      continue; // the energy of this interval will be part of the next one
+    }
+    add_interval(stats, (energy_J[slot] - stats->previous_energy_J) / seconds, seconds);
+    stats->previous_time = time;
+    stats->previous_energy_J = energy_J[slot];
+  }
+}
+
+static double get_percentile(const slot_stats_t *stats, double fraction) {
+  const double target = fraction * stats->seconds;
+  double seconds = 0;
+  int bucket = 0;
+  for (; bucket < NUM_BUCKETS - 1; bucket++) {
+    seconds += stats->histogram[bucket];
+    if (seconds >= target && stats->histogram[bucket] > 0) {
+      break;
+    }
+  }
+  return fmin(fmax(get_bucket_value(bucket), stats->min_W), stats->max_W);
+}
+
+int get_power_stats(int slot, power_stats_t *result) {
+  const slot_stats_t *const stats = &slots[slot];
+  if (stats->num_intervals == 0) {
+    return -1;
+  }
+  memset(result, 0, sizeof(*result));
+  result->num_intervals = stats->num_intervals;
+  result->seconds = stats->seconds;
+  result->mean_W = stats->mean_W;
+  result->stddev_W = sqrt(fmax(stats->m2 / stats->seconds, 0));
+  result->min_W = stats->min_W;
+  result->max_W = stats->max_W;
+  result->p50_W = get_percentile(stats, 0.50);
+  result->p95_W = get_percentile(stats, 0.95);
+  result->p99_W = get_percentile(stats, 0.99);
+  memcpy(
+      result->seconds_above_threshold,
+      stats->seconds_above_threshold,
+      num_thresholds * sizeof(double));
+  return 0;
+}
+
+void close_power_stats() {
+  free(slots);
+  slots = NULL;
+  num_slots = 0;
+  num_thresholds = 0;
+}
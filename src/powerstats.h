@@ -0,0 +1,70 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_powerstats
+#define _h_powerstats
+
+#include <stdint.h>
+
+/*
+ * Streaming statistics of the power in the intervals between samples, for each slot (i.e., domain
+ * of a node). The memory does not grow with the number of samples: the mean and the variance are
+ * computed with Welford's online algorithm, and the percentiles come from a histogram with
+ * logarithmic buckets (as in HDR histograms) with a relative error of at most 1/64.
+ *
+ * All statistics are weighted by the length of the intervals, such that the mean is the average
+ * power, and p95 is the power that was not exceeded during 95% of the time.
+ */
+
+#define MAX_POWER_THRESHOLDS 8
+
+typedef struct {
+  uint64_t num_intervals;
+  double seconds; // total length of the intervals
+  double mean_W;
+  double stddev_W;
+  double min_W;
+  double max_W;
+  double p50_W;
+  double p95_W;
+  double p99_W;
+  double seconds_above_threshold[MAX_POWER_THRESHOLDS]; // time with a power above each threshold
+} power_stats_t;
+
+/**
+ * Allocate the statistics of num_slots slots, which also count the time spent above each of the
+ * given thresholds (in watts).
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_power_stats(int num_slots, int num_thresholds, const double thresholds_W[]);
+
+/**
+ * Check whether the statistics are open.
+ */
+int is_power_stats_open();
+
+/**
+ * Add the interval since the previous sample of each updated slot, where energy_J is the energy
+ * consumed so far by each slot. If energy_J is NULL, all statistics restart at the given time.
+ */
+void add_power_sample(double time, const unsigned char updated[], const double energy_J[]);
+
+/**
+ * Compute the statistics of the given slot.
+ *
+ * @return 0 on success and -1 if the slot has no intervals
+ */
+int get_power_stats(int slot, power_stats_t *stats);
+
+/**
+ * Free the statistics.
+ */
+void close_power_stats();
+
+#endif
@@ -7,6 +7,14 @@
 //
 // SPDX-License-Identifier: BSD-3-Clause
 
+#ifndef _h_rapl_impl
+#define _h_rapl_impl
+
+#include "rapl.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
 /* Replacement for pow() where the base is 2 and the power is unsigned and less than 31 (will get
  * invalid numbers if 31 or greater) */
 #define B2POW(e) (((e) == 0) ? 1 : (2 << ((e)-1)))
@@ -71,6 +79,50 @@ typedef union {
   } fields;
 } rapl_parameters_msr_t;
 
+/* One energy counter that is read in each sample */
+typedef struct {
+  int fd;        // file descriptor of the MSR device (or the perf event group) of the node
+  off_t address; // address of the energy-status MSR
+  uint64_t mask; // bits of the raw value that contain the counter
+  double unit;   // joules per counter tick
+  double wrap;   // energy in joules at which the counter wraps around
+  uint64_t modulus; // ticks at which the counter wraps around if not mask + 1, 0 otherwise
+  int slot;      // index into the (flattened) [node][domain] measurement arrays
+} sample_plan_entry_t;
+
+/*
+ * Read the raw values of the given plan entries, which all belong to the same node.
+ * Stores the value of entry i in raw[i] and whether reading it failed in failed[i].
+ */
+typedef void (*read_entries_fn_t)(
+    const sample_plan_entry_t *entries, int count, uint64_t raw[], unsigned char failed[]);
+
+/* Capabilities of a backend */
+#define RAPL_CAP_INTEL_ONLY 0x1 // requires a processor of Intel family 6
+#define RAPL_CAP_MSR_READS 0x2  // entries are reads of fd at address, allows msr-safe and io_uring
+#define RAPL_CAP_REPLAY 0x4     // finite samples with own nodes and times, read in plan order
+
+/*
+ * Interface of a way of accessing the RAPL counters. init_rapl() calls open(), uses is_supported()
+ * and plan_entry() for building the sampling plan and close() in terminate_rapl().
+ */
+typedef struct {
+  const char *name;
+  unsigned int capabilities;
+  int (*open)(int *num_nodes); // may change the number of nodes, returns 0 on success, -1 otherwise
+  int (*is_supported)(enum RAPL_DOMAIN domain);
+  // fill fd, address, mask, unit and wrap of the entry, returns -1 if the node lacks the domain
+  int (*plan_entry)(int node, enum RAPL_DOMAIN domain, sample_plan_entry_t *entry);
+  read_entries_fn_t read_entries;
+  long (*get_maximum_read_interval)(); // may be NULL to derive the interval from the plan
+  void (*close)();
+} rapl_backend_t;
+
+/**
+ * Use the given backend instead of one selected by set_rapl_backend().
+ */
+void use_rapl_backend(const rapl_backend_t *backend);
+
 extern double RAPL_TIME_UNIT;
 extern double RAPL_ENERGY_UNIT;
 extern double RAPL_DRAM_ENERGY_UNIT;
@@ -92,3 +144,36 @@ int get_total_energy_consumed_via_msr(
 double get_max_power(int node);
 
 int read_rapl_units(uint32_t processor_signature);
+
+/**
+ * Build the sampling plan for the given number of nodes with the current backend,
+ * which needs to be opened before (for MSRs, config_msr_table() and read_rapl_units()).
+ *
+ * Returns 0 on success, -1 otherwise
+ */
+int build_sample_plan(int num_node);
+
+/**
+ * Prepare a batch of msr-safe reads for all entries of the sampling plan.
+ * The batch device needs to be opened before.
+ *
+ * Returns 0 on success, -1 otherwise
+ */
+int prepare_sample_plan_batch();
+
+/**
+ * Set up an io_uring with one read for each entry of the sampling plan, which then submits the
+ * reads of all sockets at once (see uring.h). Only for backends with RAPL_CAP_MSR_READS.
+ *
+ * Returns 0 on success, -1 otherwise (e.g., if io_uring is not available)
+ */
+int prepare_sample_plan_uring();
+
+/**
+ * Create a recording with the entries of the sampling plan, to which each sample is written.
+ *
+ * Returns 0 on success, -1 otherwise
+ */
+int open_sample_plan_recording(const char *path);
+
+#endif
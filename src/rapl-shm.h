@@ -0,0 +1,121 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_rapl_shm
+#define _h_rapl_shm
+
+/*
+ * Layout of the shared-memory segment that "cpu-energy-meter -m NAME" publishes in /dev/shm/NAME,
+ * and a header-only reader for it:
+ *
+ *   const rapl_shm_t *shm = rapl_shm_open("cpu-energy-meter");
+ *   rapl_shm_values_t values;
+ *   rapl_shm_read(shm, &values);
+ *   printf("%f J\n", values.cum_energy_J[0][0]); // package of the first CPU
+ *   rapl_shm_close(shm);
+ *
+ * The values are protected by a sequence lock: the writer increments the sequence number before
+ * and after each update, such that it is odd during an update. Readers copy the values and retry
+ * if the sequence number was odd or changed meanwhile. Reading does not need any system calls
+ * and never blocks the writer, and any number of processes can read at the same time.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RAPL_SHM_MAGIC "CEM-SHM"
+#define RAPL_SHM_VERSION 1 // incremented for incompatible changes of the layout
+#define RAPL_SHM_MAX_NODES 64
+#define RAPL_SHM_NR_DOMAIN 5 // same order as enum RAPL_DOMAIN: package, core, uncore, dram, psys
+
+typedef struct {
+  uint64_t num_samples;
+  double start_time; // CLOCK_MONOTONIC seconds at which the accumulation started
+  // CLOCK_MONOTONIC seconds of the last successful read of each counter (0 if never read)
+  double sample_time[RAPL_SHM_MAX_NODES][RAPL_SHM_NR_DOMAIN];
+  double cum_energy_J[RAPL_SHM_MAX_NODES][RAPL_SHM_NR_DOMAIN]; // since start_time
+} rapl_shm_values_t;
+
+typedef struct {
+  // Written once before the segment is published, i.e., before sequence becomes non-zero.
+  char magic[8]; // RAPL_SHM_MAGIC
+  uint32_t version;
+  uint32_t size; // sizeof(rapl_shm_t)
+  uint32_t num_nodes;
+  uint32_t domain_mask; // bit d set if domain d is supported
+  int32_t writer_pid;
+  int32_t node_cpus[RAPL_SHM_MAX_NODES]; // a CPU of each package
+
+  uint64_t sequence; // odd while the values are updated
+  rapl_shm_values_t values;
+} rapl_shm_t;
+
+/**
+ * Map the segment with the given name (without the leading slash) read-only.
+ *
+ * @return the segment, or NULL if it does not exist or has an incompatible layout
+ */
+static inline const rapl_shm_t *rapl_shm_open(const char *name) {
+  char path[256] = "/dev/shm/";
+  if (strlen(name) >= sizeof(path) - strlen(path)) {
+    return NULL;
+  }
+  strcat(path, name);
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat status;
+  void *address = MAP_FAILED;
+  if (fstat(fd, &status) == 0 && status.st_size >= (off_t)sizeof(rapl_shm_t)) {
+    address = mmap(NULL, sizeof(rapl_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (address == MAP_FAILED) {
+    return NULL;
+  }
+  const rapl_shm_t *const shm = (const rapl_shm_t *)address;
+  if (memcmp(shm->magic, RAPL_SHM_MAGIC, sizeof(RAPL_SHM_MAGIC)) != 0 || shm->version != RAPL_SHM_VERSION
+      || shm->size != sizeof(rapl_shm_t) || __atomic_load_n(&shm->sequence, __ATOMIC_ACQUIRE) == 0) {
+    munmap(address, sizeof(rapl_shm_t));
+    return NULL;
+  }
+  return shm;
+}
+
+/**
+ * Copy a consistent state of the values of the segment.
+ *
+ * @return the sequence number of the copied state, which changes with every update
+ */
+static inline uint64_t rapl_shm_read(const rapl_shm_t *shm, rapl_shm_values_t *values) {
+  while (1) {
+    const uint64_t before = __atomic_load_n(&shm->sequence, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      continue; // the writer is updating the values, which takes well below a microsecond
+    }
+    memcpy(values, (const void *)&shm->values, sizeof(*values));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shm->sequence, __ATOMIC_RELAXED) == before) {
+      return before;
+    }
+  }
+}
+
+/**
+ * Unmap the segment.
+ */
+static inline void rapl_shm_close(const rapl_shm_t *shm) {
+  munmap((void *)shm, sizeof(rapl_shm_t));
+}
+
+#endif
@@ -17,10 +17,21 @@
 #endif
 
 #include "rapl.h"
+#include "cgroup.h"
 #include "cpuinfo.h"
 #include "intel-family.h"
 #include "msr.h"
+#include "msrsafe.h"
+#include "perf.h"
+#include "powercap.h"
+#include "powerstats.h"
 #include "rapl-impl.h"
+#include "recording.h"
+#include "sampler.h"
+#include "shmexport.h"
+#include "simulator.h"
+#include "tracefile.h"
+#include "uring.h"
 #include "util.h"
 
 #include <assert.h>
@@ -29,6 +40,8 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef TEST // don't print the error-msg when unit-testing
@@ -40,10 +53,44 @@ static const int FALLBACK_THERMAL_SPEC_POWER =
 static const int MIN_THERMAL_SPEC_POWER =
     1.0e-03; // minimum power in watts that we assume as a legal value
 
+// Factor by which the power may rise above the observed power before an adaptive interval is too long
+static const double ADAPTIVE_POWER_HEADROOM = 4.0;
+// Bounds for adaptive intervals in seconds
+static const double MIN_ADAPTIVE_READ_INTERVAL = 0.01;
+static const double MAX_ADAPTIVE_READ_INTERVAL = 3600.0;
+
 const char *const RAPL_DOMAIN_STRINGS[RAPL_NR_DOMAIN] = {
     "package", "core", "uncore", "dram", "psys"};
 const char *const RAPL_DOMAIN_FORMATTED_STRINGS[RAPL_NR_DOMAIN] = {
     "Package", "Core", "Uncore", "DRAM", "PSYS"};
+const char *const RAPL_BACKEND_STRINGS[RAPL_NR_BACKEND] = {"msr", "perf", "powercap", "sim", "replay"};
+
+// The backends are defined at the end of this file.
+static const rapl_backend_t msr_backend;
+static const rapl_backend_t perf_backend;
+static const rapl_backend_t powercap_backend;
+static const rapl_backend_t simulated_backend;
+static const rapl_backend_t replay_backend;
+static const rapl_backend_t *const BACKENDS[RAPL_NR_BACKEND] = {
+    &msr_backend, &perf_backend, &powercap_backend, &simulated_backend, &replay_backend};
+
+static const rapl_backend_t *backend = &msr_backend;
+
+// Signature of the processor, only used with RAPL_CAP_INTEL_ONLY
+static uint32_t processor_signature = 0;
+
+// Whether MSRs should be read concurrently with io_uring (if available)
+static int use_io_uring = 0;
+
+// Description of the power PMU, only used with perf_backend
+static perf_power_pmu_t perf_pmu;
+
+// Recording that is replayed by replay_backend
+static const char *replay_path;
+static recording_header_t replay_header;
+
+// Recording that all samples are written to, if not NULL
+static const char *recording_path;
 
 // Wraparound value for the total energy consumed. It is computed within init_rapl().
 double MAX_ENERGY_STATUS_JOULES; /* default: 65536 */
@@ -62,6 +109,30 @@ static int num_nodes = 0;
 
 static int *pkg_map; // node-to-cpu mapping
 
+// Sampling plan with one entry per supported energy-status register of each node.
+// It is built once in init_rapl() such that the sampling loop needs no further lookups.
+static sample_plan_entry_t *sample_plan;
+static int sample_plan_size = 0;
+static int sample_plan_nodes = 0;
+static int *node_plan_begin; // entries of node n are node_plan_begin[n] to node_plan_begin[n + 1]
+
+// Time between the first and the last node being read in the most recent sample
+static double last_sample_skew = 0;
+
+// Time (CLOCK_MONOTONIC) of the most recent sample, or its recorded time when replaying
+static double last_sample_time = 0;
+
+// Shortest time in seconds after which one of the counters would wrap around at the power
+// observed between the two most recent samples, or INFINITY if no power was observed
+static double observed_wrap_time = INFINITY;
+
+// Time of the counter update found by align_to_counter_update() that the next sample is taken at,
+// or 0 if the next sample is not aligned
+static double aligned_sample_time = 0;
+
+// Result of backend->get_maximum_read_interval(), which is safe for any power (0 if not yet known)
+static long known_maximum_read_interval = 0;
+
 static unsigned int umax(unsigned int a, unsigned int b) {
   return a > b ? a : b;
 }
@@ -171,28 +242,134 @@ int check_if_supported_processor(uint32_t *current_processor_signature) {
   return 0;
 }
 
+void set_rapl_backend(enum RAPL_BACKEND rapl_backend) {
+  backend = BACKENDS[rapl_backend];
+}
+
+void use_rapl_backend(const rapl_backend_t *rapl_backend) {
+  backend = rapl_backend;
+}
+
+void set_replay_file(const char *path) {
+  replay_path = path;
+}
+
+void set_recording_file(const char *path) {
+  recording_path = path;
+}
+
+void enable_io_uring() {
+  use_io_uring = 1;
+}
+
+static int open_msr_backend(int *num_node) {
+  if (open_msr_fd(*num_node, &get_cpu_from_node) != 0) {
+    return -1;
+  }
+
+  config_msr_table();
+
+  if (read_rapl_units(processor_signature) != 0) {
+    return -1;
+  }
+
+  /* 32 is the width of these fields when they are stored */
+  MAX_ENERGY_STATUS_JOULES = (double)(RAPL_ENERGY_UNIT * (pow(2, 32) - 1));
+  return 0;
+}
+
+static void close_msr_backend() {
+  close_msr_fd();
+}
+
+static int open_perf_backend(int *num_node) {
+  if (read_perf_power_pmu(PERF_SYSFS_ROOT, &perf_pmu) != 0) {
+    return -1;
+  }
+  return open_perf_fds(*num_node, &get_cpu_from_node, &perf_pmu);
+}
+
+static void close_perf_backend() {
+  close_perf_fds();
+  memset(&perf_pmu, 0, sizeof(perf_pmu));
+}
+
+static int open_powercap_backend(int *num_node) {
+  return open_powercap_zones(POWERCAP_SYSFS_ROOT, *num_node);
+}
+
+static int open_simulated_backend(int *num_node) {
+  if (open_simulator() != 0) {
+    return -1;
+  }
+  // All nodes use the same power curves, and configured nodes are mapped to the real packages
+  // round-robin, such that sampling threads can be pinned as usual.
+  const int sockets = get_simulator_sockets();
+  if (sockets > 0 && sockets != *num_node) {
+    int *const map = malloc(sockets * sizeof(int));
+    if (map == NULL) {
+      close_simulator();
+      return -1;
+    }
+    for (int node = 0; node < sockets; node++) {
+      map[node] = pkg_map[node % *num_node];
+    }
+    free(pkg_map);
+    pkg_map = map;
+    *num_node = sockets;
+  }
+  return 0;
+}
+
+static int open_replay_backend(int *num_node) {
+  if (replay_path == NULL || open_replay(replay_path, &replay_header) != 0) {
+    return -1;
+  }
+  *num_node = replay_header.num_nodes;
+  RAPL_TIME_UNIT = replay_header.time_unit;
+  RAPL_ENERGY_UNIT = replay_header.energy_unit;
+  RAPL_DRAM_ENERGY_UNIT = replay_header.dram_energy_unit;
+  RAPL_POWER_UNIT = replay_header.power_unit;
+  return 0;
+}
+
+static void close_replay_backend() {
+  close_replay();
+  memset(&replay_header, 0, sizeof(replay_header));
+}
+
 int init_rapl() {
-  uint32_t processor_signature;
-  if (check_if_supported_processor(&processor_signature) != 0) {
+  // The kernel knows the units and quirks of each processor for the other backends.
+  if ((backend->capabilities & RAPL_CAP_INTEL_ONLY)
+      && check_if_supported_processor(&processor_signature) != 0) {
     return -1;
   }
 
-  if (build_topology() != 0) {
+  // A recording brings its own number of nodes.
+  if (!(backend->capabilities & RAPL_CAP_REPLAY) && build_topology() != 0) {
     goto err;
   }
 
-  if (open_msr_fd(num_nodes, &get_cpu_from_node) != 0) {
+  DEBUG("Using %s backend.", backend->name);
+  if (backend->open(&num_nodes) != 0) {
     goto err;
   }
 
-  config_msr_table();
-
-  if (read_rapl_units(processor_signature) != 0) {
+  if (build_sample_plan(num_nodes) != 0) {
     goto err;
   }
 
-  /* 32 is the width of these fields when they are stored */
-  MAX_ENERGY_STATUS_JOULES = (double)(RAPL_ENERGY_UNIT * (pow(2, 32) - 1));
+  // Prefer reading all registers with a single ioctl if msr-safe is available and allows reading
+  // all of them, otherwise every sample would fail
+  if ((backend->capabilities & RAPL_CAP_MSR_READS) && open_msr_batch(MSR_BATCH_DEVICE) == 0
+      && (prepare_sample_plan_batch() != 0 || check_msr_batch() != 0)) {
+    DEBUG("Not using batch reads of msr-safe.%s", "");
+    close_msr_batch();
+  }
+
+  if (recording_path != NULL && open_sample_plan_recording(recording_path) != 0) {
+    goto err;
+  }
 
   return 0;
 
@@ -203,7 +380,14 @@ err:
 
 void terminate_rapl() {
   // This function should work correctly no matter in what state it is called.
-  close_msr_fd();
+  stop_sampler_threads();
+  close_uring();
+  close_msr_batch();
+  close_recording();
+  close_shm_export();
+  close_cgroup_attribution();
+  close_power_stats();
+  backend->close();
 
   if (NULL != pkg_map) {
     free(pkg_map);
@@ -215,10 +399,28 @@ void terminate_rapl() {
     msr_support_table = NULL;
   }
 
+  if (NULL != sample_plan) {
+    free(sample_plan);
+    sample_plan = NULL;
+  }
+  sample_plan_size = 0;
+  sample_plan_nodes = 0;
+  observed_wrap_time = INFINITY;
+  known_maximum_read_interval = 0;
+  aligned_sample_time = 0;
+
+  if (NULL != node_plan_begin) {
+    free(node_plan_begin);
+    node_plan_begin = NULL;
+  }
+
   num_nodes = 0;
 }
 
 int is_supported_msr(off_t msr) {
+  if (msr_support_table == NULL) {
+    return 0; // MSRs are not used by the current backend
+  }
   return msr_support_table[msr & MSR_SUPPORT_MASK];
 }
 
@@ -247,9 +449,26 @@ static off_t get_msr_for_domain(enum RAPL_DOMAIN power_domain) {
  * \return 1 if supported, 0 otherwise
  */
 int is_supported_domain(enum RAPL_DOMAIN power_domain) {
+  return backend->is_supported(power_domain);
+}
+
+static int is_supported_msr_domain(enum RAPL_DOMAIN power_domain) {
   return is_supported_msr(get_msr_for_domain(power_domain));
 }
 
+static int is_supported_perf_domain(enum RAPL_DOMAIN power_domain) {
+  return perf_pmu.supported[power_domain];
+}
+
+static int is_supported_replay_domain(enum RAPL_DOMAIN power_domain) {
+  for (int i = 0; i < replay_header.num_entries; i++) {
+    if (replay_header.entries[i].address == get_msr_for_domain(power_domain)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
 /*!
  * \brief Get the number of RAPL nodes on this machine.
  *
@@ -293,41 +512,539 @@ int get_total_energy_consumed(
       node, get_msr_for_domain(power_domain), total_energy_consumed_joules);
 }
 
-int get_total_energy_consumed_for_nodes(
-    int num_node,
-    double current_measurements[num_node][RAPL_NR_DOMAIN],
-    double cum_energy_J[num_node][RAPL_NR_DOMAIN]) {
-  int result = 0;
-  for (int i = 0; i < num_node; i++) {
+int build_sample_plan(int num_node) {
+  assert(sample_plan == NULL);
+
+  assert(node_plan_begin == NULL);
+
+  sample_plan = (sample_plan_entry_t *)calloc(num_node * RAPL_NR_DOMAIN, sizeof(*sample_plan));
+  node_plan_begin = (int *)calloc(num_node + 1, sizeof(int));
+  if (sample_plan == NULL || node_plan_begin == NULL) {
+    warn("Could not allocate sampling plan");
+    return -1;
+  }
+
+  // Entries are ordered by node and domain, i.e., by slot, such that the sampling loop
+  // walks through the result arrays sequentially.
+  sample_plan_size = 0;
+  sample_plan_nodes = num_node;
+  for (int node = 0; node < num_node; node++) {
+    node_plan_begin[node] = sample_plan_size;
     for (int domain = 0; domain < RAPL_NR_DOMAIN; ++domain) {
-      if (is_supported_domain(domain)) {
-        double new_sample;
-        if (get_total_energy_consumed(i, domain, &new_sample) != 0) {
-          warnx("Measuring domain %s of CPU %d failed.", RAPL_DOMAIN_FORMATTED_STRINGS[domain], i);
-          result = 1;
-          continue; // at least continue reading other domains
-        }
-
-        if (cum_energy_J != NULL) {
-          double delta = new_sample - current_measurements[i][domain];
-
-          /* Handle wraparound */
-          if (delta < 0) {
-            delta += MAX_ENERGY_STATUS_JOULES;
-          }
-
-          cum_energy_J[i][domain] += delta;
-        }
-
-        current_measurements[i][domain] = new_sample;
+      sample_plan_entry_t *entry = &sample_plan[sample_plan_size];
+      memset(entry, 0, sizeof(*entry));
+      if (!is_supported_domain(domain) || backend->plan_entry(node, domain, entry) != 0) {
+        continue;
+      }
+      entry->slot = node * RAPL_NR_DOMAIN + domain;
+      sample_plan_size++;
+    }
+  }
+  node_plan_begin[num_node] = sample_plan_size;
+
+  DEBUG("Sampling plan contains %d registers.", sample_plan_size);
+  return 0;
+}
+
+static int plan_msr_entry(int node, enum RAPL_DOMAIN domain, sample_plan_entry_t *entry) {
+  const off_t address = get_msr_for_domain(domain);
+  entry->fd = get_msr_fd(node);
+  entry->address = address;
+  entry->mask = UINT32_MAX; // cf. energy_status_msr_t
+  entry->unit = (address == MSR_RAPL_DRAM_ENERGY_STATUS) ? RAPL_DRAM_ENERGY_UNIT : RAPL_ENERGY_UNIT;
+  entry->wrap = entry->unit * ((double)entry->mask + 1);
+  return 0;
+}
+
+static int plan_perf_entry(int node, enum RAPL_DOMAIN domain, sample_plan_entry_t *entry) {
+  // the events of the group are in the same order as the entries of the node
+  entry->fd = get_perf_group_fd(node);
+  entry->address = 0;
+  entry->mask = UINT64_MAX;
+  entry->unit = perf_pmu.scale[domain];
+  entry->wrap = entry->unit * ((double)entry->mask + 1);
+  return 0;
+}
+
+static int plan_powercap_entry(int node, enum RAPL_DOMAIN domain, sample_plan_entry_t *entry) {
+  entry->fd = get_powercap_fd(node, domain);
+  if (entry->fd == -1) {
+    return -1; // domain might exist only for some of the packages
+  }
+  entry->address = 0;
+  entry->mask = UINT64_MAX;
+  entry->unit = POWERCAP_ENERGY_UNIT;
+  entry->modulus = get_powercap_max_energy_range(node, domain);
+  entry->wrap = entry->unit * entry->modulus;
+  return 0;
+}
+
+static int plan_simulated_entry(int node, enum RAPL_DOMAIN domain, sample_plan_entry_t *entry) {
+  (void)node;
+  (void)domain;
+  entry->fd = -1;
+  entry->address = 0;
+  entry->mask = UINT32_MAX;
+  entry->unit = get_simulator_energy_unit();
+  entry->wrap = entry->unit * ((double)entry->mask + 1);
+  return 0;
+}
+
+static int plan_replay_entry(int node, enum RAPL_DOMAIN domain, sample_plan_entry_t *entry) {
+  // The recorded entries are in the same order as the sampling plan, because they come from it.
+  for (int i = 0; i < replay_header.num_entries; i++) {
+    const recording_entry_t *recorded = &replay_header.entries[i];
+    if (recorded->node == node && recorded->address == get_msr_for_domain(domain)) {
+      entry->fd = -1;
+      entry->address = recorded->address;
+      entry->mask = recorded->mask;
+      entry->unit = recorded->unit;
+      entry->wrap = recorded->wrap;
+      // counters that do not wrap at a power of two were recorded from powercap
+      const double ticks = round(recorded->wrap / recorded->unit);
+      entry->modulus = (ticks == (double)recorded->mask + 1) ? 0 : (uint64_t)ticks;
+      return 0;
+    }
+  }
+  return -1; // domain might exist only for some of the packages
+}
+
+int open_sample_plan_recording(const char *path) {
+  recording_entry_t entries[sample_plan_size > 0 ? sample_plan_size : 1];
+  for (int i = 0; i < sample_plan_size; i++) {
+    entries[i].node = sample_plan[i].slot / RAPL_NR_DOMAIN;
+    entries[i].address = get_msr_for_domain(sample_plan[i].slot % RAPL_NR_DOMAIN);
+    entries[i].unit = sample_plan[i].unit;
+    entries[i].mask = sample_plan[i].mask;
+    entries[i].wrap = sample_plan[i].wrap;
+  }
+  const recording_header_t header = {
+      .time_unit = RAPL_TIME_UNIT,
+      .energy_unit = RAPL_ENERGY_UNIT,
+      .dram_energy_unit = RAPL_DRAM_ENERGY_UNIT,
+      .power_unit = RAPL_POWER_UNIT,
+      .num_nodes = sample_plan_nodes,
+      .num_entries = sample_plan_size,
+      .entries = entries,
+  };
+  return open_recording(path, &header);
+}
+
+int open_trace_file_for_nodes(const char *path) {
+  unsigned int domain_mask = 0;
+  for (int domain = 0; domain < RAPL_NR_DOMAIN; domain++) {
+    if (is_supported_domain(domain)) {
+      domain_mask |= 1u << domain;
+    }
+  }
+  const int domains_per_node = __builtin_popcount(domain_mask);
+  const int num_columns = num_nodes * domains_per_node;
+  double units[num_columns > 0 ? num_columns : 1];
+  memset(units, 0, sizeof(units));
+  for (int i = 0; i < sample_plan_size; i++) {
+    const int node = sample_plan[i].slot / RAPL_NR_DOMAIN;
+    const int domain = sample_plan[i].slot % RAPL_NR_DOMAIN;
+    // the column of the domain is the number of supported domains before it
+    const int column = node * domains_per_node + __builtin_popcount(domain_mask & ((1u << domain) - 1));
+    units[column] = sample_plan[i].unit;
+  }
+  const trace_file_header_t header = {
+      .num_nodes = num_nodes,
+      .domain_mask = domain_mask,
+      .time_unit = RAPL_TIME_UNIT,
+      .energy_unit = RAPL_ENERGY_UNIT,
+      .dram_energy_unit = RAPL_DRAM_ENERGY_UNIT,
+      .power_unit = RAPL_POWER_UNIT,
+      .num_columns = num_columns,
+      .units = units,
+  };
+  return open_trace_file(path, &header);
+}
+
+int open_shm_export_for_nodes(const char *name) {
+  unsigned int domain_mask = 0;
+  for (int domain = 0; domain < RAPL_NR_DOMAIN; domain++) {
+    if (is_supported_domain(domain)) {
+      domain_mask |= 1u << domain;
+    }
+  }
+  int node_cpus[num_nodes > 0 ? num_nodes : 1];
+  for (int node = 0; node < num_nodes; node++) {
+    node_cpus[node] = get_cpu_from_node(node);
+  }
+  return open_shm_export(name, num_nodes, domain_mask, node_cpus);
+}
+
+/*
+ * Pass the cumulative energy of each slot (or the start of the accumulation if cum is NULL) of the
+ * sample that was just accumulated to the shared memory and the power statistics.
+ */
+static void publish_slot_energy(const unsigned char failed[], const uint64_t *cum) {
+  const int num_slots = num_nodes * RAPL_NR_DOMAIN;
+  unsigned char updated[num_slots > 0 ? num_slots : 1];
+  double energy_J[num_slots > 0 ? num_slots : 1];
+  memset(updated, 0, sizeof(updated));
+  memset(energy_J, 0, sizeof(energy_J));
+  for (int i = 0; i < sample_plan_size; i++) {
+    const int slot = sample_plan[i].slot;
+    updated[slot] = !failed[i];
+    if (cum != NULL) {
+      energy_J[slot] = sample_plan[i].unit * cum[slot];
+    }
+  }
+  if (is_shm_export_open()) {
+    publish_shm_sample(last_sample_time, updated, (cum != NULL) ? energy_J : NULL);
+  }
+  if (is_power_stats_open()) {
+    add_power_sample(last_sample_time, updated, (cum != NULL) ? energy_J : NULL);
+  }
+}
+
+/*
+ * Attribute the energy of all packages up to the sample that was just accumulated to the cgroups
+ * (or restart the attribution if cum is NULL).
+ */
+static void attribute_sample_to_cgroups(const uint64_t *cum) {
+  double energy_J[CGROUP_NR_DOMAIN] = {0};
+  for (int i = 0; cum != NULL && i < sample_plan_size; i++) {
+    const int domain = sample_plan[i].slot % RAPL_NR_DOMAIN;
+    if (domain == RAPL_PKG || domain == RAPL_PP0) {
+      energy_J[(domain == RAPL_PKG) ? CGROUP_DOMAIN_PACKAGE : CGROUP_DOMAIN_CORE] +=
+          sample_plan[i].unit * cum[sample_plan[i].slot];
+    }
+  }
+  update_cgroup_attribution(last_sample_time, (cum != NULL) ? energy_J : NULL);
+}
+
+static void read_msr_entries(
+    const sample_plan_entry_t *entries, int count, uint64_t raw[], unsigned char failed[]) {
+  for (int i = 0; i < count; i++) {
+    failed[i] = read_msr_fd(entries[i].fd, entries[i].address, &raw[i]) != 0;
+  }
+}
+
+static void read_perf_entries(
+    const sample_plan_entry_t *entries, int count, uint64_t raw[], unsigned char failed[]) {
+  // all entries of a node are read from the group leader at once
+  const int result = (count > 0) ? read_perf_group(entries[0].fd, count, raw) : 0;
+  memset(failed, result != 0, count);
+}
+
+static void read_powercap_entries(
+    const sample_plan_entry_t *entries, int count, uint64_t raw[], unsigned char failed[]) {
+  for (int i = 0; i < count; i++) {
+    failed[i] = read_powercap_energy(entries[i].fd, &raw[i]) != 0;
+  }
+}
+
+static void read_replay_entries(
+    const sample_plan_entry_t *entries, int count, uint64_t raw[], unsigned char failed[]) {
+  (void)entries; // the values are recorded in the order of the entries
+  if (read_replay(count, raw, failed, &last_sample_time) != 0) {
+    memset(failed, 1, count);
+  }
+}
+
+static void read_simulated_entries(
+    const sample_plan_entry_t *entries, int count, uint64_t raw[], unsigned char failed[]) {
+  for (int i = 0; i < count; i++) {
+    raw[i] = read_simulated_counter(entries[i].slot % RAPL_NR_DOMAIN);
+    failed[i] = 0;
+  }
+}
+
+static void read_sample_plan_serially(uint64_t raw[], unsigned char failed[]) {
+  const read_entries_fn_t read_entries = backend->read_entries;
+  double first_node_finished = 0;
+  for (int node = 0; node < sample_plan_nodes; node++) {
+    const int begin = node_plan_begin[node];
+    const int count = node_plan_begin[node + 1] - begin;
+    read_entries(&sample_plan[begin], count, &raw[begin], &failed[begin]);
+    if (node == 0) {
+      first_node_finished = get_monotonic_time();
+    }
+  }
+  last_sample_skew = (sample_plan_nodes > 1) ? get_monotonic_time() - first_node_finished : 0;
+}
+
+int prepare_sample_plan_batch() {
+  int cpus[sample_plan_size > 0 ? sample_plan_size : 1];
+  off_t msrs[sample_plan_size > 0 ? sample_plan_size : 1];
+  for (int i = 0; i < sample_plan_size; i++) {
+    cpus[i] = get_cpu_from_node(sample_plan[i].slot / RAPL_NR_DOMAIN);
+    msrs[i] = sample_plan[i].address;
+  }
+  return prepare_msr_batch(sample_plan_size, cpus, msrs);
+}
+
+static void read_sample_plan_batched(uint64_t raw[], unsigned char failed[]) {
+  const double start = get_monotonic_time();
+  read_msr_batch(raw, failed); // failures are reported per register
+  // The driver does not tell when each register was read, so this is an upper bound
+  last_sample_skew = (sample_plan_nodes > 1) ? get_monotonic_time() - start : 0;
+}
+
+int prepare_sample_plan_uring() {
+  int fds[sample_plan_size > 0 ? sample_plan_size : 1];
+  off_t addresses[sample_plan_size > 0 ? sample_plan_size : 1];
+  for (int i = 0; i < sample_plan_size; i++) {
+    fds[i] = sample_plan[i].fd;
+    addresses[i] = sample_plan[i].address;
+  }
+  return open_uring(sample_plan_size, fds, addresses);
+}
+
+static void read_sample_plan_with_uring(uint64_t raw[], unsigned char failed[]) {
+  const double start = get_monotonic_time();
+  if (read_uring(raw, failed) != 0) {
+    warnx("Reading registers with io_uring failed, reading sockets one after another.");
+    close_uring();
+    read_sample_plan_serially(raw, failed);
+    return;
+  }
+  // The completions do not tell when each register was read, so this is an upper bound
+  last_sample_skew = (sample_plan_nodes > 1) ? get_monotonic_time() - start : 0;
+}
+
+int start_parallel_sampling() {
+  if (sample_plan_nodes < 2 || is_msr_batch_open() || (backend->capabilities & RAPL_CAP_REPLAY)) {
+    return 0; // nothing to parallelize
+  }
+  if (use_io_uring && (backend->capabilities & RAPL_CAP_MSR_READS)) {
+    if (prepare_sample_plan_uring() == 0) {
+      DEBUG("Reading registers of all sockets concurrently with io_uring.%s", "");
+      return 0;
+    }
+    warnx("io_uring is not available, using sampling threads instead.");
+  }
+  return start_sampler_threads(
+      sample_plan_nodes,
+      &get_cpu_from_node,
+      sample_plan,
+      node_plan_begin,
+      backend->read_entries);
+}
+
+double get_last_sample_skew() {
+  return last_sample_skew;
+}
+
+double get_last_sample_time() {
+  return last_sample_time;
+}
+
+int get_remaining_samples() {
+  return (backend->capabilities & RAPL_CAP_REPLAY) ? get_remaining_replay_samples() : -1;
+}
+
+double align_to_counter_update(double timeout_seconds) {
+  // recorded counters cannot be watched, and without any registers there is nothing to watch
+  if ((backend->capabilities & RAPL_CAP_REPLAY) || sample_plan_size == 0
+      || node_plan_begin[1] == 0) {
+    return -1;
+  }
+  // read all entries of the first node, because some backends can only read them together
+  const int count = node_plan_begin[1];
+  uint64_t raw[count];
+  unsigned char failed[count];
+
+  backend->read_entries(sample_plan, count, raw, failed);
+  const uint64_t initial = raw[0] & sample_plan[0].mask;
+  const double start = get_monotonic_time();
+  double before_read = start;
+  while (!failed[0] && before_read - start < timeout_seconds) {
+    backend->read_entries(sample_plan, count, raw, failed);
+    const double after_read = get_monotonic_time();
+    if ((raw[0] & sample_plan[0].mask) != initial) {
+      // the update happened between the start of the previous read and the end of this one
+      aligned_sample_time = after_read;
+      return after_read - before_read;
+    }
+    before_read = after_read;
+  }
+  return -1;
+}
+
+/*
+ * Accumulate the raw values of a sample into current and cum (if not NULL) as described for
+ * get_total_energy_consumed_for_nodes(). If wrap_time is not NULL, the shortest time after which
+ * one of the counters would wrap around at the power observed in the elapsed seconds is stored in
+ * it. Besides the sampling plan, this does not access any global state.
+ */
+static int accumulate_sample(
+    const uint64_t raw[],
+    const unsigned char failed[],
+    uint64_t *current,
+    uint64_t *cum,
+    double elapsed,
+    double *wrap_time) {
+  int result = 0;
+  if (wrap_time != NULL) {
+    *wrap_time = INFINITY;
+  }
+  for (int i = 0; i < sample_plan_size; i++) {
+    const sample_plan_entry_t *const entry = &sample_plan[i];
+
+    if (failed[i]) {
+      warnx(
+          "Measuring domain %s of CPU %d failed.",
+          RAPL_DOMAIN_FORMATTED_STRINGS[entry->slot % RAPL_NR_DOMAIN],
+          entry->slot / RAPL_NR_DOMAIN);
+      result = 1;
+      continue; // at least continue with the other domains
+    }
+
+    const uint64_t new_sample = raw[i] & entry->mask;
+
+    if (cum != NULL) {
+      /* Handle wraparound: unsigned subtraction is correct modulo mask + 1 */
+      uint64_t delta = (new_sample - current[entry->slot]) & entry->mask;
+      if (new_sample < current[entry->slot]) {
+        delta += entry->modulus;
+      }
+
+      cum[entry->slot] += delta;
+
+      // wrap / (delta * unit / elapsed), i.e., the wraparound time at the observed power
+      if (wrap_time != NULL && delta > 0 && elapsed > 0) {
+        *wrap_time = fmin(*wrap_time, entry->wrap * elapsed / (delta * entry->unit));
       }
     }
+
+    current[entry->slot] = new_sample;
   }
+  return result;
+}
 
+int get_total_energy_consumed_for_nodes(
+    int num_node,
+    uint64_t current_ticks[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN]) {
+  assert(sample_plan_size == 0 || sample_plan[sample_plan_size - 1].slot < num_node * RAPL_NR_DOMAIN);
+  uint64_t raw[sample_plan_size > 0 ? sample_plan_size : 1];
+  unsigned char failed[sample_plan_size > 0 ? sample_plan_size : 1];
+  const double previous_sample_time = last_sample_time;
+
+  // First read all registers as close together as possible ...
+  if (is_msr_batch_open()) {
+    read_sample_plan_batched(raw, failed);
+  } else if (is_uring_open()) {
+    read_sample_plan_with_uring(raw, failed);
+  } else if (sampler_threads_running()) {
+    run_sampler_threads(raw, failed, &last_sample_skew);
+  } else {
+    read_sample_plan_serially(raw, failed);
+  }
+  if (aligned_sample_time > 0) {
+    last_sample_time = aligned_sample_time;
+    aligned_sample_time = 0;
+  } else if (!(backend->capabilities & RAPL_CAP_REPLAY)) {
+    last_sample_time = get_monotonic_time();
+  }
+  if (is_recording()) {
+    record_sample(last_sample_time, raw, failed);
+  }
+
+  // ... and only afterwards do the (comparatively slow) conversion and accumulation.
+  const int result = accumulate_sample(
+      raw,
+      failed,
+      &current_ticks[0][0],
+      (cum_ticks != NULL) ? &cum_ticks[0][0] : NULL,
+      last_sample_time - previous_sample_time,
+      (cum_ticks != NULL) ? &observed_wrap_time : NULL);
+  if (is_shm_export_open() || is_power_stats_open()) {
+    publish_slot_energy(failed, (cum_ticks != NULL) ? &cum_ticks[0][0] : NULL);
+  }
+  if (is_cgroup_attribution_open()) {
+    attribute_sample_to_cgroups((cum_ticks != NULL) ? &cum_ticks[0][0] : NULL);
+  }
   return result;
 }
 
+int sample_energy_of_nodes(
+    int num_node,
+    uint64_t current_ticks[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double *sample_time) {
+  assert(sample_plan_size == 0 || sample_plan[sample_plan_size - 1].slot < num_node * RAPL_NR_DOMAIN);
+  if (backend->capabilities & RAPL_CAP_REPLAY) {
+    return 1; // replaying is not reentrant
+  }
+  uint64_t raw[sample_plan_size > 0 ? sample_plan_size : 1];
+  unsigned char failed[sample_plan_size > 0 ? sample_plan_size : 1];
+
+  // The backends read each register with its own system call, which is safe in parallel.
+  for (int node = 0; node < sample_plan_nodes; node++) {
+    const int begin = node_plan_begin[node];
+    const int count = node_plan_begin[node + 1] - begin;
+    backend->read_entries(&sample_plan[begin], count, &raw[begin], &failed[begin]);
+  }
+  *sample_time = get_monotonic_time();
+
+  return accumulate_sample(
+      raw, failed, &current_ticks[0][0], (cum_ticks != NULL) ? &cum_ticks[0][0] : NULL, 0, NULL);
+}
+
+void convert_ticks_to_joules(
+    int num_node,
+    uint64_t ticks[num_node][RAPL_NR_DOMAIN],
+    double energy_J[num_node][RAPL_NR_DOMAIN]) {
+  memset(energy_J, 0, num_node * RAPL_NR_DOMAIN * sizeof(double));
+  for (int i = 0; i < sample_plan_size; i++) {
+    const int slot = sample_plan[i].slot;
+    assert(slot < num_node * RAPL_NR_DOMAIN);
+    (&energy_J[0][0])[slot] = sample_plan[i].unit * (&ticks[0][0])[slot];
+  }
+}
+
+/*
+ * Compute the interval from the wraparound value of each counter, given the maximum power.
+ */
+static long get_maximum_read_interval_from_plan(double max_power) {
+  double min_wrap = INFINITY;
+  for (int i = 0; i < sample_plan_size; i++) {
+    min_wrap = fmin(min_wrap, sample_plan[i].wrap);
+  }
+
+  // divide by two to guarantee that we measure twice between overflows
+  const double seconds = min_wrap / max_power / 2;
+  return (long)fmax(floor(fmin(seconds, LONG_MAX / 2) - 1), 1);
+}
+
 long get_maximum_read_interval() {
+  if (backend->get_maximum_read_interval == NULL) {
+    // the maximum power cannot be read, so the fallback value is used
+    return get_maximum_read_interval_from_plan(FALLBACK_THERMAL_SPEC_POWER);
+  }
+  return backend->get_maximum_read_interval();
+}
+
+double get_adaptive_read_interval(double previous_interval) {
+  // Read twice per wraparound period even if the power rises by the headroom factor.
+  double interval = observed_wrap_time / ADAPTIVE_POWER_HEADROOM / 2;
+
+  // Shrink immediately if the power rises, but grow only gradually if it drops.
+  if (previous_interval > 0) {
+    interval = fmin(interval, 2 * previous_interval);
+  }
+  interval = fmin(fmax(interval, MIN_ADAPTIVE_READ_INTERVAL), MAX_ADAPTIVE_READ_INTERVAL);
+
+  // If the backend knows the maximum power, waiting for the worst-case interval is always safe.
+  if (backend->get_maximum_read_interval != NULL) {
+    if (known_maximum_read_interval == 0) {
+      known_maximum_read_interval = backend->get_maximum_read_interval();
+    }
+    interval = fmax(interval, known_maximum_read_interval);
+  }
+  DEBUG(
+      "Observed wraparound time is %fs, next adaptive interval is %fs.",
+      observed_wrap_time,
+      interval);
+  return interval;
+}
+
+static long get_maximum_read_interval_via_msr() {
   // get maximum power consumption over all nodes (this will lead to the fastest overflow)
   double max_power = 1;
   for (int node = 0; node < num_nodes; node++) {
@@ -408,3 +1125,64 @@ int read_rapl_units(uint32_t processor_signature) {
 
   return 0;
 }
+
+static long get_maximum_read_interval_of_simulator() {
+  return get_maximum_read_interval_from_plan(fmax(get_simulator_max_power(), 1));
+}
+
+/* Backends */
+
+static const rapl_backend_t msr_backend = {
+    .name = "msr",
+    .capabilities = RAPL_CAP_INTEL_ONLY | RAPL_CAP_MSR_READS,
+    .open = &open_msr_backend,
+    .is_supported = &is_supported_msr_domain,
+    .plan_entry = &plan_msr_entry,
+    .read_entries = &read_msr_entries,
+    .get_maximum_read_interval = &get_maximum_read_interval_via_msr,
+    .close = &close_msr_backend,
+};
+
+static const rapl_backend_t perf_backend = {
+    .name = "perf",
+    .capabilities = 0,
+    .open = &open_perf_backend,
+    .is_supported = &is_supported_perf_domain,
+    .plan_entry = &plan_perf_entry,
+    .read_entries = &read_perf_entries,
+    .get_maximum_read_interval = NULL,
+    .close = &close_perf_backend,
+};
+
+static const rapl_backend_t powercap_backend = {
+    .name = "powercap",
+    .capabilities = 0,
+    .open = &open_powercap_backend,
+    .is_supported = &is_supported_powercap_domain,
+    .plan_entry = &plan_powercap_entry,
+    .read_entries = &read_powercap_entries,
+    .get_maximum_read_interval = NULL,
+    .close = &close_powercap_zones,
+};
+
+static const rapl_backend_t simulated_backend = {
+    .name = "sim",
+    .capabilities = 0,
+    .open = &open_simulated_backend,
+    .is_supported = &is_simulated_domain,
+    .plan_entry = &plan_simulated_entry,
+    .read_entries = &read_simulated_entries,
+    .get_maximum_read_interval = &get_maximum_read_interval_of_simulator,
+    .close = &close_simulator,
+};
+
+static const rapl_backend_t replay_backend = {
+    .name = "replay",
+    .capabilities = RAPL_CAP_REPLAY,
+    .open = &open_replay_backend,
+    .is_supported = &is_supported_replay_domain,
+    .plan_entry = &plan_replay_entry,
+    .read_entries = &read_replay_entries,
+    .get_maximum_read_interval = NULL,
+    .close = &close_replay_backend,
+};
@@ -35,6 +35,39 @@ enum RAPL_DOMAIN {
 extern const char *const RAPL_DOMAIN_STRINGS[RAPL_NR_DOMAIN];
 extern const char *const RAPL_DOMAIN_FORMATTED_STRINGS[RAPL_NR_DOMAIN];
 
+/* Ways of accessing the RAPL counters */
+enum RAPL_BACKEND {
+  RAPL_BACKEND_MSR,      // MSR device files of the msr (or msr-safe) kernel module
+  RAPL_BACKEND_PERF,     // power PMU of the perf_event subsystem
+  RAPL_BACKEND_POWERCAP, // intel-rapl zones of the powercap framework in sysfs
+  RAPL_BACKEND_SIM,      // simulated counters, cf. simulator.h
+  RAPL_BACKEND_REPLAY,   // counters from a recording, cf. recording.h
+};
+#define RAPL_NR_BACKEND 5 /* Number of backends */
+
+extern const char *const RAPL_BACKEND_STRINGS[RAPL_NR_BACKEND];
+
+/**
+ * Select the backend that is used by init_rapl(). The default is RAPL_BACKEND_MSR.
+ */
+void set_rapl_backend(enum RAPL_BACKEND backend);
+
+/**
+ * Let start_parallel_sampling() read the MSRs of all sockets concurrently with io_uring instead of
+ * using sampling threads. Without io_uring support in the kernel, the threads are used anyway.
+ */
+void enable_io_uring();
+
+/**
+ * Set the recording that is replayed by RAPL_BACKEND_REPLAY.
+ */
+void set_replay_file(const char *path);
+
+/**
+ * Let init_rapl() create a recording at the given path, to which all raw counter values are written.
+ */
+void set_recording_file(const char *path);
+
 /*!
  * This function must be called before calling any other function from this module.
  * Returns 0 on success, 1 on failure.
@@ -64,14 +97,106 @@ int get_total_energy_consumed(
     int node, enum RAPL_DOMAIN power_domain, double *total_energy_consumed_joules);
 
 /**
- * Read measurements for all nodes and domains and write them to current_measurements.
- * If cum_energy_J is not NULL, read previous measurements from current_measurements
- * and accumulate delta in cum_energy_J.
+ * Read the raw counters of all nodes and domains and write them to current_ticks.
+ * If cum_ticks is not NULL, read previous values from current_ticks
+ * and accumulate the delta in cum_ticks.
+ * The accumulation is done in integer counter ticks, which do not lose precision over time,
+ * use convert_ticks_to_joules() for getting the energy.
  */
 int get_total_energy_consumed_for_nodes(
     int num_node,
-    double current_measurements[num_node][RAPL_NR_DOMAIN],
-    double cum_energy_J[num_node][RAPL_NR_DOMAIN]);
+    uint64_t current_ticks[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN]);
+
+/**
+ * Reentrant variant of get_total_energy_consumed_for_nodes() that reads all registers one after
+ * another in the calling thread and stores the time of the sample in sample_time. Apart from the
+ * sampling plan, which does not change between init_rapl() and terminate_rapl(), it does not use or
+ * modify any global state, so it may be called from several threads in parallel (with separate
+ * arrays). Sampling threads, io_uring, msr-safe batches, recordings and replaying are not used.
+ */
+int sample_energy_of_nodes(
+    int num_node,
+    uint64_t current_ticks[num_node][RAPL_NR_DOMAIN],
+    uint64_t cum_ticks[num_node][RAPL_NR_DOMAIN],
+    double *sample_time);
+
+/**
+ * Convert the ticks accumulated by get_total_energy_consumed_for_nodes() to joules.
+ */
+void convert_ticks_to_joules(
+    int num_node,
+    uint64_t ticks[num_node][RAPL_NR_DOMAIN],
+    double energy_J[num_node][RAPL_NR_DOMAIN]);
+
+/**
+ * Start one sampling thread per node that is pinned to a CPU of its package, such that
+ * get_total_energy_consumed_for_nodes() reads all nodes in parallel without migrating the calling
+ * thread. Does nothing on single-socket machines. Should be called after dropping privileges.
+ *
+ * Returns 0 on success, -1 otherwise (sampling then continues serially).
+ */
+int start_parallel_sampling();
+
+/**
+ * Create a binary trace file (see tracefile.h) with one column per supported domain of each node.
+ * Records are appended with write_trace_file_record() and the file is closed with
+ * close_trace_file().
+ *
+ * Returns 0 on success, -1 otherwise
+ */
+int open_trace_file_for_nodes(const char *path);
+
+/**
+ * Publish the cumulative energy of every subsequent call to get_total_energy_consumed_for_nodes()
+ * in the shared memory /dev/shm/NAME (see rapl-shm.h), where a call without cum_ticks restarts the
+ * accumulation. The shared memory is removed by terminate_rapl().
+ *
+ * Returns 0 on success, -1 otherwise
+ */
+int open_shm_export_for_nodes(const char *name);
+
+/*
+ * If open_cgroup_attribution() (see cgroup.h) was called, get_total_energy_consumed_for_nodes()
+ * attributes the package and core energy of each sample to the cgroups, where a call without
+ * cum_ticks restarts the attribution. It is closed by terminate_rapl().
+ */
+
+/*
+ * Likewise, if open_power_stats() (see powerstats.h) was called with num_node * RAPL_NR_DOMAIN
+ * slots, get_total_energy_consumed_for_nodes() adds the power of each domain in the interval since
+ * the previous sample to the statistics. They are freed by terminate_rapl().
+ */
+
+/**
+ * Get the time in seconds between the first and the last node being read
+ * during the most recent call to get_total_energy_consumed_for_nodes().
+ */
+double get_last_sample_skew();
+
+/**
+ * Get the time (in seconds of CLOCK_MONOTONIC) at which the most recent sample was taken.
+ * When replaying, this is the recorded time.
+ */
+double get_last_sample_time();
+
+/**
+ * Get the number of samples that can still be taken, or -1 if there is no limit.
+ * Samples with a limit (from a recording) should be taken as fast as possible.
+ */
+int get_remaining_samples();
+
+/**
+ * Spin on the first counter of the first node (usually its package) until its value changes,
+ * i.e., until the hardware updated the counters (which happens about once per millisecond).
+ * The next call to get_total_energy_consumed_for_nodes() should follow immediately, and the time
+ * of its sample is the time of the update instead of the time of the read.
+ * This makes the boundaries of short measurements exact up to the duration of one read.
+ *
+ * Returns the maximum error of the time of the update in seconds,
+ * or a negative value if no update was observed within timeout_seconds.
+ */
+double align_to_counter_update(double timeout_seconds);
 
 /**
  * Calculate how often the RAPL values need to be read such that overflows can be detected reliably.
@@ -82,4 +207,16 @@ int get_total_energy_consumed_for_nodes(
  */
 long get_maximum_read_interval();
 
+/**
+ * Calculate the interval until the next read from the power that was observed between the two
+ * most recent samples taken with get_total_energy_consumed_for_nodes(), instead of the worst-case
+ * power that get_maximum_read_interval() assumes. The interval guarantees two reads per wraparound
+ * period of each counter as long as the power does not rise by more than a factor of 4 before the
+ * next read. It shrinks immediately if the power rises, but at most doubles per sample.
+ * It is never shorter than get_maximum_read_interval() if the backend knows the maximum power.
+ *
+ * Returns the number of seconds that should be waited until the next read.
+ */
+double get_adaptive_read_interval(double previous_interval);
+
 #endif
@@ -0,0 +1,286 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "recording.h"
+#include "util.h"
+
+#include <assert.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TEST // don't print the error-msg when unit-testing
+#define warnx(...)
+#define warn(...)
+#endif
+
+static FILE *recording_file;
+static recording_header_t recording_header;
+
+// loaded recording for replaying, with one element per recorded value
+static recording_header_t replay_header;
+static int replay_size = 0;
+static int replay_position = 0;
+static double *replay_times;
+static uint64_t *replay_values;
+static unsigned char *replay_failed;
+
+int open_recording(const char *path, const recording_header_t *header) {
+  assert(recording_file == NULL);
+
+  recording_file = fopen(path, "w");
+  if (recording_file == NULL) {
+    warn("Could not create recording %s", path);
+    return -1;
+  }
+
+  recording_header = *header;
+  recording_header.entries = malloc(header->num_entries * sizeof(recording_entry_t) + 1);
+  if (recording_header.entries == NULL) {
+    close_recording();
+    return -1;
+  }
+  memcpy(recording_header.entries, header->entries, header->num_entries * sizeof(recording_entry_t));
+
+  fprintf(recording_file, "# CPU Energy Meter recording\n");
+  fprintf(recording_file, "version %d\n", RECORDING_VERSION);
+  fprintf(
+      recording_file,
+      "units time=%.17g energy=%.17g dram=%.17g power=%.17g\n",
+      header->time_unit,
+      header->energy_unit,
+      header->dram_energy_unit,
+      header->power_unit);
+  fprintf(recording_file, "nodes %d\n", header->num_nodes);
+  for (int i = 0; i < header->num_entries; i++) {
+    const recording_entry_t *entry = &header->entries[i];
+    fprintf(
+        recording_file,
+        "entry %d 0x%jx unit=%.17g mask=0x%" PRIx64 " wrap=%.17g\n",
+        entry->node,
+        (uintmax_t)entry->address,
+        entry->unit,
+        entry->mask,
+        entry->wrap);
+  }
+  fprintf(recording_file, "data\n");
+  return 0;
+}
+
+int is_recording() {
+  return recording_file != NULL;
+}
+
+void record_sample(double timestamp, const uint64_t raw[], const unsigned char failed[]) {
+  assert(recording_file != NULL);
+  for (int i = 0; i < recording_header.num_entries; i++) {
+    const recording_entry_t *entry = &recording_header.entries[i];
+    if (failed[i]) {
+      fprintf(recording_file, "%.9f %d 0x%jx -\n", timestamp, entry->node, (uintmax_t)entry->address);
+    } else {
+      fprintf(
+          recording_file,
+          "%.9f %d 0x%jx %" PRIu64 "\n",
+          timestamp,
+          entry->node,
+          (uintmax_t)entry->address,
+          raw[i]);
+    }
+  }
+}
+
+void close_recording() {
+  if (recording_file != NULL) {
+    if (fclose(recording_file) != 0) {
+      warn("Could not write recording");
+    }
+    recording_file = NULL;
+  }
+  free(recording_header.entries);
+  memset(&recording_header, 0, sizeof(recording_header));
+}
+
+static int parse_header_line(const char *line, recording_header_t *header, int *in_data) {
+  int version;
+  recording_entry_t entry;
+  uintmax_t address;
+  if (line[0] == '#') {
+    return 0;
+  } else if (sscanf(line, "version %d", &version) == 1) {
+    return (version == RECORDING_VERSION) ? 0 : -1;
+  } else if (strncmp(line, "units ", strlen("units ")) == 0) {
+    return sscanf(
+               line,
+               "units time=%lf energy=%lf dram=%lf power=%lf",
+               &header->time_unit,
+               &header->energy_unit,
+               &header->dram_energy_unit,
+               &header->power_unit)
+                   == 4
+               ? 0
+               : -1;
+  } else if (sscanf(line, "nodes %d", &header->num_nodes) == 1) {
+    return (header->num_nodes > 0) ? 0 : -1;
+  } else if (
+      sscanf(
+          line,
+          "entry %d %jx unit=%lf mask=%" SCNx64 " wrap=%lf",
+          &entry.node,
+          &address,
+          &entry.unit,
+          &entry.mask,
+          &entry.wrap)
+      == 5) {
+    entry.address = address;
+    recording_entry_t *entries =
+        realloc(header->entries, (header->num_entries + 1) * sizeof(recording_entry_t));
+    if (entries == NULL) {
+      return -1;
+    }
+    header->entries = entries;
+    header->entries[header->num_entries++] = entry;
+    return 0;
+  } else if (strcmp(line, "data\n") == 0) {
+    *in_data = 1;
+    return 0;
+  }
+  return -1;
+}
+
+static int append_replay_value(double timestamp, uint64_t value, unsigned char failed) {
+  // grow the arrays by doubling their size
+  if ((replay_size & (replay_size - 1)) == 0) {
+    const int capacity = (replay_size == 0) ? 1024 : 2 * replay_size;
+    double *times = realloc(replay_times, capacity * sizeof(double));
+    if (times != NULL) {
+      replay_times = times;
+    }
+    uint64_t *values = realloc(replay_values, capacity * sizeof(uint64_t));
+    if (values != NULL) {
+      replay_values = values;
+    }
+    unsigned char *failures = realloc(replay_failed, capacity);
+    if (failures != NULL) {
+      replay_failed = failures;
+    }
+    if (times == NULL || values == NULL || failures == NULL) {
+      return -1;
+    }
+  }
+  replay_times[replay_size] = timestamp;
+  replay_values[replay_size] = value;
+  replay_failed[replay_size] = failed;
+  replay_size++;
+  return 0;
+}
+
+static int parse_data_line(const char *line) {
+  double timestamp;
+  int node;
+  uintmax_t address;
+  char value[32];
+  if (sscanf(line, "%lf %d %jx %31s", &timestamp, &node, &address, value) != 4) {
+    return -1;
+  }
+
+  // the values need to be in the same order as the entries
+  const recording_entry_t *entry = &replay_header.entries[replay_size % replay_header.num_entries];
+  if (node != entry->node || (off_t)address != entry->address) {
+    return -1;
+  }
+
+  if (strcmp(value, "-") == 0) {
+    return append_replay_value(timestamp, 0, 1);
+  }
+  char *end;
+  const uint64_t raw = strtoull(value, &end, 10);
+  return (*end == '\0') ? append_replay_value(timestamp, raw, 0) : -1;
+}
+
+int open_replay(const char *path, recording_header_t *header) {
+  assert(replay_size == 0);
+
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    warn("Could not open recording %s", path);
+    return -1;
+  }
+
+  memset(&replay_header, 0, sizeof(replay_header));
+  char line[256];
+  int line_number = 0;
+  int in_data = 0;
+  int result = 0;
+  while (result == 0 && fgets(line, sizeof(line), file) != NULL) {
+    line_number++;
+    if (!in_data) {
+      result = parse_header_line(line, &replay_header, &in_data);
+      if (in_data && (replay_header.num_nodes == 0 || replay_header.num_entries == 0)) {
+        result = -1;
+      }
+    } else {
+      result = parse_data_line(line);
+    }
+  }
+  fclose(file);
+
+  if (result != 0 || !in_data) {
+    warnx("Invalid recording %s (line %d).", path, line_number);
+    close_replay();
+    return -1;
+  }
+  if (replay_size % replay_header.num_entries != 0) {
+    warnx("Ignoring incomplete last sample of recording %s.", path);
+    replay_size -= replay_size % replay_header.num_entries;
+  }
+
+  DEBUG(
+      "Loaded %d samples of %d registers from %s.",
+      replay_size / replay_header.num_entries,
+      replay_header.num_entries,
+      path);
+  replay_position = 0;
+  *header = replay_header;
+  return 0;
+}
+
+int get_remaining_replay_samples() {
+  if (replay_header.num_entries == 0) {
+    return 0;
+  }
+  return (replay_size - replay_position) / replay_header.num_entries;
+}
+
+int read_replay(int count, uint64_t raw[], unsigned char failed[], double *timestamp) {
+  if (count <= 0) {
+    return 0;
+  }
+  if (replay_position + count > replay_size) {
+    return -1;
+  }
+  memcpy(raw, &replay_values[replay_position], count * sizeof(uint64_t));
+  memcpy(failed, &replay_failed[replay_position], count);
+  replay_position += count;
+  *timestamp = replay_times[replay_position - 1];
+  return 0;
+}
+
+void close_replay() {
+  free(replay_header.entries);
+  memset(&replay_header, 0, sizeof(replay_header));
+  free(replay_times);
+  replay_times = NULL;
+  free(replay_values);
+  replay_values = NULL;
+  free(replay_failed);
+  replay_failed = NULL;
+  replay_size = 0;
+  replay_position = 0;
+}
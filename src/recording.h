@@ -0,0 +1,99 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_recording
+#define _h_recording
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Recordings of the raw counter values, which can be replayed later.
+ * A recording is a text file with a header that describes the units and the registers of each
+ * sample, followed by one line "SECONDS NODE MSR VALUE" per register and sample, where SECONDS is
+ * the time (CLOCK_MONOTONIC) of the sample and VALUE is "-" for failed reads:
+ *
+ *   # CPU Energy Meter recording
+ *   version 1
+ *   units time=0.0009765625 energy=6.103515625e-05 dram=1.53e-05 power=0.125
+ *   nodes 1
+ *   entry 0 0x611 unit=6.103515625e-05 mask=0xffffffff wrap=262144
+ *   data
+ *   1234.000000000 0 0x611 123456
+ *   1234.100000000 0 0x611 123789
+ */
+
+#define RECORDING_VERSION 1
+
+typedef struct {
+  int node;
+  off_t address; // energy-status MSR of the domain
+  double unit; // joules per increment of the raw value
+  uint64_t mask; // valid bits of the raw value
+  double wrap; // joules after which the counter wraps around
+} recording_entry_t;
+
+typedef struct {
+  // unit multipliers as determined by read_rapl_units()
+  double time_unit;
+  double energy_unit;
+  double dram_energy_unit;
+  double power_unit;
+  int num_nodes;
+  int num_entries; // registers per sample
+  recording_entry_t *entries;
+} recording_header_t;
+
+/**
+ * Create a recording and write the given header to it.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_recording(const char *path, const recording_header_t *header);
+
+/**
+ * Check whether a recording is open.
+ */
+int is_recording();
+
+/**
+ * Append one sample, i.e., one value for each entry of the header, to the recording.
+ */
+void record_sample(double timestamp, const uint64_t raw[], const unsigned char failed[]);
+
+/**
+ * Flush and close the recording.
+ */
+void close_recording();
+
+/**
+ * Load a recording for replaying it. The header is valid until close_replay() is called.
+ *
+ * @return 0 on success and -1 if the recording cannot be read
+ */
+int open_replay(const char *path, recording_header_t *header);
+
+/**
+ * Get the number of samples that were not yet replayed.
+ */
+int get_remaining_replay_samples();
+
+/**
+ * Replay the next count values of the recording, continuing where the last call stopped.
+ * Stores the time of the sample that the last value belongs to in timestamp.
+ *
+ * @return 0 on success and -1 if the recording does not contain enough values
+ */
+int read_replay(int count, uint64_t raw[], unsigned char failed[], double *timestamp);
+
+/**
+ * Forget the loaded recording.
+ */
+void close_replay();
+
+#endif
@@ -0,0 +1,556 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <err.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "region.h"
+#include "util.h"
+
+#define REGION_LOG_SIZE 4096   // events per thread, the log is aggregated when it is full
+#define REGION_MAX_SAMPLES 64  // energy samples per thread, the log is aggregated when they are used up
+#define REGION_MAX_DEPTH 64    // deeper nested regions are not measured
+#define DEFAULT_SAMPLE_INTERVAL 0.001 // the counters are updated about once per millisecond
+#define CALIBRATION_TIME 0.001
+
+// Values of region_event_t.id besides the ids of the sites (which start at 1)
+#define REGION_END_EVENT 0
+#define REGION_SAMPLE_EVENT -1
+
+// Same order as enum cem_domain
+static const char *const DOMAIN_NAMES[CEM_NR_DOMAINS] = {"package", "core", "uncore", "dram", "psys"};
+
+typedef struct {
+  int32_t id;      // id of the entered site, REGION_END_EVENT, or REGION_SAMPLE_EVENT
+  uint32_t sample; // index in region_thread_t.samples for REGION_SAMPLE_EVENT
+  uint64_t timestamp;
+} region_event_t;
+
+typedef struct {
+  uint64_t timestamp;
+  double joules[CEM_NR_DOMAINS]; // consumed since the thread started
+} region_sample_t;
+
+typedef struct {
+  int id;
+  double time;
+  double joules[CEM_NR_DOMAINS];
+  double child_time; // spent in directly nested regions
+  double child_joules[CEM_NR_DOMAINS];
+} region_frame_t;
+
+/*
+ * The log is only written and aggregated by its own thread and thus does not need any locks.
+ * The lock only protects the statistics, which are also read by write_region_report().
+ */
+typedef struct region_thread {
+  struct region_thread *next;
+  pthread_mutex_t lock;
+  cem_context_t *context; // NULL if the energy cannot be measured
+  int num_domains; // the joules of the domains from this index on are always 0
+  cem_sample_t first_sample;
+  uint64_t next_sample; // timestamp at which the energy is sampled next
+  int num_events;
+  region_event_t events[REGION_LOG_SIZE];
+  int num_samples;
+  region_sample_t samples[REGION_MAX_SAMPLES];
+  region_sample_t previous_sample; // last sample of the log that was aggregated most recently
+  int depth;
+  region_frame_t frames[REGION_MAX_DEPTH];
+  int num_stats;
+  region_stats_t *stats; // indexed by site id - 1
+} region_thread_t;
+
+static pthread_once_t region_once = PTHREAD_ONCE_INIT;
+static pthread_key_t region_thread_key;
+static __thread region_thread_t *current_thread __attribute__((tls_model("initial-exec")));
+
+// The lock protects the following variables, which are shared by all threads.
+static pthread_mutex_t region_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char **site_names; // indexed by site id - 1
+static int num_sites = 0;
+static region_thread_t *threads = NULL;
+static region_stats_t *exited_stats = NULL; // statistics of the threads that exited
+static int num_exited_stats = 0;
+static int energy_unavailable = 0;
+static unsigned int supported_domains = 0;
+
+// Configuration, written once by init_regions()
+static const char *backend_name = NULL;
+static const char *report_path = NULL;
+static double ticks_per_second = 1e9;
+static double sample_interval = DEFAULT_SAMPLE_INTERVAL;
+static uint64_t sample_interval_ticks;
+
+/*
+ * The time stamp counter is read without a system call, which makes entering a region cheap.
+ */
+static inline uint64_t read_timestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static void calibrate_timestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+  const double start = get_monotonic_time();
+  const uint64_t start_timestamp = read_timestamp();
+  double now;
+  while ((now = get_monotonic_time()) - start < CALIBRATION_TIME) {
+    // spin
+  }
+  ticks_per_second = (read_timestamp() - start_timestamp) / (now - start);
+#endif
+}
+
+static void write_report_at_exit();
+static void stop_thread(void *arg);
+
+static void init_regions() {
+  backend_name = getenv("CEM_BACKEND");
+  report_path = getenv("CEM_REGION_REPORT");
+  const char *interval = getenv("CEM_REGION_INTERVAL_MS");
+  if (interval != NULL) {
+    char *end;
+    const double milliseconds = strtod(interval, &end);
+    if (end != interval && *end == '\0' && milliseconds > 0) {
+      sample_interval = milliseconds / 1000;
+    } else {
+      warnx("Ignoring invalid value '%s' of CEM_REGION_INTERVAL_MS.", interval);
+    }
+  }
+  calibrate_timestamp();
+  sample_interval_ticks = (uint64_t)(sample_interval * ticks_per_second);
+  pthread_key_create(&region_thread_key, &stop_thread);
+  atexit(&write_report_at_exit);
+}
+
+void set_region_sample_interval(double seconds) {
+  pthread_once(&region_once, &init_regions);
+  sample_interval = seconds;
+  sample_interval_ticks = (uint64_t)(sample_interval * ticks_per_second);
+}
+
+static void read_sample(region_thread_t *thread, region_sample_t *sample) {
+  cem_sample_t current;
+  cem_energy_t energy;
+  if (thread->context != NULL && cem_sample(thread->context, &current) == 0
+      && cem_delta(thread->context, &thread->first_sample, &current, &energy) == 0) {
+    memset(sample->joules, 0, sizeof(sample->joules));
+    for (int node = 0; node < energy.num_nodes; node++) {
+      for (int domain = 0; domain < CEM_NR_DOMAINS; domain++) {
+        sample->joules[domain] += energy.joules[node][domain];
+      }
+    }
+  } else {
+    // without a new value, assume that no energy was consumed
+    memcpy(sample->joules, thread->previous_sample.joules, sizeof(sample->joules));
+  }
+  sample->timestamp = read_timestamp();
+}
+
+/*
+ * Make room for the statistics of all sites that were registered so far.
+ */
+static int grow_stats(region_stats_t **stats, int *num_stats) {
+  const int count = __atomic_load_n(&num_sites, __ATOMIC_ACQUIRE);
+  if (count <= *num_stats) {
+    return 0;
+  }
+  region_stats_t *grown = realloc(*stats, count * sizeof(**stats));
+  if (grown == NULL) {
+    return -1;
+  }
+  memset(&grown[*num_stats], 0, (count - *num_stats) * sizeof(*grown));
+  *stats = grown;
+  *num_stats = count;
+  return 0;
+}
+
+static void enter_region(region_thread_t *thread, int id, double time, const double joules[]) {
+  if (thread->depth < REGION_MAX_DEPTH) {
+    region_frame_t *const frame = &thread->frames[thread->depth];
+    frame->id = id;
+    frame->time = time;
+    frame->child_time = 0;
+    for (int domain = 0; domain < thread->num_domains; domain++) {
+      frame->joules[domain] = joules[domain];
+      frame->child_joules[domain] = 0;
+    }
+  }
+  thread->depth++;
+}
+
+static void leave_region(region_thread_t *thread, double time, const double joules[]) {
+  if (thread->depth == 0) {
+    return; // more regions left than entered
+  }
+  thread->depth--;
+  if (thread->depth >= REGION_MAX_DEPTH) {
+    return;
+  }
+  const region_frame_t *const frame = &thread->frames[thread->depth];
+  region_frame_t *const parent =
+      (thread->depth > 0) ? &thread->frames[thread->depth - 1] : NULL;
+  if (frame->id > thread->num_stats) {
+    return; // growing the statistics failed
+  }
+  region_stats_t *const stats = &thread->stats[frame->id - 1];
+
+  const double seconds = time - frame->time;
+  stats->calls++;
+  stats->inclusive_seconds += seconds;
+  stats->exclusive_seconds += seconds - frame->child_time;
+  if (parent != NULL) {
+    parent->child_time += seconds;
+  }
+  for (int domain = 0; domain < thread->num_domains; domain++) {
+    const double consumed = joules[domain] - frame->joules[domain];
+    stats->inclusive_joules[domain] += consumed;
+    stats->exclusive_joules[domain] += consumed - frame->child_joules[domain];
+    if (parent != NULL) {
+      parent->child_joules[domain] += consumed;
+    }
+  }
+}
+
+/*
+ * Aggregate all events of the log into the statistics of the thread.
+ * The last event of the log needs to be a sample.
+ */
+static void aggregate_log(region_thread_t *thread) {
+  pthread_mutex_lock(&thread->lock);
+  grow_stats(&thread->stats, &thread->num_stats);
+
+  // The energy at each event is interpolated between the samples before and after it.
+  const region_sample_t *previous = &thread->previous_sample;
+  uint64_t span = 0;
+  double joules_per_tick[CEM_NR_DOMAINS] = {0};
+  int next_index = 0;
+  const double seconds_per_tick = 1 / ticks_per_second;
+  for (int i = 0; i < thread->num_events; i++) {
+    const region_event_t *const event = &thread->events[i];
+    if (event->id == REGION_SAMPLE_EVENT) {
+      previous = &thread->samples[event->sample];
+      continue;
+    }
+    if (next_index <= i) {
+      next_index = i + 1;
+      while (thread->events[next_index].id != REGION_SAMPLE_EVENT) {
+        next_index++;
+      }
+      const region_sample_t *const next = &thread->samples[thread->events[next_index].sample];
+      span = next->timestamp - previous->timestamp;
+      for (int domain = 0; domain < thread->num_domains; domain++) {
+        joules_per_tick[domain] =
+            (span > 0) ? (next->joules[domain] - previous->joules[domain]) / span : 0;
+      }
+    }
+
+    // the sample before an event may have been read after it if both are close together
+    const uint64_t elapsed = (event->timestamp > previous->timestamp)
+                                 ? event->timestamp - previous->timestamp
+                                 : 0;
+    const double ticks = (double)((elapsed < span) ? elapsed : span);
+    double joules[CEM_NR_DOMAINS];
+    for (int domain = 0; domain < thread->num_domains; domain++) {
+      joules[domain] = previous->joules[domain] + joules_per_tick[domain] * ticks;
+    }
+    const double time = event->timestamp * seconds_per_tick;
+
+    if (event->id == REGION_END_EVENT) {
+      leave_region(thread, time, joules);
+    } else {
+      enter_region(thread, event->id, time, joules);
+    }
+  }
+
+  thread->previous_sample = *previous;
+  thread->num_events = 0;
+  thread->num_samples = 0;
+  pthread_mutex_unlock(&thread->lock);
+}
+
+static void take_sample(region_thread_t *thread) {
+  region_sample_t *const sample = &thread->samples[thread->num_samples];
+  read_sample(thread, sample);
+  region_event_t *const event = &thread->events[thread->num_events++];
+  event->id = REGION_SAMPLE_EVENT;
+  event->sample = thread->num_samples++;
+  event->timestamp = sample->timestamp;
+  thread->next_sample = sample->timestamp + sample_interval_ticks;
+
+  if (thread->num_samples == REGION_MAX_SAMPLES || thread->num_events >= REGION_LOG_SIZE - 1) {
+    aggregate_log(thread);
+  }
+}
+
+static void start_thread() {
+  pthread_once(&region_once, &init_regions);
+  region_thread_t *const thread = calloc(1, sizeof(*thread));
+  if (thread == NULL) {
+    return;
+  }
+  pthread_mutex_init(&thread->lock, NULL);
+
+  // Only try once to open the counters, such that the error is not repeated for each thread.
+  if (!__atomic_load_n(&energy_unavailable, __ATOMIC_RELAXED)) {
+    thread->context = cem_open(backend_name);
+    if (thread->context == NULL || cem_sample(thread->context, &thread->first_sample) != 0) {
+      warnx("Measuring the energy of regions is not possible, measuring only their time.");
+      cem_close(thread->context);
+      thread->context = NULL;
+      __atomic_store_n(&energy_unavailable, 1, __ATOMIC_RELAXED);
+    }
+  }
+  read_sample(thread, &thread->previous_sample);
+  thread->next_sample = thread->previous_sample.timestamp + sample_interval_ticks;
+
+  pthread_mutex_lock(&region_lock);
+  if (thread->context != NULL) {
+    for (int domain = 0; domain < CEM_NR_DOMAINS; domain++) {
+      if (cem_is_supported_domain(thread->context, domain)) {
+        supported_domains |= 1u << domain;
+        thread->num_domains = domain + 1;
+      }
+    }
+  }
+  thread->next = threads;
+  threads = thread;
+  pthread_mutex_unlock(&region_lock);
+
+  pthread_setspecific(region_thread_key, thread);
+  current_thread = thread;
+}
+
+static inline void log_event(int32_t id) {
+  region_thread_t *thread = current_thread;
+  if (__builtin_expect(thread == NULL, 0)) {
+    start_thread();
+    if ((thread = current_thread) == NULL) {
+      return;
+    }
+  }
+  const uint64_t now = read_timestamp();
+  region_event_t *const event = &thread->events[thread->num_events++];
+  event->id = id;
+  event->timestamp = now;
+  // keep one event free for the sample
+  if (__builtin_expect(now >= thread->next_sample || thread->num_events >= REGION_LOG_SIZE - 1, 0)) {
+    take_sample(thread);
+  }
+}
+
+static int register_site(cem_region_site_t *site) {
+  pthread_once(&region_once, &init_regions);
+  pthread_mutex_lock(&region_lock);
+  int id = site->id;
+  for (int i = 0; id == 0 && i < num_sites; i++) {
+    if (strcmp(site_names[i], site->name) == 0) {
+      id = i + 1;
+    }
+  }
+  if (id == 0) {
+    const char **names = realloc(site_names, (num_sites + 1) * sizeof(*site_names));
+    if (names != NULL) {
+      site_names = names;
+      site_names[num_sites] = site->name;
+      id = num_sites + 1;
+      __atomic_store_n(&num_sites, id, __ATOMIC_RELEASE);
+    }
+  }
+  __atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&region_lock);
+  return id;
+}
+
+void cem_region_begin(cem_region_site_t *site) {
+  int id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+  if (__builtin_expect(id == 0, 0) && (id = register_site(site)) == 0) {
+    return;
+  }
+  log_event(id);
+}
+
+void cem_region_end(void) {
+  log_event(REGION_END_EVENT);
+}
+
+void cem_region_flush(void) {
+  region_thread_t *const thread = current_thread;
+  if (thread != NULL) {
+    take_sample(thread);
+    if (thread->num_events > 0) {
+      aggregate_log(thread);
+    }
+  }
+}
+
+static void add_stats(region_stats_t *sum, const region_stats_t *stats) {
+  sum->calls += stats->calls;
+  sum->inclusive_seconds += stats->inclusive_seconds;
+  sum->exclusive_seconds += stats->exclusive_seconds;
+  for (int domain = 0; domain < CEM_NR_DOMAINS; domain++) {
+    sum->inclusive_joules[domain] += stats->inclusive_joules[domain];
+    sum->exclusive_joules[domain] += stats->exclusive_joules[domain];
+  }
+}
+
+/*
+ * Move the statistics of an exiting thread to exited_stats and free it.
+ */
+static void stop_thread(void *arg) {
+  region_thread_t *const thread = arg;
+  cem_region_flush();
+  cem_close(thread->context);
+  current_thread = NULL;
+
+  pthread_mutex_lock(&region_lock);
+  region_thread_t **link = &threads;
+  while (*link != thread) {
+    link = &(*link)->next;
+  }
+  *link = thread->next;
+  if (grow_stats(&exited_stats, &num_exited_stats) == 0) {
+    for (int i = 0; i < thread->num_stats; i++) {
+      add_stats(&exited_stats[i], &thread->stats[i]);
+    }
+  }
+  pthread_mutex_unlock(&region_lock);
+
+  pthread_mutex_destroy(&thread->lock);
+  free(thread->stats);
+  free(thread);
+}
+
+void reset_regions() {
+  region_thread_t *const thread = current_thread;
+  if (thread != NULL) {
+    pthread_setspecific(region_thread_key, NULL);
+    current_thread = NULL;
+    cem_close(thread->context);
+    pthread_mutex_lock(&region_lock);
+    region_thread_t **link = &threads;
+    while (*link != thread) {
+      link = &(*link)->next;
+    }
+    *link = thread->next;
+    pthread_mutex_unlock(&region_lock);
+    pthread_mutex_destroy(&thread->lock);
+    free(thread->stats);
+    free(thread);
+  }
+
+  pthread_mutex_lock(&region_lock);
+  free(exited_stats);
+  exited_stats = NULL;
+  num_exited_stats = 0;
+  energy_unavailable = 0;
+  supported_domains = 0;
+  pthread_mutex_unlock(&region_lock);
+}
+
+/*
+ * Sum the statistics of the exited and the running threads, region_lock needs to be held.
+ */
+static region_stats_t *sum_stats(int count) {
+  region_stats_t *const sum = calloc(count > 0 ? count : 1, sizeof(*sum));
+  if (sum == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < count && i < num_exited_stats; i++) {
+    add_stats(&sum[i], &exited_stats[i]);
+  }
+  for (region_thread_t *thread = threads; thread != NULL; thread = thread->next) {
+    pthread_mutex_lock(&thread->lock);
+    for (int i = 0; i < count && i < thread->num_stats; i++) {
+      add_stats(&sum[i], &thread->stats[i]);
+    }
+    pthread_mutex_unlock(&thread->lock);
+  }
+  return sum;
+}
+
+int get_region_stats(const char *name, region_stats_t *stats) {
+  int result = -1;
+  pthread_mutex_lock(&region_lock);
+  for (int i = 0; i < num_sites; i++) {
+    if (strcmp(site_names[i], name) == 0) {
+      region_stats_t *const sum = sum_stats(i + 1);
+      if (sum != NULL) {
+        *stats = sum[i];
+        free(sum);
+        result = 0;
+      }
+      break;
+    }
+  }
+  pthread_mutex_unlock(&region_lock);
+  return result;
+}
+
+void write_region_report(FILE *file) {
+  pthread_mutex_lock(&region_lock);
+  region_stats_t *const sum = sum_stats(num_sites);
+  if (sum == NULL) {
+    pthread_mutex_unlock(&region_lock);
+    return;
+  }
+
+  fprintf(file, "region,calls,inclusive_seconds,exclusive_seconds");
+  for (int domain = 0; domain < CEM_NR_DOMAINS; domain++) {
+    if (supported_domains & (1u << domain)) {
+      fprintf(file, ",%s_inclusive_joules,%s_exclusive_joules", DOMAIN_NAMES[domain], DOMAIN_NAMES[domain]);
+    }
+  }
+  fprintf(file, "\n");
+  for (int i = 0; i < num_sites; i++) {
+    fprintf(
+        file,
+        "%s,%llu,%f,%f",
+        site_names[i],
+        (unsigned long long)sum[i].calls,
+        sum[i].inclusive_seconds,
+        sum[i].exclusive_seconds);
+    for (int domain = 0; domain < CEM_NR_DOMAINS; domain++) {
+      if (supported_domains & (1u << domain)) {
+        fprintf(file, ",%f,%f", sum[i].inclusive_joules[domain], sum[i].exclusive_joules[domain]);
+      }
+    }
+    fprintf(file, "\n");
+  }
+  pthread_mutex_unlock(&region_lock);
+  free(sum);
+}
+
+static void write_report_at_exit() {
+  // The destructors of thread-specific data do not run for the main thread.
+  cem_region_flush();
+  if (__atomic_load_n(&num_sites, __ATOMIC_ACQUIRE) == 0 || (report_path != NULL && report_path[0] == '\0')) {
+    return;
+  }
+  FILE *file = (report_path != NULL) ? fopen(report_path, "w") : stderr;
+  if (file == NULL) {
+    warn("Could not write region report to %s", report_path);
+    return;
+  }
+  write_region_report(file);
+  if (file != stderr) {
+    fclose(file);
+  }
+}
@@ -0,0 +1,53 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_region
+#define _h_region
+
+/*
+ * Implementation of the energy regions of cpuenergymeter.h (CEM_REGION_BEGIN() and CEM_REGION_END()).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpuenergymeter.h"
+
+typedef struct {
+  uint64_t calls;
+  double inclusive_seconds;
+  double exclusive_seconds; // without the time spent in nested regions
+  double inclusive_joules[CEM_NR_DOMAINS];
+  double exclusive_joules[CEM_NR_DOMAINS];
+} region_stats_t;
+
+/**
+ * Set the time between two energy samples of each thread, overriding CEM_REGION_INTERVAL_MS.
+ */
+void set_region_sample_interval(double seconds);
+
+/**
+ * Get the statistics of the region with the given name, summed over all threads that exited or
+ * called cem_region_flush().
+ *
+ * @return 0 on success and -1 if no region with this name was entered
+ */
+int get_region_stats(const char *name, region_stats_t *stats);
+
+/**
+ * Write the statistics of all regions as CSV, with one line per region.
+ */
+void write_region_report(FILE *file);
+
+/**
+ * Discard the statistics of the calling thread and of the exited threads, and open the energy
+ * counters again on the next event. Only for tests, no other thread may use regions meanwhile.
+ */
+void reset_regions();
+
+#endif
@@ -0,0 +1,52 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "runstats.h"
+
+#include <math.h>
+
+// Two-sided 97.5% quantiles of Student's t-distribution for 1 to 30 degrees of freedom
+static const double T_QUANTILES[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+#define NUM_T_QUANTILES (int)(sizeof(T_QUANTILES) / sizeof(T_QUANTILES[0]))
+
+static double get_t_quantile(int degrees_of_freedom) {
+  if (degrees_of_freedom <= NUM_T_QUANTILES) {
+    return T_QUANTILES[degrees_of_freedom - 1];
+  }
+  // within 0.002 of the exact value above 30 degrees of freedom
+  return 1.96 + 2.5 / degrees_of_freedom;
+}
+
+void add_run_value(run_stats_t *stats, double value) {
+  stats->count++;
+  const double delta = value - stats->mean;
+  stats->mean += delta / stats->count;
+  stats->m2 += delta * (value - stats->mean);
+}
+
+double get_run_stddev(const run_stats_t *stats) {
+  if (stats->count < 2) {
+    return 0;
+  }
+  return sqrt(fmax(stats->m2 / (stats->count - 1), 0));
+}
+
+double get_run_ci95(const run_stats_t *stats) {
+  if (stats->count < 2) {
+    return INFINITY;
+  }
+  return get_t_quantile(stats->count - 1) * get_run_stddev(stats) / sqrt(stats->count);
+}
+
+int is_run_precision_reached(const run_stats_t *stats, double precision) {
+  return stats->count >= BENCH_MIN_RUNS && get_run_ci95(stats) <= precision * fabs(stats->mean);
+}
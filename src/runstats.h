@@ -0,0 +1,48 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_runstats
+#define _h_runstats
+
+/*
+ * Statistics of a value (e.g., energy or time) over the runs of a benchmark. The mean and the
+ * variance are computed with Welford's online algorithm, and the confidence interval of the mean
+ * uses Student's t-distribution, because benchmarks usually have only few runs.
+ */
+
+#define BENCH_MIN_RUNS 3 // for stopping early
+
+typedef struct {
+  int count;
+  double mean;
+  double m2; // sum of squared differences from the mean
+} run_stats_t;
+
+/**
+ * Add the value of a run.
+ */
+void add_run_value(run_stats_t *stats, double value);
+
+/**
+ * Get the sample standard deviation, which is 0 if there are fewer than two runs.
+ */
+double get_run_stddev(const run_stats_t *stats);
+
+/**
+ * Get the half-width of the 95% confidence interval of the mean, which is infinite if there are
+ * fewer than two runs.
+ */
+double get_run_ci95(const run_stats_t *stats);
+
+/**
+ * Check whether the half-width of the 95% confidence interval of the mean is at most the given
+ * fraction of the mean, after at least BENCH_MIN_RUNS runs.
+ */
+int is_run_precision_reached(const run_stats_t *stats, double precision);
+
+#endif
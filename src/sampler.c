@@ -0,0 +1,242 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "sampler.h"
+#include "util.h"
+
+#include <assert.h>
+#include <err.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * State that is only used by one sampling thread. It is allocated by the thread itself after it
+ * has been pinned to its package, such that the memory is local to the NUMA node of the package
+ * (Linux places pages on the node of the CPU that touches them first).
+ */
+typedef struct {
+  sample_plan_entry_t *plan; // private copy of the plan entries of this node
+  int plan_size;
+  int plan_offset; // index of the first entry of this node in the global plan
+  struct timespec finished; // time when the reads of the last sample were finished
+} node_state_t;
+
+typedef struct {
+  pthread_t thread;
+  int node;
+  int cpu;
+  const sample_plan_entry_t *plan;
+  int plan_offset;
+  int plan_size;
+  node_state_t *state; // set by the thread during startup, NULL on failure
+} node_thread_t;
+
+static node_thread_t *threads;
+static int num_threads = 0;
+static read_entries_fn_t read_entries_of_node;
+
+// All fields below are protected by lock.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trigger_cond = PTHREAD_COND_INITIALIZER; // signals a new generation
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;    // signals pending == 0
+static unsigned long generation = 0;
+static int pending = 0; // number of threads that still need to finish the current step
+static int stopping = 0;
+static uint64_t *target_raw;
+static unsigned char *target_failed;
+
+static void finish_step() {
+  pthread_mutex_lock(&lock);
+  if (--pending == 0) {
+    pthread_cond_signal(&done_cond);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+static node_state_t *create_node_state(node_thread_t *t) {
+  if (bind_cpu(t->cpu, NULL) != 0) {
+    return NULL;
+  }
+
+  node_state_t *state = malloc(sizeof(node_state_t));
+  if (state == NULL) {
+    return NULL;
+  }
+  state->plan = calloc(t->plan_size > 0 ? t->plan_size : 1, sizeof(sample_plan_entry_t));
+  if (state->plan == NULL) {
+    free(state);
+    return NULL;
+  }
+  memcpy(state->plan, t->plan + t->plan_offset, t->plan_size * sizeof(sample_plan_entry_t));
+  state->plan_size = t->plan_size;
+  state->plan_offset = t->plan_offset;
+  return state;
+}
+
+static void *sampler_thread(void *arg) {
+  node_thread_t *t = arg;
+  node_state_t *state = create_node_state(t);
+  t->state = state;
+  // threads of an earlier start_sampler_threads() may have seen other generations already
+  pthread_mutex_lock(&lock);
+  unsigned long seen_generation = generation;
+  pthread_mutex_unlock(&lock);
+  finish_step(); // startup is done
+
+  if (state == NULL) {
+    return NULL;
+  }
+
+  while (1) {
+    pthread_mutex_lock(&lock);
+    while (generation == seen_generation && !stopping) {
+      pthread_cond_wait(&trigger_cond, &lock);
+    }
+    if (stopping) {
+      pthread_mutex_unlock(&lock);
+      break;
+    }
+    seen_generation = generation;
+    uint64_t *raw = target_raw + state->plan_offset;
+    unsigned char *failed = target_failed + state->plan_offset;
+    pthread_mutex_unlock(&lock);
+
+    read_entries_of_node(state->plan, state->plan_size, raw, failed);
+    clock_gettime(CLOCK_MONOTONIC, &state->finished);
+
+    finish_step();
+  }
+
+  free(state->plan);
+  free(state);
+  return NULL;
+}
+
+static void join_threads(int count) {
+  pthread_mutex_lock(&lock);
+  stopping = 1;
+  pthread_cond_broadcast(&trigger_cond);
+  pthread_mutex_unlock(&lock);
+
+  for (int i = 0; i < count; i++) {
+    pthread_join(threads[i].thread, NULL);
+  }
+  free(threads);
+  threads = NULL;
+  num_threads = 0;
+  stopping = 0;
+}
+
+int start_sampler_threads(
+    int num_node,
+    int (*node_to_cpu)(int),
+    const sample_plan_entry_t *plan,
+    const int *node_plan_begin,
+    read_entries_fn_t read_entries) {
+  assert(threads == NULL);
+  read_entries_of_node = read_entries;
+
+  threads = calloc(num_node, sizeof(node_thread_t));
+  if (threads == NULL) {
+    warn("Could not allocate sampling threads");
+    return -1;
+  }
+
+  pthread_mutex_lock(&lock);
+  pending = num_node;
+  pthread_mutex_unlock(&lock);
+
+  for (int node = 0; node < num_node; node++) {
+    node_thread_t *t = &threads[node];
+    t->node = node;
+    t->cpu = node_to_cpu(node);
+    t->plan = plan;
+    t->plan_offset = node_plan_begin[node];
+    t->plan_size = node_plan_begin[node + 1] - node_plan_begin[node];
+
+    const int error = pthread_create(&t->thread, NULL, sampler_thread, t);
+    if (error != 0) {
+      warnx("Could not start sampling thread for socket %d: %s", node, strerror(error));
+      pthread_mutex_lock(&lock);
+      pending -= num_node - node; // threads that will never report back
+      while (pending > 0) {
+        pthread_cond_wait(&done_cond, &lock);
+      }
+      pthread_mutex_unlock(&lock);
+      join_threads(node);
+      return -1;
+    }
+  }
+  num_threads = num_node;
+
+  // wait until each thread has pinned itself and copied its part of the plan
+  pthread_mutex_lock(&lock);
+  while (pending > 0) {
+    pthread_cond_wait(&done_cond, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+
+  for (int node = 0; node < num_node; node++) {
+    if (threads[node].state == NULL) {
+      warnx("Could not set up sampling thread for socket %d.", node);
+      join_threads(num_threads);
+      return -1;
+    }
+    DEBUG("Sampling thread for socket %d is pinned to CPU %d.", node, threads[node].cpu);
+  }
+  return 0;
+}
+
+static double timespec_to_sec(struct timespec ts) {
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void run_sampler_threads(uint64_t raw[], unsigned char failed[], double *skew_seconds) {
+  assert(threads != NULL);
+
+  pthread_mutex_lock(&lock);
+  target_raw = raw;
+  target_failed = failed;
+  pending = num_threads;
+  generation++;
+  pthread_cond_broadcast(&trigger_cond);
+  while (pending > 0) {
+    pthread_cond_wait(&done_cond, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+
+  double first = timespec_to_sec(threads[0].state->finished);
+  double last = first;
+  for (int i = 1; i < num_threads; i++) {
+    const double finished = timespec_to_sec(threads[i].state->finished);
+    if (finished < first) {
+      first = finished;
+    }
+    if (finished > last) {
+      last = finished;
+    }
+  }
+  *skew_seconds = last - first;
+}
+
+int sampler_threads_running() {
+  return threads != NULL;
+}
+
+void stop_sampler_threads() {
+  if (threads == NULL) {
+    return;
+  }
+  join_threads(num_threads);
+}
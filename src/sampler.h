@@ -0,0 +1,50 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_sampler
+#define _h_sampler
+
+#include "rapl-impl.h"
+
+#include <stdint.h>
+
+/**
+ * Start one long-lived sampling thread per node. Each thread pins itself once to the CPU of its
+ * package and keeps a private copy of the entries node_plan_begin[node] to
+ * node_plan_begin[node + 1] of the given sampling plan, which it reads with read_entries.
+ *
+ * The threads inherit the privileges of the calling thread, so this should be called after
+ * privileges have been dropped.
+ *
+ * @return 0 on success and -1 on failure (in which case no threads are left running)
+ */
+int start_sampler_threads(
+    int num_node,
+    int (*node_to_cpu)(int),
+    const sample_plan_entry_t *plan,
+    const int *node_plan_begin,
+    read_entries_fn_t read_entries);
+
+/**
+ * Let all sampling threads read their registers in parallel and wait until all are finished.
+ * The results are stored at the plan index of each entry in raw and failed.
+ * The time between the first and the last node finishing its reads is stored in skew_seconds.
+ */
+void run_sampler_threads(uint64_t raw[], unsigned char failed[], double *skew_seconds);
+
+/**
+ * Check whether the sampling threads are running.
+ */
+int sampler_threads_running();
+
+/**
+ * Stop and join all sampling threads. Does nothing if they are not running.
+ */
+void stop_sampler_threads();
+
+#endif
@@ -0,0 +1,128 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "shmexport.h"
+#include "rapl-shm.h"
+#include "util.h"
+
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static rapl_shm_t *shm = NULL;
+static char shm_path[256];
+
+/*
+ * Check whether the segment at shm_path was left behind by a writer that does not exist anymore.
+ */
+static int is_stale_segment() {
+  const int fd = open(shm_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  rapl_shm_t existing;
+  const int complete = read(fd, &existing, sizeof(existing)) >= (ssize_t)offsetof(rapl_shm_t, sequence);
+  close(fd);
+  return !complete || existing.writer_pid <= 0
+         || (kill(existing.writer_pid, 0) != 0 && errno == ESRCH);
+}
+
+int open_shm_export(const char *name, int num_nodes, unsigned int domain_mask, const int node_cpus[]) {
+  if (num_nodes > RAPL_SHM_MAX_NODES) {
+    warnx("Shared memory supports at most %d packages.", RAPL_SHM_MAX_NODES);
+    return -1;
+  }
+  if (*name == '\0' || strchr(name, '/') != NULL
+      || snprintf(shm_path, sizeof(shm_path), "/dev/shm/%s", name) >= (int)sizeof(shm_path)) {
+    warnx("Invalid name %s for shared memory.", name);
+    return -1;
+  }
+
+  int fd = open(shm_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0 && errno == EEXIST && is_stale_segment()) {
+    DEBUG("Replacing stale shared memory %s.", shm_path);
+    unlink(shm_path);
+    fd = open(shm_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  }
+  if (fd < 0) {
+    warn("Could not create shared memory %s", shm_path);
+    return -1;
+  }
+  if (ftruncate(fd, sizeof(rapl_shm_t)) != 0) {
+    warn("Could not resize shared memory %s", shm_path);
+    close(fd);
+    unlink(shm_path);
+    return -1;
+  }
+  void *const address = mmap(NULL, sizeof(rapl_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) {
+    warn("Could not map shared memory %s", shm_path);
+    unlink(shm_path);
+    return -1;
+  }
+
+  // The file is zero-filled, and readers ignore it until the sequence number is non-zero.
+  shm = address;
+  memcpy(shm->magic, RAPL_SHM_MAGIC, sizeof(RAPL_SHM_MAGIC));
+  shm->version = RAPL_SHM_VERSION;
+  shm->size = sizeof(rapl_shm_t);
+  shm->num_nodes = num_nodes;
+  shm->domain_mask = domain_mask;
+  shm->writer_pid = getpid();
+  for (int node = 0; node < num_nodes; node++) {
+    shm->node_cpus[node] = node_cpus[node];
+  }
+  __atomic_store_n(&shm->sequence, 2, __ATOMIC_RELEASE);
+  DEBUG("Publishing cumulative energy in %s.", shm_path);
+  return 0;
+}
+
+int is_shm_export_open() {
+  return shm != NULL;
+}
+
+void publish_shm_sample(double time, const unsigned char updated[], const double energy_J[]) {
+  const uint64_t sequence = shm->sequence; // only this process writes it
+  __atomic_store_n(&shm->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  rapl_shm_values_t *const values = &shm->values;
+  double *const sample_time = &values->sample_time[0][0];
+  double *const cum_energy_J = &values->cum_energy_J[0][0];
+  const int num_slots = shm->num_nodes * RAPL_SHM_NR_DOMAIN;
+  if (energy_J == NULL) {
+    values->num_samples = 0;
+    values->start_time = time;
+    memset(cum_energy_J, 0, num_slots * sizeof(double));
+  } else {
+    values->num_samples++;
+    memcpy(cum_energy_J, energy_J, num_slots * sizeof(double));
+  }
+  for (int slot = 0; slot < num_slots; slot++) {
+    if (updated[slot]) {
+      sample_time[slot] = time;
+    }
+  }
+
+  __atomic_store_n(&shm->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void close_shm_export() {
+  if (shm != NULL) {
+    munmap(shm, sizeof(rapl_shm_t));
+    shm = NULL;
+    if (unlink(shm_path) != 0) {
+      DEBUG("Could not remove %s.", shm_path);
+    }
+  }
+}
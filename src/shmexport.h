@@ -0,0 +1,42 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_shmexport
+#define _h_shmexport
+
+/*
+ * Writer of the shared-memory segment described in rapl-shm.h, which lets other processes read
+ * the cumulative energy without any system calls. Values are indexed by slot, i.e., by
+ * node * RAPL_SHM_NR_DOMAIN + domain.
+ */
+
+/**
+ * Create the segment /dev/shm/NAME (replacing one whose writer does not exist anymore) with the
+ * given topology and publish it with zero energy.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_shm_export(const char *name, int num_nodes, unsigned int domain_mask, const int node_cpus[]);
+
+/**
+ * Check whether the segment is open.
+ */
+int is_shm_export_open();
+
+/**
+ * Publish the cumulative energy of all slots, and time as the sample time of each slot whose
+ * updated flag is set. If energy_J is NULL, the accumulation restarts at time with zero energy.
+ */
+void publish_shm_sample(double time, const unsigned char updated[], const double energy_J[]);
+
+/**
+ * Unmap and remove the segment.
+ */
+void close_shm_export();
+
+#endif
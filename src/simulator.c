@@ -0,0 +1,321 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "simulator.h"
+#include "util.h"
+
+#include <err.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef TEST // don't print the error-msg when unit-testing
+#define warnx(...)
+#endif
+
+#define COUNTER_RANGE 4294967296.0 // the counters are 32 bits wide
+
+typedef enum { CURVE_NONE, CURVE_CONSTANT, CURVE_SQUARE, CURVE_CSV } curve_type_t;
+
+typedef struct {
+  curve_type_t type;
+  double low; // watts, only for square waves
+  double high; // watts, also used for constant power
+  double period; // seconds, only for square waves
+  double duty; // fraction of the period with high power, only for square waves
+  int num_points; // only for CSV curves
+  double *times; // start of each segment in seconds, relative to the first one
+  double *watts; // power during each segment
+  double *energy; // energy in joules consumed before each segment
+} curve_t;
+
+// Same order as enum RAPL_DOMAIN
+static const char *const DOMAIN_NAMES[RAPL_NR_DOMAIN] = {"package", "core", "uncore", "dram", "psys"};
+
+static curve_t curves[RAPL_NR_DOMAIN];
+static double energy_unit = 6.103515625e-05; // 2^-14 J, the usual unit of client processors
+static double update_interval = 1e-3;
+static double read_latency = 0;
+static int sockets = 0; // 0 for the sockets of the machine
+static int configured = 0;
+static struct timespec start;
+
+static void free_curve(curve_t *curve) {
+  free(curve->times);
+  free(curve->watts);
+  free(curve->energy);
+  memset(curve, 0, sizeof(*curve));
+}
+
+static int parse_double(const char *s, double *value) {
+  char *end;
+  *value = strtod(s, &end);
+  return (end == s || *end != '\0' || !isfinite(*value) || *value < 0) ? -1 : 0;
+}
+
+static int add_csv_point(curve_t *curve, double time, double watts) {
+  const int n = curve->num_points;
+  if (n > 0 && time < curve->times[n - 1]) {
+    return -1;
+  }
+  double *times = realloc(curve->times, (n + 1) * sizeof(double));
+  if (times != NULL) {
+    curve->times = times;
+  }
+  double *power = realloc(curve->watts, (n + 1) * sizeof(double));
+  if (power != NULL) {
+    curve->watts = power;
+  }
+  double *energy = realloc(curve->energy, (n + 1) * sizeof(double));
+  if (energy != NULL) {
+    curve->energy = energy;
+  }
+  if (times == NULL || power == NULL || energy == NULL) {
+    return -1;
+  }
+
+  curve->times[n] = time;
+  curve->watts[n] = watts;
+  curve->energy[n] =
+      (n == 0) ? 0 : curve->energy[n - 1] + curve->watts[n - 1] * (time - curve->times[n - 1]);
+  curve->num_points++;
+  return 0;
+}
+
+static int load_csv_curve(const char *path, curve_t *curve) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    warnx("Could not open %s.", path);
+    return -1;
+  }
+
+  char line[256];
+  int line_number = 0;
+  double first_time = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line_number++;
+    if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+      continue;
+    }
+    double time;
+    double watts;
+    if (sscanf(line, "%lf,%lf", &time, &watts) != 2) {
+      if (line_number == 1) {
+        continue; // header
+      }
+      warnx("Invalid line %d in %s.", line_number, path);
+      fclose(file);
+      return -1;
+    }
+    if (curve->num_points == 0) {
+      first_time = time;
+    }
+    if (watts < 0 || add_csv_point(curve, time - first_time, watts) != 0) {
+      warnx("Invalid line %d in %s.", line_number, path);
+      fclose(file);
+      return -1;
+    }
+  }
+  fclose(file);
+
+  if (curve->num_points == 0) {
+    warnx("No power values found in %s.", path);
+    return -1;
+  }
+  return 0;
+}
+
+static int parse_curve(char *value, curve_t *curve) {
+  int consumed = -1;
+  if (strncmp(value, "constant:", strlen("constant:")) == 0) {
+    curve->type = CURVE_CONSTANT;
+    return parse_double(value + strlen("constant:"), &curve->high);
+
+  } else if (strncmp(value, "square:", strlen("square:")) == 0) {
+    curve->type = CURVE_SQUARE;
+    curve->duty = 0.5;
+    const int fields = sscanf(
+        value,
+        "square:%lf:%lf:%lf%n:%lf%n",
+        &curve->low,
+        &curve->high,
+        &curve->period,
+        &consumed,
+        &curve->duty,
+        &consumed);
+    if (fields < 3 || consumed < 0 || value[consumed] != '\0') {
+      return -1;
+    }
+    return (curve->low < 0 || curve->high < 0 || curve->period <= 0 || curve->duty < 0
+            || curve->duty > 1)
+               ? -1
+               : 0;
+
+  } else if (strncmp(value, "csv:", strlen("csv:")) == 0) {
+    curve->type = CURVE_CSV;
+    return load_csv_curve(value + strlen("csv:"), curve);
+  }
+  return -1;
+}
+
+static int parse_item(char *item) {
+  char *value = strchr(item, '=');
+  if (value == NULL) {
+    return -1;
+  }
+  *value++ = '\0';
+
+  for (int domain = 0; domain < RAPL_NR_DOMAIN; domain++) {
+    if (strcmp(item, DOMAIN_NAMES[domain]) == 0) {
+      free_curve(&curves[domain]);
+      return parse_curve(value, &curves[domain]);
+    }
+  }
+
+  double number;
+  if (parse_double(value, &number) != 0) {
+    return -1;
+  }
+  if (strcmp(item, "unit") == 0 && number > 0) {
+    energy_unit = number;
+  } else if (strcmp(item, "update") == 0 && number > 0) {
+    update_interval = number / 1e3;
+  } else if (strcmp(item, "latency") == 0) {
+    read_latency = number / 1e6;
+  } else if (strcmp(item, "sockets") == 0 && number >= 1 && number <= SIMULATOR_MAX_SOCKETS
+             && number == (int)number) {
+    sockets = (int)number;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+int configure_simulator(const char *config) {
+  close_simulator();
+
+  char *copy = strdup(config);
+  if (copy == NULL) {
+    return -1;
+  }
+  char *saveptr;
+  for (char *item = strtok_r(copy, ",", &saveptr); item != NULL;
+       item = strtok_r(NULL, ",", &saveptr)) {
+    if (parse_item(item) != 0) {
+      warnx("Invalid configuration '%s' of the simulated device.", item);
+      free(copy);
+      close_simulator();
+      return -1;
+    }
+  }
+  free(copy);
+
+  configured = 1;
+  return 0;
+}
+
+int open_simulator() {
+  if (!configured && configure_simulator(SIMULATOR_DEFAULT_CONFIG) != 0) {
+    return -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  DEBUG("Simulating RAPL counters with unit %eJ and updates every %fs.", energy_unit, update_interval);
+  return 0;
+}
+
+int is_simulated_domain(enum RAPL_DOMAIN domain) {
+  return curves[domain].type != CURVE_NONE;
+}
+
+double get_simulator_energy_unit() {
+  return energy_unit;
+}
+
+int get_simulator_sockets() {
+  return sockets;
+}
+
+double get_simulator_max_power() {
+  double max_power = 0;
+  for (int domain = 0; domain < RAPL_NR_DOMAIN; domain++) {
+    const curve_t *curve = &curves[domain];
+    max_power = fmax(max_power, curve->high);
+    max_power = fmax(max_power, curve->low);
+    for (int i = 0; i < curve->num_points; i++) {
+      max_power = fmax(max_power, curve->watts[i]);
+    }
+  }
+  return max_power;
+}
+
+/*
+ * Compute the energy in joules that the curve consumed in the given number of seconds.
+ */
+static double get_energy(const curve_t *curve, double t) {
+  switch (curve->type) {
+  case CURVE_CONSTANT:
+    return curve->high * t;
+  case CURVE_SQUARE: {
+    const double high_time = curve->duty * curve->period;
+    const double periods = floor(t / curve->period);
+    const double rest = t - periods * curve->period;
+    return periods * (curve->high * high_time + curve->low * (curve->period - high_time))
+           + curve->high * fmin(rest, high_time) + curve->low * fmax(0, rest - high_time);
+  }
+  case CURVE_CSV: {
+    // find the last segment that started before t
+    int low = 0;
+    int high = curve->num_points - 1;
+    while (low < high) {
+      const int middle = (low + high + 1) / 2;
+      if (curve->times[middle] <= t) {
+        low = middle;
+      } else {
+        high = middle - 1;
+      }
+    }
+    return curve->energy[low] + curve->watts[low] * (t - curve->times[low]);
+  }
+  default:
+    return 0;
+  }
+}
+
+uint64_t get_simulated_counter(enum RAPL_DOMAIN domain, double seconds) {
+  // the counter only changes at the end of each update interval
+  const double t = floor(seconds / update_interval) * update_interval;
+  const double increments = floor(get_energy(&curves[domain], t) / energy_unit);
+  return (uint64_t)fmod(increments, COUNTER_RANGE);
+}
+
+uint64_t read_simulated_counter(enum RAPL_DOMAIN domain) {
+  const double begin = get_monotonic_time();
+  double now = begin;
+  while (now - begin < read_latency) {
+    now = get_monotonic_time();
+  }
+  const double since_start = now - ((double)start.tv_sec + (double)start.tv_nsec / 1e9);
+  return get_simulated_counter(domain, since_start);
+}
+
+void close_simulator() {
+  for (int domain = 0; domain < RAPL_NR_DOMAIN; domain++) {
+    free_curve(&curves[domain]);
+  }
+  energy_unit = 6.103515625e-05;
+  update_interval = 1e-3;
+  read_latency = 0;
+  sockets = 0;
+  configured = 0;
+}
@@ -0,0 +1,87 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_simulator
+#define _h_simulator
+
+#include "rapl.h"
+
+#include <stdint.h>
+
+/*
+ * A simulated RAPL device that produces energy-status counters from configured power curves.
+ * Like the real registers, the counters are 32 bits wide, wrap around, and are only updated
+ * in fixed intervals (1 ms by default). All sockets use the same power curves, and unless
+ * configured otherwise, there are as many sockets as in the machine.
+ *
+ * The configuration is a comma-separated list of the following items:
+ *   DOMAIN=constant:WATTS                       constant power
+ *   DOMAIN=square:LOW:HIGH:PERIOD_SEC[:DUTY]    HIGH watts for DUTY (default 0.5) of each period,
+ *                                               LOW watts for the rest
+ *   DOMAIN=csv:FILE                             lines "SECONDS,WATTS", the power changes at the
+ *                                               given time and stays constant after the last line
+ *   unit=JOULES                                 energy per counter increment (default 2^-14)
+ *   update=MILLISEC                             interval of counter updates (default 1)
+ *   latency=MICROSEC                            busy-waiting time per read (default 0)
+ *   sockets=COUNT                               number of simulated sockets (at most 64)
+ * DOMAIN is one of package, core, uncore, dram and psys. Domains without a curve are not supported.
+ */
+
+#define SIMULATOR_DEFAULT_CONFIG "package=constant:20,core=constant:10,dram=constant:5"
+#define SIMULATOR_MAX_SOCKETS 64
+
+/**
+ * Parse the given configuration and use it for the following calls.
+ *
+ * @return 0 on success and -1 if the configuration is invalid
+ */
+int configure_simulator(const char *config);
+
+/**
+ * Start the simulated clock. Uses SIMULATOR_DEFAULT_CONFIG if configure_simulator() was not called.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_simulator();
+
+/**
+ * Check whether a power curve is configured for the given domain.
+ */
+int is_simulated_domain(enum RAPL_DOMAIN domain);
+
+/**
+ * Get the energy in joules per counter increment.
+ */
+double get_simulator_energy_unit();
+
+/**
+ * Get the configured number of sockets, or 0 if the sockets of the machine are simulated.
+ */
+int get_simulator_sockets();
+
+/**
+ * Get the highest power in watts of all configured curves.
+ */
+double get_simulator_max_power();
+
+/**
+ * Get the counter value that the given domain has the given number of seconds after start.
+ */
+uint64_t get_simulated_counter(enum RAPL_DOMAIN domain, double seconds);
+
+/**
+ * Read the current counter value of the given domain, taking the configured read latency.
+ */
+uint64_t read_simulated_counter(enum RAPL_DOMAIN domain);
+
+/**
+ * Forget the configuration.
+ */
+void close_simulator();
+
+#endif
@@ -0,0 +1,119 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "textformat.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const uint64_t POWERS_OF_TEN[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+char *append_uint(char *buffer, uint64_t value) {
+  char digits[20];
+  int length = 0;
+  do {
+    digits[length++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (length > 0) {
+    *buffer++ = digits[--length];
+  }
+  return buffer;
+}
+
+char *append_fixed(char *buffer, double value, int decimals) {
+  const uint64_t scale = POWERS_OF_TEN[decimals];
+  // 1e18 keeps the scaled value within uint64_t
+  if (!isfinite(value) || fabs(value) >= 1e18 / scale) {
+    return buffer + snprintf(buffer, TEXTFORMAT_MAX_NUMBER_LENGTH, "%.17g", value);
+  }
+  const uint64_t scaled = (uint64_t)(fabs(value) * scale + 0.5);
+  if (value < 0 && scaled > 0) {
+    *buffer++ = '-';
+  }
+  buffer = append_uint(buffer, scaled / scale);
+  if (decimals > 0) {
+    *buffer++ = '.';
+    uint64_t fraction = scaled % scale;
+    for (int i = decimals - 1; i >= 0; i--) {
+      buffer[i] = '0' + fraction % 10;
+      fraction /= 10;
+    }
+    buffer += decimals;
+  }
+  return buffer;
+}
+
+char *append_string(char *buffer, const char *string) {
+  const size_t length = strlen(string);
+  memcpy(buffer, string, length);
+  return buffer + length;
+}
+
+/*
+ * Append a number of a trace record, where JSON has no representation of NaN and infinity.
+ */
+static char *append_value(char *buffer, int json, double value, int decimals) {
+  if (json && !isfinite(value)) {
+    return append_string(buffer, "null");
+  }
+  return append_fixed(buffer, value, decimals);
+}
+
+char *format_trace_record(
+    char *buffer,
+    int json,
+    double time,
+    double interval,
+    uint64_t dropped_before,
+    int num_nodes,
+    int num_domains,
+    unsigned int domain_mask,
+    const double energy_J[]) {
+  char *end = append_string(buffer, json ? "{\"time\":" : "");
+  end = append_value(end, json, time, 9);
+  end = append_string(end, json ? ",\"interval\":" : ",");
+  end = append_value(end, json, interval, 9);
+  end = append_string(end, json ? ",\"dropped\":" : ",");
+  end = append_uint(end, dropped_before);
+  // JSON has an array of the energy of all nodes followed by one of the power, CSV has both columns
+  // of each domain next to each other.
+  for (int watts = 0; watts <= json; watts++) {
+    if (json) {
+      end = append_string(end, watts ? "],\"watts\":[" : ",\"joules\":[");
+    }
+    for (int i = 0; i < num_nodes; i++) {
+      if (json) {
+        end = append_string(end, (i == 0) ? "[" : ",[");
+      }
+      const char *separator = json ? "" : ",";
+      for (int domain = 0; domain < num_domains; ++domain) {
+        if (!(domain_mask & (1u << domain))) {
+          continue;
+        }
+        const double joules = energy_J[i * num_domains + domain];
+        const double power_W = (interval > 0) ? joules / interval : 0;
+        end = append_string(end, separator);
+        if (json) {
+          end = watts ? append_value(end, json, power_W, 3) : append_value(end, json, joules, 6);
+        } else {
+          end = append_fixed(end, joules, 6);
+          end = append_string(end, ",");
+          end = append_fixed(end, power_W, 3);
+        }
+        separator = ",";
+      }
+      if (json) {
+        end = append_string(end, "]");
+      }
+    }
+  }
+  return append_string(end, json ? "]}\n" : "\n");
+}
@@ -0,0 +1,61 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_textformat
+#define _h_textformat
+
+#include <stdint.h>
+
+/*
+ * Formatting of numbers for output that is written for every sample. Unlike printf(), these
+ * functions do not parse a format string and do not depend on the locale. Each one appends to the
+ * given buffer (without terminating it) and returns the end of the appended text, such that a
+ * whole line can be built up and written at once.
+ */
+
+// Enough for any value that is passed to the following functions
+#define TEXTFORMAT_MAX_NUMBER_LENGTH 48
+
+/**
+ * Append an unsigned integer.
+ */
+char *append_uint(char *buffer, uint64_t value);
+
+/**
+ * Append a number with the given number of decimals (at most 9), rounded half away from zero.
+ * Numbers that are not finite or too large for fixed-point notation are appended like "%.17g".
+ */
+char *append_fixed(char *buffer, double value, int decimals);
+
+/**
+ * Append a string.
+ */
+char *append_string(char *buffer, const char *string);
+
+// Enough for a record of format_trace_record() with the given number of energy values
+#define TEXTFORMAT_TRACE_RECORD_LENGTH(num_values) \
+  (64 + (num_values) * 2 * (TEXTFORMAT_MAX_NUMBER_LENGTH + 4))
+
+/**
+ * Append one record of a trace in the CSV or (if json is set) the JSON Lines format, including
+ * the newline. energy_J has num_domains values per node, of which those in domain_mask are
+ * written together with the power over the given interval. JSON has null instead of numbers
+ * that are not finite.
+ */
+char *format_trace_record(
+    char *buffer,
+    int json,
+    double time,
+    double interval,
+    uint64_t dropped_before,
+    int num_nodes,
+    int num_domains,
+    unsigned int domain_mask,
+    const double energy_J[]);
+
+#endif
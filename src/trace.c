@@ -0,0 +1,152 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "trace.h"
+#include "util.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// How long the consumer sleeps if the buffer is empty
+static const struct timespec CONSUMER_POLL_INTERVAL = {.tv_sec = 0, .tv_nsec = 10000000};
+
+/*
+ * The producer only writes head and the consumer only writes tail, each of them with release
+ * semantics after the record itself was written or read. Both counters only increase and the
+ * position of a record in the ring is the counter modulo the capacity. They are placed on separate
+ * cache lines, such that the two threads do not contend for the same line.
+ */
+static struct {
+  uint64_t head __attribute__((aligned(64))); // number of records pushed so far
+  uint64_t tail __attribute__((aligned(64))); // number of records popped so far
+  // fields below are only used by the producer
+  uint64_t pending_drops __attribute__((aligned(64))); // drops since the last pushed record
+  uint64_t total_drops;
+} ring;
+
+static uint64_t capacity = 0; // always a power of two
+static int record_values = 0;
+static double *timestamps;
+static uint64_t *drops;
+static uint64_t *values; // record_values values per record
+
+static pthread_t consumer;
+static int consumer_running = 0;
+static int consumer_stopping = 0;
+static trace_writer_fn_t writer;
+
+int open_trace_buffer(int requested_capacity, int num_values) {
+  assert(capacity == 0);
+  assert(requested_capacity > 0 && num_values > 0);
+
+  uint64_t size = 1;
+  while (size < (uint64_t)requested_capacity) {
+    size *= 2;
+  }
+
+  timestamps = malloc(size * sizeof(double));
+  drops = malloc(size * sizeof(uint64_t));
+  values = malloc(size * num_values * sizeof(uint64_t));
+  if (timestamps == NULL || drops == NULL || values == NULL) {
+    close_trace_buffer();
+    return -1;
+  }
+  memset(&ring, 0, sizeof(ring));
+  capacity = size;
+  record_values = num_values;
+  DEBUG("Allocated trace buffer for %lu records.", (unsigned long)capacity);
+  return 0;
+}
+
+int push_trace_record(double timestamp, const uint64_t record[]) {
+  const uint64_t head = ring.head; // only written by this thread
+  if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) == capacity) {
+    ring.pending_drops++;
+    __atomic_store_n(&ring.total_drops, ring.total_drops + 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+
+  const uint64_t position = head & (capacity - 1);
+  timestamps[position] = timestamp;
+  drops[position] = ring.pending_drops;
+  memcpy(&values[position * record_values], record, record_values * sizeof(uint64_t));
+  ring.pending_drops = 0;
+  __atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int pop_trace_record(double *timestamp, uint64_t *dropped_before, uint64_t record[]) {
+  const uint64_t tail = ring.tail; // only written by this thread
+  if (__atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) == tail) {
+    return -1;
+  }
+
+  const uint64_t position = tail & (capacity - 1);
+  *timestamp = timestamps[position];
+  *dropped_before = drops[position];
+  memcpy(record, &values[position * record_values], record_values * sizeof(uint64_t));
+  __atomic_store_n(&ring.tail, tail + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+uint64_t get_dropped_trace_records() {
+  return __atomic_load_n(&ring.total_drops, __ATOMIC_RELAXED);
+}
+
+static void *consume_trace(void *arg) {
+  (void)arg;
+  uint64_t record[record_values];
+  double timestamp;
+  uint64_t dropped_before;
+  while (1) {
+    // check for stopping first, such that the records pushed before stopping are still written
+    const int stopping = __atomic_load_n(&consumer_stopping, __ATOMIC_ACQUIRE);
+    while (pop_trace_record(&timestamp, &dropped_before, record) == 0) {
+      writer(timestamp, dropped_before, record);
+    }
+    if (stopping) {
+      return NULL;
+    }
+    nanosleep(&CONSUMER_POLL_INTERVAL, NULL);
+  }
+}
+
+int start_trace_consumer(trace_writer_fn_t write_record) {
+  assert(capacity > 0 && !consumer_running);
+  writer = write_record;
+  consumer_stopping = 0;
+  if (pthread_create(&consumer, NULL, &consume_trace, NULL) != 0) {
+    return -1;
+  }
+  consumer_running = 1;
+  return 0;
+}
+
+void stop_trace_consumer() {
+  if (!consumer_running) {
+    return;
+  }
+  __atomic_store_n(&consumer_stopping, 1, __ATOMIC_RELEASE);
+  pthread_join(consumer, NULL);
+  consumer_running = 0;
+}
+
+void close_trace_buffer() {
+  stop_trace_consumer();
+  free(timestamps);
+  timestamps = NULL;
+  free(drops);
+  drops = NULL;
+  free(values);
+  values = NULL;
+  capacity = 0;
+  record_values = 0;
+}
@@ -0,0 +1,74 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_trace
+#define _h_trace
+
+#include <stdint.h>
+
+/*
+ * Buffer for tracing, i.e., for passing one record per sample from the measurement loop
+ * (the single producer) to a consumer thread that writes them out (the single consumer).
+ * The buffer is a lock-free ring, such that the producer never waits for slow output:
+ * if the ring is full, the record is dropped and the drop is counted instead.
+ *
+ * Each record consists of a timestamp, the number of records that were dropped directly before it,
+ * and a fixed number of values (e.g., energy deltas in counter ticks).
+ */
+
+/**
+ * Called by the consumer thread for each record in the order in which they were pushed.
+ */
+typedef void (*trace_writer_fn_t)(double timestamp, uint64_t dropped_before, const uint64_t values[]);
+
+/**
+ * Allocate a buffer for capacity records (rounded up to a power of two)
+ * of num_values values each.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_trace_buffer(int capacity, int num_values);
+
+/**
+ * Append a record to the buffer. Must only be called by the producer.
+ *
+ * @return 0 on success and -1 if the buffer is full and the record was dropped
+ */
+int push_trace_record(double timestamp, const uint64_t values[]);
+
+/**
+ * Take the oldest record from the buffer. Must only be called by the consumer.
+ *
+ * @return 0 on success and -1 if the buffer is empty
+ */
+int pop_trace_record(double *timestamp, uint64_t *dropped_before, uint64_t values[]);
+
+/**
+ * Get the number of records that were dropped so far because the buffer was full.
+ */
+uint64_t get_dropped_trace_records();
+
+/**
+ * Start a thread that repeatedly takes all records from the buffer and passes them to write_record.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int start_trace_consumer(trace_writer_fn_t write_record);
+
+/**
+ * Let the consumer thread write the remaining records and wait for it to finish.
+ * Does nothing if it is not running.
+ */
+void stop_trace_consumer();
+
+/**
+ * Stop the consumer thread and free the buffer.
+ */
+void close_trace_buffer();
+
+#endif
@@ -0,0 +1,505 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "tracefile.h"
+
+#include <assert.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TEST // don't print the error-msg when unit-testing
+#define warnx(...)
+#define warn(...)
+#endif
+
+static const char HEADER_MAGIC[8] = {'C', 'E', 'M', 'T', 'R', 'A', 'C', 'E'};
+static const char CHUNK_MAGIC[4] = {'C', 'H', 'N', 'K'};
+
+#define MAX_VARINT_SIZE 10 // bytes of a 64-bit varint
+#define MAX_COLUMNS 65536
+#define CHUNK_RECORDS 1024 // a truncated file loses at most about one second at 1 ms per sample
+
+/*
+ * State of the deltas of deltas, which restarts from 0 in each chunk.
+ */
+typedef struct {
+  uint64_t time; // microseconds
+  uint64_t time_increase;
+  uint64_t *values; // one per column
+} delta_state_t;
+
+static FILE *trace_file;
+static trace_file_header_t trace_header;
+static delta_state_t write_state;
+static uint8_t *chunk; // encoded records of the current chunk
+static size_t chunk_size = 0;
+static uint64_t chunk_records = 0;
+
+static FILE *reader_file;
+static trace_file_header_t reader_header;
+static delta_state_t read_state;
+static uint8_t *reader_chunk;
+static size_t reader_chunk_size = 0;
+static size_t reader_position = 0;
+static uint64_t reader_remaining_records = 0;
+static uint64_t reader_skipped_chunks = 0;
+static uint64_t reader_skipped_records = 0;
+
+/* CRC-32 as used by zlib and PNG */
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size) {
+  if (crc_table[1] == 0) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int bit = 0; bit < 8; bit++) {
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      crc_table[i] = c;
+    }
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/* Encoding */
+
+static size_t put_varint(uint8_t *target, uint64_t value) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    target[size++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  target[size++] = (uint8_t)value;
+  return size;
+}
+
+static size_t put_double(uint8_t *target, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  for (int i = 0; i < 8; i++) {
+    target[i] = (uint8_t)(bits >> (8 * i));
+  }
+  return 8;
+}
+
+static size_t put_uint32(uint8_t *target, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    target[i] = (uint8_t)(value >> (8 * i));
+  }
+  return 4;
+}
+
+static uint64_t zigzag(uint64_t difference) {
+  return (difference << 1) ^ (uint64_t)((int64_t)difference >> 63);
+}
+
+static uint64_t unzigzag(uint64_t value) {
+  return (value >> 1) ^ (uint64_t)(-(int64_t)(value & 1));
+}
+
+static int count_columns(const trace_file_header_t *header) {
+  return header->num_nodes * __builtin_popcount(header->domain_mask);
+}
+
+static int init_delta_state(delta_state_t *state, int num_columns) {
+  state->values = calloc(num_columns, sizeof(uint64_t));
+  state->time = 0;
+  state->time_increase = 0;
+  return (state->values == NULL) ? -1 : 0;
+}
+
+static void reset_delta_state(delta_state_t *state, int num_columns) {
+  state->time = 0;
+  state->time_increase = 0;
+  memset(state->values, 0, num_columns * sizeof(uint64_t));
+}
+
+int open_trace_file(const char *path, const trace_file_header_t *header) {
+  assert(trace_file == NULL);
+  if (header->num_columns != count_columns(header) || header->num_columns <= 0
+      || header->num_columns > MAX_COLUMNS) {
+    return -1;
+  }
+
+  uint8_t
+      encoded_header[sizeof(HEADER_MAGIC) + 3 * MAX_VARINT_SIZE + (4 + header->num_columns) * 8 + 4];
+  size_t size = 0;
+  memcpy(encoded_header, HEADER_MAGIC, sizeof(HEADER_MAGIC));
+  size += sizeof(HEADER_MAGIC);
+  size += put_varint(&encoded_header[size], TRACE_FILE_VERSION);
+  size += put_varint(&encoded_header[size], header->num_nodes);
+  size += put_varint(&encoded_header[size], header->domain_mask);
+  size += put_double(&encoded_header[size], header->time_unit);
+  size += put_double(&encoded_header[size], header->energy_unit);
+  size += put_double(&encoded_header[size], header->dram_energy_unit);
+  size += put_double(&encoded_header[size], header->power_unit);
+  for (int i = 0; i < header->num_columns; i++) {
+    size += put_double(&encoded_header[size], header->units[i]);
+  }
+  size += put_uint32(&encoded_header[size], crc32_update(0, encoded_header, size));
+
+  trace_header = *header;
+  trace_header.units = NULL; // not needed for writing
+  chunk = malloc(CHUNK_RECORDS * (2 + header->num_columns) * MAX_VARINT_SIZE);
+  if (chunk == NULL || init_delta_state(&write_state, header->num_columns) != 0) {
+    close_trace_file();
+    return -1;
+  }
+
+  trace_file = fopen(path, "wb");
+  if (trace_file == NULL) {
+    warn("Could not create trace file %s", path);
+    close_trace_file();
+    return -1;
+  }
+  if (fwrite(encoded_header, 1, size, trace_file) != size) {
+    warn("Could not write trace file %s", path);
+    close_trace_file();
+    return -1;
+  }
+  return 0;
+}
+
+static int write_chunk() {
+  if (chunk_records == 0) {
+    return 0;
+  }
+  uint8_t chunk_header[sizeof(CHUNK_MAGIC) + 2 * MAX_VARINT_SIZE + 4];
+  size_t size = 0;
+  memcpy(chunk_header, CHUNK_MAGIC, sizeof(CHUNK_MAGIC));
+  size += sizeof(CHUNK_MAGIC);
+  size += put_varint(&chunk_header[size], chunk_size);
+  size += put_varint(&chunk_header[size], chunk_records);
+  size += put_uint32(&chunk_header[size], crc32_update(0, chunk, chunk_size));
+
+  const int result = (fwrite(chunk_header, 1, size, trace_file) == size
+                      && fwrite(chunk, 1, chunk_size, trace_file) == chunk_size
+                      && fflush(trace_file) == 0)
+                         ? 0
+                         : -1;
+  chunk_size = 0;
+  chunk_records = 0;
+  reset_delta_state(&write_state, trace_header.num_columns);
+  return result;
+}
+
+int write_trace_file_record(double time, uint64_t dropped_before, const uint64_t values[]) {
+  assert(trace_file != NULL);
+  const uint64_t time_us = (uint64_t)(time * 1e6 + 0.5);
+  const uint64_t time_increase = time_us - write_state.time;
+
+  const uint64_t time_field = zigzag(time_increase - write_state.time_increase) << 1;
+  if (dropped_before > 0) {
+    chunk_size += put_varint(&chunk[chunk_size], time_field | 1);
+    chunk_size += put_varint(&chunk[chunk_size], dropped_before);
+  } else {
+    chunk_size += put_varint(&chunk[chunk_size], time_field);
+  }
+  write_state.time = time_us;
+  write_state.time_increase = time_increase;
+  for (int i = 0; i < trace_header.num_columns; i++) {
+    chunk_size += put_varint(&chunk[chunk_size], zigzag(values[i] - write_state.values[i]));
+    write_state.values[i] = values[i];
+  }
+
+  if (++chunk_records == CHUNK_RECORDS) {
+    if (write_chunk() != 0) {
+      warn("Could not write trace file");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int close_trace_file() {
+  int result = 0;
+  if (trace_file != NULL) {
+    result = write_chunk();
+    if (fclose(trace_file) != 0 || result != 0) {
+      warn("Could not write trace file");
+      result = -1;
+    }
+    trace_file = NULL;
+  }
+  free(chunk);
+  chunk = NULL;
+  chunk_size = 0;
+  chunk_records = 0;
+  free(write_state.values);
+  write_state.values = NULL;
+  return result;
+}
+
+/* Decoding */
+
+/*
+ * Read a varint from the file and add its bytes to the CRC (if crc is not NULL).
+ */
+static int read_varint_from_file(FILE *file, uint64_t *value, uint32_t *crc) {
+  *value = 0;
+  for (int i = 0; i < MAX_VARINT_SIZE; i++) {
+    const int c = fgetc(file);
+    if (c == EOF) {
+      return -1;
+    }
+    if (crc != NULL) {
+      const uint8_t byte = (uint8_t)c;
+      *crc = crc32_update(*crc, &byte, 1);
+    }
+    *value |= (uint64_t)(c & 0x7f) << (7 * i);
+    if (!(c & 0x80)) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int read_bytes_from_file(FILE *file, uint8_t *target, size_t size, uint32_t *crc) {
+  if (fread(target, 1, size, file) != size) {
+    return -1;
+  }
+  if (crc != NULL) {
+    *crc = crc32_update(*crc, target, size);
+  }
+  return 0;
+}
+
+static uint32_t get_uint32(const uint8_t *source) {
+  return source[0] | (source[1] << 8) | (source[2] << 16) | ((uint32_t)source[3] << 24);
+}
+
+static int read_double_from_file(FILE *file, double *value, uint32_t *crc) {
+  uint8_t bytes[8];
+  if (read_bytes_from_file(file, bytes, sizeof(bytes), crc) != 0) {
+    return -1;
+  }
+  uint64_t bits = 0;
+  for (int i = 0; i < 8; i++) {
+    bits |= (uint64_t)bytes[i] << (8 * i);
+  }
+  memcpy(value, &bits, sizeof(bits));
+  return 0;
+}
+
+static int read_header(FILE *file, trace_file_header_t *header) {
+  uint32_t crc = 0;
+  uint8_t magic[sizeof(HEADER_MAGIC)];
+  uint64_t version, num_nodes, domain_mask;
+  if (read_bytes_from_file(file, magic, sizeof(magic), &crc) != 0
+      || memcmp(magic, HEADER_MAGIC, sizeof(magic)) != 0
+      || read_varint_from_file(file, &version, &crc) != 0 || version != TRACE_FILE_VERSION
+      || read_varint_from_file(file, &num_nodes, &crc) != 0
+      || read_varint_from_file(file, &domain_mask, &crc) != 0 || num_nodes > MAX_COLUMNS
+      || domain_mask > 0xff) {
+    return -1;
+  }
+  header->num_nodes = num_nodes;
+  header->domain_mask = domain_mask;
+  header->num_columns = count_columns(header);
+  if (header->num_columns <= 0 || header->num_columns > MAX_COLUMNS
+      || read_double_from_file(file, &header->time_unit, &crc) != 0
+      || read_double_from_file(file, &header->energy_unit, &crc) != 0
+      || read_double_from_file(file, &header->dram_energy_unit, &crc) != 0
+      || read_double_from_file(file, &header->power_unit, &crc) != 0) {
+    return -1;
+  }
+  header->units = malloc(header->num_columns * sizeof(double));
+  if (header->units == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < header->num_columns; i++) {
+    if (read_double_from_file(file, &header->units[i], &crc) != 0) {
+      return -1;
+    }
+  }
+  uint8_t stored_crc[4];
+  if (read_bytes_from_file(file, stored_crc, sizeof(stored_crc), NULL) != 0
+      || get_uint32(stored_crc) != crc) {
+    return -1;
+  }
+  return 0;
+}
+
+int open_trace_file_reader(const char *path, trace_file_header_t *header) {
+  assert(reader_file == NULL);
+  reader_file = fopen(path, "rb");
+  if (reader_file == NULL) {
+    warn("Could not open trace file %s", path);
+    return -1;
+  }
+
+  memset(&reader_header, 0, sizeof(reader_header));
+  if (read_header(reader_file, &reader_header) != 0
+      || init_delta_state(&read_state, reader_header.num_columns) != 0) {
+    warnx("%s is not a valid trace file.", path);
+    close_trace_file_reader();
+    return -1;
+  }
+  *header = reader_header;
+  return 0;
+}
+
+/*
+ * Read the chunk at the current position of reader_file into reader_chunk. The number of records
+ * is stored in num_records as soon as the header of the chunk is known to be plausible.
+ * Returns 0 on success, 1 at the end of the file, and -1 for a truncated or corrupted chunk.
+ */
+static int read_chunk_at_position(uint64_t *num_records) {
+  uint8_t magic[sizeof(CHUNK_MAGIC)];
+  const size_t magic_size = fread(magic, 1, sizeof(magic), reader_file);
+  if (magic_size == 0 && feof(reader_file)) {
+    return 1;
+  }
+  uint64_t payload_size, records;
+  uint8_t stored_crc[4];
+  if (magic_size != sizeof(magic) || memcmp(magic, CHUNK_MAGIC, sizeof(magic)) != 0
+      || read_varint_from_file(reader_file, &payload_size, NULL) != 0
+      || read_varint_from_file(reader_file, &records, NULL) != 0
+      || read_bytes_from_file(reader_file, stored_crc, sizeof(stored_crc), NULL) != 0
+      || records == 0 || records > CHUNK_RECORDS
+      || payload_size > (uint64_t)CHUNK_RECORDS * (2 + reader_header.num_columns) * MAX_VARINT_SIZE) {
+    return -1;
+  }
+  *num_records = records;
+
+  if (payload_size > reader_chunk_size) {
+    uint8_t *buffer = realloc(reader_chunk, payload_size);
+    if (buffer == NULL) {
+      return -1;
+    }
+    reader_chunk = buffer;
+  }
+  reader_chunk_size = payload_size;
+  if (read_bytes_from_file(reader_file, reader_chunk, payload_size, NULL) != 0
+      || crc32_update(0, reader_chunk, payload_size) != get_uint32(stored_crc)) {
+    return -1;
+  }
+  reader_position = 0;
+  reader_remaining_records = records;
+  reset_delta_state(&read_state, reader_header.num_columns);
+  return 0;
+}
+
+/*
+ * Move reader_file to the next occurrence of the chunk magic at or after the given offset.
+ * Returns 0 on success and -1 if there is none.
+ */
+static int seek_next_chunk(long offset) {
+  if (fseek(reader_file, offset, SEEK_SET) != 0) {
+    return -1;
+  }
+  size_t matched = 0;
+  int c;
+  while ((c = fgetc(reader_file)) != EOF) {
+    if (c == CHUNK_MAGIC[matched]) {
+      matched++;
+    } else {
+      // the first byte of the magic does not occur again in it
+      matched = (c == CHUNK_MAGIC[0]) ? 1 : 0;
+    }
+    if (matched == sizeof(CHUNK_MAGIC)) {
+      return fseek(reader_file, -(long)sizeof(CHUNK_MAGIC), SEEK_CUR);
+    }
+  }
+  return -1;
+}
+
+/*
+ * Read the next intact chunk into reader_chunk. Corrupted chunks are skipped by searching for
+ * the magic of the next chunk, and counted in reader_skipped_chunks and reader_skipped_records.
+ * Returns 0 on success, 1 at the end of the file, and -1 if no intact chunk follows a
+ * truncated or corrupted one.
+ */
+static int read_chunk() {
+  for (;;) {
+    const long start = ftell(reader_file);
+    uint64_t num_records = 0;
+    const int result = read_chunk_at_position(&num_records);
+    if (result >= 0) {
+      return result;
+    }
+    reader_skipped_chunks++;
+    reader_skipped_records += num_records;
+    if (start < 0 || seek_next_chunk(start + 1) != 0) {
+      return -1;
+    }
+  }
+}
+
+static int get_varint(uint64_t *value) {
+  *value = 0;
+  for (int i = 0; i < MAX_VARINT_SIZE && reader_position < reader_chunk_size; i++) {
+    const uint8_t byte = reader_chunk[reader_position++];
+    *value |= (uint64_t)(byte & 0x7f) << (7 * i);
+    if (!(byte & 0x80)) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int read_trace_file_record(double *time, uint64_t *dropped_before, uint64_t values[]) {
+  assert(reader_file != NULL);
+  if (reader_remaining_records == 0) {
+    const int result = read_chunk();
+    if (result != 0) {
+      return result;
+    }
+  }
+
+  uint64_t encoded;
+  if (get_varint(&encoded) != 0) {
+    return -1;
+  }
+  *dropped_before = 0;
+  if ((encoded & 1) && get_varint(dropped_before) != 0) {
+    return -1;
+  }
+  read_state.time_increase += unzigzag(encoded >> 1);
+  read_state.time += read_state.time_increase;
+  for (int i = 0; i < reader_header.num_columns; i++) {
+    if (get_varint(&encoded) != 0) {
+      return -1;
+    }
+    read_state.values[i] += unzigzag(encoded);
+    values[i] = read_state.values[i];
+  }
+  *time = read_state.time / 1e6;
+  reader_remaining_records--;
+  return 0;
+}
+
+void get_skipped_trace_file_chunks(uint64_t *chunks, uint64_t *records) {
+  *chunks = reader_skipped_chunks;
+  *records = reader_skipped_records;
+}
+
+void close_trace_file_reader() {
+  if (reader_file != NULL) {
+    fclose(reader_file);
+    reader_file = NULL;
+  }
+  free(reader_header.units);
+  memset(&reader_header, 0, sizeof(reader_header));
+  free(read_state.values);
+  read_state.values = NULL;
+  free(reader_chunk);
+  reader_chunk = NULL;
+  reader_chunk_size = 0;
+  reader_position = 0;
+  reader_remaining_records = 0;
+  reader_skipped_chunks = 0;
+  reader_skipped_records = 0;
+}
@@ -0,0 +1,111 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_tracefile
+#define _h_tracefile
+
+#include <stdint.h>
+
+/*
+ * Compact binary files for traces, i.e., for the energy consumed by each domain of each node in
+ * every interval of a measurement with a high sampling rate.
+ *
+ * All integers are unsigned LEB128 varints ("varint") and all floating-point numbers are IEEE 754
+ * doubles in little-endian byte order ("double"). A file consists of a header and any number of
+ * chunks:
+ *
+ *   header:  "CEMTRACE" version:varint num_nodes:varint domain_mask:varint
+ *            time_unit:double energy_unit:double dram_energy_unit:double power_unit:double
+ *            unit:double (for each column) crc32:4 bytes (of everything before)
+ *   chunk:   "CHNK" payload_size:varint num_records:varint crc32:4 bytes (of payload) payload
+ *   payload: one record after the other, each consisting of
+ *            time:zigzag+flag [dropped_before:varint] value:zigzag (for each column)
+ *
+ * Bit d of domain_mask is set if domain d (enum RAPL_DOMAIN) is supported, and there is one column
+ * per node and supported domain (in this order, i.e., the domains of node 0 come first). The unit
+ * of a column is the number of joules per tick of its values. Records contain the time in
+ * microseconds since the start of the measurement and the ticks consumed since the previous record
+ * in each column. dropped_before is the number of samples that were dropped directly before the
+ * record, whose ticks are contained in the record. It is only present if the lowest bit of the
+ * time field is set, and the remaining bits are the zig-zag encoded time.
+ *
+ * The time and the values are stored as deltas of deltas: each one is stored as the difference
+ * between its increase over the previous record and the increase of the previous record,
+ * zig-zag encoded into a varint (0, -1, 1, -2, ... become 0, 1, 2, 3, ...). For evenly spaced
+ * samples with similar power this is mostly one byte per value. The deltas restart from 0 in each
+ * chunk, such that each chunk can be decoded on its own, and a truncated or corrupted chunk only
+ * loses the records in it: the reader skips it by searching for the magic of the next chunk.
+ */
+
+#define TRACE_FILE_VERSION 1
+
+typedef struct {
+  int num_nodes;
+  unsigned int domain_mask; // bit d set for each supported domain d
+  // unit multipliers as determined by read_rapl_units()
+  double time_unit;
+  double energy_unit;
+  double dram_energy_unit;
+  double power_unit;
+  int num_columns; // num_nodes times the number of supported domains
+  double *units; // joules per tick of each column
+} trace_file_header_t;
+
+/**
+ * Create a trace file and write the given header to it.
+ *
+ * @return 0 on success and -1 on failure
+ */
+int open_trace_file(const char *path, const trace_file_header_t *header);
+
+/**
+ * Append one record to the trace file, where time is the number of seconds since the start of the
+ * measurement and values contains the ticks consumed since the previous record for each column.
+ * The records are written in chunks, i.e., not immediately.
+ *
+ * @return 0 on success and -1 if writing failed
+ */
+int write_trace_file_record(double time, uint64_t dropped_before, const uint64_t values[]);
+
+/**
+ * Write the last chunk and close the trace file.
+ *
+ * @return 0 on success and -1 if writing failed
+ */
+int close_trace_file();
+
+/**
+ * Open a trace file for reading and read its header.
+ * The header is valid until close_trace_file_reader() is called.
+ *
+ * @return 0 on success and -1 if the file cannot be read or is not a trace file
+ */
+int open_trace_file_reader(const char *path, trace_file_header_t *header);
+
+/**
+ * Read the next record of the trace file that was opened for reading.
+ * Corrupted chunks are skipped, get_skipped_trace_file_chunks() tells how many.
+ *
+ * @return 0 on success, 1 at the end of the file,
+ *         and -1 if the rest of the file is truncated or corrupted
+ */
+int read_trace_file_record(double *time, uint64_t *dropped_before, uint64_t values[]);
+
+/**
+ * Get the number of truncated or corrupted chunks that were skipped while reading the trace file,
+ * and the number of records in them. The records of a chunk whose header is corrupted cannot be
+ * counted.
+ */
+void get_skipped_trace_file_chunks(uint64_t *chunks, uint64_t *records);
+
+/**
+ * Close the trace file that was opened for reading.
+ */
+void close_trace_file_reader();
+
+#endif
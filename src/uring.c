@@ -0,0 +1,222 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "uring.h"
+#include "util.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * We use the system calls directly instead of liburing in order to avoid an additional dependency.
+ * For documentation see https://kernel.dk/io_uring.pdf and io_uring_setup(2).
+ */
+
+static int ring_fd = -1;
+
+static void *sq_ptr = MAP_FAILED;
+static size_t sq_size;
+static void *cq_ptr = MAP_FAILED;
+static size_t cq_size;
+static struct io_uring_sqe *sqes = MAP_FAILED;
+static size_t sqes_size;
+
+static unsigned *sq_tail;
+static unsigned *sq_mask;
+static unsigned *sq_array;
+static unsigned *cq_head;
+static unsigned *cq_tail;
+static unsigned *cq_mask;
+static struct io_uring_cqe *cqes;
+
+// prepared reads
+static int num_reads = 0;
+static int *read_fds;
+static off_t *read_offsets;
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int map_rings(const struct io_uring_params *p) {
+  sq_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+  cq_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+  const int single_mmap = p->features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_size = cq_size = (sq_size > cq_size) ? sq_size : cq_size;
+  }
+
+  sq_ptr = mmap(
+      NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ptr == MAP_FAILED) {
+    return -1;
+  }
+  if (single_mmap) {
+    cq_ptr = sq_ptr;
+  } else {
+    cq_ptr = mmap(
+        NULL,
+        cq_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        ring_fd,
+        IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) {
+      return -1;
+    }
+  }
+
+  sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+  sqes = mmap(
+      NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return -1;
+  }
+
+  sq_tail = (unsigned *)((char *)sq_ptr + p->sq_off.tail);
+  sq_mask = (unsigned *)((char *)sq_ptr + p->sq_off.ring_mask);
+  sq_array = (unsigned *)((char *)sq_ptr + p->sq_off.array);
+  cq_head = (unsigned *)((char *)cq_ptr + p->cq_off.head);
+  cq_tail = (unsigned *)((char *)cq_ptr + p->cq_off.tail);
+  cq_mask = (unsigned *)((char *)cq_ptr + p->cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)((char *)cq_ptr + p->cq_off.cqes);
+  return 0;
+}
+
+int open_uring(int count, const int fds[], const off_t offsets[]) {
+  assert(ring_fd == -1);
+  if (count <= 0) {
+    return -1;
+  }
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd = io_uring_setup(count, &params);
+  if (ring_fd == -1) {
+    DEBUG("io_uring is not available: %s", strerror(errno));
+    return -1;
+  }
+  if (map_rings(&params) != 0) {
+    DEBUG("Could not map io_uring: %s", strerror(errno));
+    close_uring();
+    return -1;
+  }
+
+  read_fds = malloc(count * sizeof(int));
+  read_offsets = malloc(count * sizeof(off_t));
+  if (read_fds == NULL || read_offsets == NULL) {
+    close_uring();
+    return -1;
+  }
+  memcpy(read_fds, fds, count * sizeof(int));
+  memcpy(read_offsets, offsets, count * sizeof(off_t));
+  num_reads = count;
+
+  // Older kernels do not support IORING_OP_READ, which we can only find out by trying.
+  uint64_t values[count];
+  unsigned char failed[count];
+  if (read_uring(values, failed) != 0) {
+    close_uring();
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    if (failed[i] == EINVAL) {
+      DEBUG("io_uring does not support IORING_OP_READ.%s", "");
+      close_uring();
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int is_uring_open() {
+  return ring_fd != -1;
+}
+
+int read_uring(uint64_t values[], unsigned char failed[]) {
+  assert(ring_fd != -1);
+
+  // fill the submission queue
+  unsigned tail = *sq_tail;
+  for (int i = 0; i < num_reads; i++) {
+    const unsigned index = tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = read_fds[i];
+    sqe->off = read_offsets[i];
+    sqe->addr = (uintptr_t)&values[i];
+    sqe->len = sizeof(uint64_t);
+    sqe->user_data = i;
+    sq_array[index] = index;
+    tail++;
+  }
+  __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+  if (io_uring_enter(num_reads, num_reads, IORING_ENTER_GETEVENTS) < 0) {
+    return -1;
+  }
+
+  // reap the completions, which may arrive in any order
+  int completed = 0;
+  while (completed < num_reads) {
+    unsigned head = *cq_head;
+    const unsigned available = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != available; head++, completed++) {
+      const struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+      const int res = cqe->res;
+      // store the (positive) error code to let open_uring() detect unsupported operations
+      failed[cqe->user_data] = (res == sizeof(uint64_t)) ? 0 : (res < 0 ? -res : EIO);
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    if (completed < num_reads && io_uring_enter(0, num_reads - completed, IORING_ENTER_GETEVENTS) < 0
+        && errno != EINTR) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void close_uring() {
+  if (sqes != MAP_FAILED) {
+    munmap(sqes, sqes_size);
+    sqes = MAP_FAILED;
+  }
+  if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+    munmap(cq_ptr, cq_size);
+  }
+  cq_ptr = MAP_FAILED;
+  if (sq_ptr != MAP_FAILED) {
+    munmap(sq_ptr, sq_size);
+    sq_ptr = MAP_FAILED;
+  }
+  if (ring_fd != -1) {
+    close(ring_fd);
+    ring_fd = -1;
+  }
+  free(read_fds);
+  read_fds = NULL;
+  free(read_offsets);
+  read_offsets = NULL;
+  num_reads = 0;
+}
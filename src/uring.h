@@ -0,0 +1,48 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2015-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _h_uring
+#define _h_uring
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Concurrent reads of MSRs with io_uring (Linux 5.6 or newer).
+ * All reads of a sample are submitted with a single io_uring_enter() call. The kernel executes
+ * reads of the MSR device files in its worker threads, such that the cross-CPU calls for different
+ * sockets overlap instead of being executed one after another.
+ */
+
+/**
+ * Set up an io_uring and prepare it for count reads of 8 bytes each,
+ * where read i is from fds[i] at offsets[i].
+ *
+ * @return 0 on success and -1 if io_uring is not available
+ */
+int open_uring(int count, const int fds[], const off_t offsets[]);
+
+/**
+ * Check whether the io_uring is set up.
+ */
+int is_uring_open();
+
+/**
+ * Execute all prepared reads concurrently and wait for their completion.
+ * Stores the result of read i in values[i] and whether it failed in failed[i].
+ *
+ * @return 0 on success and -1 if the reads could not be submitted
+ */
+int read_uring(uint64_t values[], unsigned char failed[]);
+
+/**
+ * Tear down the io_uring.
+ */
+void close_uring();
+
+#endif
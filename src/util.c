@@ -15,7 +15,9 @@
 
 #include <err.h>
 #include <grp.h>
+#include <string.h>
 #include <sys/capability.h>
+#include <time.h>
 #include <unistd.h>
 
 static int debug_enabled = 0;
@@ -128,3 +130,22 @@ int bind_context(cpu_set_t *new_context, cpu_set_t *old_context) {
 
   return 0;
 }
+
+int read_sysfs_file(const char *path, char *buf, size_t size) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  const int result = (fgets(buf, size, file) != NULL) ? 0 : -1;
+  fclose(file);
+  if (result == 0) {
+    buf[strcspn(buf, "\n")] = '\0';
+  }
+  return result;
+}
+
+double get_monotonic_time() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
@@ -56,4 +56,17 @@ int bind_cpu(int cpu, cpu_set_t *old_context);
  */
 int bind_context(cpu_set_t *new_context, cpu_set_t *old_context);
 
+/**
+ * Read the first line of a (small) file like the ones in sysfs into buf, without the trailing
+ * newline.
+ *
+ * Returns 0 on success and -1 on failure.
+ */
+int read_sysfs_file(const char *path, char *buf, size_t size);
+
+/**
+ * Get the current time in seconds of CLOCK_MONOTONIC.
+ */
+double get_monotonic_time();
+
 #endif /* _h_util */
@@ -0,0 +1,115 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "cgroup.h"
+#include "mock_util.h"
+
+static char root[] = "/tmp/test_cgroup_XXXXXX";
+static char *cgroups[] = {"a", "b/c"};
+
+static void write_usage(const char *cgroup, unsigned long usage_usec) {
+  char path[128];
+  snprintf(path, sizeof(path), "%s/%s/cpu.stat", root, cgroup);
+  FILE *file = fopen(path, "w");
+  TEST_ASSERT_NOT_NULL(file);
+  fprintf(file, "usage_usec %lu\nuser_usec 0\nsystem_usec 0\n", usage_usec);
+  fclose(file);
+}
+
+static void remove_file(const char *cgroup) {
+  char path[128];
+  snprintf(path, sizeof(path), "%s/%s/cpu.stat", root, cgroup);
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/%s", root, cgroup);
+  rmdir(path);
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  TEST_ASSERT_NOT_NULL(mkdtemp(root));
+  char path[128];
+  snprintf(path, sizeof(path), "%s/a", root);
+  mkdir(path, 0755);
+  snprintf(path, sizeof(path), "%s/b", root);
+  mkdir(path, 0755);
+  snprintf(path, sizeof(path), "%s/b/c", root);
+  mkdir(path, 0755);
+  write_usage(".", 1000000);
+  write_usage("a", 100000);
+  write_usage("b/c", 0);
+}
+
+void tearDown(void) {
+  close_cgroup_attribution();
+  remove_file("b/c");
+  remove_file("b");
+  remove_file("a");
+  remove_file(".");
+  rmdir(root);
+  strcpy(root, "/tmp/test_cgroup_XXXXXX");
+}
+
+void test_CgroupAttribution_SplitsEnergyByCpuTime(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_cgroup_attribution(root, 2, cgroups, 4));
+  update_cgroup_attribution(10.0, NULL);
+
+  // In one second of 4 CPUs, a ran for 1s, b/c for 0.5s, and other processes for 0.5s.
+  write_usage(".", 3000000);
+  write_usage("a", 1100000);
+  write_usage("b/c", 500000);
+  const double energy_J[CGROUP_NR_DOMAIN] = {40.0, 20.0};
+  update_cgroup_attribution(11.0, energy_J);
+
+  TEST_ASSERT_EQUAL_INT(4, get_num_cgroup_entries());
+  TEST_ASSERT_EQUAL_STRING("a", get_cgroup_energy(0)->name);
+  TEST_ASSERT_EQUAL_DOUBLE(1.0, get_cgroup_energy(0)->cpu_seconds);
+  TEST_ASSERT_EQUAL_DOUBLE(10.0, get_cgroup_energy(0)->energy_J[CGROUP_DOMAIN_PACKAGE]);
+  TEST_ASSERT_EQUAL_DOUBLE(5.0, get_cgroup_energy(0)->energy_J[CGROUP_DOMAIN_CORE]);
+  TEST_ASSERT_EQUAL_STRING("b/c", get_cgroup_energy(1)->name);
+  TEST_ASSERT_EQUAL_DOUBLE(5.0, get_cgroup_energy(1)->energy_J[CGROUP_DOMAIN_PACKAGE]);
+  TEST_ASSERT_EQUAL_STRING("other", get_cgroup_energy(2)->name);
+  TEST_ASSERT_EQUAL_DOUBLE(0.5, get_cgroup_energy(2)->cpu_seconds);
+  TEST_ASSERT_EQUAL_DOUBLE(5.0, get_cgroup_energy(2)->energy_J[CGROUP_DOMAIN_PACKAGE]);
+  TEST_ASSERT_EQUAL_STRING("idle", get_cgroup_energy(3)->name);
+  TEST_ASSERT_EQUAL_DOUBLE(2.0, get_cgroup_energy(3)->cpu_seconds);
+  TEST_ASSERT_EQUAL_DOUBLE(20.0, get_cgroup_energy(3)->energy_J[CGROUP_DOMAIN_PACKAGE]);
+
+  // the next interval is idle and accumulates on top of the previous one
+  const double next_energy_J[CGROUP_NR_DOMAIN] = {50.0, 22.0};
+  update_cgroup_attribution(12.0, next_energy_J);
+  TEST_ASSERT_EQUAL_DOUBLE(10.0, get_cgroup_energy(0)->energy_J[CGROUP_DOMAIN_PACKAGE]);
+  TEST_ASSERT_EQUAL_DOUBLE(30.0, get_cgroup_energy(3)->energy_J[CGROUP_DOMAIN_PACKAGE]);
+  TEST_ASSERT_EQUAL_DOUBLE(12.0, get_cgroup_energy(3)->energy_J[CGROUP_DOMAIN_CORE]);
+}
+
+void test_CgroupAttribution_LimitsCpuTimeToCapacity(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_cgroup_attribution(root, 2, cgroups, 1));
+  update_cgroup_attribution(0.0, NULL);
+  // the cgroup was read slightly later than the counters and reports more than 1s of 1 CPU
+  write_usage(".", 2200000);
+  write_usage("a", 1300000);
+  const double energy_J[CGROUP_NR_DOMAIN] = {12.0, 6.0};
+  update_cgroup_attribution(1.0, energy_J);
+  TEST_ASSERT_EQUAL_DOUBLE(12.0, get_cgroup_energy(0)->energy_J[CGROUP_DOMAIN_PACKAGE]);
+  TEST_ASSERT_EQUAL_DOUBLE(0.0, get_cgroup_energy(2)->energy_J[CGROUP_DOMAIN_PACKAGE]);
+  TEST_ASSERT_EQUAL_DOUBLE(0.0, get_cgroup_energy(3)->energy_J[CGROUP_DOMAIN_PACKAGE]);
+}
+
+void test_OpenCgroupAttribution_FailsForMissingCgroup(void) {
+  char *missing[] = {"a", "missing"};
+  TEST_ASSERT_EQUAL_INT(-1, open_cgroup_attribution(root, 2, missing, 1));
+  TEST_ASSERT_EQUAL_INT(0, is_cgroup_attribution_open());
+  TEST_ASSERT_EQUAL_INT(0, get_num_cgroup_entries());
+}
@@ -0,0 +1,104 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "command.h"
+#include "mock_util.h"
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  // markers are announced with SIGIO, which would terminate the test otherwise
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGIO);
+  sigprocmask(SIG_BLOCK, &set, NULL);
+}
+
+void test_Command_RunsOnlyAfterStartAndReportsExitCode(void) {
+  char *argv[] = {"sh", "-c", "exit 3", NULL};
+  command_result_t result;
+  TEST_ASSERT_EQUAL_INT(0, prepare_command(argv));
+  usleep(10000);
+  TEST_ASSERT_EQUAL_INT(0, wait_for_command(0, &result));
+
+  TEST_ASSERT_EQUAL_INT(0, start_command());
+  TEST_ASSERT_EQUAL_INT(1, wait_for_command(1, &result));
+  TEST_ASSERT_EQUAL_INT(3, get_command_exit_code(&result));
+  TEST_ASSERT_EQUAL_INT(-1, wait_for_command(0, &result));
+}
+
+void test_StartCommand_FailsIfCommandDoesNotExist(void) {
+  char *argv[] = {"cpu-energy-meter-no-such-command", NULL};
+  command_result_t result;
+  TEST_ASSERT_EQUAL_INT(0, prepare_command(argv));
+  TEST_ASSERT_EQUAL_INT(-1, start_command());
+  TEST_ASSERT_EQUAL_INT(1, wait_for_command(1, &result));
+  TEST_ASSERT_EQUAL_INT(127, get_command_exit_code(&result));
+}
+
+void test_CancelCommand_DoesNotRunCommand(void) {
+  char path[] = "/tmp/test_command_XXXXXX";
+  const int fd = mkstemp(path);
+  close(fd);
+  unlink(path);
+  char *argv[] = {"touch", path, NULL};
+  TEST_ASSERT_EQUAL_INT(0, prepare_command(argv));
+  cancel_command();
+  TEST_ASSERT_EQUAL_INT(-1, access(path, F_OK));
+}
+
+void test_PrepareCommand_StartsPreparedCommandsInOrder(void) {
+  char *first[] = {"sh", "-c", "exit 1", NULL};
+  char *second[] = {"sh", "-c", "exit 2", NULL};
+  char *third[] = {"sleep", "10", NULL};
+  command_result_t result;
+  TEST_ASSERT_EQUAL_INT(0, prepare_command(first));
+  TEST_ASSERT_EQUAL_INT(0, prepare_command(second));
+  TEST_ASSERT_EQUAL_INT(0, prepare_command(third));
+
+  TEST_ASSERT_EQUAL_INT(0, start_command());
+  TEST_ASSERT_EQUAL_INT(1, wait_for_command(1, &result));
+  TEST_ASSERT_EQUAL_INT(1, get_command_exit_code(&result));
+  TEST_ASSERT_EQUAL_INT(0, start_command());
+  TEST_ASSERT_EQUAL_INT(1, wait_for_command(1, &result));
+  TEST_ASSERT_EQUAL_INT(2, get_command_exit_code(&result));
+  cancel_command(); // must not wait for sleep to run
+  TEST_ASSERT_EQUAL_INT(-1, wait_for_command(0, &result));
+}
+
+void test_SignalCommand_ReportsSignalAsExitCode(void) {
+  char *argv[] = {"sleep", "10", NULL};
+  command_result_t result;
+  TEST_ASSERT_EQUAL_INT(0, prepare_command(argv));
+  TEST_ASSERT_EQUAL_INT(0, start_command());
+  signal_command(SIGTERM);
+  TEST_ASSERT_EQUAL_INT(1, wait_for_command(1, &result));
+  TEST_ASSERT_EQUAL_INT(128 + SIGTERM, get_command_exit_code(&result));
+}
+
+void test_ReadCommandMarker_ReturnsLinesWrittenByCommand(void) {
+  char *argv[] = {"sh", "-c", "printf 'setup\\ncompute\\r\\npart' >&$CEM_MARK_FD", NULL};
+  command_result_t result;
+  char label[8];
+  TEST_ASSERT_EQUAL_INT(0, prepare_command(argv));
+  TEST_ASSERT_EQUAL_INT(0, start_command());
+  TEST_ASSERT_EQUAL_INT(1, wait_for_command(1, &result));
+  TEST_ASSERT_EQUAL_INT(0, get_command_exit_code(&result));
+
+  TEST_ASSERT_EQUAL_INT(1, read_command_marker(label, sizeof(label)));
+  TEST_ASSERT_EQUAL_STRING("setup", label);
+  TEST_ASSERT_EQUAL_INT(1, read_command_marker(label, 4));
+  TEST_ASSERT_EQUAL_STRING("com", label);
+  TEST_ASSERT_EQUAL_INT(0, read_command_marker(label, sizeof(label))); // incomplete line
+  cancel_command();
+}
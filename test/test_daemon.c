@@ -0,0 +1,137 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "daemon.h"
+#include "mock_util.h"
+
+static char socket_dir[] = "/tmp/test_daemon_XXXXXX";
+static char socket_path[64];
+static int wake_pipe[2];
+static int client_fd;
+
+// The fake accumulator consumes 10 ticks per sample in the first value and 1 tick in the second.
+static uint64_t fake_values[2];
+static double fake_time;
+
+static int sample_fake_values(uint64_t values[], double *time) {
+  fake_values[0] += 10;
+  fake_values[1] += 1;
+  fake_time += 0.5;
+  memcpy(values, fake_values, sizeof(fake_values));
+  *time = fake_time;
+  return 0;
+}
+
+static int format_fake_values(const uint64_t values[], char *buffer, size_t size) {
+  return snprintf(buffer, size, "a=%llu\nb=%llu\n", (unsigned long long)values[0], (unsigned long long)values[1]);
+}
+
+static const daemon_source_t fake_source = {2, &sample_fake_values, &format_fake_values};
+
+static int connect_client(void) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  strcpy(address.sun_path, socket_path);
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  TEST_ASSERT_EQUAL_INT(0, connect(fd, (const struct sockaddr *)&address, sizeof(address)));
+  return fd;
+}
+
+/*
+ * Send a request and let the daemon answer it.
+ */
+static void request(int fd, const char *text, char *reply, size_t size) {
+  TEST_ASSERT_EQUAL_INT((int)strlen(text), (int)write(fd, text, strlen(text)));
+  size_t received = 0;
+  for (int i = 0; i < 100 && (received < 2 || strncmp(reply + received - 2, "\n\n", 2) != 0); i++) {
+    TEST_ASSERT_EQUAL_INT(0, serve_daemon_requests(wake_pipe[0], 0.01));
+    const ssize_t n = recv(fd, reply + received, size - 1 - received, MSG_DONTWAIT);
+    if (n > 0) {
+      received += n;
+    }
+  }
+  reply[received] = '\0';
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  TEST_ASSERT_NOT_NULL(mkdtemp(socket_dir));
+  snprintf(socket_path, sizeof(socket_path), "%s/socket", socket_dir);
+  TEST_ASSERT_EQUAL_INT(0, pipe(wake_pipe));
+  fake_values[0] = fake_values[1] = 0;
+  fake_time = 0;
+  TEST_ASSERT_EQUAL_INT(0, open_daemon_socket(socket_path, 0600, -1, -1, &fake_source));
+  client_fd = connect_client();
+}
+
+void tearDown(void) {
+  close(client_fd);
+  close_daemon_socket();
+  close(wake_pipe[0]);
+  close(wake_pipe[1]);
+  rmdir(socket_dir);
+  strcpy(socket_dir, "/tmp/test_daemon_XXXXXX");
+}
+
+void test_Daemon_ReportsEnergySinceStartOfSession(void) {
+  char reply[1024];
+  request(client_fd, "open\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING("ok\nsession=1\n\n", reply);
+  request(client_fd, "open\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING("ok\nsession=2\n\n", reply);
+  TEST_ASSERT_EQUAL_INT(2, get_open_daemon_sessions());
+
+  // session 1 started at the first sample, i.e., two samples ago
+  request(client_fd, "snapshot 1 after setup\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING(
+      "ok\nsession=1\nlabel=after setup\nduration_seconds=1.000000\na=20\nb=2\n\n", reply);
+  request(client_fd, "close 2\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING("ok\nsession=2\nduration_seconds=1.000000\na=20\nb=2\n\n", reply);
+  TEST_ASSERT_EQUAL_INT(1, get_open_daemon_sessions());
+
+  request(client_fd, "close 2\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING("error unknown session\n\n", reply);
+  request(client_fd, "measure\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING("error unknown request measure\n\n", reply);
+}
+
+void test_Daemon_KeepsSessionsAcrossConnections(void) {
+  char reply[1024];
+  request(client_fd, "open\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING("ok\nsession=1\n\n", reply);
+  close(client_fd);
+
+  client_fd = connect_client();
+  request(client_fd, "close 1 done\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING("ok\nsession=1\nlabel=done\nduration_seconds=0.500000\na=10\nb=1\n\n", reply);
+  TEST_ASSERT_EQUAL_INT(0, get_open_daemon_sessions());
+}
+
+void test_Daemon_ReturnsWhenWoken(void) {
+  TEST_ASSERT_EQUAL_INT(1, (int)write(wake_pipe[1], "x", 1));
+  TEST_ASSERT_EQUAL_INT(1, serve_daemon_requests(wake_pipe[0], 10));
+}
+
+void test_OpenDaemonSocket_FailsIfSocketIsInUse(void) {
+  TEST_ASSERT_EQUAL_INT(-1, open_daemon_socket(socket_path, 0600, -1, -1, &fake_source));
+}
+
+void test_OpenDaemonSocket_SetsMode(void) {
+  struct stat status;
+  TEST_ASSERT_EQUAL_INT(0, stat(socket_path, &status));
+  TEST_ASSERT_EQUAL_UINT(0600, status.st_mode & 0777);
+  TEST_ASSERT_EQUAL_UINT(getuid(), status.st_uid);
+}
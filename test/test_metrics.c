@@ -0,0 +1,143 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "metrics.h"
+#include "mock_util.h"
+
+static int wake_pipe[2];
+
+static const char METRICS[] = "# TYPE cpu_energy_joules_total counter\n"
+                              "cpu_energy_joules_total{socket=\"0\",domain=\"package\"} 12.5\n";
+
+static double read_clock(int num_calls) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+ * Connect to the listener on localhost, send a request, and let the listener answer it.
+ */
+static void scrape(const char *text, char *reply, size_t size) {
+  struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(get_metrics_port())};
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  TEST_ASSERT_EQUAL_INT(0, connect(fd, (const struct sockaddr *)&address, sizeof(address)));
+  TEST_ASSERT_EQUAL_INT((int)strlen(text), (int)write(fd, text, strlen(text)));
+
+  // the listener closes the connection after the reply
+  size_t received = 0;
+  ssize_t n = -1;
+  for (int i = 0; i < 100 && n != 0; i++) {
+    TEST_ASSERT_EQUAL_INT(0, serve_metrics_requests(wake_pipe[0], 0.01));
+    n = recv(fd, reply + received, size - 1 - received, MSG_DONTWAIT);
+    if (n > 0) {
+      received += n;
+    }
+  }
+  reply[received] = '\0';
+  close(fd);
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  get_monotonic_time_StubWithCallback(&read_clock);
+  TEST_ASSERT_EQUAL_INT(0, pipe(wake_pipe));
+  TEST_ASSERT_EQUAL_INT(0, open_metrics_listener("127.0.0.1:0"));
+}
+
+void tearDown(void) {
+  set_metrics_client_timeout(10);
+  close_metrics_listener();
+  close(wake_pipe[0]);
+  close(wake_pipe[1]);
+}
+
+void test_Metrics_ServesPublishedTextWithSampleAge(void) {
+  char reply[2048];
+  TEST_ASSERT_EQUAL_INT(0, publish_metrics(METRICS, strlen(METRICS), read_clock(0) - 2));
+  scrape("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n", reply, sizeof(reply));
+
+  TEST_ASSERT_EQUAL_STRING_LEN("HTTP/1.0 200 OK\r\n", reply, 17);
+  TEST_ASSERT_NOT_NULL(strstr(reply, "Content-Type: text/plain; version=0.0.4"));
+  const char *body = strstr(reply, "\r\n\r\n") + 4;
+  TEST_ASSERT_EQUAL_STRING_LEN(METRICS, body, strlen(METRICS));
+
+  double age;
+  const char *gauge = strstr(body, "\ncpu_energy_meter_last_sample_age_seconds ");
+  TEST_ASSERT_NOT_NULL(gauge);
+  TEST_ASSERT_EQUAL_INT(1, sscanf(gauge, "\ncpu_energy_meter_last_sample_age_seconds %lf", &age));
+  TEST_ASSERT_DOUBLE_WITHIN(1.0, 2.5, age);
+
+  int content_length;
+  const char *header = strstr(reply, "Content-Length:");
+  TEST_ASSERT_EQUAL_INT(1, sscanf(header, "Content-Length: %d", &content_length));
+  TEST_ASSERT_EQUAL_INT((int)strlen(body), content_length);
+}
+
+void test_Metrics_KeepsServingTheLatestPublishedText(void) {
+  char reply[2048];
+  TEST_ASSERT_EQUAL_INT(0, publish_metrics("a 1\n", 4, read_clock(0)));
+  TEST_ASSERT_EQUAL_INT(0, publish_metrics("a 2\n", 4, read_clock(0)));
+  scrape("GET /metrics HTTP/1.0\n\n", reply, sizeof(reply));
+  TEST_ASSERT_NOT_NULL(strstr(reply, "\r\n\r\na 2\n"));
+}
+
+void test_Metrics_RejectsOtherRequests(void) {
+  char reply[2048];
+  scrape("GET /metrics HTTP/1.1\r\n\r\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING_LEN("HTTP/1.0 503 ", reply, 13);
+
+  TEST_ASSERT_EQUAL_INT(0, publish_metrics(METRICS, strlen(METRICS), read_clock(0)));
+  scrape("GET / HTTP/1.1\r\n\r\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING_LEN("HTTP/1.0 404 ", reply, 13);
+  scrape("POST /metrics HTTP/1.1\r\n\r\n", reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING_LEN("HTTP/1.0 405 ", reply, 13);
+}
+
+void test_Metrics_DropsClientsThatDoNotFinishInTime(void) {
+  set_metrics_client_timeout(0.05);
+  struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(get_metrics_port())};
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  TEST_ASSERT_EQUAL_INT(0, connect(fd, (const struct sockaddr *)&address, sizeof(address)));
+  TEST_ASSERT_EQUAL_INT(0, serve_metrics_requests(wake_pipe[0], 0.01)); // accept
+  TEST_ASSERT_EQUAL_INT(12, (int)write(fd, "GET /metrics", 12)); // never finished
+
+  const double start = read_clock(0);
+  char reply[16];
+  ssize_t n = -1;
+  while (n != 0 && read_clock(0) - start < 1) {
+    TEST_ASSERT_EQUAL_INT(0, serve_metrics_requests(wake_pipe[0], 0.01));
+    n = recv(fd, reply, sizeof(reply), MSG_DONTWAIT);
+  }
+  TEST_ASSERT_EQUAL_INT(0, (int)n);
+  TEST_ASSERT_TRUE(read_clock(0) - start < 0.5);
+  close(fd);
+}
+
+void test_Metrics_ReturnsWhenWoken(void) {
+  TEST_ASSERT_EQUAL_INT(1, (int)write(wake_pipe[1], "x", 1));
+  TEST_ASSERT_EQUAL_INT(1, serve_metrics_requests(wake_pipe[0], 10));
+}
+
+void test_OpenMetricsListener_RejectsInvalidAddress(void) {
+  close_metrics_listener();
+  TEST_ASSERT_EQUAL_INT(-1, open_metrics_listener("[::1:9100"));
+  TEST_ASSERT_EQUAL_INT(-1, open_metrics_listener("127.0.0.1:"));
+  TEST_ASSERT_EQUAL_INT(-1, get_metrics_port());
+}
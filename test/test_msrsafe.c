@@ -0,0 +1,105 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_util.h"
+#include "msrsafe.h"
+#include "rapl-impl.h"
+
+static char device_path[64];
+static int device_fd = -1;
+
+static void write_msr_to_file(int cpu, off_t msr, uint64_t value) {
+  TEST_ASSERT_EQUAL(
+      sizeof(value), pwrite(device_fd, &value, sizeof(value), MSR_BATCH_FILE_OFFSET(cpu, msr)));
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  strcpy(device_path, "/tmp/cpu-energy-meter-msr-batch-XXXXXX");
+  device_fd = mkstemp(device_path);
+  TEST_ASSERT_TRUE(device_fd != -1);
+}
+
+void tearDown(void) {
+  close_msr_batch();
+  close(device_fd);
+  unlink(device_path);
+}
+
+void test_OpenMsrBatch_FailsForMissingDevice(void) {
+  TEST_ASSERT_EQUAL_INT(-1, open_msr_batch("/nonexistent/msr_batch"));
+  TEST_ASSERT_FALSE(is_msr_batch_open());
+}
+
+void test_ReadMsrBatch_ReadsAllRegistersOfAllCpus(void) {
+  write_msr_to_file(0, MSR_RAPL_PKG_ENERGY_STATUS, 494516256);
+  write_msr_to_file(0, MSR_RAPL_PKG_POWER_INFO, 120); // adjacent register must not interfere
+  write_msr_to_file(0, MSR_RAPL_DRAM_ENERGY_STATUS, 37908518);
+  write_msr_to_file(12, MSR_RAPL_PKG_ENERGY_STATUS, 42);
+
+  TEST_ASSERT_EQUAL_INT(0, open_msr_batch(device_path));
+  TEST_ASSERT_TRUE(is_msr_batch_open());
+
+  const int cpus[] = {0, 0, 12};
+  const off_t msrs[] = {
+      MSR_RAPL_PKG_ENERGY_STATUS, MSR_RAPL_DRAM_ENERGY_STATUS, MSR_RAPL_PKG_ENERGY_STATUS};
+  TEST_ASSERT_EQUAL_INT(0, prepare_msr_batch(3, cpus, msrs));
+
+  uint64_t values[3];
+  unsigned char failed[3];
+  TEST_ASSERT_EQUAL_INT(0, read_msr_batch(values, failed));
+  TEST_ASSERT_EQUAL_UINT64(494516256, values[0]);
+  TEST_ASSERT_EQUAL_UINT64(37908518, values[1]);
+  TEST_ASSERT_EQUAL_UINT64(42, values[2]);
+  TEST_ASSERT_FALSE(failed[0]);
+  TEST_ASSERT_FALSE(failed[1]);
+  TEST_ASSERT_FALSE(failed[2]);
+
+  // each read sees the current content
+  write_msr_to_file(12, MSR_RAPL_PKG_ENERGY_STATUS, 43);
+  TEST_ASSERT_EQUAL_INT(0, read_msr_batch(values, failed));
+  TEST_ASSERT_EQUAL_UINT64(43, values[2]);
+}
+
+void test_ReadMsrBatch_ReportsFailedRegisters(void) {
+  write_msr_to_file(0, MSR_RAPL_PKG_ENERGY_STATUS, 1);
+
+  TEST_ASSERT_EQUAL_INT(0, open_msr_batch(device_path));
+  const int cpus[] = {0, 3};
+  const off_t msrs[] = {MSR_RAPL_PKG_ENERGY_STATUS, MSR_RAPL_PLATFORM_ENERGY_STATUS};
+  TEST_ASSERT_EQUAL_INT(0, prepare_msr_batch(2, cpus, msrs));
+
+  uint64_t values[2];
+  unsigned char failed[2];
+  TEST_ASSERT_EQUAL_INT(0, read_msr_batch(values, failed));
+  TEST_ASSERT_FALSE(failed[0]);
+  TEST_ASSERT_TRUE(failed[1]); // beyond the end of the file
+}
+
+void test_CheckMsrBatch_FailsIfAnyRegisterCannotBeRead(void) {
+  write_msr_to_file(0, MSR_RAPL_PKG_ENERGY_STATUS, 1);
+  write_msr_to_file(1, MSR_RAPL_PKG_ENERGY_STATUS, 2);
+
+  TEST_ASSERT_EQUAL_INT(0, open_msr_batch(device_path));
+  const int cpus[] = {0, 1, 1};
+  const off_t msrs[] = {
+      MSR_RAPL_PKG_ENERGY_STATUS, MSR_RAPL_PKG_ENERGY_STATUS, MSR_RAPL_DRAM_ENERGY_STATUS};
+  TEST_ASSERT_EQUAL_INT(0, prepare_msr_batch(2, cpus, msrs));
+  TEST_ASSERT_EQUAL_INT(0, check_msr_batch());
+  close_msr_batch();
+
+  // like a register that is missing from the allowlist
+  TEST_ASSERT_EQUAL_INT(0, open_msr_batch(device_path));
+  TEST_ASSERT_EQUAL_INT(0, prepare_msr_batch(3, cpus, msrs));
+  TEST_ASSERT_EQUAL_INT(-1, check_msr_batch());
+}
@@ -0,0 +1,141 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_util.h"
+#include "perf.h"
+
+static char sysfs_root[64];
+static char pmu_dir[PATH_MAX];
+
+static void write_file(const char *name, const char *content) {
+  char path[PATH_MAX + 64];
+  snprintf(path, sizeof(path), "%s/%s", pmu_dir, name);
+  FILE *file = fopen(path, "w");
+  TEST_ASSERT_NOT_NULL(file);
+  fputs(content, file);
+  fclose(file);
+}
+
+static void write_event(const char *name, const char *event, const char *scale) {
+  char file[64];
+  snprintf(file, sizeof(file), "events/%s", name);
+  write_file(file, event);
+  snprintf(file, sizeof(file), "events/%s.scale", name);
+  write_file(file, scale);
+  snprintf(file, sizeof(file), "events/%s.unit", name);
+  write_file(file, "Joules\n");
+}
+
+// The fake files are read like util.c does.
+static int read_fake_sysfs_file(const char *path, char *buf, size_t size, int num_calls) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  const int result = (fgets(buf, size, file) != NULL) ? 0 : -1;
+  fclose(file);
+  buf[strcspn(buf, "\n")] = '\0';
+  return result;
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  read_sysfs_file_StubWithCallback(&read_fake_sysfs_file);
+
+  // create a fake sysfs tree with the power PMU
+  strcpy(sysfs_root, "/tmp/cpu-energy-meter-sysfs-XXXXXX");
+  TEST_ASSERT_NOT_NULL(mkdtemp(sysfs_root));
+  const char *dirs[] = {"bus", "bus/event_source", "bus/event_source/devices",
+                        "bus/event_source/devices/power", "bus/event_source/devices/power/events"};
+  for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+    snprintf(pmu_dir, sizeof(pmu_dir), "%s/%s", sysfs_root, dirs[i]);
+    TEST_ASSERT_EQUAL_INT(0, mkdir(pmu_dir, 0700));
+  }
+  snprintf(pmu_dir, sizeof(pmu_dir), "%s/bus/event_source/devices/power", sysfs_root);
+}
+
+void tearDown(void) {
+  char command[PATH_MAX];
+  snprintf(command, sizeof(command), "rm -rf %s", sysfs_root);
+  TEST_ASSERT_EQUAL_INT(0, system(command));
+}
+
+void test_ReadPerfPowerPmu_ReadsSupportedEvents(void) {
+  write_file("type", "17\n");
+  write_event("energy-pkg", "event=0x02\n", "2.3283064365386962890625e-10\n");
+  write_event("energy-ram", "event=0x03\n", "6.103515625e-05\n");
+
+  perf_power_pmu_t pmu;
+  TEST_ASSERT_EQUAL_INT(0, read_perf_power_pmu(sysfs_root, &pmu));
+  TEST_ASSERT_EQUAL_UINT(17, pmu.type);
+
+  TEST_ASSERT_TRUE(pmu.supported[RAPL_PKG]);
+  TEST_ASSERT_FALSE(pmu.supported[RAPL_PP0]);
+  TEST_ASSERT_FALSE(pmu.supported[RAPL_PP1]);
+  TEST_ASSERT_TRUE(pmu.supported[RAPL_DRAM]);
+  TEST_ASSERT_FALSE(pmu.supported[RAPL_PSYS]);
+
+  TEST_ASSERT_EQUAL_UINT64(2, pmu.config[RAPL_PKG]);
+  TEST_ASSERT_EQUAL_UINT64(3, pmu.config[RAPL_DRAM]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-20, 2.3283064365386962890625e-10, pmu.scale[RAPL_PKG]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-15, 6.103515625e-05, pmu.scale[RAPL_DRAM]);
+}
+
+void test_ReadPerfPowerPmu_FailsWithoutPmuOrEvents(void) {
+  perf_power_pmu_t pmu;
+  TEST_ASSERT_EQUAL_INT(-1, read_perf_power_pmu(sysfs_root, &pmu)); // no type file
+
+  write_file("type", "17\n");
+  TEST_ASSERT_EQUAL_INT(-1, read_perf_power_pmu(sysfs_root, &pmu)); // no events
+}
+
+void test_ParsePerfEventConfig_ReturnsCorrectValues(void) {
+  uint64_t config;
+  TEST_ASSERT_EQUAL_INT(0, parse_perf_event_config("event=0x02", &config));
+  TEST_ASSERT_EQUAL_UINT64(2, config);
+  TEST_ASSERT_EQUAL_INT(0, parse_perf_event_config("event=17", &config));
+  TEST_ASSERT_EQUAL_UINT64(17, config);
+
+  TEST_ASSERT_EQUAL_INT(-1, parse_perf_event_config("umask=0x02", &config));
+  TEST_ASSERT_EQUAL_INT(-1, parse_perf_event_config("event=", &config));
+  TEST_ASSERT_EQUAL_INT(-1, parse_perf_event_config("event=0x02,umask=0x1", &config));
+}
+
+void test_ParsePerfEventScale_ReturnsCorrectValues(void) {
+  double scale;
+  TEST_ASSERT_EQUAL_INT(0, parse_perf_event_scale("2.3283064365386962890625e-10", "Joules", &scale));
+  TEST_ASSERT_FLOAT_WITHIN(1e-20, 2.3283064365386962890625e-10, scale);
+
+  TEST_ASSERT_EQUAL_INT(-1, parse_perf_event_scale("1e-6", "Watts", &scale));
+  TEST_ASSERT_EQUAL_INT(-1, parse_perf_event_scale("abc", "Joules", &scale));
+  TEST_ASSERT_EQUAL_INT(-1, parse_perf_event_scale("0", "Joules", &scale));
+}
+
+void test_DecodePerfGroup_ReturnsValuesInGroupOrder(void) {
+  const uint64_t buf[] = {3, 100, 200, 300};
+  uint64_t values[3];
+  TEST_ASSERT_EQUAL_INT(0, decode_perf_group(buf, sizeof(buf), 3, values));
+  TEST_ASSERT_EQUAL_UINT64(100, values[0]);
+  TEST_ASSERT_EQUAL_UINT64(200, values[1]);
+  TEST_ASSERT_EQUAL_UINT64(300, values[2]);
+}
+
+void test_DecodePerfGroup_FailsOnMismatch(void) {
+  const uint64_t buf[] = {2, 100, 200};
+  uint64_t values[3];
+  TEST_ASSERT_EQUAL_INT(-1, decode_perf_group(buf, sizeof(buf), 3, values)); // wrong count
+  TEST_ASSERT_EQUAL_INT(-1, decode_perf_group(buf, sizeof(uint64_t) * 2, 2, values)); // short
+  TEST_ASSERT_EQUAL_INT(-1, decode_perf_group(buf, 0, 0, values));
+}
@@ -0,0 +1,76 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <string.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "phases.h"
+
+void tearDown(void) {
+  close_phases();
+}
+
+void test_Phases_SumUpPhasesWithTheSameLabel(void) {
+  uint64_t values[2] = {100, 10};
+  TEST_ASSERT_EQUAL_INT(0, open_phases(2, "start", 1.0, values));
+  values[0] = 110;
+  TEST_ASSERT_EQUAL_INT(0, mark_phase("compute", 2.0, values));
+  values[0] = 150;
+  values[1] = 14;
+  TEST_ASSERT_EQUAL_INT(0, mark_phase("io", 4.0, values));
+  values[0] = 160;
+  TEST_ASSERT_EQUAL_INT(0, mark_phase("compute", 4.5, values));
+  values[0] = 200;
+  end_phases(5.5, values);
+
+  TEST_ASSERT_EQUAL_INT(3, get_num_phases());
+  TEST_ASSERT_EQUAL_STRING("start", get_phase(0)->label);
+  TEST_ASSERT_EQUAL_INT(10, get_phase(0)->values[0]);
+  TEST_ASSERT_EQUAL_STRING("compute", get_phase(1)->label);
+  TEST_ASSERT_EQUAL_INT(2, get_phase(1)->count);
+  TEST_ASSERT_EQUAL_DOUBLE(3.0, get_phase(1)->duration);
+  TEST_ASSERT_EQUAL_INT(80, get_phase(1)->values[0]);
+  TEST_ASSERT_EQUAL_INT(4, get_phase(1)->values[1]);
+  TEST_ASSERT_EQUAL_STRING("io", get_phase(2)->label);
+  TEST_ASSERT_EQUAL_INT(10, get_phase(2)->values[0]);
+  TEST_ASSERT_EQUAL_INT(0, get_phase(2)->values[1]);
+}
+
+void test_MarkPhase_ReplacesControlCharactersAndTruncates(void) {
+  const uint64_t values[1] = {0};
+  char label[2 * PHASE_LABEL_SIZE];
+  memset(label, 'x', sizeof(label) - 1);
+  label[sizeof(label) - 1] = '\0';
+  TEST_ASSERT_EQUAL_INT(0, open_phases(1, "a\tb", 0, values));
+  TEST_ASSERT_EQUAL_INT(0, mark_phase(label, 0, values));
+  TEST_ASSERT_EQUAL_STRING("a_b", get_phase(0)->label);
+  TEST_ASSERT_EQUAL_INT(PHASE_LABEL_SIZE - 1, (int)strlen(get_phase(1)->label));
+}
+
+void test_MarkPhase_ContinuesPhaseIfThereAreTooManyLabels(void) {
+  uint64_t values[1] = {0};
+  TEST_ASSERT_EQUAL_INT(0, open_phases(1, "phase0", 0, values));
+  char label[16];
+  for (int i = 1; i < MAX_PHASES; i++) {
+    snprintf(label, sizeof(label), "phase%d", i);
+    TEST_ASSERT_EQUAL_INT(0, mark_phase(label, i, values));
+  }
+  values[0] = 5;
+  TEST_ASSERT_EQUAL_INT(-1, mark_phase("one too many", MAX_PHASES, values));
+  end_phases(MAX_PHASES + 1, values);
+  TEST_ASSERT_EQUAL_INT(MAX_PHASES, get_num_phases());
+  TEST_ASSERT_EQUAL_INT(5, get_phase(MAX_PHASES - 1)->values[0]);
+  TEST_ASSERT_EQUAL_DOUBLE(2.0, get_phase(MAX_PHASES - 1)->duration);
+}
+
+void test_MarkPhase_FailsIfPhasesAreNotOpen(void) {
+  const uint64_t values[1] = {0};
+  TEST_ASSERT_EQUAL_INT(-1, mark_phase("phase", 1.0, values));
+  TEST_ASSERT_EQUAL_INT(0, get_num_phases());
+}
@@ -0,0 +1,122 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_util.h"
+#include "powercap.h"
+
+static char root[64];
+
+static void write_file(const char *zone, const char *file, const char *content) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s/%s", root, zone, file);
+  FILE *f = fopen(path, "w");
+  TEST_ASSERT_NOT_NULL(f);
+  fputs(content, f);
+  fclose(f);
+}
+
+static void create_zone(const char *zone, const char *name, const char *energy, const char *range) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", root, zone);
+  TEST_ASSERT_EQUAL_INT(0, mkdir(path, 0700));
+  write_file(zone, "name", name);
+  write_file(zone, "energy_uj", energy);
+  write_file(zone, "max_energy_range_uj", range);
+}
+
+// The fake files are read like util.c does.
+static int read_fake_sysfs_file(const char *path, char *buf, size_t size, int num_calls) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return -1;
+  }
+  const int result = (fgets(buf, size, file) != NULL) ? 0 : -1;
+  fclose(file);
+  buf[strcspn(buf, "\n")] = '\0';
+  return result;
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  read_sysfs_file_StubWithCallback(&read_fake_sysfs_file);
+
+  // create a fake /sys/class/powercap of a machine with two packages
+  strcpy(root, "/tmp/cpu-energy-meter-powercap-XXXXXX");
+  TEST_ASSERT_NOT_NULL(mkdtemp(root));
+  create_zone("intel-rapl:0", "package-0\n", "1000\n", "262143328850\n");
+  create_zone("intel-rapl:0:0", "core\n", "2000\n", "262143328850\n");
+  create_zone("intel-rapl:0:1", "dram\n", "3000\n", "65712999613\n");
+  create_zone("intel-rapl:1", "package-1\n", "4000\n", "262143328850\n");
+  create_zone("intel-rapl:1:0", "core\n", "5000\n", "262143328850\n");
+  create_zone("intel-rapl:2", "psys\n", "6000\n", "262143328850\n");
+  create_zone("intel-rapl-mmio:0", "package-0\n", "0\n", "262143328850\n"); // ignored
+}
+
+void tearDown(void) {
+  close_powercap_zones();
+  char command[PATH_MAX];
+  snprintf(command, sizeof(command), "rm -rf %s", root);
+  TEST_ASSERT_EQUAL_INT(0, system(command));
+}
+
+static uint64_t read_zone(int node, enum RAPL_DOMAIN domain) {
+  uint64_t energy = 0;
+  const int fd = get_powercap_fd(node, domain);
+  TEST_ASSERT_TRUE(fd != -1);
+  TEST_ASSERT_EQUAL_INT(0, read_powercap_energy(fd, &energy));
+  return energy;
+}
+
+void test_OpenPowercapZones_MapsZonesToNodesAndDomains(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_powercap_zones(root, 2));
+
+  TEST_ASSERT_EQUAL_UINT64(1000, read_zone(0, RAPL_PKG));
+  TEST_ASSERT_EQUAL_UINT64(2000, read_zone(0, RAPL_PP0));
+  TEST_ASSERT_EQUAL_UINT64(3000, read_zone(0, RAPL_DRAM));
+  TEST_ASSERT_EQUAL_UINT64(4000, read_zone(1, RAPL_PKG));
+  TEST_ASSERT_EQUAL_UINT64(5000, read_zone(1, RAPL_PP0));
+  TEST_ASSERT_EQUAL_UINT64(6000, read_zone(0, RAPL_PSYS));
+
+  TEST_ASSERT_EQUAL_INT(-1, get_powercap_fd(1, RAPL_DRAM));
+  TEST_ASSERT_EQUAL_INT(-1, get_powercap_fd(0, RAPL_PP1));
+
+  TEST_ASSERT_TRUE(is_supported_powercap_domain(RAPL_PKG));
+  TEST_ASSERT_TRUE(is_supported_powercap_domain(RAPL_DRAM));
+  TEST_ASSERT_FALSE(is_supported_powercap_domain(RAPL_PP1));
+}
+
+void test_OpenPowercapZones_ReadsMaxEnergyRange(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_powercap_zones(root, 2));
+  TEST_ASSERT_EQUAL_UINT64(262143328850ULL, get_powercap_max_energy_range(0, RAPL_PKG));
+  TEST_ASSERT_EQUAL_UINT64(65712999613ULL, get_powercap_max_energy_range(0, RAPL_DRAM));
+}
+
+void test_ReadPowercapEnergy_RereadsOpenFile(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_powercap_zones(root, 2));
+  TEST_ASSERT_EQUAL_UINT64(1000, read_zone(0, RAPL_PKG));
+
+  write_file("intel-rapl:0", "energy_uj", "1234567\n");
+  TEST_ASSERT_EQUAL_UINT64(1234567, read_zone(0, RAPL_PKG));
+}
+
+void test_OpenPowercapZones_IgnoresUnknownPackages(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_powercap_zones(root, 1));
+  TEST_ASSERT_EQUAL_UINT64(1000, read_zone(0, RAPL_PKG));
+  TEST_ASSERT_EQUAL_UINT64(3000, read_zone(0, RAPL_DRAM));
+}
+
+void test_OpenPowercapZones_FailsWithoutZones(void) {
+  TEST_ASSERT_EQUAL_INT(-1, open_powercap_zones("/nonexistent", 1));
+}
@@ -0,0 +1,93 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <math.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "powerstats.h"
+
+static const unsigned char all_updated[2] = {1, 1};
+
+void tearDown(void) {
+  close_power_stats();
+}
+
+void test_PowerStats_WeightsIntervalsByTheirLength(void) {
+  const double threshold_W = 15;
+  TEST_ASSERT_EQUAL_INT(0, open_power_stats(2, 1, &threshold_W));
+  add_power_sample(1.0, NULL, NULL);
+  double energy_J[2] = {10, 0};
+  add_power_sample(2.0, all_updated, energy_J); // 10 W for 1 s
+  energy_J[0] = 70;
+  add_power_sample(5.0, all_updated, energy_J); // 20 W for 3 s
+
+  power_stats_t stats;
+  TEST_ASSERT_EQUAL_INT(0, get_power_stats(0, &stats));
+  TEST_ASSERT_EQUAL_INT(2, (int)stats.num_intervals);
+  TEST_ASSERT_EQUAL_DOUBLE(4.0, stats.seconds);
+  TEST_ASSERT_EQUAL_DOUBLE(17.5, stats.mean_W);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, sqrt(18.75), stats.stddev_W);
+  TEST_ASSERT_EQUAL_DOUBLE(10.0, stats.min_W);
+  TEST_ASSERT_EQUAL_DOUBLE(20.0, stats.max_W);
+  TEST_ASSERT_DOUBLE_WITHIN(20.0 / 64, 20.0, stats.p50_W);
+  TEST_ASSERT_EQUAL_DOUBLE(3.0, stats.seconds_above_threshold[0]);
+
+  TEST_ASSERT_EQUAL_INT(0, get_power_stats(1, &stats));
+  TEST_ASSERT_EQUAL_DOUBLE(0.0, stats.max_W);
+}
+
+void test_PowerStats_PercentilesOfSkewedDistribution(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_power_stats(1, 0, NULL));
+  double energy_J[1] = {0};
+  for (int i = 1; i <= 100; i++) {
+    energy_J[0] += (i % 50 == 0) ? 100 : 1; // two intervals at 100 W, the others at 1 W
+    add_power_sample(i, all_updated, energy_J);
+  }
+
+  power_stats_t stats;
+  TEST_ASSERT_EQUAL_INT(0, get_power_stats(0, &stats));
+  TEST_ASSERT_DOUBLE_WITHIN(1.0 / 64, 1.0, stats.p50_W);
+  TEST_ASSERT_DOUBLE_WITHIN(1.0 / 64, 1.0, stats.p95_W);
+  TEST_ASSERT_DOUBLE_WITHIN(100.0 / 64, 100.0, stats.p99_W);
+  TEST_ASSERT_EQUAL_DOUBLE(100.0, stats.max_W);
+  TEST_ASSERT_EQUAL_DOUBLE(2.98, stats.mean_W);
+}
+
+void test_AddPowerSample_MergesIntervalWithFailedRead(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_power_stats(1, 0, NULL));
+  const unsigned char failed[1] = {0};
+  double energy_J[1] = {5};
+  add_power_sample(1.0, failed, energy_J);
+  energy_J[0] = 8;
+  add_power_sample(2.0, all_updated, energy_J);
+
+  power_stats_t stats;
+  TEST_ASSERT_EQUAL_INT(0, get_power_stats(0, &stats));
+  TEST_ASSERT_EQUAL_INT(1, (int)stats.num_intervals);
+  TEST_ASSERT_EQUAL_DOUBLE(4.0, stats.max_W);
+}
+
+void test_AddPowerSample_RestartsWithoutEnergy(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_power_stats(1, 0, NULL));
+  double energy_J[1] = {5};
+  add_power_sample(1.0, all_updated, energy_J);
+  add_power_sample(3.0, NULL, NULL);
+
+  power_stats_t stats;
+  TEST_ASSERT_EQUAL_INT(-1, get_power_stats(0, &stats));
+  energy_J[0] = 2;
+  add_power_sample(4.0, all_updated, energy_J);
+  TEST_ASSERT_EQUAL_INT(0, get_power_stats(0, &stats));
+  TEST_ASSERT_EQUAL_DOUBLE(2.0, stats.mean_W);
+}
+
+void test_OpenPowerStats_FailsWithTooManyThresholds(void) {
+  const double thresholds_W[MAX_POWER_THRESHOLDS + 1] = {0};
+  TEST_ASSERT_EQUAL_INT(-1, open_power_stats(1, MAX_POWER_THRESHOLDS + 1, thresholds_W));
+  TEST_ASSERT_EQUAL_INT(0, is_power_stats_open());
+}
@@ -9,24 +9,61 @@
 #include <sched.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "unity.h" // needs to be placed before all the other custom h-files
 #include "intel-family.h"
+#include "mock_cgroup.h"
 #include "mock_cpuinfo.h"
 #include "mock_msr.h"
+#include "mock_msrsafe.h"
+#include "mock_perf.h"
+#include "mock_powercap.h"
+#include "mock_powerstats.h"
+#include "mock_recording.h"
+#include "mock_sampler.h"
+#include "mock_shmexport.h"
+#include "mock_simulator.h"
+#include "mock_tracefile.h"
+#include "mock_uring.h"
 #include "mock_util.h"
 #include "rapl.h"
 #include "rapl-impl.h"
 
 const uint32_t INTEL_SIG = 526057;
 
+static double read_clock(int num_calls) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
 void setUp(void) {
   is_debug_enabled_IgnoreAndReturn(0);
+  get_monotonic_time_StubWithCallback(&read_clock);
   bind_cpu_IgnoreAndReturn(0);
   bind_context_IgnoreAndReturn(0);
   read_msr_IgnoreAndReturn(0); // make each msr available in the table
   close_msr_fd_Ignore();
-
+  stop_sampler_threads_Ignore();
+  close_msr_batch_Ignore();
+  close_perf_fds_Ignore();
+  close_powercap_zones_Ignore();
+  close_uring_Ignore();
+  close_recording_Ignore();
+  close_shm_export_Ignore();
+  close_cgroup_attribution_Ignore();
+  close_power_stats_Ignore();
+  is_recording_IgnoreAndReturn(0);
+  is_shm_export_open_IgnoreAndReturn(0);
+  is_cgroup_attribution_open_IgnoreAndReturn(0);
+  is_power_stats_open_IgnoreAndReturn(0);
+  is_msr_batch_open_IgnoreAndReturn(0);
+  is_uring_open_IgnoreAndReturn(0);
+  sampler_threads_running_IgnoreAndReturn(0);
+
+  set_rapl_backend(RAPL_BACKEND_MSR);
   config_msr_table();
 }
 
@@ -299,3 +336,268 @@ void test_ReadRaplUnits_ReturnsCorrectValues(void) {
   check_ReadRaplUnits_ExpectedValues(CPU_INTEL_HASWELL_X, exp_retval_server);
   check_ReadRaplUnits_ExpectedValues(CPU_INTEL_SKYLAKE_X, exp_retval_server);
 }
+
+static void config_msr_table_with_only_dram_supported(void) {
+  int cpu = 0;
+  read_msr_ExpectAndReturn(cpu, MSR_RAPL_POWER_UNIT, NULL, 0);
+  read_msr_ExpectAndReturn(cpu, MSR_RAPL_PKG_ENERGY_STATUS, NULL, -1);
+  read_msr_ExpectAndReturn(cpu, MSR_RAPL_PKG_POWER_INFO, NULL, 0);
+  read_msr_ExpectAndReturn(cpu, MSR_RAPL_DRAM_ENERGY_STATUS, NULL, 0);
+  read_msr_IgnoreAndReturn(-1);
+
+  terminate_rapl();
+  config_msr_table();
+}
+
+static void expect_energy_status_read(int fd, uint64_t *value) {
+  read_msr_fd_ExpectAndReturn(fd, MSR_RAPL_DRAM_ENERGY_STATUS, NULL, 0);
+  read_msr_fd_IgnoreArg_val();
+  read_msr_fd_ReturnThruPtr_val(value);
+}
+
+void test_GetTotalEnergyConsumedForNodes_ReadsOnlyPlannedRegisters(void) {
+  config_msr_table_with_only_dram_supported();
+  RAPL_DRAM_ENERGY_UNIT = 15.3e-6;
+
+  // the plan contains exactly one register per node, read through the fd of the node
+  get_msr_fd_ExpectAndReturn(0, 3);
+  get_msr_fd_ExpectAndReturn(1, 4);
+  TEST_ASSERT_EQUAL_INT(0, build_sample_plan(2));
+
+  uint64_t first_node0 = 1000;
+  uint64_t first_node1 = 2000;
+  expect_energy_status_read(3, &first_node0);
+  expect_energy_status_read(4, &first_node1);
+
+  uint64_t current[2][RAPL_NR_DOMAIN] = {{0}};
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(2, current, NULL));
+
+  TEST_ASSERT_EQUAL_UINT64(1000, current[0][RAPL_DRAM]);
+  TEST_ASSERT_EQUAL_UINT64(2000, current[1][RAPL_DRAM]);
+  TEST_ASSERT_EQUAL_UINT64(0, current[0][RAPL_PKG]);
+}
+
+void test_GetTotalEnergyConsumedForNodes_AccumulatesDeltas(void) {
+  config_msr_table_with_only_dram_supported();
+  RAPL_DRAM_ENERGY_UNIT = 15.3e-6;
+
+  get_msr_fd_ExpectAndReturn(0, 3);
+  TEST_ASSERT_EQUAL_INT(0, build_sample_plan(1));
+
+  uint64_t current[1][RAPL_NR_DOMAIN] = {{0}};
+  uint64_t cum[1][RAPL_NR_DOMAIN] = {{0}};
+  double cum_J[1][RAPL_NR_DOMAIN];
+
+  uint64_t first = 1000;
+  expect_energy_status_read(3, &first);
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, NULL));
+
+  uint64_t second = 3000;
+  expect_energy_status_read(3, &second);
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, cum));
+
+  TEST_ASSERT_EQUAL_UINT64(2000, cum[0][RAPL_DRAM]);
+
+  // a failing read is reported, but does not modify the accumulated value
+  read_msr_fd_ExpectAndReturn(3, MSR_RAPL_DRAM_ENERGY_STATUS, NULL, -1);
+  read_msr_fd_IgnoreArg_val();
+  TEST_ASSERT_EQUAL_INT(1, get_total_energy_consumed_for_nodes(1, current, cum));
+  TEST_ASSERT_EQUAL_UINT64(2000, cum[0][RAPL_DRAM]);
+
+  double delta = 1e-09;
+  convert_ticks_to_joules(1, cum, cum_J);
+  TEST_ASSERT_FLOAT_WITHIN(delta, 2000 * 15.3e-6, cum_J[0][RAPL_DRAM]);
+  TEST_ASSERT_FLOAT_WITHIN(delta, 0, cum_J[0][RAPL_PKG]);
+}
+
+static uint64_t fake_counter;
+
+static int open_fake_backend(int *num_node) {
+  return 0;
+}
+
+static int is_supported_fake_domain(enum RAPL_DOMAIN domain) {
+  return domain == RAPL_PKG;
+}
+
+static int plan_fake_entry(int node, enum RAPL_DOMAIN domain, sample_plan_entry_t *entry) {
+  entry->fd = -1;
+  entry->address = 0;
+  entry->mask = UINT32_MAX;
+  entry->unit = 0.5;
+  entry->wrap = 0.5 * 4294967296.0;
+  return 0;
+}
+
+static void read_fake_entries(
+    const sample_plan_entry_t *entries, int count, uint64_t raw[], unsigned char failed[]) {
+  for (int i = 0; i < count; i++) {
+    raw[i] = fake_counter;
+    failed[i] = 0;
+  }
+}
+
+static void close_fake_backend() {}
+
+static const rapl_backend_t fake_backend = {
+    .name = "fake",
+    .capabilities = 0,
+    .open = &open_fake_backend,
+    .is_supported = &is_supported_fake_domain,
+    .plan_entry = &plan_fake_entry,
+    .read_entries = &read_fake_entries,
+    .get_maximum_read_interval = NULL,
+    .close = &close_fake_backend,
+};
+
+void test_GetTotalEnergyConsumedForNodes_HandlesWraparoundOfPluggedBackend(void) {
+  terminate_rapl();
+  use_rapl_backend(&fake_backend);
+  TEST_ASSERT_TRUE(is_supported_domain(RAPL_PKG));
+  TEST_ASSERT_FALSE(is_supported_domain(RAPL_DRAM));
+  TEST_ASSERT_EQUAL_INT(0, build_sample_plan(2));
+
+  uint64_t current[2][RAPL_NR_DOMAIN] = {{0}};
+  uint64_t cum[2][RAPL_NR_DOMAIN] = {{0}};
+  double cum_J[2][RAPL_NR_DOMAIN];
+  fake_counter = UINT32_MAX - 9;
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(2, current, NULL));
+  fake_counter = 20;
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(2, current, cum));
+
+  TEST_ASSERT_EQUAL_UINT64(30, cum[0][RAPL_PKG]);
+  TEST_ASSERT_EQUAL_UINT64(30, cum[1][RAPL_PKG]);
+
+  double delta = 1e-09;
+  convert_ticks_to_joules(2, cum, cum_J);
+  TEST_ASSERT_FLOAT_WITHIN(delta, 15, cum_J[0][RAPL_PKG]); // 30 ticks of 0.5 J
+  TEST_ASSERT_FLOAT_WITHIN(delta, 15, cum_J[1][RAPL_PKG]);
+  TEST_ASSERT_FLOAT_WITHIN(delta, 0, cum_J[0][RAPL_DRAM]);
+  // half of the time that 2^31 J take at the fallback power of 200 W, minus one second
+  TEST_ASSERT_EQUAL_INT64(5368708, get_maximum_read_interval());
+  terminate_rapl();
+}
+
+static int plan_fake_powercap_entry(int node, enum RAPL_DOMAIN domain, sample_plan_entry_t *entry) {
+  entry->fd = -1;
+  entry->address = 0;
+  entry->mask = UINT64_MAX;
+  entry->unit = 1e-6;
+  entry->modulus = 262143328850; // max_energy_range_uj of a typical package
+  entry->wrap = entry->unit * entry->modulus;
+  return 0;
+}
+
+void test_GetTotalEnergyConsumedForNodes_HandlesWraparoundAtArbitraryModulus(void) {
+  terminate_rapl();
+  rapl_backend_t powercap_like_backend = fake_backend;
+  powercap_like_backend.plan_entry = &plan_fake_powercap_entry;
+  use_rapl_backend(&powercap_like_backend);
+  TEST_ASSERT_EQUAL_INT(0, build_sample_plan(1));
+
+  uint64_t current[1][RAPL_NR_DOMAIN] = {{0}};
+  uint64_t cum[1][RAPL_NR_DOMAIN] = {{0}};
+  fake_counter = 262143328850 - 100;
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, NULL));
+  fake_counter = 50;
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, cum));
+  TEST_ASSERT_EQUAL_UINT64(150, cum[0][RAPL_PKG]);
+
+  // many tiny deltas add up exactly
+  for (int i = 0; i < 1000000; i++) {
+    fake_counter++;
+    TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, cum));
+  }
+  TEST_ASSERT_EQUAL_UINT64(1000150, cum[0][RAPL_PKG]);
+  terminate_rapl();
+}
+
+void test_GetAdaptiveReadInterval_FollowsObservedPower(void) {
+  terminate_rapl();
+  use_rapl_backend(&fake_backend);
+  TEST_ASSERT_EQUAL_INT(0, build_sample_plan(1));
+
+  uint64_t current[1][RAPL_NR_DOMAIN] = {{0}};
+  uint64_t cum[1][RAPL_NR_DOMAIN] = {{0}};
+  fake_counter = 0;
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, NULL));
+
+  double delta = 1e-09;
+  // without any observed power, the interval grows gradually up to one hour
+  TEST_ASSERT_FLOAT_WITHIN(delta, 20, get_adaptive_read_interval(10));
+  TEST_ASSERT_FLOAT_WITHIN(delta, 3600, get_adaptive_read_interval(3000));
+
+  // 0.5 J in at least 1 ms means that the counter wraps around after more than an hour
+  usleep(1000);
+  fake_counter = 1;
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, cum));
+  TEST_ASSERT_FLOAT_WITHIN(delta, 20, get_adaptive_read_interval(10));
+
+  // almost a complete wraparound between two samples snaps back to the shortest interval
+  fake_counter = UINT32_MAX;
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, cum));
+  TEST_ASSERT_FLOAT_WITHIN(delta, 0.01, get_adaptive_read_interval(10));
+  terminate_rapl();
+}
+
+static int reads_until_update;
+
+static void read_updating_fake_entries(
+    const sample_plan_entry_t *entries, int count, uint64_t raw[], unsigned char failed[]) {
+  if (--reads_until_update == 0) {
+    fake_counter++;
+  }
+  read_fake_entries(entries, count, raw, failed);
+}
+
+void test_AlignToCounterUpdate_WaitsForChangedCounter(void) {
+  terminate_rapl();
+  rapl_backend_t updating_backend = fake_backend;
+  updating_backend.read_entries = &read_updating_fake_entries;
+  use_rapl_backend(&updating_backend);
+  TEST_ASSERT_EQUAL_INT(0, build_sample_plan(1));
+
+  fake_counter = 0;
+  reads_until_update = 5;
+  const double error = align_to_counter_update(1);
+  TEST_ASSERT_TRUE(error >= 0 && error < 1);
+  TEST_ASSERT_EQUAL_INT(0, reads_until_update);
+
+  // the sample gets the time of the update, which was before the sample was taken
+  uint64_t current[1][RAPL_NR_DOMAIN] = {{0}};
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, NULL));
+  TEST_ASSERT_EQUAL_UINT64(1, current[0][RAPL_PKG]);
+  const double aligned_time = get_last_sample_time();
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, current, NULL));
+  TEST_ASSERT_TRUE(get_last_sample_time() > aligned_time);
+
+  // a counter that does not change cannot be aligned with
+  reads_until_update = -1;
+  TEST_ASSERT_TRUE(align_to_counter_update(0.001) < 0);
+  terminate_rapl();
+}
+
+void test_SampleEnergyOfNodes_AccumulatesIndependentlyOfGlobalSamples(void) {
+  terminate_rapl();
+  use_rapl_backend(&fake_backend);
+  TEST_ASSERT_EQUAL_INT(0, build_sample_plan(1));
+
+  uint64_t current[1][RAPL_NR_DOMAIN] = {{0}};
+  uint64_t cum[1][RAPL_NR_DOMAIN] = {{0}};
+  uint64_t global_current[1][RAPL_NR_DOMAIN] = {{0}};
+  double sample_time = 0;
+  fake_counter = 10;
+  TEST_ASSERT_EQUAL_INT(0, sample_energy_of_nodes(1, current, NULL, &sample_time));
+  TEST_ASSERT_TRUE(sample_time > 0);
+
+  // samples of other callers do not influence the accumulated values
+  fake_counter = 15;
+  TEST_ASSERT_EQUAL_INT(0, get_total_energy_consumed_for_nodes(1, global_current, NULL));
+  fake_counter = 20;
+  const double previous_time = sample_time;
+  TEST_ASSERT_EQUAL_INT(0, sample_energy_of_nodes(1, current, cum, &sample_time));
+  TEST_ASSERT_EQUAL_UINT64(10, cum[0][RAPL_PKG]);
+  TEST_ASSERT_EQUAL_UINT64(20, current[0][RAPL_PKG]);
+  TEST_ASSERT_TRUE(sample_time >= previous_time);
+  terminate_rapl();
+}
@@ -0,0 +1,137 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_util.h"
+#include "recording.h"
+
+static char path[64];
+
+static recording_entry_t entries[] = {
+    {.node = 0, .address = 0x611, .unit = 6.103515625e-05, .mask = 0xffffffff, .wrap = 262144},
+    {.node = 0, .address = 0x619, .unit = 1.53e-05, .mask = 0xffffffff, .wrap = 65712.9},
+    {.node = 1, .address = 0x611, .unit = 6.103515625e-05, .mask = 0xffffffff, .wrap = 262144},
+};
+
+static const recording_header_t header = {
+    .time_unit = 0.0009765625,
+    .energy_unit = 6.103515625e-05,
+    .dram_energy_unit = 1.53e-05,
+    .power_unit = 0.125,
+    .num_nodes = 2,
+    .num_entries = 3,
+    .entries = entries,
+};
+
+static void write_file(const char *content) {
+  FILE *file = fopen(path, "w");
+  TEST_ASSERT_NOT_NULL(file);
+  fputs(content, file);
+  fclose(file);
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  strcpy(path, "/tmp/cpu-energy-meter-recording-XXXXXX");
+  const int fd = mkstemp(path);
+  TEST_ASSERT_TRUE(fd != -1);
+  close(fd);
+}
+
+void tearDown(void) {
+  close_recording();
+  close_replay();
+  unlink(path);
+}
+
+void test_Replay_ReturnsRecordedSamples(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_recording(path, &header));
+  TEST_ASSERT_TRUE(is_recording());
+  const uint64_t first[] = {1000, 2000, 3000};
+  const uint64_t second[] = {4294967295ull, 2500, 0};
+  const unsigned char none_failed[] = {0, 0, 0};
+  const unsigned char dram_failed[] = {0, 1, 0};
+  record_sample(10.5, first, none_failed);
+  record_sample(11.25, second, dram_failed);
+  close_recording();
+  TEST_ASSERT_FALSE(is_recording());
+
+  recording_header_t replayed;
+  TEST_ASSERT_EQUAL_INT(0, open_replay(path, &replayed));
+  TEST_ASSERT_EQUAL_INT(2, replayed.num_nodes);
+  TEST_ASSERT_EQUAL_INT(3, replayed.num_entries);
+  TEST_ASSERT_EQUAL_DOUBLE(1.53e-05, replayed.dram_energy_unit);
+  TEST_ASSERT_EQUAL_DOUBLE(0.125, replayed.power_unit);
+  TEST_ASSERT_EQUAL_INT(0x619, replayed.entries[1].address);
+  TEST_ASSERT_EQUAL_DOUBLE(65712.9, replayed.entries[1].wrap);
+  TEST_ASSERT_EQUAL_INT(1, replayed.entries[2].node);
+  TEST_ASSERT_EQUAL_INT(2, get_remaining_replay_samples());
+
+  uint64_t raw[3];
+  unsigned char failed[3];
+  double timestamp = 0;
+  // samples can be read in parts, e.g., node by node
+  TEST_ASSERT_EQUAL_INT(0, read_replay(2, raw, failed, &timestamp));
+  TEST_ASSERT_EQUAL_INT(0, read_replay(1, &raw[2], &failed[2], &timestamp));
+  TEST_ASSERT_EQUAL_UINT64(1000, raw[0]);
+  TEST_ASSERT_EQUAL_UINT64(3000, raw[2]);
+  TEST_ASSERT_EQUAL_DOUBLE(10.5, timestamp);
+  TEST_ASSERT_EQUAL_INT(1, get_remaining_replay_samples());
+
+  TEST_ASSERT_EQUAL_INT(0, read_replay(3, raw, failed, &timestamp));
+  TEST_ASSERT_EQUAL_UINT64(4294967295ull, raw[0]);
+  TEST_ASSERT_EQUAL_INT(0, failed[0]);
+  TEST_ASSERT_EQUAL_INT(1, failed[1]);
+  TEST_ASSERT_EQUAL_DOUBLE(11.25, timestamp);
+  TEST_ASSERT_EQUAL_INT(0, get_remaining_replay_samples());
+  TEST_ASSERT_EQUAL_INT(-1, read_replay(1, raw, failed, &timestamp));
+}
+
+void test_OpenReplay_IgnoresIncompleteLastSample(void) {
+  write_file("version 1\n"
+             "units time=1 energy=1 dram=1 power=1\n"
+             "nodes 1\n"
+             "entry 0 0x611 unit=1 mask=0xffffffff wrap=4294967296\n"
+             "entry 0 0x619 unit=1 mask=0xffffffff wrap=4294967296\n"
+             "data\n"
+             "1.0 0 0x611 5\n"
+             "1.0 0 0x619 6\n"
+             "2.0 0 0x611 7\n");
+
+  recording_header_t replayed;
+  TEST_ASSERT_EQUAL_INT(0, open_replay(path, &replayed));
+  TEST_ASSERT_EQUAL_INT(1, get_remaining_replay_samples());
+}
+
+void test_OpenReplay_RejectsInvalidRecordings(void) {
+  recording_header_t replayed;
+  TEST_ASSERT_EQUAL_INT(-1, open_replay("/nonexistent", &replayed));
+
+  write_file("version 2\nnodes 1\nentry 0 0x611 unit=1 mask=0xff wrap=256\ndata\n");
+  TEST_ASSERT_EQUAL_INT(-1, open_replay(path, &replayed));
+
+  write_file("version 1\nnodes 1\ndata\n"); // no entries
+  TEST_ASSERT_EQUAL_INT(-1, open_replay(path, &replayed));
+
+  // values in a different order than the entries
+  write_file("version 1\nnodes 1\n"
+             "entry 0 0x611 unit=1 mask=0xff wrap=256\n"
+             "entry 0 0x619 unit=1 mask=0xff wrap=256\n"
+             "data\n"
+             "1.0 0 0x619 5\n"
+             "1.0 0 0x611 6\n");
+  TEST_ASSERT_EQUAL_INT(-1, open_replay(path, &replayed));
+
+  write_file("version 1\nnodes 1\nentry 0 0x611 unit=1 mask=0xff wrap=256\ndata\n1.0 0 0x611 x\n");
+  TEST_ASSERT_EQUAL_INT(-1, open_replay(path, &replayed));
+}
@@ -0,0 +1,201 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_cpuenergymeter.h"
+#include "mock_util.h"
+#include "region.h"
+
+#define FAKE_JOULES_PER_TICK 1e-8
+
+// Whether cem_open() returns the fake context, whose package energy increases with the same
+// timestamps that the regions are measured with, such that the results do not depend on timing.
+static int fake_counters = 0;
+static int fake_context;
+
+static cem_context_t *open_fake_context(const char *backend, int num_calls) {
+  return fake_counters ? (cem_context_t *)&fake_context : NULL;
+}
+
+static int is_fake_domain(const cem_context_t *context, enum cem_domain domain, int num_calls) {
+  return domain == CEM_DOMAIN_PACKAGE;
+}
+
+static uint64_t read_timestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static int sample_fake_context(cem_context_t *context, cem_sample_t *sample, int num_calls) {
+  memset(sample, 0, sizeof(*sample));
+  sample->num_nodes = 1;
+  sample->ticks[0][CEM_DOMAIN_PACKAGE] = read_timestamp();
+  return 0;
+}
+
+static int delta_fake_context(
+    const cem_context_t *context,
+    const cem_sample_t *begin,
+    const cem_sample_t *end,
+    cem_energy_t *energy,
+    int num_calls) {
+  const uint64_t ticks = end->ticks[0][CEM_DOMAIN_PACKAGE] - begin->ticks[0][CEM_DOMAIN_PACKAGE];
+  memset(energy, 0, sizeof(*energy));
+  energy->num_nodes = 1;
+  energy->joules[0][CEM_DOMAIN_PACKAGE] = ticks * FAKE_JOULES_PER_TICK;
+  return 0;
+}
+
+static double read_clock(int num_calls) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void setUp(void) {
+  get_monotonic_time_StubWithCallback(&read_clock);
+  // without the fake counters, only the calls and times are measured
+  cem_open_StubWithCallback(&open_fake_context);
+  cem_is_supported_domain_StubWithCallback(&is_fake_domain);
+  cem_sample_StubWithCallback(&sample_fake_context);
+  cem_delta_StubWithCallback(&delta_fake_context);
+  cem_close_Ignore();
+  setenv("CEM_REGION_REPORT", "", 1);
+  fake_counters = 0;
+  set_region_sample_interval(0.001);
+  reset_regions();
+}
+
+void tearDown(void) {}
+
+void test_RegionStats_SplitEnergyBetweenNestedRegions(void) {
+  fake_counters = 1;
+  // more samples than fit into the log, such that it is also aggregated within the regions
+  set_region_sample_interval(0.0001);
+  CEM_REGION_BEGIN("energy outer");
+  usleep(2000);
+  for (int i = 0; i < 3; i++) {
+    CEM_REGION_BEGIN("energy inner");
+    usleep(2000);
+    CEM_REGION_END();
+  }
+  CEM_REGION_END();
+  cem_region_flush();
+
+  region_stats_t outer;
+  region_stats_t inner;
+  TEST_ASSERT_EQUAL_INT(0, get_region_stats("energy outer", &outer));
+  TEST_ASSERT_EQUAL_INT(0, get_region_stats("energy inner", &inner));
+  TEST_ASSERT_EQUAL_UINT64(3, inner.calls);
+  const double *const outer_joules = outer.inclusive_joules;
+  const double *const inner_joules = inner.inclusive_joules;
+  TEST_ASSERT_TRUE(inner_joules[CEM_DOMAIN_PACKAGE] > 0);
+  TEST_ASSERT_TRUE(outer.exclusive_joules[CEM_DOMAIN_PACKAGE] > 0);
+  // the energy grows with the timestamps, so all regions have the same average power
+  const double watts = outer_joules[CEM_DOMAIN_PACKAGE] / outer.inclusive_seconds;
+  TEST_ASSERT_FLOAT_WITHIN(
+      0.01 * watts, watts, inner_joules[CEM_DOMAIN_PACKAGE] / inner.inclusive_seconds);
+  TEST_ASSERT_FLOAT_WITHIN(
+      0.01 * watts, watts, outer.exclusive_joules[CEM_DOMAIN_PACKAGE] / outer.exclusive_seconds);
+  TEST_ASSERT_FLOAT_WITHIN(
+      1e-9,
+      outer_joules[CEM_DOMAIN_PACKAGE] - inner_joules[CEM_DOMAIN_PACKAGE],
+      outer.exclusive_joules[CEM_DOMAIN_PACKAGE]);
+  TEST_ASSERT_FLOAT_WITHIN(
+      1e-9, inner_joules[CEM_DOMAIN_PACKAGE], inner.exclusive_joules[CEM_DOMAIN_PACKAGE]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, 0, outer_joules[CEM_DOMAIN_CORE]);
+}
+
+static void enter_inner_region(void) {
+  CEM_REGION_BEGIN("inner");
+  usleep(1000);
+  CEM_REGION_END();
+}
+
+void test_RegionStats_SeparateInclusiveAndExclusiveTime(void) {
+  CEM_REGION_BEGIN("outer");
+  usleep(1000);
+  for (int i = 0; i < 3; i++) {
+    enter_inner_region();
+  }
+  CEM_REGION_END();
+  cem_region_flush();
+
+  region_stats_t outer;
+  region_stats_t inner;
+  TEST_ASSERT_EQUAL_INT(0, get_region_stats("outer", &outer));
+  TEST_ASSERT_EQUAL_INT(0, get_region_stats("inner", &inner));
+  TEST_ASSERT_EQUAL_UINT64(1, outer.calls);
+  TEST_ASSERT_EQUAL_UINT64(3, inner.calls);
+  TEST_ASSERT_TRUE(inner.inclusive_seconds >= 0.003);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, inner.inclusive_seconds, inner.exclusive_seconds);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, outer.inclusive_seconds - inner.inclusive_seconds, outer.exclusive_seconds);
+  TEST_ASSERT_TRUE(outer.exclusive_seconds >= 0.001);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, 0, outer.inclusive_joules[CEM_DOMAIN_PACKAGE]);
+}
+
+void test_RegionStats_MergeSitesWithSameName(void) {
+  CEM_REGION_BEGIN("merged");
+  CEM_REGION_END();
+  CEM_REGION_BEGIN("merged");
+  CEM_REGION_END();
+  CEM_REGION_END(); // without a matching begin, ignored
+  cem_region_flush();
+
+  region_stats_t stats;
+  TEST_ASSERT_EQUAL_INT(0, get_region_stats("merged", &stats));
+  TEST_ASSERT_EQUAL_UINT64(2, stats.calls);
+  TEST_ASSERT_EQUAL_INT(-1, get_region_stats("never entered", &stats));
+}
+
+void test_RegionStats_ManyEventsAreAggregatedWhenLogIsFull(void) {
+  for (int i = 0; i < 10000; i++) {
+    CEM_REGION_BEGIN("frequent");
+    CEM_REGION_END();
+  }
+  region_stats_t stats;
+  TEST_ASSERT_EQUAL_INT(0, get_region_stats("frequent", &stats));
+  TEST_ASSERT_TRUE(stats.calls > 0 && stats.calls < 10000);
+  cem_region_flush();
+  TEST_ASSERT_EQUAL_INT(0, get_region_stats("frequent", &stats));
+  TEST_ASSERT_EQUAL_UINT64(10000, stats.calls);
+}
+
+static void *enter_region_in_thread(void *arg) {
+  CEM_REGION_BEGIN("thread");
+  CEM_REGION_END();
+  return arg;
+}
+
+void test_RegionStats_IncludeExitedThreads(void) {
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[i], NULL, &enter_region_in_thread, NULL));
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  region_stats_t stats;
+  TEST_ASSERT_EQUAL_INT(0, get_region_stats("thread", &stats));
+  TEST_ASSERT_EQUAL_UINT64(4, stats.calls);
+}
@@ -0,0 +1,47 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <math.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "runstats.h"
+
+void test_RunStats_ComputesMeanStddevAndConfidenceInterval(void) {
+  run_stats_t stats = {0};
+  const double values[] = {2, 4, 4, 4, 5, 5, 7, 9};
+  for (int i = 0; i < 8; i++) {
+    add_run_value(&stats, values[i]);
+  }
+  TEST_ASSERT_EQUAL_INT(8, stats.count);
+  TEST_ASSERT_EQUAL_DOUBLE(5.0, stats.mean);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, sqrt(32.0 / 7), get_run_stddev(&stats));
+  // t(0.975, 7) = 2.365
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 2.365 * sqrt(32.0 / 7) / sqrt(8), get_run_ci95(&stats));
+}
+
+void test_RunStats_HasNoConfidenceIntervalForSingleRun(void) {
+  run_stats_t stats = {0};
+  add_run_value(&stats, 3);
+  TEST_ASSERT_EQUAL_DOUBLE(0.0, get_run_stddev(&stats));
+  TEST_ASSERT_TRUE(isinf(get_run_ci95(&stats)));
+  TEST_ASSERT_FALSE(is_run_precision_reached(&stats, 1.0));
+}
+
+void test_IsRunPrecisionReached_NeedsMinimumRuns(void) {
+  run_stats_t stats = {0};
+  add_run_value(&stats, 10);
+  add_run_value(&stats, 10);
+  TEST_ASSERT_FALSE(is_run_precision_reached(&stats, 0.01));
+  for (int i = 2; i < BENCH_MIN_RUNS; i++) {
+    add_run_value(&stats, 10);
+  }
+  TEST_ASSERT_TRUE(is_run_precision_reached(&stats, 0.01));
+  add_run_value(&stats, 12);
+  TEST_ASSERT_FALSE(is_run_precision_reached(&stats, 0.01));
+  TEST_ASSERT_TRUE(is_run_precision_reached(&stats, 0.5));
+}
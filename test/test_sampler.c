@@ -0,0 +1,159 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <pthread.h>
+#include <string.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_util.h"
+#include "sampler.h"
+
+#define NUM_NODES 3
+#define PLAN_SIZE 5
+#define CPUS_PER_NODE 4
+#define UNPINNED -1
+
+static const int node_plan_begin[NUM_NODES + 1] = {0, 2, 3, 5};
+static sample_plan_entry_t plan[PLAN_SIZE];
+
+// Which thread is pinned to which CPU, written by the sampling threads through bind_cpu().
+static pthread_mutex_t pinned_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t pinned_threads[NUM_NODES];
+static int pinned_cpus[NUM_NODES];
+static int num_pinned = 0;
+static int failing_cpu = UNPINNED;
+
+static uint64_t round_value = 0;  // added to the values of each read
+static int read_on_cpu[PLAN_SIZE]; // CPU of the thread that read each entry
+
+static int node_to_cpu(int node) {
+  return node * CPUS_PER_NODE;
+}
+
+static int pin_thread(int cpu, cpu_set_t *old_context, int num_calls) {
+  if (cpu == failing_cpu) {
+    return -1;
+  }
+  pthread_mutex_lock(&pinned_lock);
+  pinned_threads[num_pinned] = pthread_self();
+  pinned_cpus[num_pinned] = cpu;
+  num_pinned++;
+  pthread_mutex_unlock(&pinned_lock);
+  return 0;
+}
+
+static int get_pinned_cpu() {
+  int cpu = UNPINNED;
+  pthread_mutex_lock(&pinned_lock);
+  for (int i = 0; i < num_pinned; i++) {
+    if (pthread_equal(pinned_threads[i], pthread_self())) {
+      cpu = pinned_cpus[i];
+    }
+  }
+  pthread_mutex_unlock(&pinned_lock);
+  return cpu;
+}
+
+static void read_fake_entries(
+    const sample_plan_entry_t *entries, int count, uint64_t raw[], unsigned char failed[]) {
+  const int cpu = get_pinned_cpu();
+  for (int i = 0; i < count; i++) {
+    raw[i] = entries[i].address + round_value;
+    failed[i] = entries[i].fd < 0;
+    read_on_cpu[entries[i].slot] = cpu;
+  }
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  bind_cpu_StubWithCallback(&pin_thread);
+  num_pinned = 0;
+  failing_cpu = UNPINNED;
+  round_value = 0;
+  memset(plan, 0, sizeof(plan));
+  for (int i = 0; i < PLAN_SIZE; i++) {
+    plan[i].address = 0x611 + i * 0x1000;
+    plan[i].slot = i;
+    read_on_cpu[i] = UNPINNED;
+  }
+}
+
+void tearDown(void) {
+  stop_sampler_threads();
+}
+
+void test_StartSamplerThreads_PinsOneThreadPerNode(void) {
+  TEST_ASSERT_FALSE(sampler_threads_running());
+  TEST_ASSERT_EQUAL_INT(
+      0, start_sampler_threads(NUM_NODES, &node_to_cpu, plan, node_plan_begin, &read_fake_entries));
+  TEST_ASSERT_TRUE(sampler_threads_running());
+
+  TEST_ASSERT_EQUAL_INT(NUM_NODES, num_pinned);
+  for (int node = 0; node < NUM_NODES; node++) {
+    int found = 0;
+    for (int i = 0; i < num_pinned; i++) {
+      found |= pinned_cpus[i] == node_to_cpu(node);
+      TEST_ASSERT_FALSE(pthread_equal(pinned_threads[i], pthread_self()));
+    }
+    TEST_ASSERT_TRUE(found);
+  }
+}
+
+void test_RunSamplerThreads_ReadsEntriesOfEachNodeOnItsCpu(void) {
+  plan[3].fd = -1;
+  TEST_ASSERT_EQUAL_INT(
+      0, start_sampler_threads(NUM_NODES, &node_to_cpu, plan, node_plan_begin, &read_fake_entries));
+  // the threads keep their own copy of the plan
+  plan[0].address = 0;
+
+  uint64_t raw[PLAN_SIZE];
+  unsigned char failed[PLAN_SIZE];
+  double skew = -1;
+  run_sampler_threads(raw, failed, &skew);
+  for (int i = 0; i < PLAN_SIZE; i++) {
+    TEST_ASSERT_EQUAL_UINT64(0x611 + i * 0x1000, raw[i]);
+    TEST_ASSERT_EQUAL_INT(i == 3, failed[i]);
+  }
+  TEST_ASSERT_TRUE(skew >= 0);
+  for (int node = 0; node < NUM_NODES; node++) {
+    for (int i = node_plan_begin[node]; i < node_plan_begin[node + 1]; i++) {
+      TEST_ASSERT_EQUAL_INT(node_to_cpu(node), read_on_cpu[i]);
+    }
+  }
+
+  // each run reads the entries again
+  round_value = 1;
+  run_sampler_threads(raw, failed, &skew);
+  for (int i = 0; i < PLAN_SIZE; i++) {
+    TEST_ASSERT_EQUAL_UINT64(0x611 + i * 0x1000 + 1, raw[i]);
+  }
+}
+
+void test_StartSamplerThreads_FailsIfThreadCannotBePinned(void) {
+  failing_cpu = node_to_cpu(1);
+  TEST_ASSERT_EQUAL_INT(
+      -1,
+      start_sampler_threads(NUM_NODES, &node_to_cpu, plan, node_plan_begin, &read_fake_entries));
+  TEST_ASSERT_FALSE(sampler_threads_running());
+
+  // nothing is left over from the failed start
+  failing_cpu = UNPINNED;
+  TEST_ASSERT_EQUAL_INT(
+      0, start_sampler_threads(NUM_NODES, &node_to_cpu, plan, node_plan_begin, &read_fake_entries));
+  TEST_ASSERT_TRUE(sampler_threads_running());
+}
+
+void test_StopSamplerThreads_CanBeCalledRepeatedly(void) {
+  stop_sampler_threads();
+  TEST_ASSERT_EQUAL_INT(
+      0, start_sampler_threads(NUM_NODES, &node_to_cpu, plan, node_plan_begin, &read_fake_entries));
+  stop_sampler_threads();
+  TEST_ASSERT_FALSE(sampler_threads_running());
+  stop_sampler_threads();
+  TEST_ASSERT_FALSE(sampler_threads_running());
+}
@@ -0,0 +1,130 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_util.h"
+#include "rapl-shm.h"
+#include "shmexport.h"
+
+static const int NODE_CPUS[2] = {0, 4};
+static const unsigned int DOMAIN_MASK = 0x3; // package and core
+#define NUM_SLOTS (2 * RAPL_SHM_NR_DOMAIN)
+
+static char shm_name[64];
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  snprintf(shm_name, sizeof(shm_name), "test_shmexport_%d", (int)getpid());
+  TEST_ASSERT_EQUAL_INT(0, open_shm_export(shm_name, 2, DOMAIN_MASK, NODE_CPUS));
+}
+
+void tearDown(void) {
+  close_shm_export();
+}
+
+void test_ShmExport_PublishesTopologyAndEnergy(void) {
+  const rapl_shm_t *shm = rapl_shm_open(shm_name);
+  TEST_ASSERT_NOT_NULL(shm);
+  TEST_ASSERT_EQUAL_INT(2, shm->num_nodes);
+  TEST_ASSERT_EQUAL_INT(DOMAIN_MASK, shm->domain_mask);
+  TEST_ASSERT_EQUAL_INT(4, shm->node_cpus[1]);
+  TEST_ASSERT_EQUAL_INT(getpid(), shm->writer_pid);
+
+  unsigned char updated[NUM_SLOTS] = {1, 1, 0, 0, 0, 1, 0};
+  publish_shm_sample(10.0, updated, NULL);
+  double energy_J[NUM_SLOTS] = {1.5, 0.5, 0, 0, 0, 2.5};
+  updated[5] = 0; // reading the package of node 1 failed
+  publish_shm_sample(11.0, updated, energy_J);
+
+  rapl_shm_values_t values;
+  const uint64_t sequence = rapl_shm_read(shm, &values);
+  TEST_ASSERT_EQUAL_INT(0, sequence % 2);
+  TEST_ASSERT_EQUAL_INT(1, values.num_samples);
+  TEST_ASSERT_EQUAL_DOUBLE(10.0, values.start_time);
+  TEST_ASSERT_EQUAL_DOUBLE(11.0, values.sample_time[0][0]);
+  TEST_ASSERT_EQUAL_DOUBLE(10.0, values.sample_time[1][0]);
+  TEST_ASSERT_EQUAL_DOUBLE(0.0, values.sample_time[1][1]);
+  TEST_ASSERT_EQUAL_DOUBLE(0.5, values.cum_energy_J[0][1]);
+  TEST_ASSERT_EQUAL_DOUBLE(2.5, values.cum_energy_J[1][0]);
+
+  // restarting the accumulation resets the energy
+  publish_shm_sample(12.0, updated, NULL);
+  TEST_ASSERT_EQUAL_INT(sequence + 2, rapl_shm_read(shm, &values));
+  TEST_ASSERT_EQUAL_DOUBLE(12.0, values.start_time);
+  TEST_ASSERT_EQUAL_DOUBLE(0.0, values.cum_energy_J[0][0]);
+  rapl_shm_close(shm);
+}
+
+void test_OpenShmExport_FailsIfWriterIsAlive(void) {
+  TEST_ASSERT_EQUAL_INT(-1, open_shm_export(shm_name, 2, DOMAIN_MASK, NODE_CPUS));
+}
+
+void test_OpenShmExport_ReplacesStaleSegment(void) {
+  // a segment whose writer has exited
+  const pid_t child = fork();
+  if (child == 0) {
+    _exit(open_shm_export("test_shmexport_stale", 2, DOMAIN_MASK, NODE_CPUS) != 0);
+  }
+  int status;
+  TEST_ASSERT_EQUAL_INT(child, waitpid(child, &status, 0));
+  TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+  const rapl_shm_t *stale = rapl_shm_open("test_shmexport_stale");
+  TEST_ASSERT_NOT_NULL(stale);
+  rapl_shm_close(stale);
+
+  close_shm_export();
+  TEST_ASSERT_EQUAL_INT(0, open_shm_export("test_shmexport_stale", 2, DOMAIN_MASK, NODE_CPUS));
+  const rapl_shm_t *shm = rapl_shm_open("test_shmexport_stale");
+  TEST_ASSERT_NOT_NULL(shm);
+  TEST_ASSERT_EQUAL_INT(getpid(), shm->writer_pid);
+  rapl_shm_close(shm);
+}
+
+static volatile int writing;
+
+static void *publish_equal_energy(void *unused) {
+  (void)unused;
+  unsigned char updated[NUM_SLOTS];
+  double energy_J[NUM_SLOTS];
+  memset(updated, 1, sizeof(updated));
+  for (int i = 1; i <= 100000; i++) {
+    for (int slot = 0; slot < NUM_SLOTS; slot++) {
+      energy_J[slot] = i;
+    }
+    publish_shm_sample(i, updated, energy_J);
+  }
+  writing = 0;
+  return NULL;
+}
+
+void test_RaplShmRead_NeverReturnsTornValues(void) {
+  const rapl_shm_t *shm = rapl_shm_open(shm_name);
+  TEST_ASSERT_NOT_NULL(shm);
+  writing = 1;
+  pthread_t writer;
+  TEST_ASSERT_EQUAL_INT(0, pthread_create(&writer, NULL, &publish_equal_energy, NULL));
+
+  rapl_shm_values_t values;
+  while (writing) {
+    rapl_shm_read(shm, &values);
+    for (int slot = 1; slot < NUM_SLOTS; slot++) {
+      TEST_ASSERT_EQUAL_DOUBLE(values.cum_energy_J[0][0], (&values.cum_energy_J[0][0])[slot]);
+    }
+    TEST_ASSERT_EQUAL_DOUBLE(values.cum_energy_J[0][0], values.sample_time[1][4]);
+  }
+  pthread_join(writer, NULL);
+  TEST_ASSERT_EQUAL_INT(100000, rapl_shm_read(shm, &values) ? values.num_samples : 0);
+  rapl_shm_close(shm);
+}
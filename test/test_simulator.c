@@ -0,0 +1,132 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_util.h"
+#include "simulator.h"
+
+static const double UNIT = 6.103515625e-05;
+
+static double read_clock(int num_calls) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  get_monotonic_time_StubWithCallback(&read_clock);
+}
+
+void tearDown(void) {
+  close_simulator();
+}
+
+void test_OpenSimulator_UsesDefaultConfig(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_simulator());
+
+  TEST_ASSERT_TRUE(is_simulated_domain(RAPL_PKG));
+  TEST_ASSERT_TRUE(is_simulated_domain(RAPL_PP0));
+  TEST_ASSERT_TRUE(is_simulated_domain(RAPL_DRAM));
+  TEST_ASSERT_FALSE(is_simulated_domain(RAPL_PP1));
+  TEST_ASSERT_FALSE(is_simulated_domain(RAPL_PSYS));
+  TEST_ASSERT_EQUAL_DOUBLE(UNIT, get_simulator_energy_unit());
+  TEST_ASSERT_EQUAL_DOUBLE(20, get_simulator_max_power());
+  TEST_ASSERT_EQUAL_INT(0, get_simulator_sockets());
+}
+
+void test_ConfigureSimulator_SetsNumberOfSockets(void) {
+  TEST_ASSERT_EQUAL_INT(0, configure_simulator("package=constant:20,sockets=16"));
+  TEST_ASSERT_EQUAL_INT(16, get_simulator_sockets());
+  close_simulator();
+  TEST_ASSERT_EQUAL_INT(0, get_simulator_sockets());
+}
+
+void test_ConfigureSimulator_RejectsInvalidConfig(void) {
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("package"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("package=linear:5"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("package=constant:-5"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("package=square:1:2"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("package=square:1:2:0"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("package=square:1:2:1:1.5"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("package=csv:/nonexistent"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("gpu=constant:5"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("unit=0"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("sockets=0"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("sockets=1.5"));
+  TEST_ASSERT_EQUAL_INT(-1, configure_simulator("sockets=65"));
+}
+
+void test_GetSimulatedCounter_ConstantPower(void) {
+  TEST_ASSERT_EQUAL_INT(0, configure_simulator("package=constant:1,update=1"));
+
+  TEST_ASSERT_EQUAL_UINT64(0, get_simulated_counter(RAPL_PKG, 0));
+  TEST_ASSERT_EQUAL_UINT64(16384, get_simulated_counter(RAPL_PKG, 1)); // 1 J
+  // the counter is only updated every millisecond
+  TEST_ASSERT_EQUAL_UINT64(16384, get_simulated_counter(RAPL_PKG, 1.0009));
+  TEST_ASSERT_EQUAL_UINT64(16400, get_simulated_counter(RAPL_PKG, 1.0015));
+  TEST_ASSERT_EQUAL_UINT64(0, get_simulated_counter(RAPL_DRAM, 1));
+}
+
+void test_GetSimulatedCounter_WrapsAround(void) {
+  // 2^32 increments of 1 J take about 136 years at 1 W, but only 4.3 seconds at 1 GW
+  TEST_ASSERT_EQUAL_INT(0, configure_simulator("package=constant:1000000000,unit=1,update=1000"));
+
+  TEST_ASSERT_EQUAL_UINT64(4000000000ull, get_simulated_counter(RAPL_PKG, 4));
+  TEST_ASSERT_EQUAL_UINT64(5000000000ull - 4294967296ull, get_simulated_counter(RAPL_PKG, 5));
+  TEST_ASSERT_EQUAL_UINT64(9000000000ull - 2 * 4294967296ull, get_simulated_counter(RAPL_PKG, 9));
+}
+
+void test_GetSimulatedCounter_SquareWave(void) {
+  // 10 W for 0.25 s and 2 W for 0.75 s of each second
+  TEST_ASSERT_EQUAL_INT(0, configure_simulator("core=square:2:10:1:0.25,unit=0.5,update=250"));
+  TEST_ASSERT_EQUAL_DOUBLE(10, get_simulator_max_power());
+
+  TEST_ASSERT_EQUAL_UINT64(5, get_simulated_counter(RAPL_PP0, 0.25)); // 2.5 J
+  TEST_ASSERT_EQUAL_UINT64(6, get_simulated_counter(RAPL_PP0, 0.5)); // 2.5 J + 0.5 J
+  TEST_ASSERT_EQUAL_UINT64(8, get_simulated_counter(RAPL_PP0, 1)); // 2.5 J + 1.5 J
+  TEST_ASSERT_EQUAL_UINT64(21, get_simulated_counter(RAPL_PP0, 2.25)); // 8 J + 2.5 J
+}
+
+void test_GetSimulatedCounter_CsvCurve(void) {
+  char path[] = "/tmp/cpu-energy-meter-simulator-XXXXXX";
+  const int fd = mkstemp(path);
+  TEST_ASSERT_TRUE(fd != -1);
+  FILE *file = fdopen(fd, "w");
+  fputs("seconds,watts\n# absolute times are shifted to start at 0\n", file);
+  fputs("100,4\n101,0\n103,8\n", file);
+  fclose(file);
+
+  char config[128];
+  snprintf(config, sizeof(config), "dram=csv:%s,unit=1,update=500", path);
+  TEST_ASSERT_EQUAL_INT(0, configure_simulator(config));
+  unlink(path);
+  TEST_ASSERT_EQUAL_DOUBLE(8, get_simulator_max_power());
+
+  TEST_ASSERT_EQUAL_UINT64(2, get_simulated_counter(RAPL_DRAM, 0.5));
+  TEST_ASSERT_EQUAL_UINT64(2, get_simulated_counter(RAPL_DRAM, 0.9)); // updated every 0.5 s
+  TEST_ASSERT_EQUAL_UINT64(4, get_simulated_counter(RAPL_DRAM, 2.5));
+  TEST_ASSERT_EQUAL_UINT64(4, get_simulated_counter(RAPL_DRAM, 3));
+  TEST_ASSERT_EQUAL_UINT64(20, get_simulated_counter(RAPL_DRAM, 5)); // constant after the end
+}
+
+void test_ReadSimulatedCounter_IncreasesOverTime(void) {
+  TEST_ASSERT_EQUAL_INT(0, configure_simulator("package=constant:1000,latency=2000"));
+  TEST_ASSERT_EQUAL_INT(0, open_simulator());
+
+  const uint64_t first = read_simulated_counter(RAPL_PKG);
+  const uint64_t second = read_simulated_counter(RAPL_PKG);
+  // each read takes at least 2 ms, so at least one update of 1 J (16384 increments) happened
+  TEST_ASSERT_TRUE(second >= first + 16384);
+}
@@ -0,0 +1,82 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <math.h>
+#include <stdint.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "textformat.h"
+
+static char buffer[TEXTFORMAT_MAX_NUMBER_LENGTH + 1];
+
+static const char *terminate(char *end) {
+  *end = '\0';
+  return buffer;
+}
+
+void test_AppendUint_AppendsDigits(void) {
+  TEST_ASSERT_EQUAL_STRING("0", terminate(append_uint(buffer, 0)));
+  TEST_ASSERT_EQUAL_STRING("18446744073709551615", terminate(append_uint(buffer, UINT64_MAX)));
+}
+
+void test_AppendFixed_RoundsToDecimals(void) {
+  TEST_ASSERT_EQUAL_STRING("19.997", terminate(append_fixed(buffer, 19.99749, 3)));
+  TEST_ASSERT_EQUAL_STRING("20.000", terminate(append_fixed(buffer, 19.9995, 3)));
+  TEST_ASSERT_EQUAL_STRING("0.000061", terminate(append_fixed(buffer, 6.103516e-05, 6)));
+  TEST_ASSERT_EQUAL_STRING("-1.50", terminate(append_fixed(buffer, -1.5, 2)));
+  TEST_ASSERT_EQUAL_STRING("0.00", terminate(append_fixed(buffer, -0.001, 2)));
+  TEST_ASSERT_EQUAL_STRING("42", terminate(append_fixed(buffer, 42.4, 0)));
+  TEST_ASSERT_EQUAL_STRING("4554.894959370", terminate(append_fixed(buffer, 4554.89495937, 9)));
+}
+
+void test_AppendFixed_FallsBackForLargeAndNonFiniteNumbers(void) {
+  TEST_ASSERT_EQUAL_STRING("1e+20", terminate(append_fixed(buffer, 1e20, 6)));
+  TEST_ASSERT_EQUAL_STRING("-inf", terminate(append_fixed(buffer, -INFINITY, 6)));
+  TEST_ASSERT_EQUAL_STRING("nan", terminate(append_fixed(buffer, NAN, 6)));
+}
+
+void test_AppendString_DoesNotTerminate(void) {
+  char *end = append_string(buffer, "cpu");
+  end = append_uint(end, 1);
+  TEST_ASSERT_EQUAL_STRING("cpu1", terminate(end));
+}
+
+void test_FormatTraceRecord_WritesSupportedDomainsOfEachNode(void) {
+  const double energy_J[2 * 3] = {1.5, 9, 0.25, 3, 9, 0.5};
+  char record[TEXTFORMAT_TRACE_RECORD_LENGTH(2 * 3) + 1];
+  const unsigned int domain_mask = (1u << 0) | (1u << 2);
+
+  *format_trace_record(record, 0, 12.5, 0.5, 2, 2, 3, domain_mask, energy_J) = '\0';
+  TEST_ASSERT_EQUAL_STRING(
+      "12.500000000,0.500000000,2,1.500000,3.000,0.250000,0.500,3.000000,6.000,0.500000,1.000\n",
+      record);
+
+  *format_trace_record(record, 1, 12.5, 0.5, 0, 2, 3, domain_mask, energy_J) = '\0';
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"time\":12.500000000,\"interval\":0.500000000,\"dropped\":0,"
+      "\"joules\":[[1.500000,0.250000],[3.000000,0.500000]],"
+      "\"watts\":[[3.000,0.500],[6.000,1.000]]}\n",
+      record);
+}
+
+void test_FormatTraceRecord_WritesNullForNonFiniteNumbersInJson(void) {
+  const double energy_J[2] = {NAN, INFINITY};
+  char record[TEXTFORMAT_TRACE_RECORD_LENGTH(2) + 1];
+
+  *format_trace_record(record, 1, 12.5, 0, 0, 1, 2, 3, energy_J) = '\0';
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"time\":12.500000000,\"interval\":0.000000000,\"dropped\":0,"
+      "\"joules\":[[null,null]],\"watts\":[[0.000,0.000]]}\n",
+      record);
+
+  *format_trace_record(record, 1, 12.5, 0.5, 0, 1, 2, 3, energy_J) = '\0';
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"time\":12.500000000,\"interval\":0.500000000,\"dropped\":0,"
+      "\"joules\":[[null,null]],\"watts\":[[null,null]]}\n",
+      record);
+}
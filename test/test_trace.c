@@ -0,0 +1,94 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_util.h"
+#include "trace.h"
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+}
+
+void tearDown(void) {
+  close_trace_buffer();
+}
+
+void test_PopTraceRecord_ReturnsRecordsInOrder(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_trace_buffer(3, 2)); // rounded up to 4 records
+
+  double timestamp;
+  uint64_t dropped;
+  uint64_t record[2];
+  TEST_ASSERT_EQUAL_INT(-1, pop_trace_record(&timestamp, &dropped, record));
+
+  // wrap around the end of the ring a few times
+  for (uint64_t i = 0; i < 10; i++) {
+    const uint64_t pushed[2] = {i, 100 + i};
+    TEST_ASSERT_EQUAL_INT(0, push_trace_record(i * 0.5, pushed));
+    TEST_ASSERT_EQUAL_INT(0, pop_trace_record(&timestamp, &dropped, record));
+    TEST_ASSERT_EQUAL_DOUBLE(i * 0.5, timestamp);
+    TEST_ASSERT_EQUAL_UINT64(0, dropped);
+    TEST_ASSERT_EQUAL_UINT64(i, record[0]);
+    TEST_ASSERT_EQUAL_UINT64(100 + i, record[1]);
+  }
+  TEST_ASSERT_EQUAL_INT(-1, pop_trace_record(&timestamp, &dropped, record));
+}
+
+void test_PushTraceRecord_DropsRecordsIfFull(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_trace_buffer(2, 1));
+
+  const uint64_t value = 42;
+  TEST_ASSERT_EQUAL_INT(0, push_trace_record(1, &value));
+  TEST_ASSERT_EQUAL_INT(0, push_trace_record(2, &value));
+  TEST_ASSERT_EQUAL_INT(-1, push_trace_record(3, &value));
+  TEST_ASSERT_EQUAL_INT(-1, push_trace_record(4, &value));
+  TEST_ASSERT_EQUAL_UINT64(2, get_dropped_trace_records());
+
+  double timestamp;
+  uint64_t dropped;
+  uint64_t record;
+  TEST_ASSERT_EQUAL_INT(0, pop_trace_record(&timestamp, &dropped, &record));
+  TEST_ASSERT_EQUAL_INT(0, push_trace_record(5, &value));
+  TEST_ASSERT_EQUAL_INT(0, pop_trace_record(&timestamp, &dropped, &record));
+  TEST_ASSERT_EQUAL_DOUBLE(2, timestamp);
+  TEST_ASSERT_EQUAL_UINT64(0, dropped);
+  // the next record tells that the two records before it are missing
+  TEST_ASSERT_EQUAL_INT(0, pop_trace_record(&timestamp, &dropped, &record));
+  TEST_ASSERT_EQUAL_DOUBLE(5, timestamp);
+  TEST_ASSERT_EQUAL_UINT64(2, dropped);
+}
+
+static uint64_t next_value = 0;
+static int consumed_in_order = 1;
+
+static void consume_record(double timestamp, uint64_t dropped_before, const uint64_t values[]) {
+  next_value += dropped_before;
+  consumed_in_order &= values[0] == next_value && timestamp == next_value;
+  next_value++;
+}
+
+void test_StartTraceConsumer_WritesAllRecords(void) {
+  TEST_ASSERT_EQUAL_INT(0, open_trace_buffer(64, 1));
+  TEST_ASSERT_EQUAL_INT(0, start_trace_consumer(&consume_record));
+
+  const uint64_t last = 100000;
+  for (uint64_t i = 0; i < last; i++) {
+    push_trace_record(i, &i); // dropped records are reported with the next pushed one
+  }
+  // give the consumer time to empty the buffer, such that all drops are reported
+  usleep(100000);
+  TEST_ASSERT_EQUAL_INT(0, push_trace_record(last, &last));
+  stop_trace_consumer();
+
+  TEST_ASSERT_TRUE(consumed_in_order);
+  TEST_ASSERT_EQUAL_UINT64(last + 1, next_value);
+}
@@ -0,0 +1,182 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for memmem()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "tracefile.h"
+
+static char path[64];
+
+static double units[] = {6.103515625e-05, 6.103515625e-05, 1.53e-05, 1e-06, 1e-06, 1e-06};
+
+static const trace_file_header_t header = {
+    .num_nodes = 2,
+    .domain_mask = (1 << 0) | (1 << 1) | (1 << 3), // package, core, dram
+    .time_unit = 0.0009765625,
+    .energy_unit = 6.103515625e-05,
+    .dram_energy_unit = 1.53e-05,
+    .power_unit = 0.125,
+    .num_columns = 6,
+    .units = units,
+};
+
+static void get_values(int record, uint64_t values[6]) {
+  for (int i = 0; i < 6; i++) {
+    // roughly constant power with some noise and an occasional large jump
+    values[i] = 300 * (i + 1) + (record * 7919 + i) % 13 + ((record % 1000 == 999) ? 1000000 : 0);
+  }
+}
+
+static void write_records(int count) {
+  TEST_ASSERT_EQUAL_INT(0, open_trace_file(path, &header));
+  for (int record = 0; record < count; record++) {
+    uint64_t values[6];
+    get_values(record, values);
+    TEST_ASSERT_EQUAL_INT(0, write_trace_file_record(0.001 * (record + 1), record % 100 == 50, values));
+  }
+  TEST_ASSERT_EQUAL_INT(0, close_trace_file());
+}
+
+static int read_records() {
+  trace_file_header_t read_header;
+  TEST_ASSERT_EQUAL_INT(0, open_trace_file_reader(path, &read_header));
+  int count = 0;
+  double time;
+  uint64_t dropped;
+  uint64_t values[6];
+  int result;
+  while ((result = read_trace_file_record(&time, &dropped, values)) == 0) {
+    uint64_t expected[6];
+    get_values(count, expected);
+    TEST_ASSERT_EQUAL_UINT64_ARRAY(expected, values, 6);
+    TEST_ASSERT_EQUAL_UINT64(count % 100 == 50, dropped);
+    TEST_ASSERT_FLOAT_WITHIN(1e-7, 0.001 * (count + 1), time);
+    count++;
+  }
+  close_trace_file_reader();
+  return (result == 1) ? count : -count;
+}
+
+void setUp(void) {
+  strcpy(path, "/tmp/cpu-energy-meter-trace-XXXXXX");
+  const int fd = mkstemp(path);
+  TEST_ASSERT_TRUE(fd != -1);
+  close(fd);
+}
+
+void tearDown(void) {
+  close_trace_file();
+  close_trace_file_reader();
+  unlink(path);
+}
+
+void test_ReadTraceFileRecord_ReturnsWrittenRecords(void) {
+  write_records(2500); // a few chunks and a partial one
+
+  trace_file_header_t read_header;
+  TEST_ASSERT_EQUAL_INT(0, open_trace_file_reader(path, &read_header));
+  TEST_ASSERT_EQUAL_INT(2, read_header.num_nodes);
+  TEST_ASSERT_EQUAL_UINT(header.domain_mask, read_header.domain_mask);
+  TEST_ASSERT_EQUAL_INT(6, read_header.num_columns);
+  TEST_ASSERT_EQUAL_DOUBLE(0.125, read_header.power_unit);
+  TEST_ASSERT_EQUAL_DOUBLE(1.53e-05, read_header.units[2]);
+  close_trace_file_reader();
+
+  TEST_ASSERT_EQUAL_INT(2500, read_records());
+
+  // evenly spaced samples with similar values need about one byte per value
+  struct stat info;
+  TEST_ASSERT_EQUAL_INT(0, stat(path, &info));
+  TEST_ASSERT_TRUE(info.st_size < 2500 * (1 + 6) * 1.5);
+}
+
+void test_ReadTraceFileRecord_KeepsCompleteChunksOfTruncatedFile(void) {
+  write_records(2500);
+  struct stat info;
+  TEST_ASSERT_EQUAL_INT(0, stat(path, &info));
+  TEST_ASSERT_EQUAL_INT(0, truncate(path, info.st_size - 10));
+
+  TEST_ASSERT_EQUAL_INT(-2048, read_records()); // two complete chunks of 1024 records
+}
+
+void test_ReadTraceFileRecord_DetectsCorruptedChunk(void) {
+  write_records(1500);
+  FILE *file = fopen(path, "r+b");
+  fseek(file, -5, SEEK_END);
+  fputc(0xff, file);
+  fclose(file);
+
+  TEST_ASSERT_EQUAL_INT(-1024, read_records());
+}
+
+void test_ReadTraceFileRecord_SkipsCorruptedChunk(void) {
+  write_records(2500);
+  FILE *file = fopen(path, "r+b");
+  char content[16384];
+  const size_t size = fread(content, 1, sizeof(content), file);
+  // corrupt the payload of the second chunk, behind its header of at most 16 bytes
+  const char *first = memmem(content, size, "CHNK", 4);
+  TEST_ASSERT_NOT_NULL(first);
+  const char *second = memmem(first + 1, size - (first + 1 - content), "CHNK", 4);
+  TEST_ASSERT_NOT_NULL(second);
+  fseek(file, second - content + 20, SEEK_SET);
+  fputc(0xff, file);
+  fclose(file);
+
+  trace_file_header_t read_header;
+  TEST_ASSERT_EQUAL_INT(0, open_trace_file_reader(path, &read_header));
+  int count = 0;
+  double time;
+  uint64_t dropped;
+  uint64_t values[6];
+  while (read_trace_file_record(&time, &dropped, values) == 0) {
+    const int record = (count < 1024) ? count : count + 1024;
+    uint64_t expected[6];
+    get_values(record, expected);
+    TEST_ASSERT_EQUAL_UINT64_ARRAY(expected, values, 6);
+    TEST_ASSERT_FLOAT_WITHIN(1e-7, 0.001 * (record + 1), time);
+    count++;
+  }
+  TEST_ASSERT_EQUAL_INT(2500 - 1024, count);
+
+  uint64_t skipped_chunks, skipped_records;
+  get_skipped_trace_file_chunks(&skipped_chunks, &skipped_records);
+  TEST_ASSERT_EQUAL_UINT64(1, skipped_chunks);
+  TEST_ASSERT_EQUAL_UINT64(1024, skipped_records);
+}
+
+void test_OpenTraceFileReader_RejectsInvalidFiles(void) {
+  trace_file_header_t read_header;
+  TEST_ASSERT_EQUAL_INT(-1, open_trace_file_reader("/nonexistent", &read_header));
+
+  // empty
+  TEST_ASSERT_EQUAL_INT(-1, open_trace_file_reader(path, &read_header));
+
+  // corrupted header
+  write_records(1);
+  FILE *file = fopen(path, "r+b");
+  fseek(file, 12, SEEK_SET);
+  fputc(0x42, file);
+  fclose(file);
+  TEST_ASSERT_EQUAL_INT(-1, open_trace_file_reader(path, &read_header));
+}
+
+void test_OpenTraceFile_RejectsInconsistentHeader(void) {
+  trace_file_header_t wrong_header = header;
+  wrong_header.num_columns = 4;
+  TEST_ASSERT_EQUAL_INT(-1, open_trace_file(path, &wrong_header));
+}
@@ -0,0 +1,109 @@
+// This file is part of CPU Energy Meter,
+// a tool for measuring energy consumption of Intel CPUs:
+// https://github.com/sosy-lab/cpu-energy-meter
+//
+// SPDX-FileCopyrightText: 2018-2021 Dirk Beyer <https://www.sosy-lab.org>
+//
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unity.h" // needs to be placed before all the other custom h-files
+#include "mock_util.h"
+#include "uring.h"
+
+// A regular file stands in for the MSR device files, which are also read at 8-byte offsets.
+static char file_path[64];
+static int file_fd = -1;
+
+static void write_value_to_file(off_t offset, uint64_t value) {
+  TEST_ASSERT_EQUAL(sizeof(value), pwrite(file_fd, &value, sizeof(value), offset));
+}
+
+static void open_uring_or_ignore(int count, const int fds[], const off_t offsets[]) {
+  if (open_uring(count, fds, offsets) != 0) {
+    TEST_IGNORE_MESSAGE("io_uring is not available on this system.");
+  }
+  TEST_ASSERT_TRUE(is_uring_open());
+}
+
+void setUp(void) {
+  is_debug_enabled_IgnoreAndReturn(0);
+  strcpy(file_path, "/tmp/cpu-energy-meter-uring-XXXXXX");
+  file_fd = mkstemp(file_path);
+  TEST_ASSERT_TRUE(file_fd != -1);
+}
+
+void tearDown(void) {
+  close_uring();
+  close(file_fd);
+  unlink(file_path);
+}
+
+void test_OpenUring_FailsWithoutReads(void) {
+  TEST_ASSERT_EQUAL_INT(-1, open_uring(0, NULL, NULL));
+  TEST_ASSERT_FALSE(is_uring_open());
+}
+
+void test_ReadUring_ReadsAllOffsets(void) {
+  write_value_to_file(0x611, 494516256);
+  write_value_to_file(0x619, 37908518);
+  write_value_to_file(0x1611, 42);
+
+  const int fds[] = {file_fd, file_fd, file_fd};
+  const off_t offsets[] = {0x611, 0x619, 0x1611};
+  open_uring_or_ignore(3, fds, offsets);
+
+  uint64_t values[3];
+  unsigned char failed[3];
+  TEST_ASSERT_EQUAL_INT(0, read_uring(values, failed));
+  TEST_ASSERT_EQUAL_UINT64(494516256, values[0]);
+  TEST_ASSERT_EQUAL_UINT64(37908518, values[1]);
+  TEST_ASSERT_EQUAL_UINT64(42, values[2]);
+  TEST_ASSERT_FALSE(failed[0]);
+  TEST_ASSERT_FALSE(failed[1]);
+  TEST_ASSERT_FALSE(failed[2]);
+
+  // each read sees the current content, also when repeated more often than the ring is large
+  for (uint64_t value = 43; value < 53; value++) {
+    write_value_to_file(0x1611, value);
+    TEST_ASSERT_EQUAL_INT(0, read_uring(values, failed));
+    TEST_ASSERT_EQUAL_UINT64(value, values[2]);
+    TEST_ASSERT_EQUAL_UINT64(494516256, values[0]);
+  }
+}
+
+void test_ReadUring_ReportsFailedReads(void) {
+  write_value_to_file(0x611, 1);
+
+  const int fds[] = {file_fd, file_fd};
+  const off_t offsets[] = {0x611, 0x10000};
+  open_uring_or_ignore(2, fds, offsets);
+
+  uint64_t values[2];
+  unsigned char failed[2];
+  TEST_ASSERT_EQUAL_INT(0, read_uring(values, failed));
+  TEST_ASSERT_EQUAL_UINT64(1, values[0]);
+  TEST_ASSERT_FALSE(failed[0]);
+  TEST_ASSERT_TRUE(failed[1]); // beyond the end of the file
+}
+
+void test_CloseUring_AllowsReopening(void) {
+  write_value_to_file(0, 7);
+
+  const int fds[] = {file_fd};
+  const off_t offsets[] = {0};
+  open_uring_or_ignore(1, fds, offsets);
+  close_uring();
+  TEST_ASSERT_FALSE(is_uring_open());
+  close_uring(); // closing twice does nothing
+
+  open_uring_or_ignore(1, fds, offsets);
+  uint64_t value;
+  unsigned char failed;
+  TEST_ASSERT_EQUAL_INT(0, read_uring(&value, &failed));
+  TEST_ASSERT_EQUAL_UINT64(7, value);
+  TEST_ASSERT_FALSE(failed);
+}